@@ -195,6 +195,7 @@ set(SOURCES src/main.cpp
     lib/http/httpServiceConfigurator.h lib/http/httpServiceConfigurator.cpp
     lib/http/httpServiceBrowser.h lib/http/httpServiceBrowser.cpp
     lib/http/mgHttpClient.h lib/http/mgHttpClient.cpp
+    lib/http/mgTlsSessionCache.h lib/http/mgTlsSessionCache.cpp
     lib/task/fnTask.h lib/task/fnTask.cpp
     lib/task/fnTaskManager.h lib/task/fnTaskManager.cpp
     lib/printer-emulator/atari_1020.h lib/printer-emulator/atari_1020.cpp
@@ -422,6 +423,31 @@ endif()
 target_include_directories(fujinet PRIVATE ${INCLUDE_DIRS} ${MBEDTLS_INCLUDE_DIR})
 target_link_libraries(fujinet ${CRYPTO_LIBS})
 
+# TLS handshake benchmark, full vs. resumed handshakes against a local server
+# (not built by default: cmake --build . --target tls_handshake_bench)
+add_executable(tls_handshake_bench EXCLUDE_FROM_ALL
+    test/pc/tls_handshake_bench.cpp
+    lib/http/mgTlsSessionCache.h lib/http/mgTlsSessionCache.cpp
+    components_pc/mongoose/mongoose.h components_pc/mongoose/mongoose.c
+)
+target_include_directories(tls_handshake_bench PRIVATE lib/http components_pc/mongoose ${MBEDTLS_INCLUDE_DIR})
+target_link_libraries(tls_handshake_bench ${CRYPTO_LIBS})
+if(CMAKE_SYSTEM_NAME STREQUAL "Windows")
+    target_link_libraries(tls_handshake_bench ws2_32)
+endif()
+
+# Path resolution benchmark, opens/sec of nested container paths through MFSOwner::resolveCache
+# (not built by default: cmake --build . --target resolve_cache_bench)
+add_executable(resolve_cache_bench EXCLUDE_FROM_ALL
+    test/pc/resolve_cache_bench.cpp
+    lib/meatloaf/meatloaf.h lib/meatloaf/meat_resolve.cpp
+    lib/utils/string_utils.h lib/utils/string_utils.cpp
+    lib/utils/U8Char.h lib/utils/U8Char.cpp
+    lib/utils/punycode.h lib/utils/punycode.cpp
+)
+target_include_directories(resolve_cache_bench PRIVATE lib/meatloaf ${INCLUDE_DIRS} ${MBEDTLS_INCLUDE_DIR})
+target_link_libraries(resolve_cache_bench pthread ${CRYPTO_LIBS})
+
 if(DEFINED USE_LIBSERIAL)
     pkg_search_module(LIBSERIALPORT REQUIRED libserialport)
     target_include_directories(fujinet PRIVATE ${LIBSERIALPORT_INCLUDE_DIRS})
@@ -66,7 +66,7 @@ long int FileHandlerTNFS::tell()
 {
     Debug_println("FileHandlerTNFS::tell");
     uint32_t pos;
-    tnfsFileHandleInfo *pFileInf = _mountinfo->get_filehandleinfo(_handle);
+    tnfsFileHandleInfo *pFileInf = _mountinfo->shared->get_filehandleinfo(_handle);
     if (pFileInf == nullptr) 
     {
         Debug_printf("\tbad handle\n");
@@ -88,35 +88,22 @@ size_t FileHandlerTNFS::read(void *ptr, size_t size, size_t count)
         return 0;
 
     size_t total_bytes_read = 0;
-    uint16_t bytes_read;
-    uint16_t read_size;
+    uint32_t bytes_read = 0;
     int result;
 
-    while (total_bytes_read < bytes_requested)
+    // Large reads keep several requests in flight
+    result = tnfs_read_pipelined(_mountinfo, _handle, (uint8_t *)ptr, bytes_requested, &bytes_read);
+    total_bytes_read += bytes_read;
+    if (result == TNFS_RESULT_BAD_FILENUM && _bad_fd_recovery() == TNFS_RESULT_SUCCESS)
     {
+        // retry read command
         bytes_read = 0;
-        if (bytes_requested - total_bytes_read > TNFS_MAX_READWRITE_PAYLOAD)
-            read_size = TNFS_MAX_READWRITE_PAYLOAD;
-        else
-            read_size = (uint16_t)(bytes_requested - total_bytes_read);
-
-        result = tnfs_read(_mountinfo, _handle, ((uint8_t *)ptr)+total_bytes_read, read_size, &bytes_read);
-        if (result == TNFS_RESULT_BAD_FILENUM && _bad_fd_recovery() == TNFS_RESULT_SUCCESS)
-        {
-            // retry read command
-            result = tnfs_read(_mountinfo, _handle, ((uint8_t *)ptr)+total_bytes_read, read_size, &bytes_read);
-        }
-        
-        if (result != TNFS_RESULT_SUCCESS)
-        {
-            if (result == TNFS_RESULT_END_OF_FILE && bytes_read > 0)
-                total_bytes_read += bytes_read;
-            else
-                errno = tnfs_code_to_errno(result);
-            break;
-        }
+        result = tnfs_read_pipelined(_mountinfo, _handle, ((uint8_t *)ptr)+total_bytes_read, bytes_requested - total_bytes_read, &bytes_read);
         total_bytes_read += bytes_read;
     }
+
+    if (result != TNFS_RESULT_SUCCESS && !(result == TNFS_RESULT_END_OF_FILE && total_bytes_read > 0))
+        errno = tnfs_code_to_errno(result);
     return bytes_requested == total_bytes_read ? count : total_bytes_read / size;
 }
 
@@ -158,17 +145,21 @@ size_t FileHandlerTNFS::write(const void *ptr, size_t size, size_t count)
 int FileHandlerTNFS::flush()
 {
     Debug_println("FileHandlerTNFS::flush");
-    // int ret = fflush(_fh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
-    // ret = fsync(fileno(_fh)); // Since we might get reset at any moment, go ahead and sync the file (not clear if fflush does this)
-    // return ret;
-    return -1;
+    // Writes are collected in the TNFS file cache
+    int result = tnfs_flush(_mountinfo, _handle);
+    if (result != TNFS_RESULT_SUCCESS)
+    {
+        errno = tnfs_code_to_errno(result);
+        return -1;
+    }
+    return 0;
 }
 
 // reopen the file and seek to last known position
 uint8_t FileHandlerTNFS::_bad_fd_recovery()
 {
     Debug_println("FileHandlerTNFS - Invalid file ID");
-    tnfsFileHandleInfo *pFileInf = _mountinfo->get_filehandleinfo(_handle);
+    tnfsFileHandleInfo *pFileInf = _mountinfo->shared->get_filehandleinfo(_handle);
     if (pFileInf == nullptr) 
     {
         Debug_printf("\tbad handle\n");
@@ -188,7 +179,7 @@ uint8_t FileHandlerTNFS::_bad_fd_recovery()
     // update file handle / fd
     _handle = handle;
     // delete bad fd filehandleinfo
-    _mountinfo->delete_filehandleinfo(pFileInf);
+    _mountinfo->shared->delete_filehandleinfo(pFileInf);
 
     // seek to last known position
     return tnfs_lseek(_mountinfo, _handle, pos, SEEK_SET, &new_pos);
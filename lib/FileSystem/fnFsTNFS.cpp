@@ -80,7 +80,6 @@ bool FileSystemTNFS::start(const char *host, uint16_t port, const char * mountpa
     _last_dns_refresh = fnSystem.millis();
 
     _mountinfo.port = port;
-    _mountinfo.session = TNFS_INVALID_SESSION;
 
     if(mountpath != nullptr)
         strlcpy(_mountinfo.mountpath, mountpath, sizeof(_mountinfo.mountpath));
@@ -107,7 +106,7 @@ bool FileSystemTNFS::start(const char *host, uint16_t port, const char * mountpa
         _started = false;
         return false;
     }
-    Debug_printf("TNFS mount successful. session: 0x%hx, version: 0x%04hx, min_retry: %hums\r\n", _mountinfo.session, _mountinfo.server_version, _mountinfo.min_retry_ms);
+    Debug_printf("TNFS mount successful. session: 0x%hx, version: 0x%04hx, min_retry: %hums\r\n", _mountinfo.shared->session, _mountinfo.shared->server_version, _mountinfo.shared->min_retry_ms);
 
 #ifdef ESP_PLATFORM
     // Register a new VFS driver to handle this connection
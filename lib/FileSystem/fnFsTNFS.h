@@ -26,6 +26,7 @@ public:
     bool start(const char *host, uint16_t port=TNFS_DEFAULT_PORT, const char * mountpath=nullptr, const char * userid=nullptr, const char * password=nullptr);
 
     fsType type() override { return FSTYPE_TNFS; };
+    tnfsMountInfo * mountinfo() { return &_mountinfo; };
     const char * typestring() override { return type_to_string(FSTYPE_TNFS); };
 
     FILE * file_open(const char* path, const char* mode = FILE_READ) override;
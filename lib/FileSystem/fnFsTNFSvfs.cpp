@@ -27,6 +27,7 @@
     int (*rename_p)(void* ctx, const char *src, const char *dst);
     int (*mkdir_p)(void* ctx, const char* name, mode_t mode);
     int (*rmdir_p)(void* ctx, const char* name);
+    int (*fsync_p)(void* ctx, int fd);
 
     NOT IMPLEMENTED:
     DIR* (*opendir_p)(void* ctx, const char* name);
@@ -42,7 +43,6 @@
     int (*link_p)(void* ctx, const char* n1, const char* n2);
     int (*fcntl_p)(void* ctx, int fd, int cmd, va_list args);
     int (*ioctl_p)(void* ctx, int fd, int cmd, va_list args);
-    int (*fsync_p)(void* ctx, int fd);
 */
 
 int vfs_tnfs_mkdir(void* ctx, const char* name, mode_t mode)
@@ -154,8 +154,8 @@ ssize_t vfs_tnfs_read(void* ctx, int fd, void * dst, size_t size)
 {
     tnfsMountInfo *mi = (tnfsMountInfo *)ctx;
 
-    uint16_t readcount;
-    int result = tnfs_read(mi, fd, (uint8_t *)dst, size, &readcount);
+    uint32_t readcount;
+    int result = tnfs_read_pipelined(mi, fd, (uint8_t *)dst, size, &readcount);
 
     if(result == TNFS_RESULT_SUCCESS || (result == TNFS_RESULT_END_OF_FILE && readcount > 0))
     {
@@ -233,10 +233,27 @@ int vfs_tnfs_fstat(void* ctx, int fd, struct stat * st)
     //Debug_printf("vfs_tnfs_fstat: %d\r\n", fd);    
     tnfsMountInfo *mi = (tnfsMountInfo *)ctx;
 
+    // The server only knows the size once cached writes are sent
+    tnfs_flush(mi, fd);
+
     const char *path = tnfs_filepath(mi, fd);
     return vfs_tnfs_stat(mi, path, st);
 }
 
+int vfs_tnfs_fsync(void* ctx, int fd)
+{
+    tnfsMountInfo *mi = (tnfsMountInfo *)ctx;
+
+    int result = tnfs_flush(mi, fd);
+    if(result != TNFS_RESULT_SUCCESS)
+    {
+        errno = tnfs_code_to_errno(result);
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
 
 // Register our functions and use tnfsMountInfo as our context
 // New basepath will be stored in basepath
@@ -256,6 +273,7 @@ esp_err_t vfs_tnfs_register(tnfsMountInfo &m_info, char *basepath, int basepathl
     vfs.lseek_p = &vfs_tnfs_lseek;
     vfs.unlink_p = &vfs_tnfs_unlink;
     vfs.rename_p = &vfs_tnfs_rename;
+    vfs.fsync_p = &vfs_tnfs_fsync;
 
     // We'll use the address of our tnfsMountInfo to provide a unique base path
     // for this instance without keeping track of how many we create
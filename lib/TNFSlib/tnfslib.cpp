@@ -50,9 +50,19 @@ bool _tnfs_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t pay
 int _tnfs_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt);
 bool _tnfs_tcp_send(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size);
 int _tnfs_tcp_recv(tnfsMountInfo *m_info, tnfsPacket &pkt);
-_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
+_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt, uint32_t timeout_ms, int *rtt_ms);
 _tnfs_recv_result _tnfs_recv_and_validate(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
 uint8_t _tnfs_session_recovery(tnfsMountInfo *m_info, uint8_t command);
+int _tnfs_login(tnfsMountInfo *m_info);
+int _tnfs_logout(tnfsMountInfo *m_info);
+
+int _tnfs_server_open(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint16_t open_mode, uint16_t create_perms);
+int _tnfs_park_handle(tnfsMountInfo *m_info, const tnfsFileHandleInfo *keep);
+int _tnfs_use_handle(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI);
+
+int _tnfs_server_lseek(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, int32_t position, uint8_t type, uint32_t *response_pos);
+int _tnfs_read_window(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint8_t *dest, uint32_t size, uint32_t *dest_used);
+int _tnfs_flush_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI);
 
 int _tnfs_adjust_with_full_path(tnfsMountInfo *m_info, char *buffer, const char *source, int bufflen);
 
@@ -63,8 +73,10 @@ const char *_tnfs_result_code_string(int resultcode);
 
 using namespace std;
 
-/* Logs-in to the TNFS server by providing a mount path, user and password.
- Success will result in a session ID set in tnfsMountInfo.
+/*
+ Logs-in to the TNFS server by providing a mount path, user and password,
+ unless another tnfsMountInfo is already logged-in with the same ones:
+ the session in tnfsMountInfo.shared is then used by both without asking the server.
  If the host_ip is set, it will be used in all transactions instead of hostname.
  Currently, mountpath, userid and password are ignored.
  port, timeout_ms, and max_retries may be set or left to defaults.
@@ -80,9 +92,44 @@ int tnfs_mount(tnfsMountInfo *m_info)
         return -1;
 
     // Unmount if we happen to have sesssion
-    if (m_info->session != TNFS_INVALID_SESSION)
+    if (m_info->shared->has_client(m_info))
         tnfs_umount(m_info);
-    m_info->session = TNFS_INVALID_SESSION; // In case tnfs_umount fails - throw out the current session ID
+
+    // If we weren't provided a mountpath, set the default
+    if (m_info->mountpath[0] == '\0')
+        m_info->mountpath[0] = '/';
+
+    // Make sure we have the right starting working directory
+    m_info->current_working_directory[0] = '/';
+
+    std::shared_ptr<tnfsSessionInfo> shared = tnfsSessionInfo::find_or_create(m_info);
+    std::lock_guard<std::recursive_mutex> lock(shared->transaction_mutex);
+
+    m_info->shared = shared;
+    if (shared->session != TNFS_INVALID_SESSION)
+    {
+        Debug_printf("TNFS joining session 0x%hx\r\n", shared->session);
+        shared->stats.mounts_shared++;
+        shared->add_client(m_info);
+        return TNFS_RESULT_SUCCESS;
+    }
+
+    int result = _tnfs_login(m_info);
+    if (result == TNFS_RESULT_SUCCESS)
+        shared->add_client(m_info);
+    else
+        m_info->shared = std::make_shared<tnfsSessionInfo>();
+    return result;
+}
+
+/*
+ Starts a new session for m_info->shared, which every client of it uses from now on
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_login(tnfsMountInfo *m_info)
+{
+    m_info->shared->session = TNFS_INVALID_SESSION;
+    m_info->shared->drop_dirlistings();
 
     tnfsPacket packet;
     packet.command = TNFS_CMD_MOUNT;
@@ -93,39 +140,33 @@ int tnfs_mount(tnfsMountInfo *m_info)
 
     int payload_offset = 2;
 
-    // If we weren't provided a mountpath, set the default
-    if (m_info->mountpath[0] == '\0')
-        m_info->mountpath[0] = '/';
-
     // Copy the mountpath to the payload
-    strlcpy((char *)packet.payload + payload_offset, m_info->mountpath, sizeof(packet.payload) - payload_offset);
+    strlcpy((char *)packet.payload + payload_offset, m_info->shared->mountpath, sizeof(packet.payload) - payload_offset);
     payload_offset += strlen((char *)packet.payload + payload_offset) + 1;
 
     // Copy user
-    strlcpy((char *)packet.payload + payload_offset, m_info->user, sizeof(packet.payload) - payload_offset);
+    strlcpy((char *)packet.payload + payload_offset, m_info->shared->user, sizeof(packet.payload) - payload_offset);
     payload_offset += strlen((char *)packet.payload + payload_offset) + 1;
 
     // Copy password
-    strlcpy((char *)packet.payload + payload_offset, m_info->password, sizeof(packet.payload) - payload_offset);
+    strlcpy((char *)packet.payload + payload_offset, m_info->shared->password, sizeof(packet.payload) - payload_offset);
     payload_offset += strlen((char *)packet.payload + payload_offset) + 1;
 
-    // Make sure we have the right starting working directory
-    m_info->current_working_directory[0] = '/';
-
     if (_tnfs_transaction(m_info, packet, payload_offset))
     {
         // Success
         if (packet.payload[0] == TNFS_RESULT_SUCCESS)
         {
-            m_info->session = TNFS_UINT16_FROM_HILOBYTES(packet.session_idh, packet.session_idl);
-            m_info->server_version = TNFS_UINT16_FROM_HILOBYTES(packet.payload[2], packet.payload[1]);
-            m_info->min_retry_ms = TNFS_UINT16_FROM_HILOBYTES(packet.payload[4], packet.payload[3]);
+            m_info->shared->session = TNFS_UINT16_FROM_HILOBYTES(packet.session_idh, packet.session_idl);
+            m_info->shared->server_version = TNFS_UINT16_FROM_HILOBYTES(packet.payload[2], packet.payload[1]);
+            m_info->shared->min_retry_ms = TNFS_UINT16_FROM_HILOBYTES(packet.payload[4], packet.payload[3]);
 
             // Check server version
-            if(m_info->server_version < 0x0102)
+            if(m_info->shared->server_version < 0x0102)
             {
-                Debug_printf("Server version 0x%04hx lower than minimum required\r\n", m_info->server_version);
-                tnfs_umount(m_info);
+                Debug_printf("Server version 0x%04hx lower than minimum required\r\n", m_info->shared->server_version);
+                _tnfs_logout(m_info);
+                m_info->shared->session = TNFS_INVALID_SESSION;
                 return TNFS_RESULT_FUNCTION_UNIMPLEMENTED;
             }
         }
@@ -134,13 +175,48 @@ int tnfs_mount(tnfsMountInfo *m_info)
     return -1;
 }
 
-/* Logs off TNFS server given data (session, host) in tnfsMountInfo
+/*
+ Logs off TNFS server given data (session, host) in tnfsMountInfo once no other
+ client uses the session. Files and the directory left open by this one are closed.
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
 */
 int tnfs_umount(tnfsMountInfo *m_info)
 {
     if (m_info == nullptr)
         return -1;
 
+    std::shared_ptr<tnfsSessionInfo> shared = m_info->shared;
+    int result = TNFS_RESULT_SUCCESS;
+    {
+        std::lock_guard<std::recursive_mutex> lock(shared->transaction_mutex);
+
+        if (m_info->dir_handle != TNFS_INVALID_HANDLE || m_info->dirlisting_open())
+            tnfs_closedir(m_info);
+
+        // Other clients may keep using the session, and cached writes have to be sent anyway
+        for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+        {
+            tnfsFileHandleInfo *pFileInf = shared->filehandleinfo_at(i);
+            if (pFileInf != nullptr && pFileInf->owner == m_info)
+                tnfs_close(m_info, pFileInf->handle_id);
+        }
+
+        if (shared->remove_client(m_info) == 0 && shared->session != TNFS_INVALID_SESSION)
+            result = _tnfs_logout(m_info);
+    }
+
+    m_info->shared = std::make_shared<tnfsSessionInfo>();
+    m_info->dir_handle = TNFS_INVALID_HANDLE;
+    m_info->close_dirlisting();
+    return result;
+}
+
+/*
+ Ends the session in m_info->shared for every client
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_logout(tnfsMountInfo *m_info)
+{
     tnfsPacket packet;
     packet.command = TNFS_CMD_UNMOUNT;
 
@@ -148,7 +224,7 @@ int tnfs_umount(tnfsMountInfo *m_info)
     {
         if (packet.payload[0] == TNFS_RESULT_SUCCESS)
         {
-            m_info->session = TNFS_INVALID_SESSION;
+            m_info->shared->session = TNFS_INVALID_SESSION;
         }
         return packet.payload[0];
     }
@@ -158,7 +234,8 @@ int tnfs_umount(tnfsMountInfo *m_info)
 /* Open a file
  open_mode: TNFS_OPENFLAG_*
  create_perms: TNFS_CREATEPERM_* (only meaningful when creating files)
- file_handle: if successful, server's file handle is stored here
+ file_handle: if successful, our handle for the file is stored here. It stays valid
+ while the file is closed on the server to make room for others (see _tnfs_use_handle).
  returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
 */
 int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, uint16_t create_perms, int16_t *file_handle)
@@ -168,8 +245,10 @@ int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, u
 
     *file_handle = TNFS_INVALID_HANDLE;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
     // Find a free slot in our table of file handles
-    tnfsFileHandleInfo *pFileInf = m_info->new_filehandleinfo();
+    tnfsFileHandleInfo *pFileInf = m_info->shared->new_filehandleinfo();
     if (pFileInf == nullptr)
         return TNFS_RESULT_TOO_MANY_FILES_OPEN;
 
@@ -188,12 +267,72 @@ int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, u
     {
         if (rs != TNFS_RESULT_FILE_NOT_FOUND)
         {
-            m_info->delete_filehandleinfo(pFileInf);
+            m_info->shared->delete_filehandleinfo(pFileInf);
             return rs;
         }
     }
 
-    // Done with STAT - now try to actually open the file
+    // Store the path we use as part of our file handle info
+    if (_tnfs_adjust_with_full_path(m_info, pFileInf->filename, filepath, sizeof(pFileInf->filename)) < 0)
+    {
+        m_info->shared->delete_filehandleinfo(pFileInf);
+        return TNFS_RESULT_INVALID_ARGUMENT;
+    }
+
+    Debug_printf("TNFS open file: \"%s\" (0x%04x, 0x%04x)\r\n", pFileInf->filename, open_mode, create_perms);
+
+    // Files may be created or change size
+    if (open_mode & TNFS_OPENMODE_WRITE)
+    {
+        m_info->shared->drop_dirlistings();
+#ifdef ESP_PLATFORM
+        m_info->shared->start_flush_task();
+#endif
+    }
+
+    int result = _tnfs_server_open(m_info, pFileInf, open_mode, create_perms);
+    if (result == TNFS_RESULT_SUCCESS)
+    {
+        // Since everything went okay, save our file info
+        pFileInf->open_mode = open_mode;
+        pFileInf->owner = m_info;
+        pFileInf->file_position = pFileInf->cached_pos = 0;
+
+        *file_handle = pFileInf->handle_id;
+
+        // Depending on the file mode and wether the file aready existed,
+        // we need to do something different with the position of the file
+        if (file_exists && (open_mode & TNFS_OPENMODE_WRITE))
+        {
+            if (open_mode & TNFS_OPENMODE_WRITE_APPEND)
+                pFileInf->file_position = pFileInf->cached_pos = pFileInf->file_size;
+            else if (open_mode & TNFS_OPENMODE_WRITE_TRUNCATE)
+                pFileInf->file_size = 0;
+        }
+        Debug_printf("File opened, handle ID: %hd (server %hu), size: %u, pos: %u\r\n", *file_handle, pFileInf->server_handle, pFileInf->file_size, pFileInf->file_position);
+    }
+
+    // Get rid fo the filehandleinfo if we're not going to use it
+    if (result != TNFS_RESULT_SUCCESS)
+        m_info->shared->delete_filehandleinfo(pFileInf);
+
+    return result;
+}
+
+/*
+ Sends TNFS_CMD_OPEN for pFHI->filename. Once TNFS_MAX_FILE_HANDLES files are open on
+ the server, or if the server says too many are, the least recently used one is closed first.
+ returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_server_open(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint16_t open_mode, uint16_t create_perms)
+{
+    while (m_info->shared->count_server_handles() >= TNFS_MAX_FILE_HANDLES)
+    {
+        int result = _tnfs_park_handle(m_info, pFHI);
+        if (result != 0)
+            return result;
+    }
+
     tnfsPacket packet;
     packet.command = TNFS_CMD_OPEN;
 
@@ -204,46 +343,88 @@ int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, u
     packet.payload[3] = TNFS_HIBYTE_FROM_UINT16(create_perms);
 
     int offset_filename = 4; // Where the filename starts in the buffer
-
-    int len = _tnfs_adjust_with_full_path(m_info, (char *)packet.payload + offset_filename, filepath, sizeof(packet.payload) - offset_filename);
-
-    // Store the path we used as part of our file handle info
-    strlcpy(pFileInf->filename, (const char *)&packet.payload[offset_filename], TNFS_MAX_FILELEN);
-
-    Debug_printf("TNFS open file: \"%s\" (0x%04x, 0x%04x)\r\n", (char *)&packet.payload[offset_filename], open_mode, create_perms);
+    strlcpy((char *)packet.payload + offset_filename, pFHI->filename, sizeof(packet.payload) - offset_filename);
 
     // Offset to filename + filename length + zero terminator
-    int result = -1;
-    len = len + offset_filename + 1;
-    if (_tnfs_transaction(m_info, packet, len))
-    {
-        if (packet.payload[0] == TNFS_RESULT_SUCCESS)
-        {
-            // Since everything went okay, save our file info
-            pFileInf->handle_id = packet.payload[1];
-            pFileInf->file_position = pFileInf->cached_pos = 0;
+    int len = offset_filename + strlen((char *)packet.payload + offset_filename) + 1;
 
-            *file_handle = pFileInf->handle_id;
+    while (true)
+    {
+        tnfsPacket request = packet;
+        if (!_tnfs_transaction(m_info, request, len))
+            return -1;
 
-            // Depending on the file mode and wether the file aready existed,
-            // we need to do something different with the position of the file
-            if (file_exists && (open_mode & TNFS_OPENMODE_WRITE))
-            {
-                if (open_mode & TNFS_OPENMODE_WRITE_APPEND)
-                    pFileInf->file_position = pFileInf->cached_pos = pFileInf->file_size;
-                else if (open_mode & TNFS_OPENMODE_WRITE_TRUNCATE)
-                    pFileInf->file_size = 0;
-            }
-            Debug_printf("File opened, handle ID: %hd, size: %u, pos: %u\r\n", *file_handle, pFileInf->file_size, pFileInf->file_position);
+        if (request.payload[0] == TNFS_RESULT_SUCCESS)
+        {
+            pFHI->server_handle = request.payload[1];
+            pFHI->server_open = true;
+            return TNFS_RESULT_SUCCESS;
         }
-        result = packet.payload[0];
+
+        // The server may allow fewer open files than we do
+        if (request.payload[0] != TNFS_RESULT_TOO_MANY_FILES_OPEN || _tnfs_park_handle(m_info, pFHI) != 0)
+            return request.payload[0];
     }
+}
 
-    // Get rid fo the filehandleinfo if we're not going to use it
-    if (result != TNFS_RESULT_SUCCESS)
-        m_info->delete_filehandleinfo(pFileInf);
+/*
+ Closes the least recently used file open on the server, other than keep, to make room for another one.
+ Its cached writes are sent first and its cache is released; _tnfs_use_handle reopens it when needed again.
+ returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+ (TNFS_RESULT_TOO_MANY_FILES_OPEN if there's nothing to close)
+*/
+int _tnfs_park_handle(tnfsMountInfo *m_info, const tnfsFileHandleInfo *keep)
+{
+    tnfsFileHandleInfo *pFHI = m_info->shared->least_recently_used_server_handle(keep);
+    if (pFHI == nullptr)
+        return TNFS_RESULT_TOO_MANY_FILES_OPEN;
 
-    return result;
+    int result = _tnfs_flush_cache(m_info, pFHI);
+    if (result != 0)
+        return result;
+
+    tnfsPacket packet;
+    packet.command = TNFS_CMD_CLOSE;
+    packet.payload[0] = pFHI->server_handle;
+
+    // The handle is gone from the server either way
+    if (!_tnfs_transaction(m_info, packet, 1))
+        return -1;
+
+    Debug_printf("TNFS closed handle %hu on the server to make room: \"%s\"\r\n", pFHI->handle_id, pFHI->filename);
+    pFHI->server_open = false;
+    pFHI->free_cache();
+    m_info->shared->stats.handles_parked++;
+    return 0;
+}
+
+/*
+ Marks the file as just used and reopens it on the server if it was closed there.
+ The server starts over at position 0 (file_position), the client's position is kept:
+ the next READ or WRITE seeks there like after any other seek outside the cache.
+ returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_use_handle(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
+{
+    m_info->shared->touch_filehandleinfo(pFHI);
+    if (pFHI->server_open)
+        return 0;
+
+    if (!pFHI->alloc_cache())
+        return TNFS_RESULT_OUT_OF_MEMORY;
+
+    // The file exists by now, and whatever was written to it must stay
+    uint16_t open_mode = pFHI->open_mode & ~(TNFS_OPENMODE_WRITE_CREATE | TNFS_OPENMODE_WRITE_TRUNCATE | TNFS_OPENMODE_CREATE_EXCLUSIVE);
+    int result = _tnfs_server_open(m_info, pFHI, open_mode, 0);
+    if (result != 0)
+    {
+        Debug_printf("TNFS failed to reopen \"%s\" (%d)\r\n", pFHI->filename, result);
+        return result;
+    }
+
+    pFHI->file_position = 0;
+    m_info->shared->stats.handles_resumed++;
+    return 0;
 }
 
 /*
@@ -255,20 +436,38 @@ int tnfs_close(tnfsMountInfo *m_info, int16_t file_handle)
     if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle))
         return -1;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
     // Find info on this handle
-    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
+    // Send anything still waiting in the cache, the handle is closed either way
+    int flush_result = _tnfs_flush_cache(m_info, pFileInf);
+    if (pFileInf->open_mode & TNFS_OPENMODE_WRITE)
+        m_info->shared->drop_dirlistings();
+    if (flush_result != 0)
+        Debug_printf("tnfs_close failed to write cached data (%d)\r\n", flush_result);
+    else if (pFileInf->write_error != 0)
+        flush_result = pFileInf->write_error;
+
+    // Nothing to tell the server if it was closed there to make room
+    if (pFileInf->server_open == false)
+    {
+        m_info->shared->delete_filehandleinfo(pFileInf);
+        return flush_result;
+    }
+
     tnfsPacket packet;
     packet.command = TNFS_CMD_CLOSE;
-    packet.payload[0] = file_handle;
+    packet.payload[0] = pFileInf->server_handle;
 
     if (_tnfs_transaction(m_info, packet, 1))
     {
         // We're going to go ahead and delete our info even though the server could reject it
-        m_info->delete_filehandleinfo(pFileInf);
-        return packet.payload[0];
+        m_info->shared->delete_filehandleinfo(pFileInf);
+        return flush_result != 0 ? flush_result : packet.payload[0];
     }
 
     return -1;
@@ -363,6 +562,9 @@ int _tnfs_read_from_cache(tnfsFileHandleInfo *pFHI, uint8_t *dest, uint16_t dest
 
 /*
  Executes as many READ calls as needed to populate our internal cache
+ from the client's position (cached_pos). Data written to the cache is sent first.
+ A miss right after the end of the previous fill loads twice as much as that one did,
+ up to TNFS_FILE_CACHE_SIZE; other misses load TNFS_FILE_CACHE_FILL bytes.
  Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
 */
 int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
@@ -373,21 +575,59 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
     Debug_printf("_TNFS_FILL_CACHE fh=%d, file_position=%d\r\n", pFHI->handle_id, pFHI->file_position);
     #endif
 
-    int error = 0;
+    int error = _tnfs_flush_cache(m_info, pFHI);
+    if (error != 0)
+        return error;
+
+    if (pFHI->cache_available > 0 && pFHI->cached_pos == pFHI->cache_start + pFHI->cache_available)
+        pFHI->cache_fill = pFHI->cache_fill * 2 > TNFS_FILE_CACHE_SIZE ? TNFS_FILE_CACHE_SIZE : pFHI->cache_fill * 2;
+    else
+        pFHI->cache_fill = TNFS_FILE_CACHE_FILL;
 
     // Reset the current cache values so it's invalid if we fail below
     pFHI->cache_available = 0;
+
+    // Move the server to the client's position if they differ
+    if (pFHI->file_position != pFHI->cached_pos)
+    {
+        uint32_t response_pos;
+        error = _tnfs_server_lseek(m_info, pFHI, pFHI->cached_pos, SEEK_SET, &response_pos);
+        if (error != 0)
+            return error;
+        pFHI->file_position = pFHI->cached_pos;
+    }
     pFHI->cache_start = pFHI->file_position;
 
     // How many bytes until we finish loading the cache
-    uint32_t bytes_remaining_to_load = sizeof(pFHI->cache);
+    uint32_t bytes_remaining_to_load = pFHI->cache_fill;
+
+    // Fills of more than one packet keep several requests in flight
+    if (m_info->shared->protocol == TNFS_PROTOCOL_UDP && m_info->shared->read_window > 1 &&
+        pFHI->file_position < pFHI->file_size && bytes_remaining_to_load > TNFS_MAX_READWRITE_PAYLOAD)
+    {
+        uint32_t window_len = pFHI->file_size - pFHI->file_position;
+        if (window_len > bytes_remaining_to_load)
+            window_len = bytes_remaining_to_load;
+
+        uint32_t window_used = 0;
+        error = _tnfs_read_window(m_info, pFHI, pFHI->cache, window_len, &window_used);
+        if (error != 0)
+            return error;
+
+        // Only keep going with single READs after a fallback
+        if (window_used == window_len)
+            bytes_remaining_to_load = 0;
+        else
+            bytes_remaining_to_load -= window_used;
+        pFHI->cache_available = pFHI->cache_fill - bytes_remaining_to_load;
+    }
 
     // Keep making TNFS READ calls as long as we still have bytes to read
     while (bytes_remaining_to_load > 0)
     {
         tnfsPacket packet;
         packet.command = TNFS_CMD_READ;
-        packet.payload[0] = pFHI->handle_id;
+        packet.payload[0] = pFHI->server_handle;
 
         // How many bytes to read in this call
         uint16_t bytes_to_read = bytes_remaining_to_load > TNFS_MAX_READWRITE_PAYLOAD ? TNFS_MAX_READWRITE_PAYLOAD : bytes_remaining_to_load;
@@ -407,7 +647,7 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
                 // Copy the actual number of bytes returned to us into our cache
                 // (offset by how many bytes we've already put in the cache)
                 uint16_t bytes_read = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
-                memcpy(pFHI->cache + (sizeof(pFHI->cache) - bytes_remaining_to_load),
+                memcpy(pFHI->cache + (pFHI->cache_fill - bytes_remaining_to_load),
                        packet.payload + 3, bytes_read);
 
                 // Keep track of our file position
@@ -450,12 +690,12 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
 #ifdef ESP_PLATFORM
     if (error == 0)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = pFHI->cache_fill - bytes_remaining_to_load;
 #else
 // TODO review EOF handling
     if (error == 0 || error == TNFS_RESULT_END_OF_FILE)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = pFHI->cache_fill - bytes_remaining_to_load;
         if (pFHI->cache_available > 0) error = 0; // neutralize EOF
 #endif
 #ifdef DEBUG
@@ -480,8 +720,10 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
 
     *resultlen = 0;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
     // Find info on this handle
-    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
@@ -489,7 +731,10 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
     Debug_printf("tnfs_read fh=%d, len=%d\r\n", file_handle, bufflen);
     #endif
 
-    int result = 0;
+    int result = _tnfs_use_handle(m_info, pFileInf);
+    if (result != 0)
+        return result;
+
     // Try to fulfill the request using our internal cache
     while ((result = _tnfs_read_from_cache(pFileInf, buffer, bufflen, resultlen)) != 0 && result != TNFS_RESULT_END_OF_FILE)
     {
@@ -519,11 +764,433 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
     return result;
 }
 
+// A READ request kept in flight by _tnfs_read_window
+struct _tnfs_read_request
+{
+    uint32_t offset = 0; // Relative to the start of the pipelined read
+    uint16_t length = 0; // 0 = free slot
+    uint8_t sequence_num = 0;
+    bool done = false;
+};
+
+/*
+ Moves the server's file position without touching our own bookkeeping
+ The position reported back by the server is placed in response_pos
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_server_lseek(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, int32_t position, uint8_t type, uint32_t *response_pos)
+{
+    tnfsPacket packet;
+    packet.command = TNFS_CMD_LSEEK;
+    packet.payload[0] = pFHI->server_handle;
+    packet.payload[1] = type;
+    TNFS_UINT32_TO_LOHI_BYTEPTR(position, packet.payload + 2);
+
+    if (!_tnfs_transaction(m_info, packet, 6))
+        return -1;
+
+    *response_pos = TNFS_UINT32_FROM_LOHI_BYTEPTR(packet.payload + 1);
+    return packet.payload[0];
+}
+
+/*
+ Marks requests received without gaps as complete and frees their slots
+*/
+void _tnfs_read_window_advance(_tnfs_read_request *requests, int window, uint32_t *complete)
+{
+    for (int i = 0; i < window; i++)
+    {
+        if (requests[i].length != 0 && requests[i].done && requests[i].offset == *complete)
+        {
+            *complete += requests[i].length;
+            requests[i].length = 0;
+            i = -1; // The next one may be in any slot
+        }
+    }
+}
+
+/*
+ Reads size bytes from the server's current file position straight into dest,
+ keeping up to m_info->shared->read_window READ requests in flight over UDP.
+ TNFS READ carries no offset: the server serves requests in the order they arrive,
+ so each one is tracked by the (offset, length) it covers when nothing is lost.
+ This assumes requests are not reordered on the way: the server replies in the order
+ it served them, so a reply overtaking an older request means the data may belong
+ to other offsets. Such a reply and everything after the last request completed in
+ order is dropped and read again stop-and-wait.
+ After a timeout the server's position tells whether only replies went missing
+ (just those requests are repeated) or a request did (everything after it is).
+ Short reads or TRY_AGAIN replies drop the mount back to stop-and-wait as well.
+ Returns: 0: success (dest_used < size after a fallback), -1: failed to deliver/receive packet,
+ other: TNFS error result code
+*/
+int _tnfs_read_window(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint8_t *dest, uint32_t size, uint32_t *dest_used)
+{
+    fnUDP udp;
+    _tnfs_read_request requests[TNFS_MAX_READ_WINDOW];
+    int window = m_info->shared->read_window > TNFS_MAX_READ_WINDOW ? TNFS_MAX_READ_WINDOW : m_info->shared->read_window;
+
+    uint32_t base = pFHI->file_position;
+    uint32_t server_pos = base; // Where the server's next READ starts if every request arrives
+    uint32_t issued = 0;        // Bytes requested so far
+    uint32_t complete = 0;      // Bytes received without gaps
+    int failures = 0;
+    bool fallback = false;
+    int error = 0;
+    uint32_t timeout_ms = m_info->shared->timeout_ms < m_info->shared->min_retry_ms ? m_info->shared->min_retry_ms : m_info->shared->timeout_ms;
+
+#ifdef ESP_PLATFORM
+    int ms_start = fnSystem.millis();
+#else
+    uint64_t ms_start = fnSystem.millis();
+#endif
+
+    while (complete < size && error == 0 && !fallback)
+    {
+        // Keep the window full
+        for (int i = 0; i < window && issued < size && error == 0; i++)
+        {
+            _tnfs_read_request &req = requests[i];
+            if (req.length != 0)
+                continue;
+
+            uint32_t pos;
+            if (server_pos != base + issued && (error = _tnfs_server_lseek(m_info, pFHI, base + issued, SEEK_SET, &pos)) != 0)
+                break;
+            server_pos = base + issued;
+
+            req.offset = issued;
+            req.length = (size - issued) > TNFS_MAX_READWRITE_PAYLOAD ? TNFS_MAX_READWRITE_PAYLOAD : size - issued;
+            req.sequence_num = m_info->shared->current_sequence_num++;
+            req.done = false;
+
+            tnfsPacket packet;
+            packet.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->shared->session);
+            packet.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->shared->session);
+            packet.sequence_num = req.sequence_num;
+            packet.command = TNFS_CMD_READ;
+            packet.payload[0] = pFHI->server_handle;
+            packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(req.length);
+            packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(req.length);
+
+            // A request lost on the way out shows up as a timeout below
+            _tnfs_send(&udp, m_info, packet, 3);
+
+            issued += req.length;
+            server_pos += req.length;
+        }
+        if (error != 0)
+            break;
+
+        if (SYSTEM_BUS.getShuttingDown())
+        {
+            Debug_println("TNFS Breakout due to Shutdown");
+            error = -1;
+            break;
+        }
+
+        tnfsPacket packet;
+        if (_tnfs_recv(&udp, m_info, packet) < 0)
+        {
+            if ((fnSystem.millis() - ms_start) < timeout_ms)
+            {
+#ifdef ESP_PLATFORM
+                fnSystem.yield();
+#else
+                fnSystem.delay_microseconds(1000);
+#endif
+                continue;
+            }
+
+            if (++failures >= m_info->max_retries)
+            {
+                Debug_printf("tnfs_read_pipelined - retry attempts failed at offset %u\r\n", base + complete);
+                error = -1;
+                break;
+            }
+
+            // Something went missing - ask the server where it stands
+            m_info->shared->stats.retransmits++;
+            uint32_t pos;
+            if ((error = _tnfs_server_lseek(m_info, pFHI, 0, SEEK_CUR, &pos)) != 0)
+                break;
+
+            if (pos == server_pos)
+            {
+                // Every request arrived, only replies were lost: repeat just those
+                for (int i = 0; i < window && error == 0 && !fallback; i++)
+                {
+                    _tnfs_read_request &req = requests[i];
+                    if (req.length == 0 || req.done)
+                        continue;
+
+                    Debug_printf("tnfs_read_pipelined - repeating read at offset %u\r\n", base + req.offset);
+                    if ((error = _tnfs_server_lseek(m_info, pFHI, base + req.offset, SEEK_SET, &pos)) != 0)
+                        break;
+                    server_pos = base + req.offset;
+
+                    tnfsPacket retry;
+                    retry.command = TNFS_CMD_READ;
+                    retry.payload[0] = pFHI->server_handle;
+                    retry.payload[1] = TNFS_LOBYTE_FROM_UINT16(req.length);
+                    retry.payload[2] = TNFS_HIBYTE_FROM_UINT16(req.length);
+                    if (!_tnfs_transaction(m_info, retry, 3))
+                    {
+                        error = -1;
+                        break;
+                    }
+                    if (retry.payload[0] != TNFS_RESULT_SUCCESS)
+                    {
+                        error = retry.payload[0];
+                        break;
+                    }
+                    if (TNFS_UINT16_FROM_LOHI_BYTEPTR(retry.payload + 1) != req.length)
+                    {
+                        fallback = true;
+                        break;
+                    }
+                    memcpy(dest + req.offset, retry.payload + 3, req.length);
+                    req.done = true;
+                    server_pos += req.length;
+                }
+            }
+            else
+            {
+                // A request was lost, so later ones were served from the wrong offset
+                Debug_printf("tnfs_read_pipelined - request lost, reading again from offset %u\r\n", base + complete);
+                for (int i = 0; i < window; i++)
+                    requests[i].length = 0;
+                issued = complete;
+                server_pos = pos;
+            }
+
+            _tnfs_read_window_advance(requests, window, &complete);
+            ms_start = fnSystem.millis();
+            continue;
+        }
+
+        // Match the reply to a request still in flight; anything else is a duplicate or stale
+        _tnfs_read_request *req = nullptr;
+        for (int i = 0; i < window; i++)
+        {
+            if (requests[i].length != 0 && !requests[i].done && requests[i].sequence_num == packet.sequence_num)
+                req = &requests[i];
+        }
+        if (req == nullptr)
+        {
+            m_info->shared->stats.duplicates++;
+            continue;
+        }
+
+        // An older request still waiting means the server may have served this one first
+        bool overtaken = false;
+        for (int i = 0; i < window; i++)
+        {
+            if (requests[i].length != 0 && !requests[i].done && requests[i].offset < req->offset)
+                overtaken = true;
+        }
+        if (overtaken)
+        {
+            Debug_printf("tnfs_read_pipelined - reply out of order at offset %u\r\n", base + req->offset);
+            m_info->shared->stats.reordered++;
+            fallback = true;
+            break;
+        }
+
+        if (packet.payload[0] == TNFS_RESULT_SUCCESS && TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1) == req->length)
+        {
+            memcpy(dest + req->offset, packet.payload + 3, req->length);
+            req->done = true;
+        }
+        else if (packet.payload[0] == TNFS_RESULT_SUCCESS || packet.payload[0] == TNFS_RESULT_END_OF_FILE ||
+                 packet.payload[0] == TNFS_RESULT_TRY_AGAIN)
+        {
+            // Short read or busy server - later replies can't be trusted to match their offsets
+            fallback = true;
+            break;
+        }
+        else
+        {
+            error = packet.payload[0];
+            break;
+        }
+
+        _tnfs_read_window_advance(requests, window, &complete);
+        m_info->shared->stats.transactions++;
+        failures = 0;
+        ms_start = fnSystem.millis();
+    }
+
+    if (fallback)
+    {
+        Debug_printf("tnfs_read_pipelined - unexpected reply at offset %u, falling back to stop-and-wait\r\n", base + complete);
+        m_info->shared->read_window = 1;
+    }
+
+    // Leave the server where the data we kept ends
+    if (server_pos != base + complete)
+    {
+        uint32_t pos;
+        int result = _tnfs_server_lseek(m_info, pFHI, base + complete, SEEK_SET, &pos);
+        if (error == 0)
+            error = result;
+    }
+
+    pFHI->file_position = base + complete;
+    *dest_used = complete;
+
+    return error;
+}
+
+/*
+ Reads from an open file like tnfs_read, without its size limit.
+ Large reads are passed to _tnfs_read_window, which keeps several READ
+ requests in flight; TCP mounts and small reads use tnfs_read.
+ Bytes actually read will be placed in resultlen
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+ */
+int tnfs_read_pipelined(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint32_t bufflen, uint32_t *resultlen)
+{
+    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle) ||
+        buffer == nullptr || resultlen == nullptr)
+        return -1;
+
+    *resultlen = 0;
+
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
+    // Find info on this handle
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
+    if (pFileInf == nullptr)
+        return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
+
+    int result = _tnfs_use_handle(m_info, pFileInf);
+    if (result != 0)
+        return result;
+
+    // Whatever is left in the cache first
+    while (*resultlen < bufflen && result == 0)
+    {
+        uint32_t remaining = bufflen - *resultlen;
+        uint16_t chunk_used = 0;
+        result = _tnfs_read_from_cache(pFileInf, buffer + *resultlen,
+                                       remaining > TNFS_MAX_READWRITE_PAYLOAD ? TNFS_MAX_READWRITE_PAYLOAD : remaining, &chunk_used);
+        *resultlen += chunk_used;
+    }
+    if (result == TNFS_RESULT_END_OF_FILE)
+        return result;
+
+    result = 0;
+    while (*resultlen < bufflen && result == 0)
+    {
+        uint32_t remaining = bufflen - *resultlen;
+
+        // Everything up to the end of the file in one window once the cache is used up
+        if (m_info->shared->protocol == TNFS_PROTOCOL_UDP && m_info->shared->read_window > 1 &&
+            pFileInf->cached_pos == pFileInf->file_position && pFileInf->file_position < pFileInf->file_size &&
+            remaining > TNFS_MAX_READWRITE_PAYLOAD)
+        {
+            uint32_t window_len = pFileInf->file_size - pFileInf->file_position;
+            if (window_len > remaining)
+                window_len = remaining;
+
+            #ifdef VERBOSE_TNFS
+            Debug_printf("tnfs_read_pipelined fh=%d, pos=%u, len=%u\r\n", file_handle, pFileInf->file_position, window_len);
+            #endif
+
+            // The window bypasses the cache, which must not hold anything unsent
+            result = _tnfs_flush_cache(m_info, pFileInf);
+            if (result != 0)
+                break;
+
+            uint32_t window_used = 0;
+            result = _tnfs_read_window(m_info, pFileInf, buffer + *resultlen, window_len, &window_used);
+            pFileInf->cache_available = 0;
+            pFileInf->cached_pos = pFileInf->file_position;
+            *resultlen += window_used;
+            if (result != 0 || window_used == window_len)
+                continue;
+        }
+
+        uint16_t chunk_used = 0;
+        uint16_t chunk = remaining > TNFS_MAX_READWRITE_PAYLOAD ? TNFS_MAX_READWRITE_PAYLOAD : remaining;
+        result = tnfs_read(m_info, file_handle, buffer + *resultlen, chunk, &chunk_used);
+        *resultlen += chunk_used;
+    }
+
+    return result;
+}
+
+
+/*
+ Sends the part of the cache written by tnfs_write to the server.
+ Whatever could not be written stays marked for the next attempt.
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_flush_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
+{
+    if (pFHI->cache_modified == false)
+        return 0;
+
+    // Written before the session had to be renewed
+    if (pFHI->server_open == false)
+    {
+        int result = _tnfs_use_handle(m_info, pFHI);
+        if (result != 0)
+            return result;
+    }
+
+    #ifdef VERBOSE_TNFS
+    Debug_printf("_tnfs_flush_cache fh=%d, start=%u, end=%u\r\n", pFHI->handle_id, pFHI->dirty_start, pFHI->dirty_end);
+    #endif
+
+    if (pFHI->file_position != pFHI->dirty_start)
+    {
+        uint32_t response_pos;
+        int result = _tnfs_server_lseek(m_info, pFHI, pFHI->dirty_start, SEEK_SET, &response_pos);
+        if (result != 0)
+            return result;
+        pFHI->file_position = pFHI->dirty_start;
+    }
+
+    while (pFHI->dirty_start < pFHI->dirty_end)
+    {
+        uint32_t remaining = pFHI->dirty_end - pFHI->dirty_start;
+        uint16_t bytes_to_write = remaining > TNFS_MAX_READWRITE_PAYLOAD ? TNFS_MAX_READWRITE_PAYLOAD : remaining;
+
+        tnfsPacket packet;
+        packet.command = TNFS_CMD_WRITE;
+        packet.payload[0] = pFHI->server_handle;
+        packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(bytes_to_write);
+        packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(bytes_to_write);
+        memcpy(packet.payload + 3, pFHI->cache + (pFHI->dirty_start - pFHI->cache_start), bytes_to_write);
+
+        if (!_tnfs_transaction(m_info, packet, bytes_to_write + 3))
+            return -1;
+        if (packet.payload[0] != TNFS_RESULT_SUCCESS)
+        {
+            Debug_printf("_tnfs_flush_cache write failed: %u\r\n", packet.payload[0]);
+            return packet.payload[0];
+        }
+
+        uint16_t written = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
+        if (written == 0)
+            return TNFS_RESULT_IO_ERROR;
+        pFHI->file_position += written;
+        pFHI->dirty_start += written;
+    }
+
+    pFHI->cache_modified = false;
+    return 0;
+}
 
 /*
  Write to an open file.
  Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
  Bytes actually written will be placed in resultlen
+ Files opened for writing (but not appending) collect writes in the cache; they
+ are sent once the cache has to hold something else, on tnfs_flush or tnfs_close,
+ or by tnfs_flush_idle once no writes happened for TNFS_WRITE_FLUSH_MS.
  Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
  */
 int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen)
@@ -534,12 +1201,72 @@ int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint
 
     *resultlen = 0;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
     // Find info on this handle
-    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
-    // For now, invalidate our cache and seek to the current position in the file before writing
+    // Earlier writes were reported done before the background flush failed, the data is still cached
+    if (pFileInf->write_error != 0)
+    {
+        int result = pFileInf->write_error;
+        pFileInf->write_error = 0;
+        return result;
+    }
+
+    int use_result = _tnfs_use_handle(m_info, pFileInf);
+    if (use_result != 0)
+        return use_result;
+
+    if ((pFileInf->open_mode & TNFS_OPENMODE_WRITE) && !(pFileInf->open_mode & TNFS_OPENMODE_WRITE_APPEND))
+    {
+        uint32_t pos = pFileInf->cached_pos;
+        uint32_t cache_end = pFileInf->cache_start + pFileInf->cache_available;
+
+        // Start over at the current position unless the write touches what's cached and fits
+        if (pFileInf->cache_available == 0 || pos < pFileInf->cache_start || pos > cache_end ||
+            pos + bufflen > pFileInf->cache_start + TNFS_FILE_CACHE_SIZE)
+        {
+            int result = _tnfs_flush_cache(m_info, pFileInf);
+            if (result != 0)
+                return result;
+            pFileInf->cache_start = pos;
+            pFileInf->cache_available = 0;
+        }
+
+        memcpy(pFileInf->cache + (pos - pFileInf->cache_start), buffer, bufflen);
+        if (pos + bufflen > pFileInf->cache_start + pFileInf->cache_available)
+            pFileInf->cache_available = pos + bufflen - pFileInf->cache_start;
+
+        // Bytes between two written ranges are cached as well, so one range covers both
+        if (pFileInf->cache_modified == false)
+        {
+            pFileInf->dirty_start = pos;
+            pFileInf->dirty_end = pos + bufflen;
+            pFileInf->cache_modified = true;
+        }
+        else
+        {
+            if (pos < pFileInf->dirty_start)
+                pFileInf->dirty_start = pos;
+            if (pos + bufflen > pFileInf->dirty_end)
+                pFileInf->dirty_end = pos + bufflen;
+        }
+        pFileInf->last_write_ms = fnSystem.millis();
+
+        pFileInf->cached_pos = pos + bufflen;
+        if (pFileInf->cached_pos > pFileInf->file_size)
+            pFileInf->file_size = pFileInf->cached_pos;
+        *resultlen = bufflen;
+        return TNFS_RESULT_SUCCESS;
+    }
+
+    // Otherwise invalidate our cache and seek to the current position in the file before writing
+    int flush_result = _tnfs_flush_cache(m_info, pFileInf);
+    if (flush_result != 0)
+        return flush_result;
     pFileInf->cache_available = 0;
     if(pFileInf->cached_pos != pFileInf->file_position)
     {
@@ -553,7 +1280,7 @@ int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint
 
     tnfsPacket packet;
     packet.command = TNFS_CMD_WRITE;
-    packet.payload[0] = file_handle;
+    packet.payload[0] = pFileInf->server_handle;
     packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(bufflen);
     packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(bufflen);
 
@@ -598,8 +1325,8 @@ int _tnfs_cache_seek(tnfsFileHandleInfo *pFHI, int32_t position, uint8_t type)
                  pFHI->cached_pos, destination_pos, pFHI->cache_start, cache_end);
 #endif
 
-    // Just update our position if we're within the cached region
-    if (destination_pos >= pFHI->cache_start && destination_pos < cache_end)
+    // Just update our position if we're within the cached region or right after it
+    if (destination_pos >= pFHI->cache_start && destination_pos <= cache_end)
     {
 #ifdef TNFS_DEBUG
         Debug_println("_tnfs_cache_seek within cached region");
@@ -626,8 +1353,10 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     if (type != SEEK_SET && type != SEEK_CUR && type != SEEK_END)
         return TNFS_RESULT_INVALID_ARGUMENT;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
     // Find info on this handle
-    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
@@ -635,6 +1364,10 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     Debug_printf("tnfs_lseek currpos=%d, pos=%d, typ=%d\r\n", pFileInf->cached_pos, position, type);
 #endif
 
+    int use_result = _tnfs_use_handle(m_info, pFileInf);
+    if (use_result != 0)
+        return use_result;
+
     // Try to fulfill the seek within our internal cache
     if (skip_cache == false && _tnfs_cache_seek(pFileInf, position, type) == 0)
     {
@@ -642,13 +1375,23 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
             *new_position = pFileInf->cached_pos;
         return 0;
     }
-    // Cache seek failed - invalidate the internal cache
+    // Cache seek failed - invalidate the internal cache once anything written to it is sent
+    int flush_result = _tnfs_flush_cache(m_info, pFileInf);
+    if (flush_result != 0)
+        return flush_result;
     pFileInf->cache_available = 0;
 
+    // The server's position can differ from the client's, make SEEK_CUR relative to the latter
+    if (type == SEEK_CUR)
+    {
+        position += pFileInf->cached_pos;
+        type = SEEK_SET;
+    }
+
     // Go ahead and execute a new TNFS SEEK request
     tnfsPacket packet;
     packet.command = TNFS_CMD_LSEEK;
-    packet.payload[0] = file_handle;
+    packet.payload[0] = pFileInf->server_handle;
     packet.payload[1] = type;
     TNFS_UINT32_TO_LOHI_BYTEPTR(position, packet.payload + 2);
 
@@ -659,8 +1402,6 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
             // Keep track of our file position
             if (type == SEEK_SET)
                 pFileInf->file_position = position;
-            else if (type == SEEK_CUR)
-                pFileInf->file_position += position;
             else
                 pFileInf->file_position = (pFileInf->file_size + position);
 
@@ -684,12 +1425,131 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     return -1;
 }
 
+/*
+ Sends data written to an open file that's still held in its cache
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+ */
+int tnfs_flush(tnfsMountInfo *m_info, int16_t file_handle)
+{
+    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle))
+        return -1;
+
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
+
+    // Find info on this handle
+    tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
+    if (pFileInf == nullptr)
+        return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
+
+    int result = _tnfs_flush_cache(m_info, pFileInf);
+    if (result == 0 && pFileInf->write_error != 0)
+        result = pFileInf->write_error;
+    pFileInf->write_error = 0;
+    return result;
+}
+
+/*
+ Sends cached writes of every open file of the session that hasn't been written to for
+ TNFS_WRITE_FLUSH_MS, on behalf of the client that opened it.
+ Meant to be called periodically; does nothing while another transaction is in progress.
+ A failed flush keeps the data cached and its result in the handle's write_error for the
+ next tnfs_write, tnfs_flush or tnfs_close to return; the file isn't retried here until then.
+ Returns: 0: success or busy, other: result of the first flush that failed
+ */
+int tnfs_flush_idle(tnfsSessionInfo *session)
+{
+    if (session == nullptr)
+        return -1;
+
+    std::unique_lock<std::recursive_mutex> lock(session->transaction_mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return 0;
+
+    uint32_t now = fnSystem.millis();
+    int result = 0;
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+    {
+        tnfsFileHandleInfo *pFileInf = session->filehandleinfo_at(i);
+        if (pFileInf == nullptr || pFileInf->cache_modified == false || pFileInf->write_error != 0 ||
+            (uint32_t)(now - pFileInf->last_write_ms) < TNFS_WRITE_FLUSH_MS)
+            continue;
+
+        // Clients close their files before leaving the session (tnfs_umount)
+        int r = _tnfs_flush_cache(const_cast<tnfsMountInfo *>(pFileInf->owner), pFileInf);
+        if (r != 0)
+        {
+            Debug_printf("tnfs_flush_idle failed to write \"%s\" (%d)\r\n", pFileInf->filename, r);
+            pFileInf->write_error = r;
+            if (result == 0)
+                result = r;
+        }
+    }
+    return result;
+}
+
+#define OFFSET_READDIRX_FLAGS 0
+#define OFFSET_READDIRX_SIZE 1
+#define OFFSET_READDIRX_MTIME 5
+#define OFFSET_READDIRX_CTIME 9
+#define OFFSET_READDIRX_PATH 13
+
+/*
+    Reads all entries of the directory opened on the server into listing,
+    asking for TNFS_READDIRX_BATCH entries at a time.
+    Returns: 0: success, 1: more than TNFS_DIRLIST_MAX_ENTRIES entries,
+    -1: failed to send/receive packet, other: TNFS server response
+*/
+int _tnfs_load_dirlisting(tnfsMountInfo *m_info, tnfsDirListing *listing)
+{
+    while (true)
+    {
+        tnfsPacket packet;
+        packet.command = TNFS_CMD_READDIRX;
+        packet.payload[0] = m_info->dir_handle;
+        packet.payload[1] = TNFS_READDIRX_BATCH;
+
+        if (!_tnfs_transaction(m_info, packet, 2))
+            return -1;
+        if (packet.payload[0] == TNFS_RESULT_END_OF_FILE)
+            return 0;
+        if (packet.payload[0] != TNFS_RESULT_SUCCESS)
+            return packet.payload[0];
+
+        uint8_t response_count = packet.payload[1];
+        uint8_t response_status = packet.payload[2];
+
+        int current_offset = 5;
+        for (int i = 0; i < response_count; i++)
+        {
+            if (listing->entries.size() >= TNFS_DIRLIST_MAX_ENTRIES)
+                return 1;
+
+            tnfsDirListEntry entry;
+            entry.flags = packet.payload[current_offset + OFFSET_READDIRX_FLAGS];
+            entry.filesize = TNFS_UINT32_FROM_LOHI_BYTEPTR(packet.payload + current_offset + OFFSET_READDIRX_SIZE);
+            entry.m_time = TNFS_UINT32_FROM_LOHI_BYTEPTR(packet.payload + current_offset + OFFSET_READDIRX_MTIME);
+            entry.c_time = TNFS_UINT32_FROM_LOHI_BYTEPTR(packet.payload + current_offset + OFFSET_READDIRX_CTIME);
+            entry.name = (char *)packet.payload + current_offset + OFFSET_READDIRX_PATH;
+
+            // flags (1) + size (4) + mtime (4) + ctime (4) + null (1) = 14
+            current_offset += 14 + entry.name.length();
+            listing->entries.push_back(std::move(entry));
+        }
+
+        if ((response_status & TNFS_READDIRX_STATUS_EOF) || response_count == 0)
+            return 0;
+    }
+}
+
 /*
     Opens directory and stores directory handle in tnfsMountInfo.dir_handle
     sortopts = zero or more TNFS_DIRSORT flags
     diropts = zero or more TNFS_DIROPT flags
     pattern = zero-terminated wildcard pattern string
     maxresults = max number of results to return or zero for unlimited
+    Without maxresults the whole directory is read at once and kept by tnfsMountInfo.
+    Opening it again with the same options and pattern only costs a STAT as long as
+    the directory's modification time is unchanged; no directory handle is used then.
     Returns: 0: success, -1: failed to send/receive packet, other: TNFS server response
 */
 int tnfs_opendirx(tnfsMountInfo *m_info, const char *directory, uint8_t sortopts, uint8_t diropts, const char *pattern, uint16_t maxresults)
@@ -707,6 +1567,7 @@ int tnfs_opendirx(tnfsMountInfo *m_info, const char *directory, uint8_t sortopts
 
     // Throw out any existing cached directory entries
     m_info->empty_dircache();
+    m_info->close_dirlisting();
 
     tnfsPacket packet;
     packet.command = TNFS_CMD_OPENDIRX;
@@ -732,6 +1593,33 @@ int tnfs_opendirx(tnfsMountInfo *m_info, const char *directory, uint8_t sortopts
     Debug_printf("TNFS open directory: sortopts=0x%02x diropts=0x%02x maxresults=0x%04x pattern=\"%s\" path=\"%s\"\r\n",
      sortopts, diropts, maxresults, (char *)(packet.payload + OFFSET_OPENDIRX_PATTERN), (char *)(packet.payload + pathoffset));
 
+    std::shared_ptr<tnfsDirListing> listing;
+    tnfsStat dirstat;
+    if (maxresults == 0 && TNFS_DIRLIST_CACHE_ENTRIES > 0 &&
+        tnfs_stat(m_info, &dirstat, directory) == TNFS_RESULT_SUCCESS && dirstat.isDir)
+    {
+        const char *fullpath = (const char *)(packet.payload + pathoffset);
+        const char *fullpattern = (const char *)(packet.payload + OFFSET_OPENDIRX_PATTERN);
+
+        listing = m_info->shared->find_dirlisting(fullpath, sortopts, diropts, fullpattern);
+        if (listing != nullptr && listing->m_time == dirstat.m_time)
+        {
+            m_info->shared->stats.dirlist_hits++;
+            m_info->open_dirlisting(listing);
+            m_info->dir_entries = listing->entries.size();
+            Debug_printf("Directory listing kept, entries: %u\r\n", m_info->dir_entries);
+            return TNFS_RESULT_SUCCESS;
+        }
+
+        m_info->shared->stats.dirlist_misses++;
+        listing = std::make_shared<tnfsDirListing>();
+        listing->path = fullpath;
+        listing->pattern = fullpattern;
+        listing->sortopts = sortopts;
+        listing->diropts = diropts;
+        listing->m_time = dirstat.m_time;
+    }
+
     if (_tnfs_transaction(m_info, packet, pathoffset + pathlen + 1))
     {
         if (packet.payload[0] == TNFS_RESULT_SUCCESS)
@@ -739,21 +1627,48 @@ int tnfs_opendirx(tnfsMountInfo *m_info, const char *directory, uint8_t sortopts
             m_info->dir_handle = packet.payload[1];
             m_info->dir_entries = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 2);
             Debug_printf("Directory opened, handle ID: %hd, entries: %u\r\n", m_info->dir_handle, m_info->dir_entries);
+
+            // The server tells how many entries there are, don't start on ones too large to keep
+            if (listing != nullptr && m_info->dir_entries <= TNFS_DIRLIST_MAX_ENTRIES)
+            {
+                int result = _tnfs_load_dirlisting(m_info, listing.get());
+                if (result == 0)
+                {
+                    // Everything's here, the server's handle isn't needed anymore
+                    tnfs_closedir(m_info);
+                    m_info->shared->store_dirlisting(listing);
+                    m_info->open_dirlisting(listing);
+                    m_info->dir_entries = listing->entries.size();
+                    Debug_printf("Directory listing loaded, entries: %u\r\n", m_info->dir_entries);
+                }
+                else if (result == 1)
+                {
+                    // Too large to keep, read it in batches from the start
+                    Debug_printf("Directory has more than %u entries, not kept\r\n", TNFS_DIRLIST_MAX_ENTRIES);
+                    return tnfs_seekdir(m_info, 0);
+                }
+                else
+                {
+                    tnfs_closedir(m_info);
+                    return result;
+                }
+            }
         }
         return packet.payload[0];
     }
     return -1;
 }
 
-void _readdirx_fill_response(tnfsDirCacheEntry *pCached, tnfsStat *filestat, char *dir_entry, int dir_entry_len)
+void _readdirx_fill_response(uint8_t flags, uint32_t filesize, uint32_t m_time, uint32_t c_time, const char *name,
+                             tnfsStat *filestat, char *dir_entry, int dir_entry_len)
 {
-    filestat->isDir = pCached->flags & TNFS_READDIRX_DIR ? true : false;
-    filestat->filesize = pCached->filesize;
-    filestat->m_time = pCached->m_time;
-    filestat->c_time = pCached->c_time;
+    filestat->isDir = flags & TNFS_READDIRX_DIR ? true : false;
+    filestat->filesize = filesize;
+    filestat->m_time = m_time;
+    filestat->c_time = c_time;
     filestat->a_time = 0;
 
-    strlcpy(dir_entry, pCached->entryname, dir_entry_len);
+    strlcpy(dir_entry, name, dir_entry_len);
 
 #ifdef DEBUG
     {
@@ -779,8 +1694,22 @@ void _readdirx_fill_response(tnfsDirCacheEntry *pCached, tnfsStat *filestat, cha
 */
 int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, int dir_entry_len)
 {
+    if (m_info == nullptr)
+        return -1;
+
+    // A complete listing needs no server
+    if (m_info->dirlisting_open())
+    {
+        const tnfsDirListEntry *pEntry = m_info->next_dirlisting_entry();
+        if (pEntry == nullptr)
+            return TNFS_RESULT_END_OF_FILE;
+        _readdirx_fill_response(pEntry->flags, pEntry->filesize, pEntry->m_time, pEntry->c_time, pEntry->name.c_str(),
+                                filestat, dir_entry, dir_entry_len);
+        return 0;
+    }
+
     // Check for a valid open handle ID
-    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
+    if (false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
         return -1;
 
     // See if we have an entry in our directory cache to return first
@@ -788,7 +1717,8 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
     if(pCached != nullptr)
     {
         Debug_print("tnfs_readdirx responding from cached entry\r\n");
-        _readdirx_fill_response(pCached, filestat, dir_entry, dir_entry_len);
+        _readdirx_fill_response(pCached->flags, pCached->filesize, pCached->m_time, pCached->c_time, pCached->entryname,
+                                filestat, dir_entry, dir_entry_len);
         return 0;
     }
 
@@ -802,12 +1732,6 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
     // Invalidate the cache before loading more
     m_info->empty_dircache();
 
-#define OFFSET_READDIRX_FLAGS 0
-#define OFFSET_READDIRX_SIZE 1
-#define OFFSET_READDIRX_MTIME 5
-#define OFFSET_READDIRX_CTIME 9
-#define OFFSET_READDIRX_PATH 13
-
     tnfsPacket packet;
     packet.command = TNFS_CMD_READDIRX;
     packet.payload[0] = m_info->dir_handle;
@@ -865,7 +1789,11 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
             Debug_printf("tnfs_readdirx cached %d entries\r\n", loaded);
             // Now that we've cached our entries, return the first one
             if(loaded > 0)
-                _readdirx_fill_response(m_info->next_dircache_entry(), filestat, dir_entry, dir_entry_len);
+            {
+                pCached = m_info->next_dircache_entry();
+                _readdirx_fill_response(pCached->flags, pCached->filesize, pCached->m_time, pCached->c_time, pCached->entryname,
+                                        filestat, dir_entry, dir_entry_len);
+            }
 
         }
         return packet.payload[0];
@@ -878,10 +1806,16 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
 */
 int tnfs_telldir(tnfsMountInfo *m_info, uint16_t *position)
 {
-    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
+    if (m_info == nullptr || position == nullptr)
         return -1;
 
-    if(position == nullptr)
+    if (m_info->dirlisting_open())
+    {
+        *position = m_info->tell_dirlisting();
+        return 0;
+    }
+
+    if (false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
         return -1;
 
     // First see if we're pointing at a currently-cached directory entry and return that
@@ -912,7 +1846,16 @@ int tnfs_telldir(tnfsMountInfo *m_info, uint16_t *position)
 */
 int tnfs_seekdir(tnfsMountInfo *m_info, uint16_t position)
 {
-    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
+    if (m_info == nullptr)
+        return -1;
+
+    if (m_info->dirlisting_open())
+    {
+        m_info->seek_dirlisting(position);
+        return 0;
+    }
+
+    if (false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
         return -1;
 
     // A SEEKDIR will always invalidate our directory cache
@@ -936,7 +1879,16 @@ int tnfs_seekdir(tnfsMountInfo *m_info, uint16_t position)
 */
 int tnfs_closedir(tnfsMountInfo *m_info)
 {
-    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
+    if (m_info == nullptr)
+        return -1;
+
+    if (m_info->dirlisting_open())
+    {
+        m_info->close_dirlisting();
+        return 0;
+    }
+
+    if (false == TNFS_VALID_AS_UINT8(m_info->dir_handle))
         return -1;
 
     // Throw out any existing cached directory entries
@@ -973,6 +1925,8 @@ int tnfs_mkdir(tnfsMountInfo *m_info, const char *directory)
 
     Debug_printf("TNFS make directory: \"%s\"\r\n", (char *)packet.payload);
 
+    m_info->shared->drop_dirlistings();
+
     if (_tnfs_transaction(m_info, packet, len + 1))
     {
         return packet.payload[0];
@@ -996,6 +1950,8 @@ int tnfs_rmdir(tnfsMountInfo *m_info, const char *directory)
 
     Debug_printf("TNFS remove directory: \"%s\"\r\n", (char *)packet.payload);
 
+    m_info->shared->drop_dirlistings();
+
     if (_tnfs_transaction(m_info, packet, len + 1))
     {
         return packet.payload[0];
@@ -1073,6 +2029,8 @@ int tnfs_unlink(tnfsMountInfo *m_info, const char *filepath)
 
     Debug_printf("TNFS unlink file: \"%s\"\r\n", (char *)packet.payload);
 
+    m_info->shared->drop_dirlistings();
+
     if (_tnfs_transaction(m_info, packet, len + 1))
     {
         return packet.payload[0];
@@ -1098,6 +2056,8 @@ int tnfs_rename(tnfsMountInfo *m_info, const char *old_filepath, const char *new
 
     Debug_printf("TNFS rename file: \"%s\" -> \"%s\"\r\n", (char *)packet.payload, (char *)(packet.payload + l1));
 
+    m_info->shared->drop_dirlistings();
+
     if (_tnfs_transaction(m_info, packet, l1 + l2))
     {
         return packet.payload[0];
@@ -1193,7 +2153,7 @@ const char *tnfs_filepath(tnfsMountInfo *m_info, int16_t file_handle)
         return nullptr;
 
     // Find info on this handle
-    const tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    const tnfsFileHandleInfo *pFileInf = m_info->shared->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return nullptr;
 
@@ -1256,18 +2216,18 @@ const char *tnfs_getcwd(tnfsMountInfo *m_info)
 */
 bool _tnfs_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size)
 {
-    if (m_info->protocol == TNFS_PROTOCOL_UNKNOWN)
+    if (m_info->shared->protocol == TNFS_PROTOCOL_UNKNOWN)
     {
         bool success = _tnfs_tcp_send(m_info, pkt, payload_size);
         if (!success)
         {
             Debug_println("Can't connect to the TCP server; falling back to UDP.");
-            m_info->protocol = TNFS_PROTOCOL_UDP;
+            m_info->shared->protocol = TNFS_PROTOCOL_UDP;
             return _tnfs_udp_send(udp, m_info, pkt, payload_size);
         }
         return success;
     }
-    else if (m_info->protocol == TNFS_PROTOCOL_TCP)
+    else if (m_info->shared->protocol == TNFS_PROTOCOL_TCP)
     {
         return _tnfs_tcp_send(m_info, pkt, payload_size);
     }
@@ -1279,14 +2239,14 @@ bool _tnfs_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t pay
 
 bool _tnfs_tcp_send(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size)
 {
-    fnTcpClient *tcp = &m_info->tcp_client;
+    fnTcpClient *tcp = &m_info->shared->tcp_client;
     if (!tcp->connected())
     {
         bool success = false;
-        if (m_info->host_ip != IPADDR_NONE)
-            success = tcp->connect(m_info->host_ip, m_info->port, TNFS_TIMEOUT);
+        if (m_info->shared->host_ip != IPADDR_NONE)
+            success = tcp->connect(m_info->shared->host_ip, m_info->shared->port, TNFS_TIMEOUT);
         else
-            success = tcp->connect(m_info->hostname, m_info->port, TNFS_TIMEOUT);
+            success = tcp->connect(m_info->shared->hostname, m_info->shared->port, TNFS_TIMEOUT);
         if (!success)
         {
             Debug_println("Can't connect to the TCP server");
@@ -1308,10 +2268,10 @@ bool _tnfs_udp_do_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint1
 {
     bool sent;
     // Use the IP address if we have it
-    if (m_info->host_ip != IPADDR_NONE)
-        sent = udp->beginPacket(m_info->host_ip, m_info->port);
+    if (m_info->shared->host_ip != IPADDR_NONE)
+        sent = udp->beginPacket(m_info->shared->host_ip, m_info->shared->port);
     else
-        sent = udp->beginPacket(m_info->hostname, m_info->port);
+        sent = udp->beginPacket(m_info->shared->hostname, m_info->shared->port);
 
     if (sent)
     {
@@ -1328,7 +2288,7 @@ bool _tnfs_udp_do_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint1
 */
 int _tnfs_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt)
 {
-    if (m_info->protocol == TNFS_PROTOCOL_TCP || m_info->protocol == TNFS_PROTOCOL_UNKNOWN)
+    if (m_info->shared->protocol == TNFS_PROTOCOL_TCP || m_info->shared->protocol == TNFS_PROTOCOL_UNKNOWN)
     {
         return _tnfs_tcp_recv(m_info, pkt);
     }
@@ -1340,7 +2300,7 @@ int _tnfs_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt)
 
 int _tnfs_tcp_recv(tnfsMountInfo *m_info, tnfsPacket &pkt)
 {
-    fnTcpClient *tcp = &m_info->tcp_client;
+    fnTcpClient *tcp = &m_info->shared->tcp_client;
     if (!tcp->connected())
     {
         return -1;
@@ -1367,7 +2327,9 @@ int _tnfs_udp_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt)
 /*
   Send constructed TNFS packet and check for reply
   The send/receive loop will be attempted tnfsPacket.max_retries times (default: TNFS_RETRIES)
-  Each retry attempt is limited to tnfsPacket.timeout_ms (default: TNFS_TIMEOUT)
+  The first attempt waits tnfsPacket.timeout_ms, which follows the measured round trip time,
+  each retry waits twice as long as the one before up to TNFS_MAX_TIMEOUT.
+  Retries are never sent sooner than the server's min_retry_ms after the previous attempt.
 
   Only the command (tnfsPacket.command) and payload contents need to be set on the packet.
   Current session ID will be copied from tnfsMountInfo and retryCount is always reset to zero.
@@ -1379,24 +2341,38 @@ int _tnfs_udp_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt)
  */
 bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size)
 {
-    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+    std::lock_guard<std::recursive_mutex> lock(m_info->shared->transaction_mutex);
 
     fnUDP udp;
 
     // Set our session ID
     tnfsPacket reqPkt = pkt;
-    reqPkt.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->session);
-    reqPkt.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->session);
+    reqPkt.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->shared->session);
+    reqPkt.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->shared->session);
 
     // Set sequence number before the transaction loop
-    reqPkt.sequence_num = m_info->current_sequence_num++;
+    reqPkt.sequence_num = m_info->shared->current_sequence_num++;
 
     // Start a new retry sequence
     for (int retry = 0; retry < m_info->max_retries; retry++)
     {
-        switch(_tnfs_send_recv(udp, m_info, reqPkt, payload_size, pkt))
+        uint32_t timeout_ms = m_info->shared->timeout_ms < m_info->shared->min_retry_ms ? m_info->shared->min_retry_ms : m_info->shared->timeout_ms;
+        int rtt_ms = -1;
+#ifdef ESP_PLATFORM
+        int ms_sent = fnSystem.millis();
+#else
+        uint64_t ms_sent = fnSystem.millis();
+#endif
+        if (retry > 0)
+            m_info->shared->stats.retransmits++;
+
+        switch(_tnfs_send_recv(udp, m_info, reqPkt, payload_size, pkt, timeout_ms, &rtt_ms))
         {
             case SUCCESS:
+            m_info->shared->stats.transactions++;
+            // A reply to a retransmission can't tell which transmission it answers (Karn)
+            if (retry == 0 && rtt_ms >= 0)
+                m_info->shared->rtt_sample(rtt_ms);
             return true;
 
             case RESET:
@@ -1408,17 +2384,22 @@ bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_
             // fallback to retry
             break;
         }
-        
-        // Make sure we wait before retrying
-        fnSystem.delay(m_info->min_retry_ms);
+
+        // Back off until a reply to a first transmission is measured again
+        m_info->shared->timeout_ms = timeout_ms * 2 > TNFS_MAX_TIMEOUT ? TNFS_MAX_TIMEOUT : timeout_ms * 2;
+
+        // Make sure we wait the server's minimum before retrying
+        int elapsed_ms = fnSystem.millis() - ms_sent;
+        if (elapsed_ms < m_info->shared->min_retry_ms)
+            fnSystem.delay(m_info->shared->min_retry_ms - elapsed_ms);
     }
 
-    Debug_printf("Retry attempts failed for host: %s, path: %s, cwd: %s\r\n", m_info->hostname, m_info->mountpath, m_info->current_working_directory);
+    Debug_printf("Retry attempts failed for host: %s, path: %s, cwd: %s\r\n", m_info->shared->hostname, m_info->mountpath, m_info->current_working_directory);
 
     return false;
 }
 
-_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt)
+_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt, uint32_t timeout_ms, int *rtt_ms)
 {
 #ifdef DEBUG
     _tnfs_debug_packet(req_pkt, payload_size);
@@ -1432,7 +2413,7 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         return FAILED;
     }
 
-    // Wait for a response at most TNFS_TIMEOUT milliseconds
+    // Wait for a response at most timeout_ms milliseconds
 #ifdef ESP_PLATFORM
     int ms_start = fnSystem.millis();
 #else
@@ -1449,8 +2430,9 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         switch(_tnfs_recv_and_validate(udp, m_info, req_pkt, payload_size, res_pkt))
         {
             case RESP_VALID:
+            *rtt_ms = fnSystem.millis() - ms_start;
 #ifndef ESP_PLATFORM
-            Debug_printf("_tnfs_transaction completed in %u ms\n", (unsigned)(fnSystem.millis() - ms_start));
+            Debug_printf("_tnfs_transaction completed in %d ms\n", *rtt_ms);
 #endif
             return SUCCESS;
 
@@ -1474,19 +2456,19 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         fnSystem.delay_microseconds(5000); // wait more time for (remote) data to arrive
 #endif
 
-    } while ((fnSystem.millis() - ms_start) < m_info->timeout_ms); // packet receive loop
+    } while ((fnSystem.millis() - ms_start) < timeout_ms); // packet receive loop
 
-    if (m_info->protocol == TNFS_PROTOCOL_UNKNOWN)
+    if (m_info->shared->protocol == TNFS_PROTOCOL_UNKNOWN)
     {
         // This is probably an old tcpd server, accepting TCP connections but not responding
         // to any commands. We should fall back to UDP too and don't count this iteration
         // in the retry counter.
         Debug_println("No response to TCP mount request; falling back to UDP.");
-        m_info->protocol = TNFS_PROTOCOL_UDP;
+        m_info->shared->protocol = TNFS_PROTOCOL_UDP;
         return RESET;
     }
     
-    Debug_printf("Timeout after %d milliseconds. Retrying\r\n", m_info->timeout_ms);
+    Debug_printf("Timeout after %u milliseconds. Retrying\r\n", timeout_ms);
     return FAILED;
 }
 
@@ -1503,16 +2485,17 @@ _tnfs_recv_result _tnfs_recv_and_validate(fnUDP &udp, tnfsMountInfo *m_info, tnf
 #ifdef DEBUG
     _tnfs_debug_packet(res_pkt, l, true);
 #endif
-    if (m_info->protocol == TNFS_PROTOCOL_UNKNOWN)
+    if (m_info->shared->protocol == TNFS_PROTOCOL_UNKNOWN)
     {
         Debug_println("TNFS server supports TCP.");
-        m_info->protocol = TNFS_PROTOCOL_TCP;
+        m_info->shared->protocol = TNFS_PROTOCOL_TCP;
     }
 
     // Delayed response for the previous request. We should just try to recv the next response.
     if (res_pkt.sequence_num < req_pkt.sequence_num)
     {
         Debug_printf("Received delayed response! Rcvd: %x, Expected: %x\r\n", res_pkt.sequence_num, req_pkt.sequence_num);
+        m_info->shared->stats.duplicates++;
         return NO_RESP;
     }
 
@@ -1550,24 +2533,30 @@ _tnfs_recv_result _tnfs_recv_and_validate(fnUDP &udp, tnfsMountInfo *m_info, tnf
             return RESP_VALID;
         }
         // retry the command using new session
-        req_pkt.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->session);
-        req_pkt.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->session);
+        req_pkt.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->shared->session);
+        req_pkt.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->shared->session);
         return SESSION_RECOVERED;
     }
 
     return RESP_VALID;
 }
 
-// Re-mount using provided tnfsMountInfo*
+// Re-mount the session shared by the provided tnfsMountInfo*
 // Returns TNFS result code
 uint8_t _tnfs_session_recovery(tnfsMountInfo *m_info, uint8_t command)
 {
-    m_info->session = TNFS_INVALID_SESSION; // prevent umount call
-    if (tnfs_mount(m_info) != TNFS_RESULT_SUCCESS)
+    if (_tnfs_login(m_info) != TNFS_RESULT_SUCCESS)
     {
         Debug_printf("_tnfs_session_recovery - remount failed\n");
         return TNFS_RESULT_INVALID_HANDLE;
     }
+    // Files of every client went with the old session, they're reopened on their next use
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+    {
+        tnfsFileHandleInfo *pFileInf = m_info->shared->filehandleinfo_at(i);
+        if (pFileInf != nullptr)
+            pFileInf->server_open = false;
+    }
     // re-mount succeeded, check the command
     switch (command)
     {
@@ -189,8 +189,11 @@ int tnfs_free(tnfsMountInfo *m_info, uint32_t *size);
 
 int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, uint16_t create_perms, int16_t *file_handle);
 int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
+int tnfs_read_pipelined(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint32_t bufflen, uint32_t *resultlen);
 int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
 int tnfs_close(tnfsMountInfo *m_info, int16_t file_handle);
+int tnfs_flush(tnfsMountInfo *m_info, int16_t file_handle);
+int tnfs_flush_idle(tnfsSessionInfo *session);
 int tnfs_stat(tnfsMountInfo *m_info, tnfsStat *filestat, const char *filepath);
 int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uint8_t type, uint32_t *new_position = nullptr, bool skip_cache = false);
 int tnfs_unlink(tnfsMountInfo *m_info, const char *filepath);
@@ -1,7 +1,48 @@
 
 #include "tnfslibMountInfo.h"
+#include "tnfslib.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <strings.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
 
 #include "compat_string.h"
+#include "../../include/debug.h"
+
+
+tnfsFileHandleInfo::tnfsFileHandleInfo()
+{
+    alloc_cache();
+}
+
+tnfsFileHandleInfo::~tnfsFileHandleInfo()
+{
+    free_cache();
+}
+
+// Returns false if there's no memory left for the cache
+bool tnfsFileHandleInfo::alloc_cache()
+{
+    if (cache != nullptr)
+        return true;
+#ifdef ESP_PLATFORM
+    cache = (uint8_t *)heap_caps_malloc(TNFS_FILE_CACHE_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if (cache == nullptr)
+#endif
+        cache = (uint8_t *)malloc(TNFS_FILE_CACHE_SIZE);
+    return cache != nullptr;
+}
+
+void tnfsFileHandleInfo::free_cache()
+{
+    free(cache);
+    cache = nullptr;
+    cache_available = 0;
+}
 
 
 tnfsMountInfo::tnfsMountInfo(const char *host_name, uint16_t host_port)
@@ -19,8 +60,113 @@ tnfsMountInfo::tnfsMountInfo(in_addr_t host_address, uint16_t host_port)
 // Make sure to clean up any memory we allocated
 tnfsMountInfo::~tnfsMountInfo()
 {
-    // Find a matching tnfsFileHandleInfo
-    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+    // Delete any remaining directory cache entries
+    empty_dircache();
+}
+
+// Sessions handed out by find_or_create, kept alive by the clients using them
+static std::mutex _tnfs_sessions_mutex;
+static std::vector<std::weak_ptr<tnfsSessionInfo>> _tnfs_sessions;
+
+/*
+ Returns the session already used for the server, port, mount path and user
+ (and password) in m_info, or a new one with those values copied from m_info.
+ A new session has no session ID yet: the caller logs in to the server.
+*/
+std::shared_ptr<tnfsSessionInfo> tnfsSessionInfo::find_or_create(const tnfsMountInfo *m_info)
+{
+    std::lock_guard<std::mutex> lock(_tnfs_sessions_mutex);
+
+    for (auto it = _tnfs_sessions.begin(); it != _tnfs_sessions.end();)
+    {
+        std::shared_ptr<tnfsSessionInfo> existing = it->lock();
+        if (existing == nullptr)
+        {
+            it = _tnfs_sessions.erase(it);
+            continue;
+        }
+        if (existing->matches(m_info))
+            return existing;
+        ++it;
+    }
+
+    std::shared_ptr<tnfsSessionInfo> created = std::make_shared<tnfsSessionInfo>();
+    created->protocol = m_info->protocol;
+    strlcpy(created->hostname, m_info->hostname, sizeof(created->hostname));
+    created->host_ip = m_info->host_ip;
+    created->port = m_info->port;
+    strlcpy(created->mountpath, m_info->mountpath, sizeof(created->mountpath));
+    strlcpy(created->user, m_info->user, sizeof(created->user));
+    strlcpy(created->password, m_info->password, sizeof(created->password));
+    _tnfs_sessions.push_back(created);
+    return created;
+}
+
+/*
+ Reports whether m_info asks for this session. The server is matched by its
+ IP address if both know it, by name otherwise. A client that didn't ask for
+ a protocol uses whichever one the session settled on.
+*/
+bool tnfsSessionInfo::matches(const tnfsMountInfo *m_info)
+{
+    if (host_ip != IPADDR_NONE && m_info->host_ip != IPADDR_NONE)
+    {
+        if (host_ip != m_info->host_ip)
+            return false;
+    }
+    else if (strcasecmp(hostname, m_info->hostname) != 0)
+        return false;
+
+    return port == m_info->port &&
+           (m_info->protocol == TNFS_PROTOCOL_UNKNOWN || m_info->protocol == protocol) &&
+           strcmp(mountpath, m_info->mountpath) == 0 &&
+           strcmp(user, m_info->user) == 0 &&
+           strcmp(password, m_info->password) == 0;
+}
+
+void tnfsSessionInfo::add_client(const tnfsMountInfo *m_info)
+{
+    if (!has_client(m_info))
+        _clients.push_back(m_info);
+}
+
+// Returns the number of clients left
+size_t tnfsSessionInfo::remove_client(const tnfsMountInfo *m_info)
+{
+    for (auto it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        if (*it == m_info)
+        {
+            _clients.erase(it);
+            break;
+        }
+    }
+    return _clients.size();
+}
+
+bool tnfsSessionInfo::has_client(const tnfsMountInfo *m_info)
+{
+    for (auto client : _clients)
+    {
+        if (client == m_info)
+            return true;
+    }
+    return false;
+}
+
+tnfsSessionInfo::~tnfsSessionInfo()
+{
+#ifdef ESP_PLATFORM
+    // Let a flush in progress finish before the session goes away
+    if (_flush_task_handle != nullptr)
+    {
+        _flush_task_stop = true;
+        xTaskNotifyGive(_flush_task_handle);
+        while (_flush_task_handle != nullptr)
+            vTaskDelay(pdMS_TO_TICKS(10));
+    }
+#endif
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
     {
         if (_file_handles[i] != nullptr)
         {
@@ -28,8 +174,99 @@ tnfsMountInfo::~tnfsMountInfo()
             _file_handles[i] = nullptr;
         }
     }
-    // Delete any remaining directory cache entries
-    empty_dircache();
+}
+
+#ifdef ESP_PLATFORM
+/*
+ Runs on its own task rather than an esp_timer callback: a flush may wait out network retries.
+ Pinned to core 0, away from the bus handling on core 1.
+*/
+void tnfsSessionInfo::start_flush_task()
+{
+    if (_flush_task_handle != nullptr)
+        return;
+
+    _flush_task_stop = false;
+    if (xTaskCreatePinnedToCore(_flush_task, "tnfs_flush", 4096, this, 5, &_flush_task_handle, 0) != pdPASS)
+    {
+        Debug_println("Failed to start TNFS flush task, cached writes go out on close");
+        _flush_task_handle = nullptr;
+    }
+}
+
+void tnfsSessionInfo::_flush_task(void *info)
+{
+    tnfsSessionInfo *session = (tnfsSessionInfo *)info;
+    while (!session->_flush_task_stop)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TNFS_WRITE_FLUSH_MS));
+        if (session->_flush_task_stop)
+            break;
+        // Failures are kept on the file handle for the next write or close to return
+        tnfs_flush_idle(session);
+    }
+    session->_flush_task_handle = nullptr;
+    vTaskDelete(NULL);
+}
+#endif
+
+/*
+ Updates the smoothed round trip time and its mean deviation with a new
+ measurement and derives the retransmit timeout from them (RFC 6298).
+ Only replies to first transmissions are measured, a reply to a retransmitted
+ request can't be matched to the transmission it answers.
+*/
+void tnfsSessionInfo::rtt_sample(int rtt_ms)
+{
+    if (stats.rtt_samples == 0)
+    {
+        rtt_srtt8 = rtt_ms << 3;
+        rtt_var4 = rtt_ms << 1;
+    }
+    else
+    {
+        int delta = rtt_ms - (rtt_srtt8 >> 3);
+        rtt_srtt8 += delta; // srtt += delta / 8
+        if (delta < 0)
+            delta = -delta;
+        rtt_var4 += delta - (rtt_var4 >> 2); // rttvar += (|delta| - rttvar) / 4
+    }
+
+    stats.rtt_samples++;
+    stats.rtt_last_ms = rtt_ms;
+    if (rtt_ms > stats.rtt_max_ms)
+        stats.rtt_max_ms = rtt_ms;
+
+    // srtt + 4 * rttvar
+    timeout_ms = (rtt_srtt8 >> 3) + rtt_var4;
+    if (timeout_ms < TNFS_MIN_TIMEOUT)
+        timeout_ms = TNFS_MIN_TIMEOUT;
+    else if (timeout_ms > TNFS_MAX_TIMEOUT)
+        timeout_ms = TNFS_MAX_TIMEOUT;
+}
+
+std::string tnfsSessionInfo::stats_json()
+{
+    int open_files = 0;
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+    {
+        if (_file_handles[i] != nullptr)
+            open_files++;
+    }
+
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"host\":\"%s\",\"port\":%u,\"session\":%u,\"srtt_ms\":%d,\"rttvar_ms\":%d,\"rto_ms\":%d,\"min_retry_ms\":%u,"
+             "\"rtt_last_ms\":%u,\"rtt_max_ms\":%u,\"rtt_samples\":%lu,\"transactions\":%lu,\"retransmits\":%lu,\"duplicates\":%lu,\"reordered\":%lu,\"read_window\":%u,"
+             "\"dirlist_hits\":%lu,\"dirlist_misses\":%lu,\"dirlists\":%u,"
+             "\"clients\":%u,\"mounts_shared\":%lu,\"open_files\":%d,\"server_handles\":%d,\"handles_parked\":%lu,\"handles_resumed\":%lu}",
+             hostname, port, session, rtt_srtt8 >> 3, rtt_var4 >> 2, timeout_ms, min_retry_ms,
+             stats.rtt_last_ms, stats.rtt_max_ms, (unsigned long)stats.rtt_samples, (unsigned long)stats.transactions,
+             (unsigned long)stats.retransmits, (unsigned long)stats.duplicates, (unsigned long)stats.reordered, read_window,
+             (unsigned long)stats.dirlist_hits, (unsigned long)stats.dirlist_misses, (unsigned)_dir_listings.size(),
+             (unsigned)_clients.size(), (unsigned long)stats.mounts_shared, open_files, count_server_handles(),
+             (unsigned long)stats.handles_parked, (unsigned long)stats.handles_resumed);
+    return buf;
 }
 
 // Empty the current contents of the directory cache
@@ -75,6 +312,76 @@ tnfsDirCacheEntry * tnfsMountInfo::next_dircache_entry()
     return _dir_cache[_dir_cache_current - 1];
 }
 
+/*
+ Returns the kept listing of a directory read with the same options and pattern,
+ or null if there is none. The caller checks whether it's still current.
+*/
+std::shared_ptr<tnfsDirListing> tnfsSessionInfo::find_dirlisting(const char *path, uint8_t sortopts, uint8_t diropts, const char *pattern)
+{
+    for (auto &listing : _dir_listings)
+    {
+        if (listing->sortopts == sortopts && listing->diropts == diropts &&
+            listing->path == path && listing->pattern == pattern)
+        {
+            listing->last_used = ++_dir_listing_uses;
+            return listing;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ Keeps a complete listing, replacing an older one of the same directory
+ or the least recently used one once TNFS_DIRLIST_CACHE_ENTRIES are kept
+*/
+void tnfsSessionInfo::store_dirlisting(std::shared_ptr<tnfsDirListing> listing)
+{
+    if (TNFS_DIRLIST_CACHE_ENTRIES == 0)
+        return;
+
+    listing->last_used = ++_dir_listing_uses;
+
+    std::shared_ptr<tnfsDirListing> *oldest = nullptr;
+    for (auto &kept : _dir_listings)
+    {
+        if (kept->sortopts == listing->sortopts && kept->diropts == listing->diropts &&
+            kept->path == listing->path && kept->pattern == listing->pattern)
+        {
+            kept = listing;
+            return;
+        }
+        if (oldest == nullptr || kept->last_used < (*oldest)->last_used)
+            oldest = &kept;
+    }
+
+    if (_dir_listings.size() < TNFS_DIRLIST_CACHE_ENTRIES)
+        _dir_listings.push_back(listing);
+    else
+        *oldest = listing;
+}
+
+/*
+ Throw out all kept listings after changing something on the server ourselves.
+ The directory's modification time only has a resolution of one second,
+ so a change right after a listing was read might not be noticed.
+*/
+void tnfsSessionInfo::drop_dirlistings()
+{
+    _dir_listings.clear();
+}
+
+/*
+ Return a pointer to the next entry of the listing being read
+ Returns null once all entries have been read
+*/
+const tnfsDirListEntry * tnfsMountInfo::next_dirlisting_entry()
+{
+    if (_dir_listing == nullptr || _dir_listing_pos >= _dir_listing->entries.size())
+        return nullptr;
+
+    return &_dir_listing->entries[_dir_listing_pos++];
+}
+
 /*
  Returns the directory position of the currently cached directory
  entry as provided by the server.
@@ -91,36 +398,34 @@ int tnfsMountInfo::tell_dircache_entry()
  Returns a pointer to the tnfsFileHandleInfo with a matching file handle,
  or null if no match exists in the table.
 */
-tnfsFileHandleInfo *tnfsMountInfo::get_filehandleinfo(uint8_t filehandle)
+tnfsFileHandleInfo *tnfsSessionInfo::get_filehandleinfo(uint8_t filehandle)
 {
-    // Find a matching tnfsFileHandleInfo
-    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
-    {
-        if (_file_handles[i] != nullptr)
-        {
-            if (_file_handles[i]->handle_id == filehandle)
-                return _file_handles[i];
-        }
-    }
-    return nullptr;
+    if (filehandle >= TNFS_MAX_OPEN_FILES)
+        return nullptr;
+    return _file_handles[filehandle];
 }
 
 /*
  Returns a pointer to a new tnfsFileHandleInfo pointer or null if table is full
+ Its handle_id is the slot it was stored in
 */
-tnfsFileHandleInfo *tnfsMountInfo::new_filehandleinfo()
+tnfsFileHandleInfo *tnfsSessionInfo::new_filehandleinfo()
 {
     // Find a free slot and create a new tnfsFileHandleInfo
-    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
     {
         if (_file_handles[i] == nullptr)
         {
             tnfsFileHandleInfo *p = new tnfsFileHandleInfo;
-            if (p != nullptr)
+            if (p != nullptr && p->cache != nullptr)
             {
+                p->handle_id = i;
+                touch_filehandleinfo(p);
                 _file_handles[i] = p;
                 return p;
             }
+            delete p;
+            return nullptr;
         }
     }
     return nullptr;
@@ -129,29 +434,22 @@ tnfsFileHandleInfo *tnfsMountInfo::new_filehandleinfo()
 /*
  Removes any existing tnfsFileHandleInfo with a matching file handle
 */
-void tnfsMountInfo::delete_filehandleinfo(uint8_t filehandle)
+void tnfsSessionInfo::delete_filehandleinfo(uint8_t filehandle)
 {
-    // Find a matching tnfsFileHandleInfo
-    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+    if (filehandle < TNFS_MAX_OPEN_FILES && _file_handles[filehandle] != nullptr)
     {
-        if (_file_handles[i] != nullptr)
-        {
-            if (_file_handles[i]->handle_id == filehandle)
-            {
-                delete _file_handles[i];
-                _file_handles[i] = nullptr;
-            }
-        }
+        delete _file_handles[filehandle];
+        _file_handles[filehandle] = nullptr;
     }
 }
 
 /*
  Removes any existing tnfsFileHandleInfo with a matching pointer
 */
-void tnfsMountInfo::delete_filehandleinfo(tnfsFileHandleInfo *pFilehandle)
+void tnfsSessionInfo::delete_filehandleinfo(tnfsFileHandleInfo *pFilehandle)
 {
     // Find a matching tnfsFileHandleInfo
-    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
     {
         if (_file_handles[i] == pFilehandle)
         {
@@ -160,3 +458,33 @@ void tnfsMountInfo::delete_filehandleinfo(tnfsFileHandleInfo *pFilehandle)
         }
     }
 }
+
+// Number of files currently open on the server
+int tnfsSessionInfo::count_server_handles()
+{
+    int count = 0;
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+    {
+        if (_file_handles[i] != nullptr && _file_handles[i]->server_open)
+            count++;
+    }
+    return count;
+}
+
+/*
+ Returns the file open on the server that was used the longest time ago, other than keep,
+ or null if there is none
+*/
+tnfsFileHandleInfo *tnfsSessionInfo::least_recently_used_server_handle(const tnfsFileHandleInfo *keep)
+{
+    tnfsFileHandleInfo *oldest = nullptr;
+    for (int i = 0; i < TNFS_MAX_OPEN_FILES; i++)
+    {
+        tnfsFileHandleInfo *p = _file_handles[i];
+        if (p == nullptr || p == keep || p->server_open == false)
+            continue;
+        if (oldest == nullptr || p->last_used < oldest->last_used)
+            oldest = p;
+    }
+    return oldest;
+}
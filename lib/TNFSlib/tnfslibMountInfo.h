@@ -2,27 +2,55 @@
 #define _TNFSLIB_MOUNTINFO_H
 
 #include <cstdint>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "fnDNS.h"
 #include "fnTcpClient.h"
 
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
 
 #define TNFS_DEFAULT_PORT 16384
 #define TNFS_RETRIES 5 // Number of times to retry if we fail to send/receive a packet
-#define TNFS_TIMEOUT 2000 // This is how long we wait for a reply packet from the server before trying again
-#define TNFS_RETRY_DELAY 1000 // Default delay before retrying. Server will provide a minimum during TNFS_CMD_MOUNT
+#define TNFS_TIMEOUT 2000 // How long we wait for a reply packet until round trips have been measured
+#define TNFS_MIN_TIMEOUT 50 // Shortest retransmit timeout derived from measured round trips
+#define TNFS_MAX_TIMEOUT 4000 // Longest retransmit timeout after backing off
+#define TNFS_RETRY_DELAY 1000 // Default minimum time between retries. Server will provide a minimum during TNFS_CMD_MOUNT
 #define TNFS_MAX_BACKOFF_DELAY 3000 // Longest we'll wait if server sends us a EAGAIN error
-#define TNFS_MAX_FILE_HANDLES 8 // Max number of file handles we'll open to the server
+#define TNFS_MAX_FILE_HANDLES 16 // Max number of file handles we'll keep open on the server per session (tnfsd allows 16)
+#define TNFS_MAX_OPEN_FILES 32 // Max number of files all clients of a session may have open, the least recently used are closed on the server
 #define TNFS_MAX_FILELEN 256
 
-#define TNFS_FILE_CACHE_SIZE 512 // 4 * 128 fits in a single packet when TNFS_MAX_READWRITE_PAYLOAD is 512
+#ifndef TNFS_FILE_CACHE_SIZE
+#define TNFS_FILE_CACHE_SIZE 4096 // Per open file, in PSRAM when available
+#endif
+#define TNFS_FILE_CACHE_FILL 512 // Loaded on a cache miss, doubled up to TNFS_FILE_CACHE_SIZE while reads are sequential
+#define TNFS_WRITE_FLUSH_MS 1000 // Written data is sent to the server once no writes happened for this long
+
+// READ requests kept in flight by tnfs_read_pipelined (1 = stop-and-wait). TNFS READ carries
+// no offset, a larger window assumes the requests reach the server in the order they were sent.
+// A reply arriving ahead of an older request drops the mount to 1, but a path reordering the
+// requests and then the replies back again would go unnoticed, so this is opt-in
+#ifndef TNFS_READ_WINDOW
+#define TNFS_READ_WINDOW 1
+#endif
+#define TNFS_MAX_READ_WINDOW 6 // lwIP queues 6 UDP packets per socket by default, more replies in flight would be dropped
 
 #define TNFS_INVALID_HANDLE -1
 #define TNFS_INVALID_SESSION 0 // We're assuming a '0' is never a valid session ID
 
 #define TNFS_MAX_DIRCACHE_ENTRIES 32 // Max number of directory cache entries we'll store
 
+#define TNFS_DIRLIST_CACHE_ENTRIES 4 // Complete directory listings kept per mount (0 disables)
+#define TNFS_DIRLIST_MAX_ENTRIES 1024 // Larger directories are read from the server in batches as before
+#define TNFS_READDIRX_BATCH 255 // Entries asked for by each READDIRX while loading a listing, the server sends as many as fit
+
 #define TNFS_PROTOCOL_UNKNOWN 0
 #define TNFS_PROTOCOL_TCP 1
 #define TNFS_PROTOCOL_UDP 2
@@ -39,6 +67,25 @@
 #define TNFS_UDP_SIMULATE_SEND_TWICE_PROB 0.05
 #define TNFS_UDP_SIMULATE_RECV_TWICE_PROB 0.05
 
+// Per-session counters shown by the web UI
+struct tnfsStats
+{
+    uint32_t transactions = 0; // Requests answered by the server
+    uint32_t retransmits = 0;  // Requests sent again after a timeout or failed send
+    uint32_t duplicates = 0;   // Late or repeated replies that were discarded
+    uint32_t reordered = 0;    // Pipelined reads dropped to stop-and-wait by a reply out of order
+    uint32_t rtt_samples = 0;  // Round trips measured (first transmissions only)
+    uint16_t rtt_last_ms = 0;
+    uint16_t rtt_max_ms = 0;
+    uint32_t dirlist_hits = 0;   // Directories listed from a kept listing
+    uint32_t dirlist_misses = 0; // Directories read from the server
+    uint32_t mounts_shared = 0;  // Clients that joined the session without a TNFS_MOUNT
+    uint32_t handles_parked = 0; // Files closed on the server to make room for another one
+    uint32_t handles_resumed = 0; // Files reopened on the server after that
+};
+
+class tnfsMountInfo;
+
 // Some things we need to keep track of for every file we open
 struct tnfsFileHandleInfo
 {
@@ -49,11 +96,29 @@ struct tnfsFileHandleInfo
     uint32_t cached_pos = 0; // File position the client thinks we're at (usually somewhere in the cached region)
     uint32_t cache_start = 0; // The file position at which the cache starts
     uint32_t cache_available = 0; // Number of valid bytes in the cache
+    uint32_t cache_fill = TNFS_FILE_CACHE_FILL; // Bytes to load on the next cache miss
 
     bool cache_modified = false; // Notes if we've written to the cache
+    uint32_t dirty_start = 0; // File positions written in the cache but not sent yet (if cache_modified)
+    uint32_t dirty_end = 0;
+    uint32_t last_write_ms = 0;
+    int write_error = 0; // Set if tnfs_flush_idle failed; reported by the next write, flush or close
+
+    uint16_t open_mode = 0;
+
+    uint8_t server_handle = 0; // Stored from server's response to TNFS_OPEN
+    bool server_open = false; // False while closed on the server to make room for another file, reopened on next use
+    uint32_t last_used = 0;
+    const tnfsMountInfo *owner = nullptr; // Client that opened the file
 
-    uint8_t cache[TNFS_FILE_CACHE_SIZE];
+    uint8_t *cache = nullptr; // TNFS_FILE_CACHE_SIZE bytes, released while closed on the server
     char filename[TNFS_MAX_FILELEN];
+
+    tnfsFileHandleInfo();
+    ~tnfsFileHandleInfo();
+
+    bool alloc_cache();
+    void free_cache();
 };
 
 // A place to store each directory entry we cache from a response to TNFS_READDIRX
@@ -67,16 +132,120 @@ struct tnfsDirCacheEntry
     char entryname[TNFS_MAX_FILELEN];
 };
 
-// Everything we need to know about and keep track of for the server we're talking to
+// An entry of a complete directory listing
+struct tnfsDirListEntry
+{
+    uint8_t flags = 0;
+    uint32_t filesize = 0;
+    uint32_t m_time = 0;
+    uint32_t c_time = 0;
+    std::string name;
+};
+
+// A complete directory listing kept by tnfs_opendirx, valid while the modification time of the directory is unchanged
+struct tnfsDirListing
+{
+    std::string path; // Full path on the server
+    std::string pattern;
+    uint8_t sortopts = 0;
+    uint8_t diropts = 0;
+    uint32_t m_time = 0;
+    uint32_t last_used = 0;
+    std::vector<tnfsDirListEntry> entries;
+};
+
+/*
+ Everything we need to know about and keep track of for a session on the server we're talking to.
+ Shared by every tnfsMountInfo mounted on the same server, port, mount path and user (see tnfs_mount),
+ which also share its socket, file handles and kept directory listings.
+*/
+class tnfsSessionInfo
+{
+private:
+    tnfsFileHandleInfo * _file_handles[TNFS_MAX_OPEN_FILES] = { nullptr }; // Index is the handle given to clients
+    uint32_t _file_handle_uses = 0;
+
+    std::vector<std::shared_ptr<tnfsDirListing>> _dir_listings; // The least recently used one is replaced when full
+    uint32_t _dir_listing_uses = 0;
+
+    std::vector<const tnfsMountInfo *> _clients;
+
+#ifdef ESP_PLATFORM
+    static void _flush_task(void *info);
+    TaskHandle_t _flush_task_handle = nullptr;
+    volatile bool _flush_task_stop = false;
+#endif
+
+public:
+    ~tnfsSessionInfo();
+
+    static std::shared_ptr<tnfsSessionInfo> find_or_create(const tnfsMountInfo *m_info);
+    bool matches(const tnfsMountInfo *m_info);
+
+    void add_client(const tnfsMountInfo *m_info);
+    size_t remove_client(const tnfsMountInfo *m_info);
+    bool has_client(const tnfsMountInfo *m_info);
+
+    tnfsFileHandleInfo * new_filehandleinfo();
+    tnfsFileHandleInfo * get_filehandleinfo(uint8_t filehandle);
+    tnfsFileHandleInfo * filehandleinfo_at(int index) { return _file_handles[index]; };
+    void delete_filehandleinfo(uint8_t filehandle);
+    void delete_filehandleinfo(tnfsFileHandleInfo * pFilehandle);
+    void touch_filehandleinfo(tnfsFileHandleInfo * pFilehandle) { pFilehandle->last_used = ++_file_handle_uses; };
+    int count_server_handles();
+    tnfsFileHandleInfo * least_recently_used_server_handle(const tnfsFileHandleInfo * keep);
+
+    void rtt_sample(int rtt_ms);
+    std::string stats_json();
+
+#ifdef ESP_PLATFORM
+    // Starts the task sending writes left in the file caches of all clients once they've been
+    // idle for a while (see tnfs_flush_idle), on the first file opened for writing
+    void start_flush_task();
+#endif
+
+    std::shared_ptr<tnfsDirListing> find_dirlisting(const char *path, uint8_t sortopts, uint8_t diropts, const char *pattern);
+    void store_dirlisting(std::shared_ptr<tnfsDirListing> listing);
+    void drop_dirlistings();
+
+    uint8_t protocol = TNFS_PROTOCOL_UNKNOWN;
+    fnTcpClient tcp_client;
+
+    // Copied from the first tnfsMountInfo using the session
+    char hostname[64] = { '\0' };
+    in_addr_t host_ip = IPADDR_NONE;
+    uint16_t port = TNFS_DEFAULT_PORT;
+    char mountpath[64] = { '\0' };
+    char user[12] = { '\0' };
+    char password[12] = { '\0' };
+
+    uint16_t session = TNFS_INVALID_SESSION; // Stored from server's response to TNFS_MOUNT
+    uint16_t min_retry_ms = TNFS_RETRY_DELAY; // Updated from server's response to TNFS_MOUNT
+    uint16_t server_version = 0;  // Stored from server's response to TNFS_MOUNT
+    int timeout_ms = TNFS_TIMEOUT; // Retransmit timeout, adapted to measured round trips
+
+    // Smoothed round trip time and its mean deviation (Jacobson/Karels), scaled by 8 and 4
+    int rtt_srtt8 = 0;
+    int rtt_var4 = 0;
+    tnfsStats stats;
+    uint8_t current_sequence_num = 0; // Updated with each transaction to the server
+    uint8_t read_window = TNFS_READ_WINDOW; // Dropped to 1 if the server mishandles pipelined reads
+
+    std::recursive_mutex transaction_mutex; // Held for every transaction and while using file handles
+};
+
+// Everything a client of the server keeps track of on its own
 class tnfsMountInfo
 {
 private:
-    tnfsFileHandleInfo * _file_handles[TNFS_MAX_FILE_HANDLES] = { nullptr }; // Stored from server's responses to TNFS_OPEN
     tnfsDirCacheEntry * _dir_cache[TNFS_MAX_DIRCACHE_ENTRIES] = { nullptr };
     uint16_t _dir_cache_current = 0;
     uint16_t _dir_cache_count = 0;
     bool _dir_cache_eof = false;
 
+    std::shared_ptr<tnfsDirListing> _dir_listing; // Being read instead of a directory handle on the server
+    uint16_t _dir_listing_pos = 0;
+
 public:
     ~tnfsMountInfo();
 
@@ -84,11 +253,6 @@ public:
     tnfsMountInfo(const char *host_name, uint16_t host_port = TNFS_DEFAULT_PORT);
     tnfsMountInfo(in_addr_t host_address, uint16_t host_port = TNFS_DEFAULT_PORT);
 
-    tnfsFileHandleInfo * new_filehandleinfo();
-    tnfsFileHandleInfo * get_filehandleinfo(uint8_t filehandle);
-    void delete_filehandleinfo(uint8_t filehandle);
-    void delete_filehandleinfo(tnfsFileHandleInfo * pFilehandle);
-
     tnfsDirCacheEntry * new_dircache_entry();
     tnfsDirCacheEntry * next_dircache_entry();
 
@@ -98,8 +262,17 @@ public:
     void set_dircache_eof() { _dir_cache_eof = true; };
     bool get_dircache_eof() { return _dir_cache_eof; };
 
-    uint8_t protocol = TNFS_PROTOCOL_UNKNOWN;
-    fnTcpClient tcp_client;
+    void open_dirlisting(std::shared_ptr<tnfsDirListing> listing) { _dir_listing = listing; _dir_listing_pos = 0; };
+    void close_dirlisting() { _dir_listing = nullptr; };
+    bool dirlisting_open() { return _dir_listing != nullptr; };
+    const tnfsDirListEntry * next_dirlisting_entry();
+    uint16_t tell_dirlisting() { return _dir_listing_pos; };
+    void seek_dirlisting(uint16_t position) { _dir_listing_pos = position; };
+
+    // Session in use, replaced by a shared one on tnfs_mount and by a new one on tnfs_umount
+    std::shared_ptr<tnfsSessionInfo> shared = std::make_shared<tnfsSessionInfo>();
+
+    uint8_t protocol = TNFS_PROTOCOL_UNKNOWN; // Protocol asked for, the one in use is shared->protocol
 
     // These char[] sizes are abitrary...
     char hostname[64] = { '\0' };
@@ -109,16 +282,10 @@ public:
     char user[12] = { '\0' };
     char password[12] = { '\0' };
     char current_working_directory[TNFS_MAX_FILELEN] = { '\0' };
-    uint16_t session = TNFS_INVALID_SESSION; // Stored from server's response to TNFS_MOUNT
-    uint16_t min_retry_ms = TNFS_RETRY_DELAY; // Updated from server's response to TNFS_MOUNT
-    uint16_t server_version = 0;  // Stored from server's response to TNFS_MOUNT
     uint8_t max_retries = TNFS_RETRIES;
-    int timeout_ms = TNFS_TIMEOUT;
-    uint8_t current_sequence_num = 0; // Updated with each transaction to the server
 
     int16_t dir_handle = TNFS_INVALID_HANDLE; // Stored from server's response to TNFS_OPENDIR
     uint16_t dir_entries = 0; // Stored from server's response to TNFS_OPENDIRX
-    std::recursive_mutex transaction_mutex;
 
 #ifdef TNFS_UDP_SIMULATE_RECV_TWICE
     uint8_t last_packet[532];
@@ -274,6 +274,10 @@ static IRAM_ATTR void delayMicrosecondsISafe(uint16_t t)
 #define S_EPYX_HEADER            0x0200  // Read EPYX FastLoad header (drive code transmission)
 #define S_EPYX_LOAD              0x0400  // Detected Epyx "load" request
 #define S_EPYX_SECTOROP          0x0800  // Detected Epyx "sector operation" request
+#define S_BURST_ENABLED          0x1000  // 1571/1581 burst mode support is enabled
+#define S_BURST_DETECTED         0x2000  // Detected fast serial (burst capable) host
+#define S_BURST_LOAD             0x4000  // Detected burst "fastload" request
+#define S_BURST_SECTOROP         0x8000  // Detected burst "sector read/write" request
 
 #define TC_NONE      0
 #define TC_DATA_LOW  1
@@ -281,6 +285,19 @@ static IRAM_ATTR void delayMicrosecondsISafe(uint16_t t)
 #define TC_CLK_LOW   3
 #define TC_CLK_HIGH  4
 
+// bus tracing: TRACE_START takes the start time of a transfer, TRACE records it
+#if IEC_TRACE_BUFFER_SIZE>0
+#define TRACE_START(t)        uint32_t t = m_trace.isEnabled() ? micros() : 0
+#define TRACE_RESTART(t)      t = m_trace.isEnabled() ? micros() : 0
+#define TRACE(type, data, t)  do { if( m_trace.isEnabled() ) m_trace.record(type, data, t, micros()); } while(0)
+#define TRACE_EVENT(type)     do { if( m_trace.isEnabled() ) { uint32_t _t = micros(); m_trace.record(type, 0, _t, _t); } } while(0)
+#else
+#define TRACE_START(t)
+#define TRACE_RESTART(t)
+#define TRACE(type, data, t)
+#define TRACE_EVENT(type)
+#endif
+
 
 IECBusHandler *IECBusHandler::s_bushandler = NULL;
 
@@ -335,6 +352,21 @@ bool IRAM_ATTR IECBusHandler::readPinRESET()
 }
 
 
+#ifdef SUPPORT_BURST
+bool IRAM_ATTR IECBusHandler::readPinSRQ()
+{
+  return digitalReadFastExt(m_pinSRQ, m_regSRQread, m_bitSRQ)!=0;
+}
+
+
+void IRAM_ATTR IECBusHandler::writePinSRQ(bool v)
+{
+  // Emulate open collector behavior (see writePinCLK)
+  pinModeFastExt(m_pinSRQ, m_regSRQmode, m_bitSRQ, v ? INPUT : OUTPUT);
+}
+#endif
+
+
 bool IECBusHandler::waitTimeout(uint16_t timeout, uint8_t cond)
 {
   // This function may be called in code where interrupts are disabled.
@@ -474,6 +506,35 @@ bool IECBusHandler::waitPinCLK(bool state, uint16_t timeout)
 }
 
 
+#ifdef SUPPORT_BURST
+bool IECBusHandler::waitPinSRQ(bool state)
+{
+  // SRQ is only ever waited on while receiving burst data (clocked by
+  // the host) so there is no timeout, we only exit if ATN changes
+#ifdef ESP_PLATFORM
+  // see comment in waitPinCLK
+  uint64_t t = esp_timer_get_time();
+  while( readPinSRQ()!=state )
+    {
+      if( ((m_flags & P_ATN)!=0) == readPinATN() )
+        return false;
+      else if( !haveInterrupts && (esp_timer_get_time()-t)>700000 )
+        {
+          interrupts(); noInterrupts();
+          t = esp_timer_get_time();
+        }
+    }
+#else
+  while( readPinSRQ()!=state )
+    if( ((m_flags & P_ATN)!=0) == readPinATN() )
+      return false;
+#endif
+
+  return true;
+}
+#endif
+
+
 void IECBusHandler::sendSRQ()
 {
   if( m_pinSRQ!=0xFF )
@@ -486,6 +547,26 @@ void IECBusHandler::sendSRQ()
 }
 
 
+uint8_t IECBusHandler::getProtocol(IECDevice *dev)
+{
+  // the "detected" flags are cleared with the next ATN so this reports the
+  // protocol of the current (or most recent) transaction
+#ifdef SUPPORT_JIFFY
+  if( dev->m_sflags & S_JIFFY_DETECTED ) return IEC_PROTOCOL_JIFFY;
+#endif
+#ifdef SUPPORT_EPYX
+  if( dev->m_sflags & (S_EPYX_LOAD|S_EPYX_SECTOROP) ) return IEC_PROTOCOL_EPYX;
+#endif
+#ifdef SUPPORT_DOLPHIN
+  if( dev->m_sflags & S_DOLPHIN_DETECTED ) return IEC_PROTOCOL_DOLPHIN;
+#endif
+#ifdef SUPPORT_BURST
+  if( dev->m_sflags & (S_BURST_LOAD|S_BURST_SECTOROP) ) return IEC_PROTOCOL_BURST;
+#endif
+  return IEC_PROTOCOL_STANDARD;
+}
+
+
 IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, uint8_t pinRESET, uint8_t pinCTRL, uint8_t pinSRQ)
 #if defined(SUPPORT_DOLPHIN)
 #if defined(ESP_PLATFORM)
@@ -527,7 +608,7 @@ IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, ui
   m_pinCTRL      = pinCTRL;
   m_pinSRQ       = pinSRQ;
 
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_BURST)
 #if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
   m_bufferSize = IEC_DEFAULT_FASTLOAD_BUFFER_SIZE;
 #else
@@ -549,6 +630,17 @@ IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, ui
   m_regDATAread  = portInputRegister(digitalPinToPort(pinDATA));
   m_regDATAwrite = portOutputRegister(digitalPinToPort(pinDATA));
   m_regDATAmode  = portModeRegister(digitalPinToPort(pinDATA));
+#ifdef SUPPORT_BURST
+  m_bitSRQ       = digitalPinToBitMask(pinSRQ);
+  m_regSRQread   = portInputRegister(digitalPinToPort(pinSRQ));
+  m_regSRQmode   = portModeRegister(digitalPinToPort(pinSRQ));
+#endif
+#endif
+
+#ifdef SUPPORT_BURST
+  m_burstHostDetected = false;
+  m_burstClk = HIGH;
+  m_burstBufferLen = 0;
 #endif
 
   m_atnInterrupt = digitalPinToInterrupt(m_pinATN);
@@ -568,7 +660,7 @@ void IECBusHandler::begin()
   pinMode(m_pinDATA,  INPUT);
   if( m_pinCTRL<0xFF )  pinMode(m_pinCTRL,  OUTPUT);
   if( m_pinRESET<0xFF ) pinMode(m_pinRESET, INPUT);
-  if( m_pinSRQ<0xFF )   pinMode(m_pinSRQ,   INPUT);
+  if( m_pinSRQ<0xFF )   { digitalWrite(m_pinSRQ, LOW); pinMode(m_pinSRQ, INPUT); }
   m_flags = 0;
 
   // allow ATN to pull DATA low in hardware
@@ -582,6 +674,13 @@ void IECBusHandler::begin()
       attachInterrupt(m_atnInterrupt, atnInterruptFcn, FALLING);
     }
 
+#ifdef SUPPORT_BURST
+  // a host in fast serial mode (C128) sends a byte clocked via SRQ after pulling
+  // ATN low, detect this via interrupt (see comment in function srqInterruptFcn)
+  if( m_pinSRQ<0xFF && s_bushandler==this && digitalPinToInterrupt(m_pinSRQ)!=NOT_AN_INTERRUPT )
+    attachInterrupt(digitalPinToInterrupt(m_pinSRQ), srqInterruptFcn, FALLING);
+#endif
+
   // call begin() function for all attached devices
   for(uint8_t i=0; i<m_numDevices; i++)
     m_devices[i]->begin();
@@ -606,7 +705,7 @@ bool IECBusHandler::attachDevice(IECDevice *dev)
     {
       m_devices[m_numDevices++] = dev;
       dev->m_handler = this;
-      dev->m_sflags &= ~(S_JIFFY_DETECTED|S_JIFFY_BLOCK|S_DOLPHIN_DETECTED|S_DOLPHIN_BURST_TRANSMIT|S_DOLPHIN_BURST_RECEIVE|S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP);
+      dev->m_sflags &= ~(S_JIFFY_DETECTED|S_JIFFY_BLOCK|S_DOLPHIN_DETECTED|S_DOLPHIN_BURST_TRANSMIT|S_DOLPHIN_BURST_RECEIVE|S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP|S_BURST_DETECTED|S_BURST_LOAD|S_BURST_SECTOROP);
 #ifdef SUPPORT_DOLPHIN
       enableParallelPins();
 #endif
@@ -657,7 +756,19 @@ void IECBusHandler::atnInterruptFcn(INTERRUPT_FCN_ARG)
 }
 
 
-#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
+#ifdef SUPPORT_BURST
+void IECBusHandler::srqInterruptFcn(INTERRUPT_FCN_ARG)
+{
+  // the host only sends its "fast" byte while ATN is low, other edges
+  // (e.g. caused by our own burst transmissions) must be ignored.
+  // The flag is reset at the end of each ATN sequence in task()
+  if( s_bushandler!=NULL && !s_bushandler->readPinATN() )
+    s_bushandler->m_burstHostDetected = true;
+}
+#endif
+
+
+#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_BURST)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
 void IECBusHandler::setBuffer(uint8_t *buffer, uint8_t bufferSize)
 {
   m_buffer     = bufferSize>0 ? buffer : NULL;
@@ -687,6 +798,7 @@ bool IECBusHandler::enableJiffyDosSupport(IECDevice *dev, bool enable)
 bool IRAM_ATTR IECBusHandler::receiveJiffyByte(bool canWriteOk)
 {
   uint8_t data = 0;
+  TRACE_START(traceStart);
   JDEBUG1();
   timer_init();
   timer_reset();
@@ -769,6 +881,7 @@ bool IRAM_ATTR IECBusHandler::receiveJiffyByte(bool canWriteOk)
     {
       // pass received data on to the device
       m_currentDevice->write(data, eoi);
+      TRACE(IEC_TRACE_RECEIVE | IEC_TRACE_JIFFY | (eoi ? IEC_TRACE_EOI : 0), data, traceStart);
     }
   else
     {
@@ -783,6 +896,7 @@ bool IRAM_ATTR IECBusHandler::receiveJiffyByte(bool canWriteOk)
 bool IRAM_ATTR IECBusHandler::transmitJiffyByte(uint8_t numData)
 {
   uint8_t data = numData>0 ? m_currentDevice->peek() : 0;
+  TRACE_START(traceStart);
 
   JDEBUG1();
   timer_init();
@@ -876,6 +990,7 @@ bool IRAM_ATTR IECBusHandler::transmitJiffyByte(uint8_t numData)
     {
       // success => discard transmitted byte (was previously read via peek())
       m_currentDevice->read();
+      TRACE(IEC_TRACE_SEND | IEC_TRACE_JIFFY | (numData==1 ? IEC_TRACE_EOI : 0), data, traceStart);
       return true;
     }
   else
@@ -885,6 +1000,7 @@ bool IRAM_ATTR IECBusHandler::transmitJiffyByte(uint8_t numData)
 
 bool IRAM_ATTR IECBusHandler::transmitJiffyBlock(uint8_t *buffer, uint8_t numBytes)
 {
+  TRACE_START(traceStart);
   JDEBUG1();
   timer_init();
 
@@ -909,6 +1025,7 @@ bool IRAM_ATTR IECBusHandler::transmitJiffyBlock(uint8_t *buffer, uint8_t numByt
       writePinCLK(LOW);
       if( !waitTimeout(100) ) return false;
       JDEBUG0(); 
+      TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_JIFFY | IEC_TRACE_EOI, 0, traceStart);
       return false;
     }
 
@@ -1006,6 +1123,7 @@ bool IRAM_ATTR IECBusHandler::transmitJiffyBlock(uint8_t *buffer, uint8_t numByt
 
   JDEBUG0();
 
+  TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_JIFFY, numBytes, traceStart);
   return true;
 }
 
@@ -1355,6 +1473,7 @@ bool IECBusHandler::receiveDolphinByte(bool canWriteOk)
       return true;
     }
 
+  TRACE_START(traceStart);
   noInterrupts();
 
   // signal "ready"
@@ -1409,6 +1528,7 @@ bool IECBusHandler::receiveDolphinByte(bool canWriteOk)
           m_currentDevice->write(data, eoi);
         }
 
+      TRACE(IEC_TRACE_RECEIVE | IEC_TRACE_DOLPHIN | (eoi ? IEC_TRACE_EOI : 0), data, traceStart);
       return true;
     }
   else
@@ -1430,6 +1550,7 @@ bool IECBusHandler::transmitDolphinByte(uint8_t numData)
   // - get the data byte to send before setting CLK high
   // - wait for DATA high in a blocking loop
   uint8_t data = numData>0 ? m_currentDevice->peek() : 0xFF;
+  TRACE_START(traceStart);
 
   noInterrupts();
 
@@ -1480,6 +1601,7 @@ bool IECBusHandler::transmitDolphinByte(uint8_t numData)
   // release parallel bus
   setParallelBusModeInput();
   
+  if( res ) TRACE(IEC_TRACE_SEND | IEC_TRACE_DOLPHIN | (numData==1 ? IEC_TRACE_EOI : 0), data, traceStart);
   return res;
 }
 
@@ -1501,6 +1623,7 @@ bool IECBusHandler::receiveDolphinBurst()
 
   // keep going while CLK is low
   bool eoi = false;
+  TRACE_START(traceStart);
   while( !eoi )
     {
       // wait for "data ready" handshake, return if ATN is asserted (high)
@@ -1521,6 +1644,8 @@ bool IECBusHandler::receiveDolphinBurst()
         {
           // data written successfully => send handshake
           parallelBusHandshakeTransmit();
+          TRACE(IEC_TRACE_BLOCK_RX | IEC_TRACE_DOLPHIN | (eoi ? IEC_TRACE_EOI : 0), n, traceStart);
+          TRACE_RESTART(traceStart);
           n = 0;
         }
       else
@@ -1573,33 +1698,39 @@ bool IECBusHandler::transmitDolphinBurst()
 
   // get data from the device and transmit it
   uint8_t n;
+  TRACE_START(traceStart);
   while( (n=m_currentDevice->read(m_buffer, m_bufferSize))>0 )
-    for(uint8_t i=0; i<n; i++)
-      {
-        // put data on bus
-        writeParallelData(m_buffer[i]);
+    {
+      for(uint8_t i=0; i<n; i++)
+        {
+          // put data on bus
+          writeParallelData(m_buffer[i]);
         
-        // send handshake
-        // sending the handshake can induce a pulse on the receive handhake
-        // line so we clear the receive handshake after sending, note that we
-        // can't have an interrupt take up time between sending the handshake
-        // and clearing the receive handshake
-        noInterrupts();
-        parallelBusHandshakeTransmit();
-        parallelBusHandshakeReceived();
-        interrupts();
+          // send handshake
+          // sending the handshake can induce a pulse on the receive handhake
+          // line so we clear the receive handshake after sending, note that we
+          // can't have an interrupt take up time between sending the handshake
+          // and clearing the receive handshake
+          noInterrupts();
+          parallelBusHandshakeTransmit();
+          parallelBusHandshakeReceived();
+          interrupts();
 
-        // wait for receiver handshake
-        while( !parallelBusHandshakeReceived() )
-          if( !readPinATN() || readPinDATA() )
-            {
-              // if receiver released DATA or pulled ATN low then there 
-              // was an error => release bus and CLK line and return
-              setParallelBusModeInput();
-              writePinCLK(HIGH);
-              return false;
-            }
-      }
+          // wait for receiver handshake
+          while( !parallelBusHandshakeReceived() )
+            if( !readPinATN() || readPinDATA() )
+              {
+                // if receiver released DATA or pulled ATN low then there 
+                // was an error => release bus and CLK line and return
+                setParallelBusModeInput();
+                writePinCLK(HIGH);
+                return false;
+              }
+        }
+
+      TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_DOLPHIN, n, traceStart);
+      TRACE_RESTART(traceStart);
+    }
 
   // switch parallel bus back to input
   setParallelBusModeInput();
@@ -1912,12 +2043,14 @@ bool IECBusHandler::receiveEpyxHeader()
   writePinCLK(HIGH);
 
   // receive fastload routine upload (256 bytes) and compute checksum
+  TRACE_START(traceStart);
   uint8_t data, checksum = 0;
   for(int i=0; i<256; i++)
     {
       if( !receiveEpyxByte(data) ) { interrupts(); return false; }
       checksum += data;
     }
+  TRACE(IEC_TRACE_BLOCK_RX | IEC_TRACE_EPYX, 0, traceStart);
 
   if( checksum==0x26 /* V1 load file */ ||
       checksum==0x86 /* V2 load file */ ||
@@ -1990,6 +2123,7 @@ bool IECBusHandler::receiveEpyxHeader()
 bool IECBusHandler::transmitEpyxBlock()
 {
   uint8_t n = m_currentDevice->read(m_buffer, m_bufferSize);
+  TRACE_START(traceStart);
 
   noInterrupts();
 
@@ -2009,6 +2143,8 @@ bool IECBusHandler::transmitEpyxBlock()
 
   interrupts();
 
+  TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_EPYX | (n==0 ? IEC_TRACE_EOI : 0), n, traceStart);
+
   // the "end transmission" condition for the receiver is receiving
   // a "0" length byte so we keep sending block until we have
   // transmitted a 0-length block (i.e. end-of-file)
@@ -2016,6 +2152,233 @@ bool IECBusHandler::transmitEpyxBlock()
 }
 
 
+#endif
+
+#ifdef SUPPORT_BURST
+
+// ------------------------------------  1571/1581 burst mode support routines  ------------------------------------
+
+// In burst mode, bytes are transferred via the SRQ (clock) and DATA lines, MSB first with
+// inverted data bits (DATA LOW = 1). The receiver samples DATA on the rising edge of SRQ.
+// When we are sending, the host toggles CLK to signal "ready for next byte".
+// When we are receiving, the host clocks in each sector back-to-back after we signal
+// "ready" by releasing DATA and we pull DATA LOW ("busy") once the sector is complete.
+
+
+bool IECBusHandler::enableBurstSupport(IECDevice *dev, bool enable)
+{
+  // burst transfers need a full 256-byte buffer (see comment in IECConfig.h)
+#if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
+  bool bufferOk = true;
+#else
+  bool bufferOk = m_bufferSize==255;
+#endif
+
+  if( enable && bufferOk && m_pinSRQ!=0xFF )
+    dev->m_sflags |= S_BURST_ENABLED;
+  else
+    dev->m_sflags &= ~(S_BURST_ENABLED|S_BURST_DETECTED);
+
+  // cancel any current requests
+  dev->m_sflags &= ~(S_BURST_LOAD|S_BURST_SECTOROP);
+
+  return (dev->m_sflags & S_BURST_ENABLED)!=0;
+}
+
+
+bool IECBusHandler::burstLoadRequest(IECDevice *dev)
+{
+  // burst commands are only answered if the host has identified itself as 
+  // being capable of fast serial transfers (same as on the 1571)
+  if( (dev->m_sflags & (S_BURST_ENABLED|S_BURST_DETECTED))!=(S_BURST_ENABLED|S_BURST_DETECTED) )
+    return false;
+
+  m_burstBufferLen = 0;
+  m_burstClk = HIGH;
+  dev->m_sflags |= S_BURST_LOAD;
+  return true;
+}
+
+
+bool IECBusHandler::burstSectorRequest(IECDevice *dev, uint8_t command, uint8_t track, uint8_t sector, uint8_t numSectors)
+{
+  if( (dev->m_sflags & (S_BURST_ENABLED|S_BURST_DETECTED))!=(S_BURST_ENABLED|S_BURST_DETECTED) )
+    return false;
+
+  m_burstCmd        = command;
+  m_burstTrack      = track;
+  m_burstSector     = sector;
+  m_burstNumSectors = numSectors;
+  m_burstClk = HIGH;
+  dev->m_sflags |= S_BURST_SECTOROP;
+  return true;
+}
+
+
+void IRAM_ATTR IECBusHandler::transmitBurstBits(uint8_t data)
+{
+  // interrupts are assumed to be disabled when we get here
+  timer_init();
+  timer_reset();
+  timer_start();
+
+  for(uint8_t i=0; i<8; i++)
+    {
+      // set (inverted) data bit and pull SRQ low
+      writePinDATA(!(data & 0x80));
+      writePinSRQ(LOW);
+      timer_wait_until(3);
+
+      // release SRQ, receiver samples DATA on the rising edge
+      writePinSRQ(HIGH);
+      timer_wait_until(6);
+      timer_reset();
+
+      data <<= 1;
+    }
+
+  timer_stop();
+  writePinDATA(HIGH);
+}
+
+
+bool IRAM_ATTR IECBusHandler::receiveBurstBits(uint8_t &data)
+{
+  // interrupts are assumed to be disabled when we get here
+  for(uint8_t i=0; i<8; i++)
+    {
+      // wait for the next clock pulse from the host
+      if( !waitPinSRQ(LOW) )  return false;
+      if( !waitPinSRQ(HIGH) ) return false;
+
+      // read next (inverted) bit
+      data <<= 1;
+      if( !readPinDATA() ) data |= 0x01;
+    }
+
+  return true;
+}
+
+
+bool IECBusHandler::transmitBurstByte(uint8_t data)
+{
+  // wait (indefinitely) for the host to toggle CLK ("ready for next byte")
+  // or ATN low (abort)
+  m_burstClk = !m_burstClk;
+  if( !waitPinCLK(m_burstClk, 0) ) return false;
+
+  // all timing is clocked by us but a long interrupt in the middle of
+  // a byte could make the host time out
+  noInterrupts();
+  transmitBurstBits(data);
+  interrupts();
+
+  return true;
+}
+
+
+bool IECBusHandler::transmitBurstLoadBlock()
+{
+  // keep one byte more than fits into a block, otherwise we could
+  // not tell whether the current block is the last one
+  if( m_burstBufferLen<255 )
+    m_burstBufferLen += m_currentDevice->read(m_buffer+m_burstBufferLen, 255-m_burstBufferLen);
+
+  TRACE_START(traceStart);
+
+  if( m_burstBufferLen==0 )
+    {
+      // no data on first block => "file not found"
+      transmitBurstByte(0x02);
+      return false;
+    }
+  else if( m_burstBufferLen<255 )
+    {
+      // last block: status 0x1F, number of bytes, data
+      if( !transmitBurstByte(0x1F) ) return false;
+      if( !transmitBurstByte(m_burstBufferLen) ) return false;
+      for(uint8_t i=0; i<m_burstBufferLen; i++)
+        if( !transmitBurstByte(m_buffer[i]) )
+          return false;
+
+      TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_BURST | IEC_TRACE_EOI, m_burstBufferLen, traceStart);
+      return false;
+    }
+  else
+    {
+      // full block: status 0x00, 254 bytes of data
+      if( !transmitBurstByte(0x00) ) return false;
+      for(uint8_t i=0; i<254; i++)
+        if( !transmitBurstByte(m_buffer[i]) )
+          return false;
+
+      TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_BURST, 254, traceStart);
+
+      // carry over the extra byte
+      m_buffer[0] = m_buffer[254];
+      m_burstBufferLen = 1;
+      return true;
+    }
+}
+
+
+bool IECBusHandler::transmitBurstSectors()
+{
+  uint8_t op   = m_burstCmd & 0x0F;
+  uint8_t side = (m_burstCmd & 0x10) ? 1 : 0;
+
+  if( op==0x04 )
+    {
+      // "inquire disk" => report whether the medium can be read
+      bool ok = m_currentDevice->burstReadSector(1, 0, side, m_buffer);
+      return transmitBurstByte(ok ? 0x00 : 0x0F);
+    }
+
+  for(uint8_t n=0; n<m_burstNumSectors; n++)
+    {
+      bool ok;
+      TRACE_START(traceStart);
+      if( op==0x02 )
+        {
+          // sector write => receive sector data (host clocks it in
+          // back-to-back), then signal "busy" by pulling DATA low
+          noInterrupts();
+          writePinDATA(HIGH);
+          for(int i=0; i<256; i++)
+            if( !receiveBurstBits(m_buffer[i]) )
+              { interrupts(); return false; }
+          writePinDATA(LOW);
+          interrupts();
+
+          TRACE(IEC_TRACE_BLOCK_RX | IEC_TRACE_BURST, 0, traceStart);
+          ok = m_currentDevice->burstWriteSector(m_burstTrack, m_burstSector, side, m_buffer);
+          writePinDATA(HIGH);
+          if( !transmitBurstByte(ok ? 0x00 : 0x07) ) return false;
+        }
+      else
+        {
+          // sector read => send status, then sector data
+          ok = m_currentDevice->burstReadSector(m_burstTrack, m_burstSector, side, m_buffer);
+          if( !transmitBurstByte(ok ? 0x00 : 0x02) ) return false;
+
+          // bit 6 ("E") of the command means: ignore errors and send data anyway
+          if( ok || (m_burstCmd & 0x40) )
+            {
+              for(int i=0; i<256; i++)
+                if( !transmitBurstByte(m_buffer[i]) )
+                  return false;
+
+              TRACE(IEC_TRACE_BLOCK_TX | IEC_TRACE_BURST, 0, traceStart);
+            }
+        }
+
+      if( !ok && !(m_burstCmd & 0x40) ) return false;
+      m_burstSector++;
+    }
+
+  return true;
+}
+
 #endif
 
 // ------------------------------------  IEC protocol support routines  ------------------------------------  
@@ -2103,6 +2466,7 @@ bool IECBusHandler::receiveIECByte(bool canWriteOk)
   // NOTE: we only get here if sender has already signaled ready-to-send
   // by releasing CLK
   bool eoi = false;
+  TRACE_START(traceStart);
 
   noInterrupts();
 
@@ -2151,6 +2515,7 @@ bool IECBusHandler::receiveIECByte(bool canWriteOk)
 
       // pass received data on to the device
       m_currentDevice->write(data, eoi);
+      TRACE(IEC_TRACE_RECEIVE | (eoi ? IEC_TRACE_EOI : 0), data, traceStart);
       return true;
     }
   else
@@ -2171,6 +2536,7 @@ bool IECBusHandler::transmitIECByte(uint8_t numData)
   // know whether my interpretation here is correct. However, some 
   // programs (e.g. "copy 190") lock up if we don't handle this case.
   bool verifyError = readPinDATA();
+  TRACE_START(traceStart);
 
   noInterrupts();
 
@@ -2205,7 +2571,7 @@ bool IECBusHandler::transmitIECByte(uint8_t numData)
   interrupts();
 
   // get the data byte from the device
-  uint8_t data = m_currentDevice->read();
+  uint8_t data = m_currentDevice->read(), bits = data;
 
   // transmit the byte
   for(uint8_t i=0; i<8; i++)
@@ -2214,7 +2580,7 @@ bool IECBusHandler::transmitIECByte(uint8_t numData)
       writePinCLK(LOW);
 
       // set bit on DATA line
-      writePinDATA((data & 1)!=0);
+      writePinDATA((bits & 1)!=0);
 
       // hold for 80us
       if( !waitTimeout(80) ) return false;
@@ -2226,7 +2592,7 @@ bool IECBusHandler::transmitIECByte(uint8_t numData)
       if( !waitTimeout(60) ) return false;
 
       // next bit
-      data >>= 1;
+      bits >>= 1;
     }
 
   // pull CLK=0 and release DATA=1 to signal "busy"
@@ -2236,6 +2602,7 @@ bool IECBusHandler::transmitIECByte(uint8_t numData)
   // wait for receiver to signal "busy"
   if( !waitPinDATA(LOW) ) return false;
   
+  TRACE(IEC_TRACE_SEND | (numData==1 || verifyError ? IEC_TRACE_EOI : 0), data, traceStart);
   return true;
 }
 
@@ -2277,6 +2644,10 @@ void IECBusHandler::atnRequest()
   for(uint8_t i=0; i<m_numDevices; i++) 
     m_devices[i]->m_sflags &= ~(S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP);
 #endif
+#ifdef SUPPORT_BURST
+  for(uint8_t i=0; i<m_numDevices; i++) 
+    m_devices[i]->m_sflags &= ~(S_BURST_LOAD|S_BURST_SECTOROP);
+#endif
 }
 
 
@@ -2296,6 +2667,7 @@ void IECBusHandler::task()
     { 
       // falling edge on RESET pin
       m_flags = 0;
+      TRACE_EVENT(IEC_TRACE_RESET);
       
       // release CLK and DATA, allow ATN to pull DATA low in hardware
       writePinCLK(HIGH);
@@ -2304,7 +2676,12 @@ void IECBusHandler::task()
 
       // call "reset" function for attached devices
       for(uint8_t i=0; i<m_numDevices; i++)
-        m_devices[i]->reset(); 
+        {
+#ifdef SUPPORT_BURST
+          m_devices[i]->m_sflags &= ~(S_BURST_DETECTED|S_BURST_LOAD|S_BURST_SECTOROP);
+#endif
+          m_devices[i]->reset(); 
+        }
     }
 
   // ------------------ check for activity on ATN pin -------------------
@@ -2324,11 +2701,36 @@ void IECBusHandler::task()
       //    ATN request.
       noInterrupts();
 
+      TRACE_START(traceStart);
       if( receiveIECByteATN(m_primary) && ((m_primary == 0x3f) || (m_primary == 0x5f) || (findDevice((unsigned int) m_primary & 0x1f)!=NULL)) )
         {
+          TRACE(IEC_TRACE_ATN, m_primary, traceStart);
+
           // this is either UNLISTEN or UNTALK or we were addressed
           // => receive the secondary address, assume 0 if not sent
-          if( (m_primary == 0x3f) || (m_primary == 0x5f) || !receiveIECByteATN(m_secondary) ) m_secondary = 0;
+          TRACE_RESTART(traceStart);
+          if( (m_primary == 0x3f) || (m_primary == 0x5f) || !receiveIECByteATN(m_secondary) ) 
+            m_secondary = 0;
+          else
+            TRACE(IEC_TRACE_ATN, m_secondary, traceStart);
+
+#ifdef SUPPORT_BURST
+          // if the host sent a "fast" byte at the start of this ATN sequence and we were
+          // addressed then respond with a fast byte, telling the host that we can do burst
+          // transfers (this is what the 1571 does)
+          if( m_burstHostDetected && (m_primary & 0xC0)!=0 && (m_primary & 0x1F)!=0x1F )
+            {
+              IECDevice *dev = findDevice(m_primary & 0x1F);
+              if( dev!=NULL && (dev->m_sflags & S_BURST_ENABLED) )
+                {
+                  dev->m_sflags |= S_BURST_DETECTED;
+                  transmitBurstBits(0x00);
+
+                  // transmitBurstBits releases DATA but we must keep acknowledging
+                  writePinDATA(LOW);
+                }
+            }
+#endif
 
           // wait until ATN is released
           while( !readPinATN() );
@@ -2416,6 +2818,11 @@ void IECBusHandler::task()
 
       interrupts();
 
+#ifdef SUPPORT_BURST
+      // "fast" byte from host only applies to the ATN sequence it was sent with
+      m_burstHostDetected = false;
+#endif
+
       if( (m_flags & P_LISTENING)!=0 )
         {
           // a device is supposed to listen, check if it can accept data
@@ -2560,6 +2967,39 @@ void IECBusHandler::task()
 #endif
 #endif
 
+#ifdef SUPPORT_BURST
+  // ------------------ 1571/1581 burst mode transfer handling -------------------
+
+  for(uint8_t devidx=0; devidx<m_numDevices; devidx++)
+  if( m_devices[devidx]->m_sflags & S_BURST_LOAD )
+    {
+      m_currentDevice = m_devices[devidx];
+      if( !transmitBurstLoadBlock() )
+        {
+          // either end-of-data or transmission error => we are done
+          writePinSRQ(HIGH);
+          writePinDATA(HIGH);
+
+          // close the file (was opened when the burst fastload command was received)
+          m_currentDevice->listen(0xE0);
+          m_currentDevice->unlisten();
+
+          // no more data to send
+          m_currentDevice->m_sflags &= ~S_BURST_LOAD;
+        }
+    }
+  else if( m_devices[devidx]->m_sflags & S_BURST_SECTOROP )
+    {
+      m_currentDevice = m_devices[devidx];
+      transmitBurstSectors();
+
+      // done (or transmission error)
+      writePinSRQ(HIGH);
+      writePinDATA(HIGH);
+      m_currentDevice->m_sflags &= ~S_BURST_SECTOROP;
+    }
+#endif
+
   // ------------------ receiving data -------------------
 
   if( (m_flags & (P_ATN|P_LISTENING|P_DONE))==P_LISTENING && (m_currentDevice!=NULL) )
@@ -2591,6 +3031,7 @@ void IECBusHandler::task()
               // an error condition to the sender
               writePinDATA(HIGH);
               m_flags |= P_DONE;
+              TRACE_EVENT(IEC_TRACE_ERROR | IEC_TRACE_JIFFY);
             }
           }
 #endif
@@ -2607,6 +3048,7 @@ void IECBusHandler::task()
               // an error condition to the sender
               writePinDATA(HIGH);
               m_flags |= P_DONE;
+              TRACE_EVENT(IEC_TRACE_ERROR | IEC_TRACE_DOLPHIN);
             }
         }
 #endif
@@ -2619,6 +3061,7 @@ void IECBusHandler::task()
             {
               // receive failed => transaction is done
               m_flags |= P_DONE;
+              TRACE_EVENT(IEC_TRACE_ERROR);
             }
         }
     }
@@ -2683,6 +3126,7 @@ void IECBusHandler::task()
               {
                 // either a transmission error, no more data to send or falling edge on ATN
                 m_flags |= P_DONE;
+                if( numData>0 ) TRACE_EVENT(IEC_TRACE_ERROR | IEC_TRACE_JIFFY);
               }
           }
 #endif
@@ -2695,6 +3139,7 @@ void IECBusHandler::task()
                 // either a transmission error, no more data to send or falling edge on ATN
                 writePinCLK(HIGH);
                 m_flags |= P_DONE;
+                if( numData>0 ) TRACE_EVENT(IEC_TRACE_ERROR | IEC_TRACE_DOLPHIN);
               }
           }
 #endif
@@ -2711,6 +3156,7 @@ void IECBusHandler::task()
               {
                 // either a transmission error, no more data to send or falling edge on ATN
                 m_flags |= P_DONE;
+                if( numData>0 ) TRACE_EVENT(IEC_TRACE_ERROR);
               }
           }
        }
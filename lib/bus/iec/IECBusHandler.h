@@ -20,6 +20,7 @@
 #define IECBUSHANDLER_H
 
 #include "IECConfig.h"
+#include "IECTrace.h"
 #include <stdint.h>
 
 #if defined(__AVR__)
@@ -60,7 +61,7 @@ class IECBusHandler
   // ok but bus communication will be slower if called less frequently.
   void task();
 
-#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
+#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_BURST)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
   // if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE is set to 0 then the buffer space used
   // by fastload protocols can be set dynamically using the setBuffer function.
   void setBuffer(uint8_t *buffer, uint8_t bufferSize);
@@ -86,10 +87,23 @@ class IECBusHandler
   void dolphinBurstTransmitRequest(IECDevice *dev);
 #endif
 
+#ifdef SUPPORT_BURST
+  bool enableBurstSupport(IECDevice *dev, bool enable);
+  bool burstLoadRequest(IECDevice *dev);
+  bool burstSectorRequest(IECDevice *dev, uint8_t command, uint8_t track, uint8_t sector, uint8_t numSectors);
+#endif
+
+#if IEC_TRACE_BUFFER_SIZE>0
+  // bus transaction tracing, costs a few microseconds per byte (or block) while enabled
+  void enableTrace(bool enable) { m_trace.enable(enable); }
+  IECTrace *getTrace() { return &m_trace; }
+#endif
+
   IECDevice *findDevice(uint8_t devnr, bool includeInactive = false);
   bool canServeATN();
   bool inTransaction();
   void sendSRQ();
+  uint8_t getProtocol(IECDevice *dev);
 
   IECDevice *m_currentDevice;
   IECDevice *m_devices[MAX_DEVICES];
@@ -174,11 +188,34 @@ class IECBusHandler
   bool finishEpyxSectorCommand();
 #endif
 #endif
+
+#ifdef SUPPORT_BURST
+  inline bool readPinSRQ();
+  inline void writePinSRQ(bool v);
+  bool waitPinSRQ(bool state);
+  void transmitBurstBits(uint8_t data);
+  bool receiveBurstBits(uint8_t &data);
+  bool transmitBurstByte(uint8_t data);
+  bool transmitBurstLoadBlock();
+  bool transmitBurstSectors();
+
+  volatile bool m_burstHostDetected;
+  bool m_burstClk;
+  uint8_t m_burstCmd, m_burstTrack, m_burstSector, m_burstNumSectors, m_burstBufferLen;
+
+#ifdef IOREG_TYPE
+  volatile IOREG_TYPE *m_regSRQmode;
+  volatile const IOREG_TYPE *m_regSRQread;
+  IOREG_TYPE m_bitSRQ;
+#endif
+
+  static void srqInterruptFcn(INTERRUPT_FCN_ARG);
+#endif
   
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_BURST)
   uint8_t m_bufferSize;
 #if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
-#if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
+#if (defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)) || defined(SUPPORT_BURST)
   uint8_t  m_buffer[256];
 #else
   uint8_t  m_buffer[IEC_DEFAULT_FASTLOAD_BUFFER_SIZE];
@@ -188,6 +225,10 @@ class IECBusHandler
 #endif
 #endif
 
+#if IEC_TRACE_BUFFER_SIZE>0
+  IECTrace m_trace;
+#endif
+
   static IECBusHandler *s_bushandler;
   static void atnInterruptFcn(INTERRUPT_FCN_ARG);
 };
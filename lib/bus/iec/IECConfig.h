@@ -27,12 +27,29 @@
 #define SUPPORT_DOLPHIN
 #endif
 
+// support Commodore 1571/1581 burst mode (fast serial transfers clocked via the
+// SRQ line). Requires the SRQ pin to be passed to the IECBusHandler constructor.
+// If this is enabled and IEC_DEFAULT_FASTLOAD_BUFFER_SIZE is 0 then the buffer in
+// the setBuffer() call must have a size of at least 256 bytes and a bufferSize
+// argument of 255 (see comment for SUPPORT_EPYX_SECTOROPS below)
+// Not verified against C128 hardware yet, so it is only built for boards that
+// add "-D IEC_BURST" to their build_flags (the fujinet-iec-nugget-burst board in
+// build-platforms does). The SRQ line must not be used for anything else
+// (iec-d32pro has PIN_DEBUG on it).
+#ifdef IEC_BURST
+#define SUPPORT_BURST
+#endif
+
 // support Epyx FastLoad sector operations (disk editor, disk copy, file copy)
 // if this is enabled then the buffer in the setBuffer() call must have a size of
 // at least 256 bytes. Note that the "bufferSize" argument is a byte and therefore
 // capped at 255 bytes. Make sure the buffer itself has >=256 bytes and use a 
 // bufferSize argument of 255 or less
-//#define SUPPORT_EPYX_SECTOROPS
+// Only built for boards that add "-D IEC_EPYX_SECTOROPS" to their build_flags, like
+// fujinet-iec-nugget-burst (direct access channels and U1/U2/B-x commands work without it).
+#ifdef IEC_EPYX_SECTOROPS
+#define SUPPORT_EPYX_SECTOROPS
+#endif
 
 // defines the maximum number of devices that the bus handler will be
 // able to support - set to 4 by default but can be increased to up to 30 devices
@@ -41,7 +58,7 @@
 // sets the default size of the fastload buffer. If this is set to 0 then fastload
 // protocols can only be used if the IECBusHandler::setBuffer() function is
 // called to define the buffer.
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_BURST)
 #define IEC_DEFAULT_FASTLOAD_BUFFER_SIZE 128
 #endif
 
@@ -58,4 +75,13 @@
 // kept small on platforms with little RAM (e.g. Arduino UNO)
 #define IECFILEDEVICE_STATUS_BUFFER_SIZE 128
 
+// number of entries in the bus transaction trace buffer (must be a power of 2,
+// 8 bytes per entry). The buffer is only allocated once tracing is enabled at
+// runtime via IECBusHandler::enableTrace(). Set to 0 to remove tracing support
+#if defined(ESP_PLATFORM)
+#define IEC_TRACE_BUFFER_SIZE 4096
+#else
+#define IEC_TRACE_BUFFER_SIZE 0
+#endif
+
 #endif
@@ -45,6 +45,12 @@ void IECDevice::sendSRQ()
 }
 
 
+uint8_t IECDevice::getProtocol()
+{
+  return m_handler ? m_handler->getProtocol(this) : IEC_PROTOCOL_STANDARD;
+}
+
+
 #ifdef SUPPORT_JIFFY
 bool IECDevice::enableJiffyDosSupport(bool enable)
 {
@@ -89,9 +95,27 @@ void IECDevice::epyxLoadRequest()
 #endif  
 
 
+#ifdef SUPPORT_BURST
+bool IECDevice::enableBurstSupport(bool enable)
+{
+  return m_handler ? m_handler->enableBurstSupport(this, enable) : false;
+}
+
+bool IECDevice::burstLoadRequest()
+{
+  return m_handler ? m_handler->burstLoadRequest(this) : false;
+}
+
+bool IECDevice::burstSectorRequest(uint8_t command, uint8_t track, uint8_t sector, uint8_t numSectors)
+{
+  return m_handler ? m_handler->burstSectorRequest(this, command, track, sector, numSectors) : false;
+}
+#endif
+
+
 // default implementation of "buffer read" function which can/should be overridden
-// (for efficiency) by devices using the JiffyDos, Epyx FastLoad or DolphinDos protocol
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN)
+// (for efficiency) by devices using the JiffyDos, Epyx FastLoad, DolphinDos or burst protocol
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_BURST)
 uint8_t IECDevice::read(uint8_t *buffer, uint8_t bufferSize)
 { 
   uint8_t i;
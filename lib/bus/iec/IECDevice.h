@@ -24,6 +24,14 @@
 
 class IECBusHandler;
 
+// bus protocols, as returned by IECDevice::getProtocol()
+#define IEC_PROTOCOL_STANDARD 0
+#define IEC_PROTOCOL_JIFFY    1
+#define IEC_PROTOCOL_EPYX     2
+#define IEC_PROTOCOL_DOLPHIN  3
+#define IEC_PROTOCOL_BURST    4
+#define IEC_PROTOCOL_COUNT    5
+
 class IECDevice
 {
  friend class IECBusHandler;
@@ -55,6 +63,12 @@ class IECDevice
   bool enableEpyxFastLoadSupport(bool enable);
 #endif
 
+#ifdef SUPPORT_BURST
+  // call this to enable or disable 1571/1581 burst mode support for your device.
+  // this function will fail if no SRQ pin was given to the IECBusHandler
+  bool enableBurstSupport(bool enable);
+#endif
+
  protected:
   // called when IECBusHandler::begin() is called
   virtual void begin() {}
@@ -131,9 +145,9 @@ class IECDevice
   virtual uint8_t write(uint8_t *buffer, uint8_t bufferSize, bool eoi);
 #endif
 
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_BURST)
   // called when the device is sending data using the JiffyDOS block transfer
-  // or DolphinDos burst transfer (LOAD protocols)
+  // or DolphinDos/1571 burst transfer (LOAD protocols)
   // - should fill the buffer with as much data as possible (up to bufferSize)
   // - must return the number of bytes put into the buffer
   // read() is allowed to take an indefinite amount of time
@@ -150,6 +164,13 @@ class IECDevice
   virtual bool epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buffer) { return false; }
 #endif
 
+#ifdef SUPPORT_BURST
+  // called when the host requests 1571/1581 burst sector reads/writes ("U0" command),
+  // buffer is 256 bytes, side is 0 or 1 (double-sided media)
+  virtual bool burstReadSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer)  { return false; }
+  virtual bool burstWriteSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer) { return false; }
+#endif
+
 #ifdef SUPPORT_DOLPHIN 
   // call this to enable or disable DolphinDOS burst transmission mode
   // On the 1541, this gets enabled/disabled by the "XF+"/"XF-" command
@@ -171,6 +192,18 @@ class IECDevice
   void epyxLoadRequest();
 #endif
 
+#ifdef SUPPORT_BURST
+  // call this after receiving a burst "fastload" command ("U0"+0x1F+name) and opening
+  // the file on channel 0, the file gets closed after the transfer is done.
+  // returns false if burst mode is disabled or the host is not in fast mode
+  // (the IECFileDevice class handles this automatically)
+  bool burstLoadRequest();
+
+  // call this after receiving a burst sector read/write command on the command channel
+  // (the IECFileDevice class handles this automatically)
+  bool burstSectorRequest(uint8_t command, uint8_t track, uint8_t sector, uint8_t numSectors);
+#endif
+
   // this can be overloaded by derived classes
   virtual bool isActive() { return m_isActive; }
 
@@ -180,6 +213,9 @@ class IECDevice
   // send pulse on SRQ line (if SRQ pin was set in IECBusHandler constructor)
   void sendSRQ();
 
+  // returns the protocol (IEC_PROTOCOL_*) used by the current transaction
+  uint8_t getProtocol();
+
  protected:
   bool       m_isActive;
   uint8_t    m_devnr;
@@ -77,12 +77,56 @@ void dbg_data(uint8_t data)
 #define IFD_EXEC  3
 #define IFD_WRITE 4
 
+// transfer protocols that uploaded drive code can be dispatched to
+#define DRIVECODE_NONE 0
+#define DRIVECODE_EPYX 1
+
+// Known drive code uploads: the sequence of M-W commands (address, length and
+// 8-bit checksum of the data for each) followed by the M-E address, see checkDriveCode()
+//
+// Only loaders with a transfer protocol implemented in IECBusHandler are listed.
+// Final Cartridge III, Action Replay, Dreamload and ULoad are not: each needs
+// its own bit-level protocol emulation, plus upload sequences captured on real
+// hardware (iecDrive::execute() logs the M-W/M-E commands it receives). A guessed
+// entry would switch the bus into a protocol the C64 isn't speaking and hang the
+// load, while an unknown upload just falls back to the standard protocol.
+#define DRIVECODE_MAX_WRITES 3
+
+struct DriveCodeWrite
+{
+  uint16_t addr;
+  uint8_t  len, checksum;
+};
+
+struct DriveCodeSignature
+{
+  uint8_t        numWrites;
+  DriveCodeWrite writes[DRIVECODE_MAX_WRITES];
+  uint16_t       execAddr;
+  uint8_t        protocol;
+  const char    *name;
+};
+
+static const DriveCodeSignature driveCodeSignatures[] =
+  {
+#ifdef SUPPORT_EPYX
+    { 2, {{0x0180, 0x20, 0x2E}, {0x01A0, 0x20, 0xA5}}, 0x01A2, DRIVECODE_EPYX, "Epyx FastLoad V1" },
+    { 3, {{0x0180, 0x19, 0x53}, {0x0199, 0x19, 0xA6}, {0x01B2, 0x19, 0x8F}}, 0x01A9, DRIVECODE_EPYX, "Epyx FastLoad V2/V3" },
+#endif
+    { 0, {}, 0, DRIVECODE_NONE, NULL }
+  };
+
+// one bit per signature in m_driveCodeMatch
+#define DRIVECODE_MATCH_ALL 0xFFFF
+static_assert(sizeof(driveCodeSignatures)/sizeof(driveCodeSignatures[0]) <= 16, "too many drive code signatures");
+
 
 IECFileDevice::IECFileDevice(uint8_t devnr) : 
   IECDevice(devnr)
 {
   m_cmd = IFD_NONE;
   m_opening = false;
+  m_received = false;
 }
 
 
@@ -109,10 +153,15 @@ void IECFileDevice::begin()
 #endif
 #ifdef SUPPORT_EPYX
   ok = IECDevice::enableEpyxFastLoadSupport(true);
-  m_epyxCtr = 0;
 #if DEBUG>0
   Serial.print(F("Epyx FastLoad support ")); Serial.println(ok ? F("enabled") : F("disabled"));
 #endif
+#endif
+#ifdef SUPPORT_BURST
+  ok = IECDevice::enableBurstSupport(true);
+#if DEBUG>0
+  Serial.print(F("Burst mode support ")); Serial.println(ok ? F("enabled") : F("disabled"));
+#endif
 #endif
 
   m_statusBufferPtr = 0;
@@ -122,6 +171,9 @@ void IECFileDevice::begin()
   m_cmd = IFD_NONE;
   m_channel = 0xFF;
   m_opening = false;
+  m_received = false;
+  m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+  m_driveCodeWrites = 0;
 
   // calling fileTask() may result in significant time spent accessing the
   // disk during which we can not respond to ATN requests within the required
@@ -308,6 +360,7 @@ void IECFileDevice::write(uint8_t data, bool eoi)
 
   if( m_writeBufferLen<IECFILEDEVICE_WRITE_BUFFER_SIZE-1 )
     m_writeBuffer[m_writeBufferLen++] = data;
+  m_received = true;
  
 #if DEBUG>1
   Serial.write('W'); print_hex(data);
@@ -326,6 +379,7 @@ uint8_t IECFileDevice::write(uint8_t *buffer, uint8_t bufferSize, bool eoi)
 
       // now send data
       uint8_t nn = write(m_channel, buffer, bufferSize);
+      if( nn>0 ) m_received = true;
 #if DEBUG>0
       for(uint8_t i=0; i<nn; i++) dbg_data(buffer[i]);
 #endif
@@ -352,6 +406,9 @@ void IECFileDevice::untalk()
   Serial.write('t');
 #endif
 
+  if( m_channel<15 && m_readBufferLen[m_channel]==0 )
+    endTransfer(m_channel, true);
+
   // no current channel
   m_channel = 0xFF; 
 }
@@ -363,6 +420,7 @@ void IECFileDevice::listen(uint8_t secondary)
   Serial.write('L'); print_hex(secondary);
 #endif
   m_channel = secondary & 0x0F;
+  m_received = false;
 
   if( m_channel==15 )
     m_writeBufferLen = 0;
@@ -402,8 +460,10 @@ void IECFileDevice::unlisten()
       m_cmd = IFD_OPEN;
       // m_channel gets set to 0xFF after IFD_OPEN is processed
     }
-  else if( m_writeBufferLen>0 )
+  else if( m_channel<15 && m_cmd!=IFD_CLOSE && m_received )
     {
+      // data was sent to the channel during this LISTEN (also with an empty
+      // buffer if it was passed on already, so endTransfer() gets called)
       m_cmd = IFD_WRITE;
       // m_channel gets set to 0xFF after IFD_WRITE is processed
     }
@@ -441,6 +501,13 @@ bool IECFileDevice::epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buff
 #endif
 
 
+void IECFileDevice::clearReadBuffer(uint8_t channel)
+{
+  if( channel<15 && m_readBufferLen[channel]>0 )
+    m_readBufferLen[channel] = 0;
+}
+
+
 void IECFileDevice::fillReadBuffer()
 {
   if( m_readBufferLen[m_channel]<2 )
@@ -523,6 +590,7 @@ void IECFileDevice::fileTask()
         // note: any data that cannot be sent on at this point is lost!
         emptyWriteBuffer();
         m_writeBufferLen = 0;
+        endTransfer(m_channel, false);
         m_channel = 0xFF;
         break;
       }
@@ -545,33 +613,7 @@ void IECFileDevice::fileTask()
             Serial.print(F("EXECUTE: ")); Serial.println(cmd);
           }
 #endif
-#ifdef SUPPORT_EPYX
-        if     ( m_epyxCtr== 0 && checkMWcmd(0x0180, 0x20, 0x2E) )
-          { m_epyxCtr = 11; handled = true; }
-        else if( m_epyxCtr==11 && checkMWcmd(0x01A0, 0x20, 0xA5) )
-          { m_epyxCtr = 12; handled = true; }
-        else if( m_epyxCtr==12 && strncmp_P(cmd, PSTR("M-E\xa2\x01"), 5)==0 )
-          { m_epyxCtr = 99; handled = true; } // EPYX V1
-        else if( m_epyxCtr== 0 && checkMWcmd(0x0180, 0x19, 0x53) )
-          { m_epyxCtr = 21; handled = true; }
-        else if( m_epyxCtr==21 && checkMWcmd(0x0199, 0x19, 0xA6) )
-          { m_epyxCtr = 22; handled = true; }
-        else if( m_epyxCtr==22 && checkMWcmd(0x01B2, 0x19, 0x8F) )
-          { m_epyxCtr = 23; handled = true; }
-        else if( m_epyxCtr==23 && strncmp_P(cmd, PSTR("M-E\xa9\x01"), 5)==0 )
-          { m_epyxCtr = 99; handled = true; } // EPYX V2 or V3
-        else
-          m_epyxCtr = 0;
-
-        if( m_epyxCtr==99 )
-          {
-#if DEBUG>0
-            Serial.println(F("EPYX FASTLOAD DETECTED"));
-#endif
-            epyxLoadRequest();
-            m_epyxCtr = 0;
-          }
-#endif
+        handled = checkDriveCode(cmd);
 #ifdef SUPPORT_DOLPHIN
         if( strcmp_P(cmd, PSTR("XQ"))==0 )
           { dolphinBurstTransmitRequest(); m_channel = 0; handled = true; }
@@ -581,6 +623,38 @@ void IECFileDevice::fileTask()
           { enableDolphinBurstMode(true); setStatus(NULL, 0); handled = true; }
         else if( strcmp_P(cmd, PSTR("XF-"))==0 )
           { enableDolphinBurstMode(false); setStatus(NULL, 0); handled = true; }
+#endif
+#ifdef SUPPORT_BURST
+        // 1571/1581 burst commands: "U0" followed by a binary command byte
+        // (the "U0>..." utility commands are passed on to execute())
+        if( !handled && m_writeBufferLen>=3 && cmd[0]=='U' && cmd[1]=='0' && cmd[2]!='>' )
+          {
+            uint8_t bcmd = m_writeBuffer[2];
+            if( (bcmd & 0x1F)==0x1F )
+              {
+                // fastload => open file on channel 0, data is sent by the bus handler
+                if( m_writeBufferLen>3 && burstLoadRequest() )
+                  {
+#if DEBUG>0
+                    Serial.println(F("BURST FASTLOAD"));
+#endif
+                    m_readBufferLen[0] = open(0, cmd+3) ? 0 : -128;
+                    m_channel = 0;
+                    handled = true;
+                  }
+              }
+            else if( (bcmd & 0x0F)==0x00 || (bcmd & 0x0F)==0x02 )
+              {
+                // sector read/write: track, sector [, number of sectors]
+                if( m_writeBufferLen>=5 )
+                  handled = burstSectorRequest(bcmd, m_writeBuffer[3], m_writeBuffer[4], m_writeBufferLen>=6 ? m_writeBuffer[5] : 1);
+              }
+            else if( (bcmd & 0x0F)==0x04 )
+              {
+                // inquire disk
+                handled = burstSectorRequest(bcmd, 0, 0, 0);
+              }
+          }
 #endif
         if( !handled ) execute(cmd, m_writeBufferLen);
         m_writeBufferLen = 0;
@@ -592,20 +666,83 @@ void IECFileDevice::fileTask()
 }
 
 
-bool IECFileDevice::checkMWcmd(uint16_t addr, uint8_t len, uint8_t checksum) const
+bool IECFileDevice::matchDriveCodeWrite(uint16_t addr, uint8_t len, uint8_t checksum)
 {
-  // check buffer length and M-W command
-  if( m_writeBufferLen<len+6 || strncmp_P((const char *) m_writeBuffer, PSTR("M-W"), 3)!=0 )
-    return false;
-
-  // check data length and destination address
-  if( m_writeBuffer[3]!=(addr&0xFF) || m_writeBuffer[4]!=((addr>>8)&0xFF) || m_writeBuffer[5]!=len )
-    return false;
-
-  // check checksum
-  uint8_t c = 0;
-  for(uint8_t i=0; i<len; i++) c += m_writeBuffer[6+i];
-  return c==checksum;
+  // keep the signatures whose next M-W is this one
+  uint16_t match = 0;
+  for(uint8_t i=0; driveCodeSignatures[i].protocol!=DRIVECODE_NONE; i++)
+    {
+      const DriveCodeSignature &sig = driveCodeSignatures[i];
+      if( (m_driveCodeMatch & (1U<<i)) && m_driveCodeWrites<sig.numWrites )
+        {
+          const DriveCodeWrite &w = sig.writes[m_driveCodeWrites];
+          if( w.addr==addr && w.len==len && w.checksum==checksum ) match |= 1U<<i;
+        }
+    }
+
+  m_driveCodeMatch = match;
+  m_driveCodeWrites++;
+  return match!=0;
+}
+
+
+bool IECFileDevice::checkDriveCode(const char *cmd)
+{
+  // returns true if the command was part of a known drive code upload that we handled,
+  // any other M-W/M-E is passed on to execute() like a regular command
+  if( m_writeBufferLen>=6 && strncmp_P(cmd, PSTR("M-W"), 3)==0 && m_writeBufferLen>=m_writeBuffer[5]+6 )
+    {
+      uint16_t addr = m_writeBuffer[3] | (m_writeBuffer[4] << 8);
+      uint8_t len = m_writeBuffer[5], checksum = 0;
+      for(uint8_t i=0; i<len; i++) checksum += m_writeBuffer[6+i];
+
+      if( matchDriveCodeWrite(addr, len, checksum) )
+        return true;
+
+      // no longer a known sequence => this may be the first M-W of another one
+      bool first = m_driveCodeWrites==1;
+      m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+      m_driveCodeWrites = 0;
+      if( !first && matchDriveCodeWrite(addr, len, checksum) )
+        return true;
+
+      m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+      m_driveCodeWrites = 0;
+      return false;
+    }
+  else if( m_writeBufferLen>=5 && strncmp_P(cmd, PSTR("M-E"), 3)==0 && m_driveCodeWrites>0 )
+    {
+      uint16_t addr = m_writeBuffer[3] | (m_writeBuffer[4] << 8);
+      uint8_t protocol = DRIVECODE_NONE;
+      for(uint8_t i=0; driveCodeSignatures[i].protocol!=DRIVECODE_NONE; i++)
+        {
+          const DriveCodeSignature &sig = driveCodeSignatures[i];
+          if( (m_driveCodeMatch & (1U<<i)) && sig.numWrites==m_driveCodeWrites && sig.execAddr==addr )
+            {
+              protocol = sig.protocol;
+#if DEBUG>0
+              Serial.print(F("DRIVE CODE DETECTED: ")); Serial.println(sig.name);
+#endif
+              break;
+            }
+        }
+
+      m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+      m_driveCodeWrites = 0;
+
+      switch( protocol )
+        {
+#ifdef SUPPORT_EPYX
+        case DRIVECODE_EPYX: epyxLoadRequest(); return true;
+#endif
+        default: return false;
+        }
+    }
+
+  // any other command ends the current upload sequence
+  m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+  m_driveCodeWrites = 0;
+  return false;
 }
 
 
@@ -647,10 +784,9 @@ void IECFileDevice::reset()
   m_channel = 0xFF;
   m_cmd = IFD_NONE;
   m_opening = false;
-
-#ifdef SUPPORT_EPYX
-  m_epyxCtr = 0;
-#endif
+  m_received = false;
+  m_driveCodeMatch  = DRIVECODE_MATCH_ALL;
+  m_driveCodeWrites = 0;
 
   IECDevice::reset();
 }
@@ -75,6 +75,17 @@ class IECFileDevice : public IECDevice
   // called on falling edge of RESET line
   virtual void reset();
 
+  // called when the bus master ends a data transfer on channel 0-14. For UNTALK
+  // (talk=true) this is only called if all data returned by read() has been sent
+  // and must return quickly. For UNLISTEN (talk=false) it is called after the
+  // last write() call for the transfer.
+  // (used for relative files where each transfer reads/writes one record)
+  virtual void endTransfer(uint8_t channel, bool talk) {}
+
+  // can be called by derived class to discard data that was already returned by
+  // read() for channel but not yet sent (e.g. after re-positioning within the file)
+  void clearReadBuffer(uint8_t channel);
+
   // can be called by derived class to set the status buffer
   void setStatus(const char *data, uint8_t dataLen);
 
@@ -104,9 +115,10 @@ class IECFileDevice : public IECDevice
   void fillReadBuffer();
   void emptyWriteBuffer();
   void fileTask();
-  bool checkMWcmd(uint16_t addr, uint8_t len, uint8_t checksum) const;
+  bool checkDriveCode(const char *cmd);
+  bool matchDriveCodeWrite(uint16_t addr, uint8_t len, uint8_t checksum);
 
-  bool    m_opening, m_canServeATN;
+  bool    m_opening, m_canServeATN, m_received;
   uint8_t m_channel, m_cmd;
   uint8_t m_writeBuffer[IECFILEDEVICE_WRITE_BUFFER_SIZE];
 
@@ -114,9 +126,8 @@ class IECFileDevice : public IECDevice
   int8_t  m_statusBufferLen, m_statusBufferPtr, m_writeBufferLen, m_readBufferLen[15];
   char    m_statusBuffer[IECFILEDEVICE_STATUS_BUFFER_SIZE];
 
-#ifdef SUPPORT_EPYX
-  uint8_t m_epyxCtr;
-#endif
+  uint16_t m_driveCodeMatch;   // signatures matching the M-W commands received so far
+  uint8_t  m_driveCodeWrites;
 };
 
 
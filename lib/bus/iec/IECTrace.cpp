@@ -0,0 +1,260 @@
+// IEC bus tracing, see IECTrace.h
+
+#include "IECTrace.h"
+
+#if IEC_TRACE_BUFFER_SIZE>0
+
+#include <stdio.h>
+#include <string.h>
+
+
+static const char *protocolName(uint8_t type)
+{
+  switch( type & 0x70 )
+    {
+    case IEC_TRACE_JIFFY:   return "jiffy";
+    case IEC_TRACE_EPYX:    return "epyx";
+    case IEC_TRACE_DOLPHIN: return "dolphin";
+    case IEC_TRACE_BURST:   return "burst";
+    default:                return "standard";
+    }
+}
+
+
+static const char *eventName(uint8_t type)
+{
+  switch( type & 0x07 )
+    {
+    case IEC_TRACE_ATN:      return "atn";
+    case IEC_TRACE_RECEIVE:  return "receive";
+    case IEC_TRACE_SEND:     return "send";
+    case IEC_TRACE_BLOCK_RX: return "block_receive";
+    case IEC_TRACE_BLOCK_TX: return "block_send";
+    case IEC_TRACE_ERROR:    return "error";
+    case IEC_TRACE_RESET:    return "reset";
+    default:                 return "unknown";
+    }
+}
+
+
+// decodes a byte sent under ATN
+static void atnCommand(uint8_t data, char *buf, size_t len)
+{
+  if( data==0x3F )
+    snprintf(buf, len, "UNLISTEN");
+  else if( data==0x5F )
+    snprintf(buf, len, "UNTALK");
+  else if( (data & 0xE0)==0x20 )
+    snprintf(buf, len, "LISTEN %u", data & 0x1F);
+  else if( (data & 0xE0)==0x40 )
+    snprintf(buf, len, "TALK %u", data & 0x1F);
+  else if( (data & 0xF0)==0x60 )
+    snprintf(buf, len, "DATA %u", data & 0x0F);
+  else if( (data & 0xF0)==0xE0 )
+    snprintf(buf, len, "CLOSE %u", data & 0x0F);
+  else if( (data & 0xF0)==0xF0 )
+    snprintf(buf, len, "OPEN %u", data & 0x0F);
+  else
+    snprintf(buf, len, "$%02X", data);
+}
+
+
+IECTrace::IECTrace()
+{
+  m_entries    = NULL;
+  m_count      = 0;
+  m_clearCount = 0;
+  m_enabled    = false;
+}
+
+
+IECTrace::~IECTrace()
+{
+  m_enabled = false;
+  delete [] m_entries;
+}
+
+
+void IECTrace::enable(bool enable)
+{
+  // buffer is allocated on first use and kept afterwards since the
+  // bus handler may be recording while we get here
+  if( enable && m_entries==NULL )
+    {
+      m_entries = new IECTraceEntry[IEC_TRACE_BUFFER_SIZE];
+      if( m_entries==NULL ) return;
+    }
+
+  m_enabled = enable;
+}
+
+
+void IECTrace::clear()
+{
+  m_clearCount = m_count.load(std::memory_order_acquire);
+}
+
+
+uint32_t IECTrace::snapshot(std::vector<IECTraceEntry> &entries)
+{
+  entries.clear();
+  if( m_entries==NULL ) return 0;
+
+  uint32_t end   = m_count.load(std::memory_order_acquire);
+  uint32_t total = end - m_clearCount;
+  uint32_t n     = total < IEC_TRACE_BUFFER_SIZE ? total : IEC_TRACE_BUFFER_SIZE;
+
+  entries.resize(n);
+  for(uint32_t i=0; i<n; i++)
+    entries[i] = m_entries[(end-n+i) & (IEC_TRACE_BUFFER_SIZE-1)];
+
+  // entries older than one buffer length before the current count have been
+  // overwritten while we were copying
+  uint32_t now = m_count.load(std::memory_order_acquire);
+  uint32_t overwritten = (now-end) > (IEC_TRACE_BUFFER_SIZE-n) ? (now-end) - (IEC_TRACE_BUFFER_SIZE-n) : 0;
+  if( overwritten>n ) overwritten = n;
+  entries.erase(entries.begin(), entries.begin()+overwritten);
+
+  return total - entries.size();
+}
+
+
+void IECTrace::writeJSON(Writer out)
+{
+  std::vector<IECTraceEntry> entries;
+  uint32_t lost = snapshot(entries);
+  uint32_t t0 = entries.empty() ? 0 : entries[0].time - entries[0].duration;
+
+  char buf[160], cmd[20];
+  int len = snprintf(buf, sizeof(buf), "{\"available\":true,\"enabled\":%s,\"lost\":%u,\"time_unit\":\"us\",\"events\":[", m_enabled ? "true" : "false", (unsigned) lost);
+  out(buf, len);
+
+  for(size_t i=0; i<entries.size(); i++)
+    {
+      const IECTraceEntry &e = entries[i];
+      uint8_t ev = e.type & 0x07;
+      if( ev==IEC_TRACE_ATN )
+        atnCommand(e.data, cmd, sizeof(cmd));
+      else
+        cmd[0] = 0;
+
+      len = snprintf(buf, sizeof(buf), "%s{\"t\":%u,\"dur\":%u,\"event\":\"%s\",\"protocol\":\"%s\",\"data\":%u,\"eoi\":%s%s%s%s}",
+                     i>0 ? "," : "", (unsigned) (e.time-t0), e.duration, eventName(e.type), protocolName(e.type), e.data,
+                     (e.type & IEC_TRACE_EOI) ? "true" : "false",
+                     cmd[0] ? ",\"command\":\"" : "", cmd, cmd[0] ? "\"" : "");
+      out(buf, len);
+    }
+
+  // summarize transactions: a LISTEN/TALK plus secondary address under ATN starts a
+  // transaction which collects all data events until the next ATN sequence
+  out("],\"transactions\":[", 18);
+  bool first = true, open = false;
+  int device = -1, secondary = -1;
+  bool talk = false;
+  uint32_t start = 0, last = 0, bytes = 0;
+  uint8_t protocol = 0, eoi = 0;
+  for(size_t i=0; i<=entries.size(); i++)
+    {
+      const IECTraceEntry *e = i<entries.size() ? &entries[i] : NULL;
+      uint8_t ev = e ? (e->type & 0x07) : 0;
+
+      if( open && (e==NULL || ev==IEC_TRACE_ATN || ev==IEC_TRACE_RESET) )
+        {
+          len = snprintf(buf, sizeof(buf), "%s{\"t\":%u,\"dur\":%u,\"device\":%d,\"secondary\":%d,\"direction\":\"%s\",\"protocol\":\"%s\",\"bytes\":%u,\"eoi\":%s}",
+                         first ? "" : ",", (unsigned) (start-t0), (unsigned) (last-start), device, secondary,
+                         talk ? "talk" : "listen", protocolName(protocol), (unsigned) bytes, eoi ? "true" : "false");
+          out(buf, len);
+          first = false;
+          open = false;
+        }
+
+      if( e==NULL )
+        break;
+      else if( ev==IEC_TRACE_ATN )
+        {
+          if( e->data==0x3F || e->data==0x5F )
+            { device = -1; secondary = -1; }
+          else if( (e->data & 0xE0)==0x20 || (e->data & 0xE0)==0x40 )
+            { device = e->data & 0x1F; talk = (e->data & 0xE0)==0x40; secondary = -1; }
+          else if( device>=0 && (e->data & 0x60)==0x60 )
+            secondary = e->data;
+        }
+      else if( ev!=IEC_TRACE_RESET && ev!=IEC_TRACE_ERROR )
+        {
+          if( !open )
+            {
+              // fast-load block transfers happen outside of an ATN sequence
+              open = true;
+              start = e->time - e->duration;
+              bytes = 0;
+              eoi = 0;
+              protocol = e->type & 0x70;
+              if( ev==IEC_TRACE_BLOCK_TX || ev==IEC_TRACE_SEND ) talk = true;
+              if( ev==IEC_TRACE_BLOCK_RX || ev==IEC_TRACE_RECEIVE ) talk = false;
+            }
+
+          if( ev==IEC_TRACE_BLOCK_RX || ev==IEC_TRACE_BLOCK_TX )
+            bytes += (e->data==0 && !(e->type & IEC_TRACE_EOI)) ? 256 : e->data;
+          else
+            bytes++;
+          eoi |= e->type & IEC_TRACE_EOI;
+          last = e->time;
+        }
+    }
+
+  out("]}", 2);
+}
+
+
+void IECTrace::writeVCD(Writer out)
+{
+  std::vector<IECTraceEntry> entries;
+  snapshot(entries);
+  uint32_t t0 = entries.empty() ? 0 : entries[0].time - entries[0].duration;
+
+  static const char header[] =
+    "$version FujiNet IEC bus trace $end\n"
+    "$timescale 1us $end\n"
+    "$scope module iec $end\n"
+    "$var wire 1 a atn $end\n"
+    "$var wire 1 b busy $end\n"
+    "$var wire 1 c eoi $end\n"
+    "$var wire 1 d talk $end\n"
+    "$var wire 1 e error $end\n"
+    "$var wire 8 f data $end\n"
+    "$var wire 3 g protocol $end\n"
+    "$upscope $end\n"
+    "$enddefinitions $end\n"
+    "#0\n$dumpvars\n0a\n0b\n0c\n0d\n0e\nb0 f\nb0 g\n$end\n";
+  out(header, sizeof(header)-1);
+
+  // each event is shown as a "busy" pulse covering its handshake duration,
+  // VCD timestamps must increase so overlapping events are moved forward
+  char buf[100], bits[9];
+  uint32_t prev = 0;
+  for(size_t i=0; i<entries.size(); i++)
+    {
+      const IECTraceEntry &e = entries[i];
+      uint8_t ev = e.type & 0x07;
+      uint32_t end   = e.time - t0;
+      uint32_t start = end - e.duration;
+      if( start<=prev ) start = prev+1;
+      if( end<=start ) end = start+1;
+
+      for(int b=0; b<8; b++) bits[b] = (e.data & (0x80>>b)) ? '1' : '0';
+      bits[8] = 0;
+
+      int len = snprintf(buf, sizeof(buf), "#%u\n%ca\n1b\n%cc\n%cd\n%ce\nb%s f\nb%u%u%u g\n", (unsigned) start,
+                         ev==IEC_TRACE_ATN ? '1' : '0', (e.type & IEC_TRACE_EOI) ? '1' : '0',
+                         (ev==IEC_TRACE_SEND || ev==IEC_TRACE_BLOCK_TX) ? '1' : '0',
+                         (ev==IEC_TRACE_ERROR || ev==IEC_TRACE_RESET) ? '1' : '0', bits,
+                         (e.type >> 6) & 1, (e.type >> 5) & 1, (e.type >> 4) & 1);
+      out(buf, len);
+
+      len = snprintf(buf, sizeof(buf), "#%u\n0a\n0b\n0e\n", (unsigned) end);
+      out(buf, len);
+      prev = end;
+    }
+}
+
+#endif
@@ -0,0 +1,95 @@
+// IEC bus tracing: records bus events (ATN bytes, data bytes, fast-load
+// blocks, errors, resets) into a ring buffer and exports them as JSON or as a
+// VCD waveform for /iectrace. Compiled out when IEC_TRACE_BUFFER_SIZE is 0.
+
+#ifndef IECTRACE_H
+#define IECTRACE_H
+
+#include "IECConfig.h"
+#include <stdint.h>
+
+#if IEC_TRACE_BUFFER_SIZE>0
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#if (IEC_TRACE_BUFFER_SIZE & (IEC_TRACE_BUFFER_SIZE-1))!=0
+#error "IEC_TRACE_BUFFER_SIZE must be a power of 2"
+#endif
+
+// event (bits 0-2 of IECTraceEntry::type)
+#define IEC_TRACE_ATN       1  // byte received under ATN (data=byte)
+#define IEC_TRACE_RECEIVE   2  // data byte received (data=byte)
+#define IEC_TRACE_SEND      3  // data byte sent (data=byte)
+#define IEC_TRACE_BLOCK_RX  4  // block received by a fast-load protocol (data=number of bytes, 0=256 unless EOI)
+#define IEC_TRACE_BLOCK_TX  5  // block sent by a fast-load protocol (data=number of bytes, 0=256 unless EOI)
+#define IEC_TRACE_ERROR     6  // transfer aborted (timeout, ATN or device had no data)
+#define IEC_TRACE_RESET     7  // falling edge on RESET
+
+// flag (bit 3)
+#define IEC_TRACE_EOI       0x08
+
+// protocol (bits 4-6)
+#define IEC_TRACE_STANDARD  0x00
+#define IEC_TRACE_JIFFY     0x10
+#define IEC_TRACE_EPYX      0x20
+#define IEC_TRACE_DOLPHIN   0x30
+#define IEC_TRACE_BURST     0x40
+
+struct IECTraceEntry
+{
+  uint32_t time;      // micros() at end of the event
+  uint16_t duration;  // microseconds from start of handshake to end of event
+  uint8_t  type;      // event | flags | protocol
+  uint8_t  data;
+};
+
+
+// Ring buffer of bus events, written by the bus handler (single producer) and
+// read without locking: readers copy the buffer and drop entries that were
+// overwritten while copying.
+class IECTrace
+{
+ public:
+  typedef std::function<void(const char *data, size_t len)> Writer;
+
+  IECTrace();
+  ~IECTrace();
+
+  void enable(bool enable);
+  bool isEnabled() { return m_enabled; }
+  void clear();
+
+  // called by the bus handler, must be quick
+  inline void record(uint8_t type, uint8_t data, uint32_t start, uint32_t end)
+  {
+    uint32_t n = m_count.load(std::memory_order_relaxed);
+    IECTraceEntry &e = m_entries[n & (IEC_TRACE_BUFFER_SIZE-1)];
+    e.time     = end;
+    e.duration = (end-start)>0xFFFF ? 0xFFFF : (end-start);
+    e.type     = type;
+    e.data     = data;
+    m_count.store(n+1, std::memory_order_release);
+  }
+
+  // copies recorded entries (oldest first), returns the number of entries
+  // that were lost because the buffer wrapped around
+  uint32_t snapshot(std::vector<IECTraceEntry> &entries);
+
+  // events and per-transaction summaries (device, secondary address, protocol, byte count)
+  void writeJSON(Writer out);
+
+  // waveform for sigrok/GTKWave (1us timescale)
+  void writeVCD(Writer out);
+
+ private:
+  IECTraceEntry *m_entries;
+  std::atomic<uint32_t> m_count;
+  uint32_t m_clearCount;   // value of m_count at the last clear()
+  volatile bool m_enabled;
+};
+
+#endif
+
+#endif
@@ -12,6 +12,10 @@
 
 systemBus IEC;
 
+#if defined(SUPPORT_BURST) && defined(PINMAP_IEC_D32PRO)
+#error "Burst mode needs the SRQ line, which is PIN_DEBUG on this board"
+#endif
+
 systemBus::systemBus() : IECBusHandler(PIN_IEC_ATN, PIN_IEC_CLK_OUT, PIN_IEC_DATA_OUT,
                                        PIN_IEC_RESET==GPIO_NUM_NC ? 0xFF : PIN_IEC_RESET,
                                        0xFF,
@@ -38,6 +42,9 @@ void systemBus::setup()
 #ifdef SUPPORT_DOLPHIN
   Debug_printf("DolphinDOS protocol supported\r\n");
 #endif
+#ifdef SUPPORT_BURST
+  Debug_printf("1571/1581 burst mode protocol supported\r\n");
+#endif
 }
 
 
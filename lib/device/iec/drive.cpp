@@ -5,6 +5,9 @@
 #include <cstring>
 #include <sstream>
 #include <unordered_map>
+#include <dirent.h>
+
+#include <esp_heap_caps.h>
 
 #include "../../include/debug.h"
 #include "../../include/cbm_defines.h"
@@ -28,15 +31,22 @@
 
 #define ST_OK                  0
 #define ST_SCRATCHED           1
+#define ST_READ_ERROR         20
 #define ST_WRITE_ERROR        25
 #define ST_WRITE_PROTECT      26
 #define ST_SYNTAX_ERROR_31    31
 #define ST_SYNTAX_ERROR_33    33
+#define ST_RECORD_NOT_PRESENT 50
+#define ST_OVERFLOW_IN_RECORD 51
+#define ST_FILE_TOO_LARGE     52
 #define ST_FILE_NOT_OPEN      61
 #define ST_FILE_NOT_FOUND     62
 #define ST_FILE_EXISTS        63
 #define ST_FILE_TYPE_MISMATCH 64
+#define ST_NO_BLOCK           65
+#define ST_ILLEGAL_TRACK_SECTOR 66
 #define ST_NO_CHANNEL         70
+#define ST_DISK_FULL          72
 #define ST_SPLASH             73
 #define ST_DRIVE_NOT_READY    74
 
@@ -59,516 +69,2596 @@ static bool isMatch(std::string name, std::string pattern)
 }
 
 
+// file name of a directory entry (bytes 5-20, padded with shifted spaces)
+static std::string getEntryName(const uint8_t *entry)
+{
+  std::string name((const char *) entry+5, 16);
+  size_t p = name.find('\xa0');
+  if( p!=std::string::npos ) name.resize(p);
+  return name;
+}
+
+
+static void setEntryName(uint8_t *entry, const std::string &name)
+{
+  memset(entry+5, 0xA0, 16);
+  memcpy(entry+5, name.data(), std::min(name.length(), (size_t) 16));
+}
+
+
 // -------------------------------------------------------------------------------------------------
 
 
-iecChannelHandler::iecChannelHandler(iecDrive *drive)
-{ 
-  m_drive = drive;
-  m_data = new uint8_t[BUFFER_SIZE]; 
-  m_len = 0; 
-  m_ptr = 0; 
+iecTrackCache::iecTrackCache()
+{
+  m_useCounter = 0;
+  m_lastWrite  = 0;
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
+    {
+      // track buffers are allocated when first used, most drives never access sectors
+      m_entries[i].data = nullptr;
+      m_entries[i].numSectors = 0;
+      m_entries[i].dirty = 0;
+    }
 }
 
 
-iecChannelHandler::~iecChannelHandler()
-{ 
-  delete [] m_data; 
+iecTrackCache::~iecTrackCache()
+{
+  freeEntries();
 }
 
 
-uint8_t iecChannelHandler::read(uint8_t *data, uint8_t n)
+void iecTrackCache::freeEntries()
 {
-  // if buffer is empty then re-fill it
-  if( m_ptr >= m_len )
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
     {
-      m_ptr = 0;
-      m_len = 0;
+      heap_caps_free(m_entries[i].data);
+      m_entries[i].data = nullptr;
+    }
+}
 
-      uint8_t st = readBufferData();
-      if( st!=ST_OK )
-        {
-          m_drive->setStatusCode(st);
-          return 0;
-        }
+
+void iecTrackCache::clear()
+{
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
+    {
+      m_entries[i].numSectors = 0;
+      m_entries[i].dirty = 0;
     }
 
-  // read data from buffer
-  if( m_ptr < m_len )
+  freeEntries();
+}
+
+
+bool iecTrackCache::isDirty()
+{
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
+    if( m_entries[i].dirty!=0 )
+      return true;
+
+  return false;
+}
+
+
+bool iecTrackCache::isCached(uint8_t track, uint8_t sector)
+{
+  return findEntry(track, sector)!=nullptr;
+}
+
+
+iecTrackCache::Entry *iecTrackCache::findEntry(uint8_t track, uint8_t sector)
+{
+  uint8_t firstSector = (sector / IEC_TRACKCACHE_MAX_SECTORS) * IEC_TRACKCACHE_MAX_SECTORS;
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
     {
-      if( n==1 )
-        {
-          // common case during regular (non-fastloader) load
-          data[0] = m_data[m_ptr++];
-          return 1;
-        }
-      else
-        {
-          // copy as much data as possible
-          n = std::min((size_t) n, (size_t) (m_len - m_ptr));
-          memcpy(data, m_data + m_ptr, n);
-          m_ptr += n;
-          return n;
-        }
+      Entry &e = m_entries[i];
+      if( e.numSectors>0 && e.track==track && e.firstSector==firstSector )
+        return &e;
     }
-  else
-    return 0;
+
+  return nullptr;
 }
 
 
-uint8_t iecChannelHandler::write(uint8_t *data, uint8_t n)
+iecTrackCache::Entry *iecTrackCache::loadEntry(MStream *image, uint8_t track, uint8_t sector, uint8_t &status)
 {
-  // if buffer is full then empty it
-  if( m_len+n > BUFFER_SIZE )
+  Entry *e = findEntry(track, sector);
+  if( e==nullptr )
     {
-      uint8_t st = writeBufferData();
-      if( st!=ST_OK )
+      // replace least recently used track
+      e = &m_entries[0];
+      for(int i=1; i<IEC_TRACKCACHE_TRACKS; i++)
+        if( m_entries[i].numSectors==0 || (e->numSectors>0 && m_entries[i].lastUsed < e->lastUsed) )
+          e = &m_entries[i];
+
+      if( e->dirty!=0 )
+        Debug_printv("Dropping modified sectors in track %d", e->track);
+
+      if( e->data==nullptr )
         {
-          m_drive->setStatusCode(st);
-          return 0;
+          // 10KB blocks would be placed in internal RAM by default, keep them in PSRAM if there is some
+          size_t size = IEC_TRACKCACHE_MAX_SECTORS*256;
+          e->data = (uint8_t *) heap_caps_malloc(size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+          if( e->data==nullptr ) e->data = (uint8_t *) heap_caps_malloc(size, MALLOC_CAP_8BIT);
+          if( e->data==nullptr )
+            {
+              Debug_printv("Error: no memory for track cache");
+              e->numSectors = 0;
+              status = ST_DRIVE_NOT_READY;
+              return nullptr;
+            }
         }
 
-      m_ptr = 0;
-      m_len = 0;
+      // read sectors until the end of the track (seekSector fails) or the
+      // maximum segment length is reached
+      e->track       = track;
+      e->firstSector = (sector / IEC_TRACKCACHE_MAX_SECTORS) * IEC_TRACKCACHE_MAX_SECTORS;
+      e->numSectors  = 0;
+      e->dirty       = 0;
+      while( e->numSectors < IEC_TRACKCACHE_MAX_SECTORS &&
+             e->firstSector + e->numSectors < 256 &&
+             image->readSector(track, e->firstSector + e->numSectors, e->data + e->numSectors*256) )
+        e->numSectors++;
+
+      Debug_printv("Cached track[%d] sectors[%d-%d]", track, e->firstSector, e->firstSector+e->numSectors-1);
     }
 
-  // write data to buffer
-  if( n==1 )
-    {
-      // common case during regular (non-fastloader) save
-      m_data[m_len++] = data[0];
-    }
-  else
+  if( sector >= e->firstSector + e->numSectors )
     {
-      // copy data
-      memcpy(m_data + m_len, data, n);
-      m_len += n;
+      status = ST_ILLEGAL_TRACK_SECTOR;
+      return nullptr;
     }
 
-  return n;
+  e->lastUsed = ++m_useCounter;
+  status = ST_OK;
+  return e;
 }
 
 
-// -------------------------------------------------------------------------------------------------
+uint8_t iecTrackCache::readSector(MStream *image, uint8_t track, uint8_t sector, uint8_t *buffer)
+{
+  uint8_t status;
+  Entry *e = loadEntry(image, track, sector, status);
+  if( e!=nullptr )
+    memcpy(buffer, e->data + (sector - e->firstSector)*256, 256);
+
+  return status;
+}
 
 
-iecChannelHandlerFile::iecChannelHandlerFile(iecDrive *drive, MStream *stream, int fixLoadAddress) : iecChannelHandler(drive)
+uint8_t iecTrackCache::writeSector(MStream *image, uint8_t track, uint8_t sector, const uint8_t *buffer)
 {
-  m_stream = stream;
-  m_fixLoadAddress = fixLoadAddress;
-  m_timeStart = esp_timer_get_time();
-  m_byteCount = 0;
-  m_transportTimeUS = 0;
+  uint8_t status;
+  Entry *e = loadEntry(image, track, sector, status);
+  if( e!=nullptr )
+    {
+      memcpy(e->data + (sector - e->firstSector)*256, buffer, 256);
+      e->dirty |= 1ULL << (sector - e->firstSector);
+      m_lastWrite = esp_timer_get_time();
+    }
+
+  return status;
 }
 
 
-iecChannelHandlerFile::~iecChannelHandlerFile()
+uint8_t iecTrackCache::flush(MStream *image)
 {
-  double seconds = (esp_timer_get_time()-m_timeStart) / 1000000.0;
+  uint8_t status = ST_OK;
+  for(int i=0; i<IEC_TRACKCACHE_TRACKS; i++)
+    {
+      Entry &e = m_entries[i];
+      for(uint8_t s=0; e.dirty!=0 && s<e.numSectors; s++)
+        if( e.dirty & (1ULL << s) )
+          {
+            if( image==nullptr || !image->writeSector(e.track, e.firstSector+s, e.data + s*256) )
+              {
+                Debug_printv("Error writing track[%d] sector[%d]", e.track, e.firstSector+s);
+                if( status==ST_OK ) status = ST_WRITE_ERROR;
+              }
 
-  if( m_stream->mode == std::ios_base::out && m_len>0 )
-    writeBufferData();
+            e.dirty &= ~(1ULL << s);
+          }
+    }
 
-  m_stream->close();
-  Debug_printv("Stream closed.");
+  return status;
+}
 
-  double cps = m_byteCount / seconds;
-  Debug_printv("%s %d bytes in %0.2f seconds @ %0.2fcps", m_stream->mode == std::ios_base::in ? "Sent" : "Received", m_byteCount, seconds, cps);
 
-  double tseconds = m_transportTimeUS / 1000000.0;
-  cps = m_byteCount / (seconds-tseconds);
-  Debug_printv("Transport (network/sd) took %0.3f seconds, pure IEC transfers @ %0.2fcps", tseconds, cps);
+// -------------------------------------------------------------------------------------------------
 
-  delete m_stream;
+
+iecDiskImage::iecDiskImage(iecDrive *drive)
+{
+  m_drive = drive;
+  m_loaded = false;
+  m_dirty = false;
+  m_writingBAM = false;
 }
 
 
-uint8_t iecChannelHandlerFile::writeBufferData()
+bool iecDiskImage::load(const std::string &url, const std::string &name)
 {
-  /*
-  // if m_stream is within a disk image then m_stream->mode does not get initialized properly!
-  if( m_stream->mode != std::ios_base::out )
-    return ST_FILE_TYPE_MISMATCH;
+  m_loaded = false;
+  m_dirty  = false;
+  m_url    = url;
+
+  if( mstr::endsWith(name, ".d64", false) )
+    { m_type = 64; m_numTracks = 35; m_dirTrack = 18; m_interleave = 10; m_dirInterleave = 3; }
+  else if( mstr::endsWith(name, ".d71", false) )
+    { m_type = 71; m_numTracks = 70; m_dirTrack = 18; m_interleave = 6; m_dirInterleave = 3; }
+  else if( mstr::endsWith(name, ".d81", false) )
+    { m_type = 81; m_numTracks = 80; m_dirTrack = 40; m_interleave = 1; m_dirInterleave = 1; }
   else
-  */
+    return false;
+
+  // header sector links to the first directory sector
+  uint8_t buffer[256];
+  if( m_drive->readSector(m_dirTrack, 0, buffer)!=ST_OK ) return false;
+  m_dirSector = buffer[1];
+
+  memset(m_free, 0, sizeof(m_free));
+  memset(m_map, 0, sizeof(m_map));
+  if( m_type==81 )
     {
-      Debug_printv("bufferSize[%d]", m_len);
-      uint64_t t = esp_timer_get_time();
-      size_t n = m_stream->write(m_data, m_len);
-      m_transportTimeUS += (esp_timer_get_time()-t);
-      m_byteCount += n;
-      if( n<m_len )
+      // BAM for tracks 1-40 in 40/1 and 41-80 in 40/2: free count followed by 5 bitmap bytes
+      for(uint8_t b=0; b<2; b++)
         {
-          Debug_printv("Error: write failed: n[%d] < m_len[%d]", n, m_len);
-          return ST_WRITE_ERROR;
+          if( m_drive->readSector(40, 1+b, buffer)!=ST_OK ) return false;
+          for(uint8_t t=1; t<=40; t++)
+            {
+              const uint8_t *p = buffer + 0x10 + (t-1)*6;
+              m_free[t+b*40] = p[0];
+              for(uint8_t i=0; i<5; i++) m_map[t+b*40] |= ((uint64_t) p[1+i]) << (i*8);
+            }
         }
     }
-  
-  return ST_OK;
-}
-
-
-uint8_t iecChannelHandlerFile::readBufferData()
-{
-  /*
-  // if m_stream is within a disk image then m_stream->mode does not get initialized properly!
-  if( m_stream->mode != std::ios_base::in )
-    return ST_FILE_TYPE_MISMATCH;
   else
-  */
     {
-      Debug_printv("size[%d] avail[%d] pos[%d]", m_stream->size(), m_stream->available(), m_stream->position());
+      // single-sided disk in a D71 image
+      if( m_type==71 && (buffer[3] & 0x80)==0 ) m_numTracks = 35;
 
-      if( m_fixLoadAddress>=0 && m_stream->position()==0 )
+      // BAM in 18/0: free count followed by 3 bitmap bytes per track
+      for(uint8_t t=1; t<=35; t++)
         {
-          uint64_t t = esp_timer_get_time();
-          m_len = m_stream->read(m_data, BUFFER_SIZE);
-          m_transportTimeUS += (esp_timer_get_time()-t);
-          if( m_len>=2 )
-            {
-              m_data[0] = (m_fixLoadAddress & 0x00FF);
-              m_data[1] = (m_fixLoadAddress & 0xFF00) >> 8;
-            }
-          m_fixLoadAddress = -1;
+          const uint8_t *p = buffer + t*4;
+          m_free[t] = p[0];
+          m_map[t]  = p[1] | (p[2] << 8) | (p[3] << 16);
         }
-      else
-        m_len = 0;
 
-      // try to fill buffer
-      while( m_len<BUFFER_SIZE && !m_stream->eos() )
+      // second side of 1571 disks: free counts in 18/0, bitmaps in 53/0
+      if( m_numTracks>35 )
         {
-          uint64_t t = esp_timer_get_time();
-          m_len += m_stream->read(m_data+m_len, BUFFER_SIZE-m_len);
-          m_transportTimeUS += (esp_timer_get_time()-t);
+          uint8_t side[256];
+          if( m_drive->readSector(53, 0, side)!=ST_OK ) return false;
+          for(uint8_t t=36; t<=70; t++)
+            {
+              const uint8_t *p = side + (t-36)*3;
+              m_free[t] = buffer[0xDD + t-36];
+              m_map[t]  = p[0] | (p[1] << 8) | (p[2] << 16);
+            }
         }
-
-      m_byteCount += m_len;
     }
 
-  return ST_OK;
+  for(uint8_t t=1; t<=m_numTracks; t++)
+    m_map[t] &= (1ULL << getSectorCount(t)) - 1;
+
+  m_loaded = true;
+  Debug_printv("Disk image [%s]: %d tracks, %d blocks free", name.c_str(), m_numTracks, blocksFree());
+  return true;
 }
 
 
-// -------------------------------------------------------------------------------------------------
+bool iecDiskImage::isBAMSector(uint8_t track, uint8_t sector)
+{
+  if( m_type==81 )
+    return track==40 && (sector==1 || sector==2);
+  else
+    return (track==18 || (m_type==71 && track==53)) && sector==0;
+}
 
 
-iecChannelHandlerDir::iecChannelHandlerDir(iecDrive *drive, MFile *dir) : iecChannelHandler(drive)
+uint8_t iecDiskImage::getSectorCount(uint8_t track)
 {
-  m_dir = dir;
-  m_headerLine = 1;
-  
-  std::string url = m_dir->host;
-  url = mstr::toPETSCII2(url);
-  std::string path = m_dir->path;
-  path = mstr::toPETSCII2(path);
-  std::string archive = m_dir->media_archive;
-  archive = mstr::toPETSCII2(archive);
-  std::string image = m_dir->media_image;
-  image = mstr::toPETSCII2(image);
-  
-  m_headers.clear();
-  if( url.size()>0 )     addExtraInfo("URL", url);
-  if( path.size()>1 )    addExtraInfo("PATH", path);
-  if( archive.size()>1 ) addExtraInfo("ARCHIVE", archive);
-  if( image.size()>0 )   addExtraInfo("IMAGE", image);
-  if( m_headers.size()>0 ) m_headers.push_back("NFO ----------------");
-  
-  // If SD Card is available and we are at the root path show it as a directory at the top
-  if( fnSDFAT.running() && m_dir->url.size() < 2 )
-    m_headers.push_back("DIR SD");
+  if( m_type==81 ) return 40;
+  if( track>35 ) track -= 35;
+  return track<18 ? 21 : (track<25 ? 19 : (track<31 ? 18 : 17));
 }
 
 
-iecChannelHandlerDir::~iecChannelHandlerDir()
+uint16_t iecDiskImage::blocksFree()
 {
-  delete m_dir;
+  uint16_t n = 0;
+  for(uint8_t t=1; t<=m_numTracks; t++)
+    if( !isSystemTrack(t) )
+      n += m_free[t];
+
+  return n;
+}
+
+
+void iecDiskImage::take(uint8_t track, uint8_t sector)
+{
+  m_map[track] &= ~(1ULL << sector);
+  if( m_free[track]>0 ) m_free[track]--;
+  m_dirty = true;
 }
 
 
-void iecChannelHandlerDir::addExtraInfo(std::string title, std::string text)
+uint8_t iecDiskImage::allocateBlock(uint8_t &track, uint8_t &sector)
 {
-  m_headers.push_back("NFO ["+title+"]");
-  while( text.size()>0 )
+  // continue on the current track, "interleave" sectors after the previous block
+  if( track>0 && track<=m_numTracks && m_free[track]>0 )
     {
-      std::string s = text.substr(0, 16);
-      m_headers.push_back("NFO "+s);
-      text.erase(0, s.size());
+      uint8_t n = getSectorCount(track);
+      for(uint8_t i=0; i<n; i++)
+        {
+          uint8_t s = (sector + m_interleave + i) % n;
+          if( isFree(track, s) )
+            {
+              take(track, s);
+              sector = s;
+              return ST_OK;
+            }
+        }
     }
+
+  // otherwise use the free track closest to the directory track
+  for(uint8_t d=1; d<m_numTracks; d++)
+    for(int i=0; i<2; i++)
+      {
+        int t = i==0 ? m_dirTrack-d : m_dirTrack+d;
+        if( t<1 || t>m_numTracks || isSystemTrack(t) || m_free[t]==0 ) continue;
+
+        uint8_t n = getSectorCount(t);
+        for(uint8_t s=0; s<n; s++)
+          if( isFree(t, s) )
+            {
+              take(t, s);
+              track  = t;
+              sector = s;
+              return ST_OK;
+            }
+      }
+
+  return ST_DISK_FULL;
 }
 
 
-uint8_t iecChannelHandlerDir::writeBufferData()
+void iecDiskImage::freeBlock(uint8_t track, uint8_t sector)
 {
-  return ST_FILE_TYPE_MISMATCH;
+  if( track>0 && track<=m_numTracks && sector<getSectorCount(track) && !isFree(track, sector) )
+    {
+      m_map[track] |= 1ULL << sector;
+      m_free[track]++;
+      m_dirty = true;
+    }
 }
 
 
-uint8_t iecChannelHandlerDir::readBufferData()
+uint8_t iecDiskImage::allocateBlockAt(uint8_t &track, uint8_t &sector)
 {
-  if( m_headerLine==1 )
+  if( !isValidBlock(track, sector) ) return ST_ILLEGAL_TRACK_SECTOR;
+
+  if( isFree(track, sector) )
     {
-      // main header line
-      m_data[0] = 0x01;
-      m_data[1] = 0x08;
-      m_data[2] = 1;
-      m_data[3] = 1;
-      m_data[4] = 0;
-      m_data[5] = 0;
-      m_data[6] = 18;
-      m_data[7] = '"';
-      std::string name = m_dir->media_header.size() ? mstr::toPETSCII2(m_dir->media_header) : PRODUCT_ID;
-      size_t n = std::min(16, (int) name.size());
-      memcpy(m_data+8, name.data(), n);
-      while( n<16 ) { m_data[8+n] = ' '; n++; }
-      sprintf((char *) m_data+24, "\" %02i 2A", m_drive->id());
-      m_len = 32;
-      m_headerLine++;
+      take(track, sector);
+      return ST_OK;
     }
-  else if( m_headerLine-2 < m_headers.size() )
-    {
-      // Send Extra INFO
-      m_data[0] = 1;
-      m_data[1] = 1;
-      m_data[2] = 0;
-      m_data[3] = 0;
 
-      std::string name = m_headers[m_headerLine-2];
-      std::string ext  = name.substr(0, 3);
+  // like the 1541: report the next free block after this one, on the following
+  // tracks (outside the directory track) if this track is full
+  for(uint8_t t=track, s=sector+1; t<=m_numTracks; t++, s=0)
+    if( (t==track || !isSystemTrack(t)) && m_free[t]>0 )
+      for(uint8_t n=getSectorCount(t); s<n; s++)
+        if( isFree(t, s) )
+          {
+            track  = t;
+            sector = s;
+            return ST_NO_BLOCK;
+          }
 
-      name = "   \"" + name.substr(4, 16) + "\"";
-      if( name.size()<21 ) name += std::string(21-name.size(), ' ');
-      name += " " + ext + "  ";
-      strcpy((char *) m_data+4, name.c_str());
-      m_data[31] = 0;
-      m_len = 32;
-      m_headerLine++;
+  track = sector = 0;
+  return ST_NO_BLOCK;
+}
+
+
+void iecDiskImage::freeChain(uint8_t track, uint8_t sector)
+{
+  // stops at blocks that are already free, so a corrupted (circular) chain ends
+  uint8_t buffer[256];
+  while( track>0 && track<=m_numTracks && sector<getSectorCount(track) && !isFree(track, sector) )
+    {
+      freeBlock(track, sector);
+      if( m_drive->readSector(track, sector, buffer)!=ST_OK ) break;
+      track  = buffer[0];
+      sector = buffer[1];
     }
-  else if( m_headerLine < 0xFF )
+}
+
+
+bool iecDiskImage::findEntry(const std::string &pattern, uint8_t *entry, uint16_t &index, uint16_t start)
+{
+  uint8_t buffer[256], track = m_dirTrack, sector = m_dirSector;
+  for(uint16_t n=0; track!=0 && n<256; n++)
     {
-      // file entries
-      std::unique_ptr<MFile> entry; 
+      if( m_drive->readSector(track, sector, buffer)!=ST_OK ) return false;
 
-      // skip over files starting with "."
-      do 
-        { 
-          entry = std::unique_ptr<MFile>( m_dir->getNextFileInDir() ); 
-          if( entry!=nullptr ) Debug_printv("%s", entry->name.c_str());
+      for(uint8_t i=0; i<8; i++)
+        {
+          const uint8_t *e = buffer + i*32;
+          if( n*8+i>=start && e[2]!=0 && isMatch(getEntryName(e), pattern) )
+            {
+              memcpy(entry, e, 32);
+              index = n*8+i;
+              return true;
+            }
         }
-      while( entry!=nullptr && entry->name[0] == '.' );
 
-      if( entry != nullptr )
+      track  = buffer[0];
+      sector = buffer[1];
+    }
+
+  return false;
+}
+
+
+uint8_t iecDiskImage::writeEntry(uint16_t index, const uint8_t *entry)
+{
+  uint8_t buffer[256], track = m_dirTrack, sector = m_dirSector;
+  for(uint16_t n=0; track!=0 && n<256; n++)
+    {
+      uint8_t st = m_drive->readSector(track, sector, buffer);
+      if( st!=ST_OK ) return st;
+
+      if( n==index/8 )
         {
-          // directory entry
-          uint16_t size = entry->blocks();
-          m_data[m_len++] = 1;
-          m_data[m_len++] = 1;
-          m_data[m_len++] = size&255;
-          m_data[m_len++] = size/256;
-          if( size<10 )    m_data[m_len++] = ' ';
-          if( size<100 )   m_data[m_len++] = ' ';
-          if( size<1000 )  m_data[m_len++] = ' ';
+          // bytes 0/1 of the first entry are the directory sector link
+          memcpy(buffer + (index%8)*32 + 2, entry+2, 30);
+          return m_drive->writeSector(track, sector, buffer);
+        }
 
-          std::string ext = entry->extension;
-          mstr::ltrim(ext);
-          if( entry->isDirectory() )
-            ext = "dir";
-          else if( ext.length()>0 )
+      track  = buffer[0];
+      sector = buffer[1];
+    }
+
+  return ST_FILE_NOT_FOUND;
+}
+
+
+uint8_t iecDiskImage::addEntry(const uint8_t *entry, uint16_t &index)
+{
+  uint8_t buffer[256], track = m_dirTrack, sector = m_dirSector;
+  for(uint16_t n=0; n<256; n++)
+    {
+      uint8_t st = m_drive->readSector(track, sector, buffer);
+      if( st!=ST_OK ) return st;
+
+      // use the first unused entry
+      for(uint8_t i=0; i<8; i++)
+        if( buffer[i*32+2]==0 )
+          {
+            memcpy(buffer + i*32 + 2, entry+2, 30);
+            index = n*8+i;
+            return m_drive->writeSector(track, sector, buffer);
+          }
+
+      if( buffer[0]==0 )
+        {
+          // directory is full => append a new directory sector on the directory track
+          uint8_t cnt = getSectorCount(m_dirTrack);
+          for(uint8_t i=0; i<cnt; i++)
             {
-              if( ext.size()>3 )
-                ext = ext.substr(0, 3);
-              else
-                ext += std::string(3-ext.size(), ' ');
+              uint8_t s = (sector + m_dirInterleave + i) % cnt;
+              if( isFree(m_dirTrack, s) )
+                {
+                  take(m_dirTrack, s);
+                  buffer[0] = m_dirTrack;
+                  buffer[1] = s;
+                  if( (st = m_drive->writeSector(track, sector, buffer))!=ST_OK ) return st;
+
+                  memset(buffer, 0, 256);
+                  buffer[1] = 0xFF;
+                  memcpy(buffer+2, entry+2, 30);
+                  index = (n+1)*8;
+                  return m_drive->writeSector(m_dirTrack, s, buffer);
+                }
             }
-          else
-            ext = "prg";
 
-          std::string name = entry->name;
-          if ( !entry->isPETSCII )
+          return ST_DISK_FULL;
+        }
+
+      track  = buffer[0];
+      sector = buffer[1];
+    }
+
+  return ST_DISK_FULL;
+}
+
+
+uint8_t iecDiskImage::writeBAM()
+{
+  if( !m_dirty ) return ST_OK;
+
+  // tells iecDrive::writeSector that these BAM writes come from here
+  m_writingBAM = true;
+
+  uint8_t buffer[256], st = ST_OK;
+  if( m_type==81 )
+    {
+      for(uint8_t b=0; st==ST_OK && b<2; b++)
+        if( (st = m_drive->readSector(40, 1+b, buffer))==ST_OK )
+          {
+            for(uint8_t t=1; t<=40; t++)
+              {
+                uint8_t *p = buffer + 0x10 + (t-1)*6;
+                p[0] = m_free[t+b*40];
+                for(uint8_t i=0; i<5; i++) p[1+i] = m_map[t+b*40] >> (i*8);
+              }
+
+            st = m_drive->writeSector(40, 1+b, buffer);
+          }
+    }
+  else if( (st = m_drive->readSector(18, 0, buffer))==ST_OK )
+    {
+      for(uint8_t t=1; t<=35; t++)
+        {
+          uint8_t *p = buffer + t*4;
+          p[0] = m_free[t];
+          p[1] = m_map[t];
+          p[2] = m_map[t] >> 8;
+          p[3] = m_map[t] >> 16;
+        }
+
+      if( m_numTracks>35 )
+        for(uint8_t t=36; t<=70; t++)
+          buffer[0xDD + t-36] = m_free[t];
+
+      st = m_drive->writeSector(18, 0, buffer);
+
+      if( st==ST_OK && m_numTracks>35 && (st = m_drive->readSector(53, 0, buffer))==ST_OK )
+        {
+          for(uint8_t t=36; t<=70; t++)
             {
-              name = mstr::toPETSCII2( name );
-              ext  = mstr::toPETSCII2( ext );
+              uint8_t *p = buffer + (t-36)*3;
+              p[0] = m_map[t];
+              p[1] = m_map[t] >> 8;
+              p[2] = m_map[t] >> 16;
             }
-          mstr::replaceAll(name, "\\", "/");
-          
-          m_data[m_len++] = '"';
-          size_t n = std::min(16, (int) name.size());
-          memcpy(m_data+m_len, name.data(), n);
-          m_len += n;
-          m_data[m_len++] = '"';
-          n = 17-n;
-          while(n-->0) m_data[m_len++] = ' ';
-          memcpy(m_data+m_len, ext.data(), 3);
-          m_len+=3;
-          while( m_len<31 ) m_data[m_len++] = ' ';
-          m_data[31] = 0;
-          m_len = 32;
+
+          st = m_drive->writeSector(53, 0, buffer);
         }
-      else
+    }
+
+  m_writingBAM = false;
+  if( st==ST_OK ) m_dirty = false;
+  return st;
+}
+
+
+uint8_t iecDiskImage::scratch(const std::string &pattern, uint8_t &count)
+{
+  uint8_t entry[32];
+  uint16_t index = 0;
+
+  count = 0;
+  while( findEntry(pattern, entry, index, index) )
+    {
+      // locked files are not scratched
+      if( (entry[2] & 0x40)==0 )
         {
-          // no more entries => footer
-#ifdef SUPPORT_DOLPHIN
-          // DolphinDos' MultiDubTwo copy program needs the "BLOCKS FREE" footer line, otherwise it aborts when reading source
-          uint32_t free = m_dir->media_image.size() ? m_dir->media_blocks_free : std::min((int) m_dir->getAvailableSpace()/254, 65535);
-          m_data[0] = 1;
-          m_data[1] = 1;
-          m_data[2] = free&255;
-          m_data[3] = free/256;
-          strcpy((char *) m_data+4, "BLOCKS FREE.");
-#else
-          uint32_t free = m_dir->media_image.size() ? m_dir->media_blocks_free : 0;
-          m_data[0] = 1;
-          m_data[1] = 1;
-          m_data[2] = free&255;
-          m_data[3] = free/256;
-          if( m_dir->media_image.size() )
-            strcpy((char *) m_data+4, "BLOCKS FREE.");
-          else
-            sprintf((char *) m_data+4, CBM_DELETE CBM_DELETE "%sBYTES FREE.", mstr::formatBytes(m_dir->getAvailableSpace()).c_str());
-#endif
-          int n = 4+strlen((char *) m_data+4);
-          while( n<29 ) m_data[n++]=' ';
-          m_data[29] = 0;
-          m_data[30] = 0;
-          m_data[31] = 0;
-          m_len = 32;
-          m_headerLine = 0xFF;
+          Debug_printv("DELETING %s", getEntryName(entry).c_str());
+          freeChain(entry[3], entry[4]);
+
+          // side sectors of relative files (on 1581 the super side sector links to the first one)
+          if( (entry[2] & 0x07)==4 )
+            freeChain(entry[21], entry[22]);
+
+          entry[2] = 0;
+          uint8_t st = writeEntry(index, entry);
+          if( st!=ST_OK ) return st;
+          count++;
         }
+
+      index++;
     }
 
-  return ST_OK;
+  return writeBAM();
+}
+
+
+uint8_t iecDiskImage::rename(const std::string &newName, const std::string &oldName)
+{
+  uint8_t entry[32];
+  uint16_t index;
+
+  if( findEntry(newName, entry, index) )
+    return ST_FILE_EXISTS;
+  else if( !findEntry(oldName, entry, index) )
+    return ST_FILE_NOT_FOUND;
+
+  setEntryName(entry, newName);
+  return writeEntry(index, entry);
 }
 
 
 // -------------------------------------------------------------------------------------------------
 
 
-iecDrive::iecDrive(uint8_t devnum) : IECFileDevice(devnum)
+iecDirCache::iecDirCache()
 {
-  m_host = nullptr;
-  m_cwd.reset( MFSOwner::File("/") );
-  m_statusCode = ST_SPLASH;
-  m_statusTrk  = 0;
-  m_numOpenChannels = 0;
-  for(int i=0; i<16; i++) 
-    m_channels[i] = nullptr;
+  m_lock       = xSemaphoreCreateMutex();
+  m_generation = 0;
+  m_hits       = 0;
+  m_misses     = 0;
+  m_useCounter = 0;
 }
 
 
-iecDrive::~iecDrive()
+iecDirCache::~iecDirCache()
 {
-  for(int i=0; i<16; i++)
-    if( m_channels[i]!=nullptr )
-      close(i);
+  vSemaphoreDelete(m_lock);
 }
 
 
-bool iecDrive::open(uint8_t channel, const char *cname)
+time_t iecDirCache::getStamp(MFile *dir)
 {
-  Debug_printv("iecDrive::open(#%d, %d, \"%s\")", m_devnr, channel, cname);
-  
-  // determine file name
-  std::string name;
-  std::vector<std::string> pt = util_tokenize(std::string(cname), ',');
-  if( pt.size()>0 ) name = pt[0];
-  if( mstr::startsWith(name, "0:") )
-    name = mstr::drop(name, 2);
+  // directories within disk images have no time stamp (the times of image entries belong
+  // to single files) => their listings are re-read once IEC_DIRCACHE_REFRESH_AGE has passed
+  if( dir->media_image.size()>0 ) return 0;
 
-  // determine file mode (read/write)
-  bool overwrite = false;
-  std::ios_base::openmode mode = std::ios_base::in;
-  if( channel==1 ) mode = std::ios_base::out;
-  if( pt.size() >= 3 )
-    {
-      if( pt[2]=="R" )
-        mode = std::ios_base::in;
-      else if( pt[2]=="W" )
-        mode = std::ios_base::out;
-    }
+  time_t stamp = dir->getLastWrite();
 
-  if( mstr::startsWith(name, "@:") )
+  // FAT does not update the time of a directory when files are added from outside
+  // (e.g. uploaded through the web interface) => also compare the names of its entries
+  uint8_t backend = iecDriveStats::getBackend(dir->url);
+  if( backend==iecDriveStats::BACKEND_SD || backend==iecDriveStats::BACKEND_FLASH )
     {
-      overwrite = true;
-      name = mstr::drop(name, 2);
-    }      
+      stamp = (time_t) getNamesHash(dir->path, stamp);
+      if( stamp==0 ) stamp = 1;
+    }
 
-  // file name officially ends at first "shifted space" (0xA0) character
-  size_t i = name.find('\xa0');
-  if( i != std::string::npos ) name = name.substr(0, i);
+  return stamp;
+}
 
-  Debug_printv("opening channel[%d] m_cwd[%s] name[%s] mode[%s]", channel, m_cwd->url.c_str(), name.c_str(), 
-               mode==std::ios_base::out ? (overwrite ? "replace" : "write") : "read");
 
-  if( name.length()==0 )
-    {
-      Debug_printv("Error: empty file name");
-      setStatusCode(ST_SYNTAX_ERROR_33);
-    }
-  else if( m_channels[channel] != nullptr )
+uint32_t iecDirCache::getNamesHash(const std::string &path, time_t mtime)
+{
+  // FNV-1a over the modification time and the entry names (each followed by a 0 byte).
+  // Only the names are read (no stat() or MFile per entry), SD and flash directories are
+  // local paths so this can go to readdir() directly
+  uint32_t hash = 2166136261UL;
+  uint64_t t = (uint64_t) mtime;
+  for(int i=0; i<8; i++, t >>= 8) hash = (hash ^ (uint8_t) t) * 16777619UL;
+
+  DIR *d = opendir(path.empty() ? "/" : path.c_str());
+  if( d!=nullptr )
     {
-      Debug_printv("Error: a file is already open on this channel");
-      setStatusCode(ST_NO_CHANNEL);
+      struct dirent *entry;
+      while( (entry = readdir(d))!=nullptr )
+        {
+          for(const char *c = entry->d_name; *c; c++) hash = (hash ^ (uint8_t) *c) * 16777619UL;
+          hash *= 16777619UL;
+        }
+      closedir(d);
     }
-  else
-    {
-      if ( name[0] == '$' ) 
-        name.clear();
 
-      // get file
-      MFile *f = m_cwd->cd(mstr::toUTF8(name));
+  return hash;
+}
 
-      if( f == nullptr || f->url.empty() )
-        {
-          Debug_printv("Error: could not find file system for URL [%s]", name.c_str());
-          setStatusCode(ST_FILE_NOT_FOUND);
-          if( f!=nullptr ) delete f;
-          f = nullptr;
-        }
-      else if( f->isDirectory() )
+
+std::shared_ptr<const std::string> iecDirCache::get(MFile *dir, time_t &stamp)
+{
+  stamp = 0;
+  if( IEC_DIRCACHE_ENTRIES==0 ) return nullptr;
+
+  std::shared_ptr<const std::string> listing;
+  stamp = getStamp(dir);
+
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  for(auto it = m_entries.begin(); it != m_entries.end(); it++)
+    if( it->url==dir->url )
+      {
+        bool expired = (esp_timer_get_time() - it->created) > IEC_DIRCACHE_REFRESH_AGE*1000000ULL;
+        if( stamp!=it->stamp )
+          {
+            // directory has changed
+            m_entries.erase(it);
+          }
+        else if( stamp==0 && expired )
+          {
+            // no time stamp (disk image, HTTP) => re-read it now
+            m_entries.erase(it);
+          }
+        else
+          {
+            listing = it->listing;
+            it->lastUsed = ++m_useCounter;
+          }
+        break;
+      }
+
+  if( listing!=nullptr ) m_hits++; else m_misses++;
+  xSemaphoreGive(m_lock);
+
+  Debug_printv("Directory cache %s [%s] hits[%u] misses[%u]", listing!=nullptr ? "hit" : "miss", 
+               dir->url.c_str(), (unsigned int) m_hits, (unsigned int) m_misses);
+  return listing;
+}
+
+
+void iecDirCache::put(const std::string &url, time_t stamp, std::shared_ptr<const std::string> listing, uint32_t generation)
+{
+  if( IEC_DIRCACHE_ENTRIES==0 || listing->size() > IEC_DIRCACHE_MAX_SIZE ) return;
+
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  if( generation==m_generation )
+    {
+      Entry *e = nullptr;
+      for(auto &it : m_entries)
+        if( it.url==url )
+          e = &it;
+
+      if( e==nullptr )
         {
-          if( mode == std::ios_base::in )
+          // replace least recently used entry if the cache is full
+          if( m_entries.size() < IEC_DIRCACHE_ENTRIES )
             {
-              // reading directory
-              std::unique_ptr<MFile> entry = std::unique_ptr<MFile>( f->getNextFileInDir() ); 
-              if( entry!=nullptr )
-                {
-                  // regular directory
-                  f->rewindDirectory();
-                  m_channels[channel] = new iecChannelHandlerDir(this, f);
-                  m_numOpenChannels++;
-                  m_cwd.reset(MFSOwner::File(f->url));
-                  Debug_printv("Reading directory [%s]", f->url.c_str());
-                  f = nullptr; // f will be deleted in iecChannelHandlerDir destructor
-                  setStatusCode(ST_OK);
-                }
-              else
-                {
-                  // can't read file etries => treat directory as file
-                  m_cwd.reset(MFSOwner::File(f->url));
-                  Debug_printv("Treating directory as file [%s]", f->url.c_str());
-                }
+              m_entries.push_back(Entry());
+              e = &m_entries.back();
             }
           else
             {
-              // cannot write to directory
-              Debug_printv("Error: attempt to write to directory [%s]", f->url.c_str());
-              setStatusCode(ST_WRITE_PROTECT);
-              delete f;
-              f = nullptr;
+              e = &m_entries[0];
+              for(auto &it : m_entries)
+                if( it.lastUsed < e->lastUsed )
+                  e = &it;
             }
         }
 
-      if( f != nullptr )
+      e->url      = url;
+      e->stamp    = stamp;
+      e->created  = esp_timer_get_time();
+      e->lastUsed = ++m_useCounter;
+      e->listing  = listing;
+    }
+  xSemaphoreGive(m_lock);
+}
+
+
+void iecDirCache::invalidate(const std::string &url)
+{
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  m_generation++;
+  for(auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+      if( mstr::startsWith(it->url, url.c_str()) )
         {
-          // opening a file
-          if( (mode == std::ios_base::in) && !f->exists() )
-            {
-              Debug_printv("Error: file doesn't exist [%s]", f->url.c_str());
-              setStatusCode(ST_FILE_NOT_FOUND);
-            }
-          else if( (mode == std::ios_base::out) && f->media_image.size()>0 )
+          Debug_printv("Dropping cached directory [%s]", it->url.c_str());
+          it = m_entries.erase(it);
+        }
+      else
+        it++;
+    }
+  xSemaphoreGive(m_lock);
+}
+
+
+void iecDirCache::clear()
+{
+  invalidate("");
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+static const char *s_statsBackendNames[iecDriveStats::BACKEND_COUNT] = {"SD", "FLASH", "TNFS", "HTTP", "OTHER"};
+static const char *s_statsProtocolNames[IEC_PROTOCOL_COUNT] = {"STANDARD", "JIFFY", "EPYX", "DOLPHIN", "BURST"};
+
+
+// returns n such that value < 2^n (value<1 => 0), capped at the last bucket
+static uint8_t statsBucket(uint64_t value)
+{
+  uint8_t n = 0;
+  while( n<IEC_STATS_BUCKETS-1 && value >= (1ULL << n) ) n++;
+  return n;
+}
+
+
+iecDriveStats::iecDriveStats()
+{
+  m_lock = xSemaphoreCreateMutex();
+  clear();
+}
+
+
+iecDriveStats::~iecDriveStats()
+{
+  vSemaphoreDelete(m_lock);
+}
+
+
+uint8_t iecDriveStats::getBackend(const std::string &url)
+{
+  if( mstr::startsWith(url, "//sd") || mstr::startsWith(url, "/sd/") )
+    return BACKEND_SD;
+  else if( mstr::startsWith(url, "tnfs:", false) )
+    return BACKEND_TNFS;
+  else if( mstr::startsWith(url, "http:", false) || mstr::startsWith(url, "https:", false) )
+    return BACKEND_HTTP;
+  else if( mstr::startsWith(url, "/") )
+    return BACKEND_FLASH;
+  else
+    return BACKEND_OTHER;
+}
+
+
+void iecDriveStats::clear()
+{
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  memset(&m_total,   0, sizeof(m_total));
+  memset(m_backend,  0, sizeof(m_backend));
+  memset(m_protocol, 0, sizeof(m_protocol));
+  memset(m_errors,   0, sizeof(m_errors));
+  xSemaphoreGive(m_lock);
+}
+
+
+void iecDriveStats::addRecord(Record &r, uint32_t bytes, uint64_t totalUS, uint64_t transportUS, uint64_t latencyUS, uint32_t stalls)
+{
+  r.files++;
+  r.bytes  += bytes;
+  r.stalls += stalls;
+  r.transportTimeUS += transportUS;
+  r.busTimeUS += totalUS>transportUS ? totalUS-transportUS : 0;
+  if( latencyUS>0 )
+    {
+      r.latencySumUS += latencyUS;
+      r.latency[statsBucket(latencyUS / 1000)]++;
+    }
+  if( bytes>0 && totalUS>0 )
+    r.rate[statsBucket((bytes * 1000000ULL / totalUS) / 256)]++;
+}
+
+
+void iecDriveStats::addTransfer(uint8_t backend, uint8_t protocol, uint32_t bytes, uint64_t totalUS,
+                                uint64_t transportUS, uint64_t latencyUS, uint32_t stalls)
+{
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  addRecord(m_total, bytes, totalUS, transportUS, latencyUS, stalls);
+  addRecord(m_backend[std::min(backend, (uint8_t) (BACKEND_COUNT-1))], bytes, totalUS, transportUS, latencyUS, stalls);
+  addRecord(m_protocol[std::min(protocol, (uint8_t) (IEC_PROTOCOL_COUNT-1))], bytes, totalUS, transportUS, latencyUS, stalls);
+  xSemaphoreGive(m_lock);
+}
+
+
+void iecDriveStats::addError(uint8_t code)
+{
+  if( code!=ST_OK && code!=ST_SCRATCHED && code!=ST_SPLASH && code<100 )
+    {
+      xSemaphoreTake(m_lock, portMAX_DELAY);
+      m_errors[code]++;
+      xSemaphoreGive(m_lock);
+    }
+}
+
+
+std::string iecDriveStats::getSummary(const std::string &which)
+{
+  Record r;
+  bool found = false;
+  uint32_t errors = 0;
+
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  if( which.empty() )
+    { r = m_total; found = true; }
+  for(int i=0; i<BACKEND_COUNT && !found; i++)
+    if( which==s_statsBackendNames[i] )
+      { r = m_backend[i]; found = true; }
+  for(int i=0; i<IEC_PROTOCOL_COUNT && !found; i++)
+    if( which==s_statsProtocolNames[i] )
+      { r = m_protocol[i]; found = true; }
+  for(int i=0; i<100; i++) errors += m_errors[i];
+  xSemaphoreGive(m_lock);
+
+  if( !found ) return std::string();
+
+  uint32_t latencyCount = 0;
+  for(int j=0; j<IEC_STATS_BUCKETS; j++) latencyCount += r.latency[j];
+  uint64_t totalUS = r.busTimeUS + r.transportTimeUS;
+
+  char buf[120];
+  snprintf(buf, sizeof(buf), "%s:%u FILES,%u BYTES,%u CPS,BUS %u%%,LAT %u MS,%u STALLS,%u ERRORS",
+           which.empty() ? "ALL" : which.c_str(), r.files, r.bytes,
+           totalUS>0 ? (unsigned) (r.bytes * 1000000ULL / totalUS) : 0,
+           totalUS>0 ? (unsigned) (r.busTimeUS * 100 / totalUS) : 0,
+           latencyCount>0 ? (unsigned) (r.latencySumUS / latencyCount / 1000) : 0,
+           r.stalls, errors);
+  return std::string(buf);
+}
+
+
+void iecDriveStats::writeRecord(std::string &s, const char *name, const Record &r)
+{
+  char buf[160];
+  std::string lname = name;
+  mstr::toLower(lname);
+  snprintf(buf, sizeof(buf), "\"%s\":{\"files\":%u,\"bytes\":%u,\"bus_us\":%llu,\"transport_us\":%llu,\"latency_sum_us\":%llu,\"stalls\":%u",
+           lname.c_str(), r.files, r.bytes, (unsigned long long) r.busTimeUS, (unsigned long long) r.transportTimeUS,
+           (unsigned long long) r.latencySumUS, r.stalls);
+  s += buf;
+
+  s += ",\"latency_ms\":[";
+  for(int i=0; i<IEC_STATS_BUCKETS; i++)
+    s += (i>0 ? "," : "") + std::to_string(r.latency[i]);
+  s += "],\"rate_cps\":[";
+  for(int i=0; i<IEC_STATS_BUCKETS; i++)
+    s += (i>0 ? "," : "") + std::to_string(r.rate[i]);
+  s += "]}";
+}
+
+
+std::string iecDriveStats::getJSON()
+{
+  // histogram bucket n counts values below 2^n ms (latency) or 2^n*256 bytes/s (rate),
+  // the last bucket also counts all larger values
+  std::string s = "{";
+
+  xSemaphoreTake(m_lock, portMAX_DELAY);
+  writeRecord(s, "TOTAL", m_total);
+
+  s += ",\"backends\":{";
+  for(int i=0; i<BACKEND_COUNT; i++)
+    {
+      if( i>0 ) s += ",";
+      writeRecord(s, s_statsBackendNames[i], m_backend[i]);
+    }
+
+  s += "},\"protocols\":{";
+  for(int i=0; i<IEC_PROTOCOL_COUNT; i++)
+    {
+      if( i>0 ) s += ",";
+      writeRecord(s, s_statsProtocolNames[i], m_protocol[i]);
+    }
+
+  s += "},\"errors\":{";
+  bool first = true;
+  for(int i=0; i<100; i++)
+    if( m_errors[i]>0 )
+      {
+        s += (first ? "\"" : ",\"") + std::to_string(i) + "\":" + std::to_string(m_errors[i]);
+        first = false;
+      }
+  xSemaphoreGive(m_lock);
+
+  s += "}}";
+  return s;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandler::iecChannelHandler(iecDrive *drive)
+{ 
+  m_drive = drive;
+  m_data = new uint8_t[BUFFER_SIZE]; 
+  m_len = 0; 
+  m_ptr = 0; 
+}
+
+
+iecChannelHandler::~iecChannelHandler()
+{ 
+  delete [] m_data; 
+}
+
+
+uint8_t iecChannelHandler::read(uint8_t *data, uint8_t n)
+{
+  // if buffer is empty then re-fill it
+  if( m_ptr >= m_len )
+    {
+      m_ptr = 0;
+      m_len = 0;
+
+      uint8_t st = readBufferData();
+      if( st!=ST_OK )
+        {
+          m_drive->setStatusCode(st);
+          return 0;
+        }
+    }
+
+  // read data from buffer
+  if( m_ptr < m_len )
+    {
+      if( n==1 )
+        {
+          // common case during regular (non-fastloader) load
+          data[0] = m_data[m_ptr++];
+          return 1;
+        }
+      else
+        {
+          // copy as much data as possible
+          n = std::min((size_t) n, (size_t) (m_len - m_ptr));
+          memcpy(data, m_data + m_ptr, n);
+          m_ptr += n;
+          return n;
+        }
+    }
+  else
+    return 0;
+}
+
+
+uint8_t iecChannelHandler::write(uint8_t *data, uint8_t n)
+{
+  // if buffer is full then empty it
+  if( m_len+n > BUFFER_SIZE )
+    {
+      uint8_t st = writeBufferData();
+      if( st!=ST_OK )
+        {
+          m_drive->setStatusCode(st);
+          return 0;
+        }
+
+      m_ptr = 0;
+      m_len = 0;
+    }
+
+  // write data to buffer
+  if( n==1 )
+    {
+      // common case during regular (non-fastloader) save
+      m_data[m_len++] = data[0];
+    }
+  else
+    {
+      // copy data
+      memcpy(m_data + m_len, data, n);
+      m_len += n;
+    }
+
+  return n;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerFile::iecChannelHandlerFile(iecDrive *drive, MStream *stream, int fixLoadAddress, uint8_t queueDepth, bool writeBehind) : iecChannelHandler(drive)
+{
+  m_stream = stream;
+  m_fixLoadAddress = fixLoadAddress;
+  m_timeStart = esp_timer_get_time();
+  m_byteCount = 0;
+  m_transportTimeUS = 0;
+
+  m_backend  = iecDriveStats::getBackend(stream->url);
+  m_protocol = IEC_PROTOCOL_STANDARD;
+  m_stalls   = 0;
+  m_timeOpen = drive->getOpenTime()>0 ? drive->getOpenTime() : m_timeStart;
+  m_timeFirstByte = 0;
+
+  // a background task would seek and read a stream the bus task uses as well for
+  // other channels or the directory (MSharedStream serialises this, files in disk
+  // images read through their own container stream)
+  if( queueDepth>0 && stream->isShared() )
+    {
+      Debug_printv("Shared stream, %s disabled [%s]", writeBehind ? "write-behind" : "read-ahead", stream->url.c_str());
+      queueDepth = 0;
+    }
+
+  m_qDepth  = queueDepth;
+  m_qWrite  = writeBehind;
+  m_qData   = nullptr;
+  m_qLen    = nullptr;
+  m_qHead   = 0;
+  m_qTail   = 0;
+  m_qEOF    = false;
+  m_qStop   = false;
+  m_qStatus = ST_OK;
+  m_qStatusReported = false;
+  m_qReady  = m_qSpace = m_qDone = nullptr;
+  m_qTask   = nullptr;
+  m_qStreamTimeUS = 0;
+
+  if( m_qDepth>0 )
+    {
+      m_qData  = new uint8_t*[m_qDepth];
+      m_qLen   = new size_t[m_qDepth];
+      for(uint8_t i=0; i<m_qDepth; i++) 
+        { m_qData[i] = new uint8_t[BUFFER_SIZE]; m_qLen[i] = 0; }
+
+      m_qReady = xSemaphoreCreateBinary();
+      m_qSpace = xSemaphoreCreateBinary();
+      m_qDone  = xSemaphoreCreateBinary();
+
+      // run on the core opposite to the bus task (which is pinned to core 1)
+      if( xTaskCreatePinnedToCore(queueTask, m_qWrite ? "iecWriteBehind" : "iecReadAhead", 8192, this, 5, &m_qTask, 0)!=pdPASS )
+        {
+          Debug_printv("Error: could not create %s task, accessing stream synchronously", m_qWrite ? "write-behind" : "read-ahead");
+          m_qTask = nullptr;
+          stopQueue();
+        }
+      else
+        Debug_printv("%s enabled, depth[%d]", m_qWrite ? "Write-behind" : "Read-ahead", m_qDepth);
+    }
+}
+
+
+iecChannelHandlerFile::~iecChannelHandlerFile()
+{
+  double seconds = (esp_timer_get_time()-m_timeStart) / 1000000.0;
+
+  if( m_qDepth>0 )
+    {
+      // for write-behind this first flushes all queued data
+      if( m_qWrite && m_len>0 ) writeBufferData();
+      stopQueue();
+      Debug_printv("%s task spent %0.3f seconds accessing stream", m_qWrite ? "Write-behind" : "Read-ahead", m_qStreamTimeUS / 1000000.0);
+    }
+  else if( m_stream->mode == std::ios_base::out && m_len>0 )
+    writeBufferData();
+
+  m_stream->close();
+  Debug_printv("Stream closed.");
+
+  double cps = m_byteCount / seconds;
+  Debug_printv("%s %d bytes in %0.2f seconds @ %0.2fcps", m_stream->mode == std::ios_base::in ? "Sent" : "Received", m_byteCount, seconds, cps);
+
+  double tseconds = m_transportTimeUS / 1000000.0;
+  cps = m_byteCount / (seconds-tseconds);
+  Debug_printv("Transport (network/sd) took %0.3f seconds, pure IEC transfers @ %0.2fcps", tseconds, cps);
+
+  m_drive->getStats().addTransfer(m_backend, m_protocol, m_byteCount, esp_timer_get_time()-m_timeStart, m_transportTimeUS,
+                                  m_timeFirstByte>0 ? m_timeFirstByte-m_timeOpen : 0, m_stalls);
+
+  delete m_stream;
+}
+
+
+void iecChannelHandlerFile::queueTask(void *arg)
+{
+  iecChannelHandlerFile *handler = (iecChannelHandlerFile *) arg;
+  if( handler->m_qWrite )
+    handler->writeBehind();
+  else
+    handler->readAhead();
+  xSemaphoreGive(handler->m_qDone);
+  vTaskDelete(NULL);
+}
+
+
+void iecChannelHandlerFile::readAhead()
+{
+  // this runs in its own task and is the only one accessing m_stream
+  // until stopQueue() has returned
+  while( !m_qStop )
+    {
+      uint32_t head = m_qHead.load(std::memory_order_relaxed);
+      if( head - m_qTail.load(std::memory_order_acquire) >= m_qDepth )
+        {
+          // ring is full => wait for the bus side to consume a block
+          xSemaphoreTake(m_qSpace, pdMS_TO_TICKS(100));
+          continue;
+        }
+
+      uint8_t *data = m_qData[head % m_qDepth];
+      size_t len = 0;
+      bool error = false;
+      uint64_t t = esp_timer_get_time();
+      while( len<BUFFER_SIZE && !m_stream->eos() && !m_qStop )
+        {
+          size_t n = m_stream->read(data+len, BUFFER_SIZE-len);
+          if( n==0 )
+            {
+              // no data before the end of the stream, retrying would spin forever
+              Debug_printv("Error: read-ahead got no data at pos[%d] size[%d]", m_stream->position(), m_stream->size());
+              m_qStatus.store(ST_READ_ERROR, std::memory_order_release);
+              error = true;
+              break;
+            }
+          len += n;
+        }
+      m_qStreamTimeUS += (esp_timer_get_time()-t);
+
+      bool eos = error || m_stream->eos();
+      m_qLen[head % m_qDepth] = len;
+      m_qHead.store(head+1, std::memory_order_release);
+      if( eos ) m_qEOF.store(true, std::memory_order_release);
+      xSemaphoreGive(m_qReady);
+      if( eos ) break;
+    }
+
+  m_qEOF.store(true, std::memory_order_release);
+  xSemaphoreGive(m_qReady);
+}
+
+
+void iecChannelHandlerFile::writeBehind()
+{
+  // this runs in its own task and is the only one accessing m_stream
+  // until stopQueue() has returned. When asked to stop, all data
+  // still in the queue is written before exiting.
+  while( true )
+    {
+      uint32_t tail = m_qTail.load(std::memory_order_relaxed);
+      if( m_qHead.load(std::memory_order_acquire)==tail )
+        {
+          if( m_qStop ) break;
+          xSemaphoreTake(m_qReady, pdMS_TO_TICKS(100));
+          continue;
+        }
+
+      uint8_t i = tail % m_qDepth;
+      if( m_qStatus.load(std::memory_order_relaxed)==ST_OK )
+        {
+          uint64_t t = esp_timer_get_time();
+          size_t n = m_stream->write(m_qData[i], m_qLen[i]);
+          m_qStreamTimeUS += (esp_timer_get_time()-t);
+          m_byteCount += n;
+          if( n<m_qLen[i] )
+            {
+              Debug_printv("Error: deferred write failed: n[%d] < len[%d]", n, m_qLen[i]);
+              m_qStatus.store(ST_WRITE_ERROR, std::memory_order_release);
+            }
+        }
+      // after an error, queued data is discarded
+
+      m_qTail.store(tail+1, std::memory_order_release);
+      xSemaphoreGive(m_qSpace);
+    }
+}
+
+
+void iecChannelHandlerFile::stopQueue()
+{
+  if( m_qTask!=nullptr )
+    {
+      // signal the task to stop and wait until it has finished (if it has
+      // already finished then m_qDone is given and this returns immediately)
+      m_qStop = true;
+      xSemaphoreGive(m_qSpace);
+      xSemaphoreGive(m_qReady);
+      xSemaphoreTake(m_qDone, portMAX_DELAY);
+      m_qTask = nullptr;
+    }
+
+  if( m_qReady!=nullptr ) vSemaphoreDelete(m_qReady);
+  if( m_qSpace!=nullptr ) vSemaphoreDelete(m_qSpace);
+  if( m_qDone!=nullptr )  vSemaphoreDelete(m_qDone);
+  m_qReady = m_qSpace = m_qDone = nullptr;
+
+  for(uint8_t i=0; i<m_qDepth; i++) delete [] m_qData[i];
+  delete [] m_qData;
+  delete [] m_qLen;
+  m_qData = nullptr;
+  m_qLen  = nullptr;
+  m_qDepth = 0;
+}
+
+
+uint8_t iecChannelHandlerFile::finish(bool wait)
+{
+  if( m_qDepth>0 && m_qWrite )
+    {
+      // hand remaining buffered data to the write-behind task
+      if( m_len>0 && writeBufferData()==ST_OK )
+        { m_ptr = 0; m_len = 0; }
+
+      if( wait )
+        while( isBusy() )
+          xSemaphoreTake(m_qSpace, pdMS_TO_TICKS(100));
+
+      return getDeferredStatus();
+    }
+
+  return ST_OK;
+}
+
+
+bool iecChannelHandlerFile::isBusy()
+{
+  return m_qDepth>0 && m_qWrite && m_qHead.load(std::memory_order_acquire)!=m_qTail.load(std::memory_order_acquire);
+}
+
+
+uint8_t iecChannelHandlerFile::getDeferredStatus()
+{
+  // each deferred error is reported only once, further writes keep failing though
+  uint8_t st = m_qStatus.load(std::memory_order_acquire);
+  if( st==ST_OK || m_qStatusReported ) return ST_OK;
+  m_qStatusReported = true;
+  return st;
+}
+
+
+uint8_t iecChannelHandlerFile::readAheadBufferData()
+{
+  uint32_t tail = m_qTail.load(std::memory_order_relaxed);
+
+  // wait for the read-ahead task to provide the next block, time spent
+  // waiting here is what the bus actually loses to the transport
+  uint64_t t = esp_timer_get_time();
+  while( m_qHead.load(std::memory_order_acquire)==tail )
+    {
+      // m_qEOF is set after m_qHead so re-check m_qHead once EOF is seen,
+      // m_qStatus tells a failed read from the end of the stream
+      if( m_qEOF.load(std::memory_order_acquire) && m_qHead.load(std::memory_order_acquire)==tail )
+        { m_len = 0; return m_qStatus.load(std::memory_order_acquire); }
+
+      xSemaphoreTake(m_qReady, pdMS_TO_TICKS(100));
+    }
+  m_transportTimeUS += (esp_timer_get_time()-t);
+
+  uint8_t i = tail % m_qDepth;
+  memcpy(m_data, m_qData[i], m_qLen[i]);
+  m_len = m_qLen[i];
+  m_qTail.store(tail+1, std::memory_order_release);
+  xSemaphoreGive(m_qSpace);
+
+  if( m_fixLoadAddress>=0 && m_byteCount==0 && m_len>=2 )
+    {
+      m_data[0] = (m_fixLoadAddress & 0x00FF);
+      m_data[1] = (m_fixLoadAddress & 0xFF00) >> 8;
+    }
+  m_fixLoadAddress = -1;
+
+  m_byteCount += m_len;
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerFile::writeBehindBufferData()
+{
+  // report errors from previously queued data
+  uint8_t st = m_qStatus.load(std::memory_order_acquire);
+  if( st!=ST_OK ) 
+    { 
+      m_qStatusReported = true; 
+      return st; 
+    }
+
+  // wait for a free slot in the queue, time spent waiting here is
+  // what the bus actually loses to the transport
+  uint32_t head = m_qHead.load(std::memory_order_relaxed);
+  uint64_t t = esp_timer_get_time();
+  while( head - m_qTail.load(std::memory_order_acquire) >= m_qDepth )
+    xSemaphoreTake(m_qSpace, pdMS_TO_TICKS(100));
+  m_transportTimeUS += (esp_timer_get_time()-t);
+
+  uint8_t i = head % m_qDepth;
+  memcpy(m_qData[i], m_data, m_len);
+  m_qLen[i] = m_len;
+  m_qHead.store(head+1, std::memory_order_release);
+  xSemaphoreGive(m_qReady);
+
+  return ST_OK;
+}
+
+
+void iecChannelHandlerFile::updateStats(uint64_t transportTimeUS)
+{
+  // "transportTimeUS" is m_transportTimeUS before the buffer was filled/emptied
+  if( m_transportTimeUS-transportTimeUS > IEC_STATS_STALL_MS*1000 ) 
+    m_stalls++;
+
+  // fast-load protocols are only detected while a transfer is in progress
+  uint8_t protocol = m_drive->getProtocol();
+  if( protocol!=IEC_PROTOCOL_STANDARD ) 
+    m_protocol = protocol;
+}
+
+
+uint8_t iecChannelHandlerFile::writeBufferData()
+{
+  uint64_t t = m_transportTimeUS;
+  uint8_t st = (m_qDepth>0 && m_qWrite) ? writeBehindBufferData() : writeStreamBufferData();
+  updateStats(t);
+  return st;
+}
+
+
+uint8_t iecChannelHandlerFile::writeStreamBufferData()
+{
+  /*
+  // if m_stream is within a disk image then m_stream->mode does not get initialized properly!
+  if( m_stream->mode != std::ios_base::out )
+    return ST_FILE_TYPE_MISMATCH;
+  else
+  */
+    {
+      Debug_printv("bufferSize[%d]", m_len);
+      uint64_t t = esp_timer_get_time();
+      size_t n = m_stream->write(m_data, m_len);
+      m_transportTimeUS += (esp_timer_get_time()-t);
+      m_byteCount += n;
+      if( n<m_len )
+        {
+          Debug_printv("Error: write failed: n[%d] < m_len[%d]", n, m_len);
+          return ST_WRITE_ERROR;
+        }
+    }
+  
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerFile::readBufferData()
+{
+  uint64_t t = m_transportTimeUS;
+  uint8_t st = (m_qDepth>0 && !m_qWrite) ? readAheadBufferData() : readStreamBufferData();
+  updateStats(t);
+  if( m_timeFirstByte==0 && m_len>0 ) m_timeFirstByte = esp_timer_get_time();
+  return st;
+}
+
+
+uint8_t iecChannelHandlerFile::readStreamBufferData()
+{
+  /*
+  // if m_stream is within a disk image then m_stream->mode does not get initialized properly!
+  if( m_stream->mode != std::ios_base::in )
+    return ST_FILE_TYPE_MISMATCH;
+  else
+  */
+    {
+      Debug_printv("size[%d] avail[%d] pos[%d]", m_stream->size(), m_stream->available(), m_stream->position());
+
+      if( m_fixLoadAddress>=0 && m_stream->position()==0 )
+        {
+          uint64_t t = esp_timer_get_time();
+          m_len = m_stream->read(m_data, BUFFER_SIZE);
+          m_transportTimeUS += (esp_timer_get_time()-t);
+          if( m_len>=2 )
+            {
+              m_data[0] = (m_fixLoadAddress & 0x00FF);
+              m_data[1] = (m_fixLoadAddress & 0xFF00) >> 8;
+            }
+          m_fixLoadAddress = -1;
+        }
+      else
+        m_len = 0;
+
+      // try to fill buffer
+      while( m_len<BUFFER_SIZE && !m_stream->eos() )
+        {
+          uint64_t t = esp_timer_get_time();
+          m_len += m_stream->read(m_data+m_len, BUFFER_SIZE-m_len);
+          m_transportTimeUS += (esp_timer_get_time()-t);
+        }
+
+      m_byteCount += m_len;
+    }
+
+  return ST_OK;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerDirect::iecChannelHandlerDirect(iecDrive *drive, uint8_t bufferNum) : iecChannelHandler(drive)
+{
+  m_bufferNum = bufferNum;
+  memset(m_data, 0, 256);
+  m_ptr = 0;
+  m_len = 256;
+}
+
+
+uint8_t iecChannelHandlerDirect::read(uint8_t *data, uint8_t n)
+{
+  // reading stops at the end of the sector (or the end set by B-R)
+  if( m_ptr >= m_len ) return 0;
+
+  n = std::min((size_t) n, (size_t) (m_len - m_ptr));
+  memcpy(data, m_data + m_ptr, n);
+  m_ptr += n;
+  return n;
+}
+
+
+uint8_t iecChannelHandlerDirect::write(uint8_t *data, uint8_t n)
+{
+  // data beyond the end of the sector buffer is dropped
+  if( m_ptr >= 256 ) return 0;
+
+  n = std::min((size_t) n, (size_t) (256 - m_ptr));
+  memcpy(m_data + m_ptr, data, n);
+  m_ptr += n;
+  return n;
+}
+
+
+uint8_t iecChannelHandlerDirect::finish(bool wait)
+{
+  return m_drive->flushSectorCache();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerRel::iecChannelHandlerRel(iecDrive *drive, uint8_t recordLen) : iecChannelHandler(drive)
+{
+  m_recordLen = recordLen;
+  m_record    = 0;
+  m_loaded    = false;
+  m_dirty     = false;
+  m_modified  = false;
+  m_eoi       = false;
+  m_next      = false;
+  m_writing   = false;
+  m_ptr = 0;
+  m_len = 0;
+}
+
+
+uint8_t iecChannelHandlerRel::loadRecord()
+{
+  uint8_t st = m_record < getNumRecords() ? readRecord(m_record, m_data) : ST_RECORD_NOT_PRESENT;
+  if( st!=ST_OK )
+    {
+      // empty record
+      memset(m_data, 0, m_recordLen);
+      m_data[0] = 0xFF;
+    }
+
+  // reading stops after the last non-zero byte of the record
+  m_len = m_recordLen;
+  while( m_len>1 && m_data[m_len-1]==0 ) m_len--;
+  m_loaded = true;
+  return st;
+}
+
+
+uint8_t iecChannelHandlerRel::storeRecord()
+{
+  uint8_t st = ST_OK;
+  if( m_dirty )
+    {
+      st = writeRecord(m_record, m_data);
+      m_dirty = false;
+    }
+
+  return st;
+}
+
+
+void iecChannelHandlerRel::nextRecord()
+{
+  uint8_t st = storeRecord();
+  if( st!=ST_OK ) m_drive->setStatusCode(st);
+
+  if( m_record<0xFFFF ) m_record++;
+  m_ptr    = 0;
+  m_loaded = false;
+  m_eoi    = false;
+  m_next   = false;
+}
+
+
+uint8_t iecChannelHandlerRel::position(uint16_t record, uint8_t pos)
+{
+  uint8_t st = storeRecord();
+
+  m_record  = record;
+  m_ptr     = std::min(pos, (uint8_t) (m_recordLen-1));
+  m_eoi     = false;
+  m_next    = false;
+  m_writing = false;
+
+  uint8_t lst = loadRecord();
+  return st!=ST_OK ? st : lst;
+}
+
+
+uint8_t iecChannelHandlerRel::read(uint8_t *data, uint8_t n)
+{
+  if( m_next ) nextRecord();
+  if( !m_loaded )
+    {
+      uint8_t st = loadRecord();
+      if( st!=ST_OK ) m_drive->setStatusCode(st);
+    }
+
+  if( m_ptr >= m_len )
+    {
+      // end of record => signal EOI until the host ends this transfer
+      m_eoi = true;
+      return 0;
+    }
+
+  n = std::min((size_t) n, (size_t) (m_len - m_ptr));
+  memcpy(data, m_data + m_ptr, n);
+  m_ptr += n;
+  return n;
+}
+
+
+uint8_t iecChannelHandlerRel::write(uint8_t *data, uint8_t n)
+{
+  if( m_next ) nextRecord();
+
+  // writing a record that does not exist yet creates it
+  if( !m_loaded ) loadRecord();
+
+  if( m_ptr >= m_recordLen )
+    {
+      m_drive->setStatusCode(ST_OVERFLOW_IN_RECORD);
+      return n;
+    }
+
+  if( !m_writing )
+    {
+      // data written in one transfer replaces the remainder of the record
+      memset(m_data + m_ptr, 0, m_recordLen - m_ptr);
+      m_writing = true;
+    }
+
+  // data that does not fit into the record is dropped
+  uint8_t nn = std::min((size_t) n, (size_t) (m_recordLen - m_ptr));
+  if( nn<n ) m_drive->setStatusCode(ST_OVERFLOW_IN_RECORD);
+  memcpy(m_data + m_ptr, data, nn);
+  m_ptr += nn;
+  m_dirty = true;
+  m_modified = true;
+  return n;
+}
+
+
+void iecChannelHandlerRel::endTransfer(bool talk)
+{
+  if( talk )
+    {
+      // host has received the whole record => next transfer reads the next record
+      if( m_eoi ) m_next = true;
+    }
+  else if( m_writing )
+    {
+      // each transfer (PRINT#) writes one record
+      uint8_t st = storeRecord();
+      if( st!=ST_OK ) m_drive->setStatusCode(st);
+      m_writing = false;
+      m_next = true;
+    }
+}
+
+
+uint8_t iecChannelHandlerRel::finish(bool wait)
+{
+  uint8_t st  = storeRecord();
+  uint8_t fst = flush();
+  return st!=ST_OK ? st : fst;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerRelFile::iecChannelHandlerRelFile(iecDrive *drive, MStream *stream, uint8_t recordLen) : iecChannelHandlerRel(drive, recordLen)
+{
+  m_stream = stream;
+  m_size   = stream->size();
+}
+
+
+iecChannelHandlerRelFile::~iecChannelHandlerRelFile()
+{
+  m_stream->close();
+  delete m_stream;
+}
+
+
+uint16_t iecChannelHandlerRelFile::getNumRecords()
+{
+  return std::min(m_size / getRecordLength(), (uint32_t) 0xFFFF);
+}
+
+
+uint8_t iecChannelHandlerRelFile::readRecord(uint16_t record, uint8_t *buffer)
+{
+  uint8_t len = getRecordLength();
+  if( !m_stream->seek(record * len) || m_stream->read(buffer, len)!=len )
+    return ST_READ_ERROR;
+
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerRelFile::writeRecord(uint16_t record, const uint8_t *buffer)
+{
+  uint8_t len = getRecordLength();
+
+  // fill the gap between the end of the file and the new record with empty records
+  uint8_t empty[254];
+  memset(empty, 0, len);
+  empty[0] = 0xFF;
+  for(uint32_t r = (m_size+len-1)/len; r<record; r++)
+    {
+      if( !m_stream->seek(r * len) || m_stream->write(empty, len)!=len )
+        return ST_WRITE_ERROR;
+      m_size = (r+1) * len;
+    }
+
+  if( !m_stream->seek(record * len) || m_stream->write(buffer, len)!=len )
+    return ST_WRITE_ERROR;
+
+  m_size = std::max(m_size, (uint32_t) (record+1) * len);
+  return ST_OK;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerRelImage::iecChannelHandlerRelImage(iecDrive *drive, iecDiskImage *image, const std::string &imageName,
+                                                     const uint8_t *entry, uint16_t index, const std::vector<uint16_t> &blocks,
+                                                     const std::vector<uint16_t> &sideSectors, uint16_t superSide, uint32_t dataSize) :
+  iecChannelHandlerRel(drive, entry[23])
+{
+  m_image       = image;
+  m_imageName   = imageName;
+  m_entryIndex  = index;
+  m_blocks      = blocks;
+  m_sideSectors = sideSectors;
+  m_superSide   = superSide;
+  m_dataSize    = dataSize;
+  memcpy(m_entry, entry, 32);
+}
+
+
+uint16_t iecChannelHandlerRelImage::getNumRecords()
+{
+  return std::min(m_dataSize / getRecordLength(), (uint32_t) 0xFFFF);
+}
+
+
+uint8_t iecChannelHandlerRelImage::readRecord(uint16_t record, uint8_t *buffer)
+{
+  uint8_t len = getRecordLength();
+  uint32_t offset = record * len;
+  if( offset+len > m_blocks.size()*254 ) return ST_RECORD_NOT_PRESENT;
+
+  // records may span two data blocks (254 data bytes each)
+  uint8_t sector[256];
+  for(uint8_t done=0; done<len; )
+    {
+      uint16_t block = (offset+done) / 254;
+      uint8_t  pos   = 2 + (offset+done) % 254;
+      uint8_t  n     = std::min(len-done, 256-pos);
+      uint8_t  st    = m_drive->readSector(m_blocks[block] / 256, m_blocks[block] & 255, sector);
+      if( st!=ST_OK ) return st;
+      memcpy(buffer+done, sector+pos, n);
+      done += n;
+    }
+
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerRelImage::writeRecord(uint16_t record, const uint8_t *buffer)
+{
+  uint8_t len = getRecordLength();
+  uint32_t offset = record * len;
+
+  if( offset+len > m_dataSize )
+    {
+      uint8_t st = extend(offset+len);
+      if( st!=ST_OK ) return st;
+    }
+
+  return writeData(offset, buffer, len);
+}
+
+
+uint8_t iecChannelHandlerRelImage::writeData(uint32_t offset, const uint8_t *data, uint8_t len)
+{
+  // records may span two data blocks (254 data bytes each)
+  uint8_t sector[256];
+  for(uint8_t done=0; done<len; )
+    {
+      uint16_t block = (offset+done) / 254;
+      uint8_t  pos   = 2 + (offset+done) % 254;
+      uint8_t  n     = std::min(len-done, 256-pos);
+      uint8_t  st    = m_drive->readSector(m_blocks[block] / 256, m_blocks[block] & 255, sector);
+      if( st!=ST_OK ) return st;
+      memcpy(sector+pos, data+done, n);
+      st = m_drive->writeSector(m_blocks[block] / 256, m_blocks[block] & 255, sector);
+      if( st!=ST_OK ) return st;
+      done += n;
+    }
+
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerRelImage::extend(uint32_t size)
+{
+  if( size<=m_dataSize ) return ST_OK;
+  if( m_image==nullptr ) return ST_WRITE_PROTECT;
+  if( !m_image->isLoaded() && !m_image->load(m_image->getUrl(), m_imageName) ) return ST_DRIVE_NOT_READY;
+
+  // data blocks plus the side sectors (120 data blocks each) and the 1581 super side sector they need
+  uint8_t  len       = getRecordLength();
+  uint32_t numBlocks = (size+253) / 254;
+  uint32_t numSide   = (numBlocks+119) / 120;
+  if( numSide > (m_image->getType()==81 ? 6*126 : 6) ) return ST_FILE_TOO_LARGE;
+
+  uint32_t needed = numBlocks - m_blocks.size() + numSide - m_sideSectors.size();
+  if( m_image->getType()==81 && m_superSide==0 ) needed++;
+  if( needed > m_image->blocksFree() ) return ST_DISK_FULL;
+
+  uint8_t st = ST_OK;
+  while( st==ST_OK && m_blocks.size()<numBlocks )
+    st = addBlock();
+
+  // the new blocks are filled with empty records, up to the last one ending in the last block
+  uint8_t buffer[256];
+  uint32_t newSize = (m_blocks.size()*254 / len) * len;
+  memset(buffer, 0, len);
+  buffer[0] = 0xFF;
+  for(uint32_t offset = (m_dataSize/len)*len; st==ST_OK && offset+len<=newSize; offset+=len)
+    st = writeData(offset, buffer, len);
+
+  if( st==ST_OK )
+    {
+      // last data block: byte 1 is the index of its last used byte
+      m_dataSize = newSize;
+      uint8_t track = m_blocks.back() / 256, sector = m_blocks.back() & 255;
+      if( (st = m_drive->readSector(track, sector, buffer))==ST_OK )
+        {
+          buffer[0] = 0;
+          buffer[1] = m_dataSize - (m_blocks.size()-1)*254 + 1;
+          st = m_drive->writeSector(track, sector, buffer);
+        }
+    }
+
+  if( st==ST_OK ) st = m_image->writeEntry(m_entryIndex, m_entry);
+  if( st==ST_OK ) st = m_image->writeBAM();
+
+  // blocks allocated for a failed extension are released by re-reading the BAM
+  if( st!=ST_OK ) m_image->unload();
+  return st;
+}
+
+
+uint8_t iecChannelHandlerRelImage::addBlock()
+{
+  uint8_t st, buffer[256];
+  uint8_t prevTrack = 0, prevSector = 0;
+  if( !m_blocks.empty() ) { prevTrack = m_blocks.back() / 256; prevSector = m_blocks.back() & 255; }
+
+  // every 120 data blocks need another side sector
+  size_t n = m_blocks.size();
+  if( n/120 >= m_sideSectors.size() && (st = addSideSector(prevTrack, prevSector))!=ST_OK )
+    return st;
+
+  uint8_t track = prevTrack, sector = prevSector;
+  if( (st = m_image->allocateBlock(track, sector))!=ST_OK ) return st;
+
+  // byte 1 of the new last block is set once the records in it are written
+  memset(buffer, 0, 256);
+  buffer[1] = 1;
+  if( (st = m_drive->writeSector(track, sector, buffer))!=ST_OK ) return st;
+
+  // link from the previous block (or the directory entry for the first one)
+  if( n==0 )
+    {
+      m_entry[3] = track;
+      m_entry[4] = sector;
+    }
+  else if( (st = m_drive->readSector(prevTrack, prevSector, buffer))==ST_OK )
+    {
+      buffer[0] = track;
+      buffer[1] = sector;
+      st = m_drive->writeSector(prevTrack, prevSector, buffer);
+    }
+  if( st!=ST_OK ) return st;
+
+  m_blocks.push_back(track*256 + sector);
+  uint16_t count = m_entry[30] + m_entry[31]*256 + 1;
+  m_entry[30] = count & 255;
+  m_entry[31] = count / 256;
+
+  // data block pointer in the side sector, byte 1 of the last side sector is the index of its last used byte
+  uint16_t ss = m_sideSectors[n/120];
+  uint8_t  i  = 16 + (n%120)*2;
+  if( (st = m_drive->readSector(ss / 256, ss & 255, buffer))!=ST_OK ) return st;
+  buffer[i]   = track;
+  buffer[i+1] = sector;
+  if( buffer[0]==0 ) buffer[1] = i+1;
+  return m_drive->writeSector(ss / 256, ss & 255, buffer);
+}
+
+
+uint8_t iecChannelHandlerRelImage::addSideSector(uint8_t track, uint8_t sector)
+{
+  uint8_t st, buffer[256];
+  uint16_t ss = m_sideSectors.size(), first = ss - ss%6;
+  uint16_t count = m_entry[30] + m_entry[31]*256;
+
+  if( (st = m_image->allocateBlock(track, sector))!=ST_OK ) return st;
+  count++;
+
+  if( m_image->getType()==81 )
+    {
+      // 1581: the directory entry points to a super side sector (byte 2 = $FE) which
+      // links to the first side sector and lists the first side sector of each group of 6
+      if( m_superSide==0 )
+        {
+          uint8_t t = track, s = sector;
+          if( (st = m_image->allocateBlock(t, s))!=ST_OK ) return st;
+          count++;
+
+          memset(buffer, 0, 256);
+          buffer[2] = 0xFE;
+          if( (st = m_drive->writeSector(t, s, buffer))!=ST_OK ) return st;
+          m_superSide = t*256 + s;
+          m_entry[21] = t;
+          m_entry[22] = s;
+        }
+
+      if( ss%6==0 )
+        {
+          if( (st = m_drive->readSector(m_superSide / 256, m_superSide & 255, buffer))!=ST_OK ) return st;
+          if( ss==0 ) { buffer[0] = track; buffer[1] = sector; }
+          buffer[3 + (ss/6)*2] = track;
+          buffer[4 + (ss/6)*2] = sector;
+          if( (st = m_drive->writeSector(m_superSide / 256, m_superSide & 255, buffer))!=ST_OK ) return st;
+        }
+    }
+  else if( ss==0 )
+    {
+      m_entry[21] = track;
+      m_entry[22] = sector;
+    }
+
+  m_entry[30] = count & 255;
+  m_entry[31] = count / 256;
+  m_sideSectors.push_back(track*256 + sector);
+
+  // new side sector: its number in the group, the record length and the group's side sectors
+  memset(buffer, 0, 256);
+  buffer[1] = 15;
+  buffer[2] = ss % 6;
+  buffer[3] = getRecordLength();
+  for(uint16_t i=first; i<m_sideSectors.size(); i++)
+    {
+      buffer[4 + (i-first)*2] = m_sideSectors[i] / 256;
+      buffer[5 + (i-first)*2] = m_sideSectors[i] & 255;
+    }
+  if( (st = m_drive->writeSector(track, sector, buffer))!=ST_OK ) return st;
+
+  // the other side sectors of the group list it as well, the previous one links to it
+  for(int i=(int) ss-1; i>=0 && i>=(int) first-1; i--)
+    {
+      uint16_t s = m_sideSectors[i];
+      if( (st = m_drive->readSector(s / 256, s & 255, buffer))!=ST_OK ) return st;
+      if( i>=first )
+        {
+          buffer[4 + (ss-first)*2] = track;
+          buffer[5 + (ss-first)*2] = sector;
+        }
+      if( i==(int) ss-1 )
+        {
+          buffer[0] = track;
+          buffer[1] = sector;
+        }
+      if( (st = m_drive->writeSector(s / 256, s & 255, buffer))!=ST_OK ) return st;
+    }
+
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerRelImage::flush()
+{
+  return m_drive->flushSectorCache();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerImageWrite::iecChannelHandlerImageWrite(iecDrive *drive, iecDiskImage *image, const std::string &name, uint8_t fileType, bool replace) : iecChannelHandler(drive)
+{
+  m_image     = image;
+  m_name      = name;
+  m_fileType  = fileType;
+  m_replace   = replace;
+  m_finished  = false;
+  m_status    = ST_OK;
+  m_blockLen  = 2;
+  m_numBlocks = 0;
+  m_track     = 0;
+  m_sector    = 0;
+  m_startTrack  = 0;
+  m_startSector = 0;
+}
+
+
+uint8_t iecChannelHandlerImageWrite::writeBlock(bool last)
+{
+  uint8_t st;
+
+  if( m_track==0 )
+    {
+      // first block of the file
+      if( (st = m_image->allocateBlock(m_track, m_sector))!=ST_OK ) return st;
+      m_startTrack  = m_track;
+      m_startSector = m_sector;
+    }
+
+  uint8_t track = m_track, sector = m_sector;
+  if( last )
+    {
+      // last block: byte 1 is the index of the last used byte
+      m_block[0] = 0;
+      m_block[1] = m_blockLen-1;
+    }
+  else
+    {
+      if( (st = m_image->allocateBlock(track, sector))!=ST_OK ) return st;
+      m_block[0] = track;
+      m_block[1] = sector;
+    }
+
+  if( (st = m_drive->writeSector(m_track, m_sector, m_block))!=ST_OK ) return st;
+
+  m_numBlocks++;
+  m_track    = track;
+  m_sector   = sector;
+  m_blockLen = 2;
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerImageWrite::writeBufferData()
+{
+  if( m_status!=ST_OK ) return m_status;
+
+  for(size_t i=0; i<m_len; )
+    {
+      // only allocate the next block once more data arrives, so the last block is known at close
+      if( m_blockLen==256 && (m_status = writeBlock(false))!=ST_OK )
+        return m_status;
+
+      size_t n = std::min(m_len-i, (size_t) (256-m_blockLen));
+      memcpy(m_block+m_blockLen, m_data+i, n);
+      m_blockLen += n;
+      i += n;
+    }
+
+  return ST_OK;
+}
+
+
+uint8_t iecChannelHandlerImageWrite::readBufferData()
+{
+  return ST_FILE_NOT_OPEN;
+}
+
+
+uint8_t iecChannelHandlerImageWrite::finish(bool wait)
+{
+  if( m_finished ) return m_status;
+  m_finished = true;
+
+  if( m_status==ST_OK && m_len>0 ) m_status = writeBufferData();
+  m_len = 0;
+  if( m_status==ST_OK ) m_status = writeBlock(true);
+
+  if( m_status==ST_OK )
+    {
+      uint8_t entry[32], old[32];
+      uint16_t index;
+
+      memset(entry, 0, 32);
+      entry[2]  = 0x80 | m_fileType;
+      entry[3]  = m_startTrack;
+      entry[4]  = m_startSector;
+      setEntryName(entry, m_name);
+      entry[30] = m_numBlocks & 255;
+      entry[31] = m_numBlocks / 256;
+
+      if( m_replace && m_image->findEntry(m_name, old, index) )
+        {
+          // "@:" save: the entry now points to the new data, free the old blocks
+          m_status = m_image->writeEntry(index, entry);
+          if( m_status==ST_OK ) m_image->freeChain(old[3], old[4]);
+        }
+      else
+        m_status = m_image->addEntry(entry, index);
+
+      if( m_status==ST_OK )
+        m_status = m_image->writeBAM();
+    }
+
+  // blocks allocated for a failed write are released by re-reading the BAM
+  if( m_status!=ST_OK ) m_image->unload();
+
+  // write BAM, directory and remaining data blocks to the image in one go
+  uint8_t st = m_drive->flushSectorCache();
+  Debug_printv("Saved [%s]: %d blocks, status %d", m_name.c_str(), m_numBlocks, m_status!=ST_OK ? m_status : st);
+  return m_status!=ST_OK ? m_status : st;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecChannelHandlerDir::iecChannelHandlerDir(iecDrive *drive, MFile *dir, iecDirCache *cache, time_t stamp, std::shared_ptr<const std::string> listing) : iecChannelHandler(drive)
+{
+  m_dir = dir;
+  m_headerLine = 1;
+  m_listing = listing;
+  m_listingPos = 0;
+  m_cache = nullptr;
+  m_cacheGeneration = 0;
+  m_cacheStamp = 0;
+
+  if( m_listing!=nullptr ) return;
+
+  if( cache!=nullptr )
+    {
+      // collect the rendered listing for the directory cache
+      m_cache = cache;
+      m_cacheGeneration = cache->getGeneration();
+      m_cacheStamp = stamp;
+      m_rendered = std::make_shared<std::string>();
+    }
+  
+  std::string url = mstr::toPETSCII2(m_dir->host);
+  std::string path = mstr::toPETSCII2(m_dir->path);
+  std::string archive = mstr::toPETSCII2(m_dir->media_archive);
+  std::string image = mstr::toPETSCII2(m_dir->media_image);
+  
+  m_headers.clear();
+  if( url.size()>0 )     addExtraInfo("URL", url);
+  if( path.size()>1 )    addExtraInfo("PATH", path);
+  if( archive.size()>1 ) addExtraInfo("ARCHIVE", archive);
+  if( image.size()>0 )   addExtraInfo("IMAGE", image);
+  if( m_headers.size()>0 ) m_headers.push_back("NFO ----------------");
+  
+  // If SD Card is available and we are at the root path show it as a directory at the top
+  if( fnSDFAT.running() && m_dir->url.size() < 2 )
+    m_headers.push_back("DIR SD");
+}
+
+
+iecChannelHandlerDir::~iecChannelHandlerDir()
+{
+  delete m_dir;
+}
+
+
+void iecChannelHandlerDir::addExtraInfo(const char *title, std::string_view text)
+{
+  m_headers.push_back(std::string("NFO [") + title + "]");
+  for(size_t i=0; i<text.size(); i+=16)
+    {
+      std::string &s = m_headers.emplace_back("NFO ");
+      s.append(text.substr(i, 16));
+    }
+}
+
+
+uint8_t iecChannelHandlerDir::writeBufferData()
+{
+  return ST_FILE_TYPE_MISMATCH;
+}
+
+
+uint8_t iecChannelHandlerDir::readBufferData()
+{
+  if( m_listing!=nullptr )
+    {
+      // send cached listing
+      m_len = std::min((size_t) BUFFER_SIZE, m_listing->size() - m_listingPos);
+      memcpy(m_data, m_listing->data() + m_listingPos, m_len);
+      m_listingPos += m_len;
+      return ST_OK;
+    }
+
+  uint8_t st = renderBufferData();
+
+  if( m_rendered!=nullptr )
+    {
+      if( m_rendered->size() + m_len > IEC_DIRCACHE_MAX_SIZE )
+        m_rendered.reset();
+      else
+        {
+          m_rendered->append((char *) m_data, m_len);
+          if( m_headerLine==0xFF )
+            {
+              // footer was rendered => listing is complete
+              m_cache->put(m_dir->url, m_cacheStamp, m_rendered, m_cacheGeneration);
+              m_rendered.reset();
+            }
+        }
+    }
+
+  return st;
+}
+
+
+uint8_t iecChannelHandlerDir::renderBufferData()
+{
+  if( m_headerLine==1 )
+    {
+      // main header line
+      m_data[0] = 0x01;
+      m_data[1] = 0x08;
+      m_data[2] = 1;
+      m_data[3] = 1;
+      m_data[4] = 0;
+      m_data[5] = 0;
+      m_data[6] = 18;
+      m_data[7] = '"';
+      std::string name = m_dir->media_header.size() ? mstr::toPETSCII2(m_dir->media_header) : PRODUCT_ID;
+      size_t n = std::min(16, (int) name.size());
+      memcpy(m_data+8, name.data(), n);
+      while( n<16 ) { m_data[8+n] = ' '; n++; }
+      sprintf((char *) m_data+24, "\" %02i 2A", m_drive->id());
+      m_len = 32;
+      m_headerLine++;
+    }
+  else if( m_headerLine-2 < m_headers.size() )
+    {
+      // Send Extra INFO
+      m_data[0] = 1;
+      m_data[1] = 1;
+      m_data[2] = 0;
+      m_data[3] = 0;
+
+      std::string name = m_headers[m_headerLine-2];
+      std::string ext  = name.substr(0, 3);
+
+      name = "   \"" + name.substr(4, 16) + "\"";
+      if( name.size()<21 ) name += std::string(21-name.size(), ' ');
+      name += " " + ext + "  ";
+      strcpy((char *) m_data+4, name.c_str());
+      m_data[31] = 0;
+      m_len = 32;
+      m_headerLine++;
+    }
+  else if( m_headerLine < 0xFF )
+    {
+      // file entries
+      std::unique_ptr<MFile> entry; 
+
+      // skip over files starting with "."
+      do 
+        { 
+          entry = std::unique_ptr<MFile>( m_dir->getNextFileInDir() ); 
+          if( entry!=nullptr ) Debug_printv("%s", entry->name.c_str());
+        }
+      while( entry!=nullptr && entry->name[0] == '.' );
+
+      if( entry != nullptr )
+        {
+          // directory entry
+          uint16_t size = entry->blocks();
+          m_data[m_len++] = 1;
+          m_data[m_len++] = 1;
+          m_data[m_len++] = size&255;
+          m_data[m_len++] = size/256;
+          if( size<10 )    m_data[m_len++] = ' ';
+          if( size<100 )   m_data[m_len++] = ' ';
+          if( size<1000 )  m_data[m_len++] = ' ';
+
+          // only the first 3 characters of the extension are shown (fits the
+          // string's internal buffer, no heap allocation)
+          std::string ext;
+          if( entry->isDirectory() )
+            ext = "dir";
+          else
+            {
+              std::string_view e = entry->extension;
+              while( !e.empty() && isspace((unsigned char) e[0]) ) e.remove_prefix(1);
+              ext = e.empty() ? "prg" : e.substr(0, 3);
+              ext.resize(3, ' ');
+            }
+
+          // names are only copied if they have to be converted to PETSCII
+          std::string converted;
+          std::string_view name = entry->name;
+          if ( !entry->isPETSCII )
+            {
+              converted = mstr::toPETSCII2( entry->name );
+              name = converted;
+              ext  = mstr::toPETSCII2( ext );
+            }
+          
+          m_data[m_len++] = '"';
+          size_t n = std::min((size_t) 16, name.size());
+          for(size_t i=0; i<n; i++)
+            m_data[m_len+i] = name[i]=='\\' ? '/' : name[i];
+          m_len += n;
+          m_data[m_len++] = '"';
+          n = 17-n;
+          while(n-->0) m_data[m_len++] = ' ';
+          memcpy(m_data+m_len, ext.data(), 3);
+          m_len+=3;
+          while( m_len<31 ) m_data[m_len++] = ' ';
+          m_data[31] = 0;
+          m_len = 32;
+        }
+      else
+        {
+          // no more entries => footer
+#ifdef SUPPORT_DOLPHIN
+          // DolphinDos' MultiDubTwo copy program needs the "BLOCKS FREE" footer line, otherwise it aborts when reading source
+          uint32_t free = m_dir->media_image.size() ? m_dir->media_blocks_free : std::min((int) m_dir->getAvailableSpace()/254, 65535);
+          m_data[0] = 1;
+          m_data[1] = 1;
+          m_data[2] = free&255;
+          m_data[3] = free/256;
+          strcpy((char *) m_data+4, "BLOCKS FREE.");
+#else
+          uint32_t free = m_dir->media_image.size() ? m_dir->media_blocks_free : 0;
+          m_data[0] = 1;
+          m_data[1] = 1;
+          m_data[2] = free&255;
+          m_data[3] = free/256;
+          if( m_dir->media_image.size() )
+            strcpy((char *) m_data+4, "BLOCKS FREE.");
+          else
+            sprintf((char *) m_data+4, CBM_DELETE CBM_DELETE "%sBYTES FREE.", mstr::formatBytes(m_dir->getAvailableSpace()).c_str());
+#endif
+          int n = 4+strlen((char *) m_data+4);
+          while( n<29 ) m_data[n++]=' ';
+          m_data[29] = 0;
+          m_data[30] = 0;
+          m_data[31] = 0;
+          m_len = 32;
+          m_headerLine = 0xFF;
+        }
+    }
+
+  return ST_OK;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+
+iecDrive::iecDrive(uint8_t devnum) : IECFileDevice(devnum), m_diskImage(this)
+{
+  m_host = nullptr;
+  m_cwd.reset( MFSOwner::File("/") );
+  m_statusCode = ST_SPLASH;
+  m_statusTrk  = 0;
+  m_statusSec  = 0;
+  m_numOpenChannels = 0;
+  m_lastWriteChannel = 0xFF;
+  m_readAheadDepth = IEC_READAHEAD_DEPTH;
+  m_writeBehindDepth = IEC_WRITEBEHIND_DEPTH;
+  m_writeBehindWaitOnClose = IEC_WRITEBEHIND_WAIT_ON_CLOSE;
+  m_writeBehindDurable = IEC_WRITEBEHIND_DURABLE;
+  m_openTime = 0;
+  for(int i=0; i<16; i++) 
+    m_channels[i] = nullptr;
+}
+
+
+iecDrive::~iecDrive()
+{
+  for(int i=0; i<16; i++)
+    if( m_channels[i]!=nullptr )
+      close(i);
+
+  reapClosedChannels(true);
+  flushSectorCache();
+}
+
+
+void iecDrive::task()
+{
+  IECFileDevice::task();
+
+  // clean up channels that were closed while their write-behind queue was still busy
+  if( !m_closingChannels.empty() )
+    {
+      uint8_t st = reapClosedChannels(false);
+      if( st!=ST_OK ) setStatusCode(st);
+    }
+
+  // write back modified sectors once sector writes have stopped for a while
+  if( (m_trackCache.isDirty() || m_imageWriter!=nullptr) && esp_timer_get_time()-m_trackCache.getLastWriteTime() > IEC_TRACKCACHE_FLUSH_DELAY*1000 )
+    {
+      uint8_t st = flushSectorCache();
+      if( st!=ST_OK ) setStatusCode(st);
+    }
+}
+
+
+uint8_t iecDrive::reapClosedChannels(bool wait)
+{
+  uint8_t res = ST_OK;
+  for(auto it = m_closingChannels.begin(); it != m_closingChannels.end(); )
+    {
+      iecChannelHandler *handler = *it;
+      if( wait || !handler->isBusy() )
+        {
+          uint8_t st = handler->finish(true);
+          if( res==ST_OK ) res = st;
+          delete handler;
+          it = m_closingChannels.erase(it);
+        }
+      else
+        it++;
+    }
+
+  return res;
+}
+
+
+bool iecDrive::open(uint8_t channel, const char *cname)
+{
+  Debug_printv("iecDrive::open(#%d, %d, \"%s\")", m_devnr, channel, cname);
+  m_openTime = esp_timer_get_time();
+
+  // make sure data from previously closed files has been written
+  if( !m_closingChannels.empty() )
+    {
+      uint8_t st = reapClosedChannels(true);
+      if( st!=ST_OK ) { setStatusCode(st); return false; }
+    }
+
+  // files and listings read the image through other streams => close the sector writer
+  if( m_imageWriter!=nullptr )
+    {
+      uint8_t st = flushSectorCache();
+      if( st!=ST_OK ) { setStatusCode(st); return false; }
+    }
+  
+  // determine file name (views into cname, only the final name is copied)
+  std::vector<std::string_view> pt = mstr::splitView(cname, ',');
+  std::string_view nv = pt[0];
+  if( mstr::startsWith(nv, "0:") )
+    nv.remove_prefix(2);
+
+  // determine file mode (read/write)
+  bool overwrite = false;
+  std::ios_base::openmode mode = std::ios_base::in;
+  if( channel==1 ) mode = std::ios_base::out;
+  if( pt.size() >= 3 )
+    {
+      if( pt[2]=="R" )
+        mode = std::ios_base::in;
+      else if( pt[2]=="W" )
+        mode = std::ios_base::out;
+    }
+
+  if( mstr::startsWith(nv, "@:") )
+    {
+      overwrite = true;
+      nv.remove_prefix(2);
+    }      
+
+  // relative file: "name,L,<record length>"
+  uint8_t recordLen = 0;
+  const char *l = strstr(cname, ",L,");
+  if( l!=nullptr ) recordLen = l[3];
+
+  // file name officially ends at first "shifted space" (0xA0) character
+  std::string name(nv.substr(0, nv.find('\xa0')));
+
+  Debug_printv("opening channel[%d] m_cwd[%s] name[%s] mode[%s]", channel, m_cwd->url.c_str(), name.c_str(), 
+               mode==std::ios_base::out ? (overwrite ? "replace" : "write") : "read");
+
+  if( name.length()==0 )
+    {
+      Debug_printv("Error: empty file name");
+      setStatusCode(ST_SYNTAX_ERROR_33);
+    }
+  else if( m_channels[channel] != nullptr )
+    {
+      Debug_printv("Error: a file is already open on this channel");
+      setStatusCode(ST_NO_CHANNEL);
+    }
+  else if( name[0] == '#' )
+    {
+      // direct access channel, optionally followed by a buffer number
+      if( getImageStream()==nullptr )
+        {
+          Debug_printv("Error: direct access requires a disk image");
+          setStatusCode(ST_DRIVE_NOT_READY);
+        }
+      else
+        {
+          uint8_t bufferNum = name.length()>1 ? atoi(name.c_str()+1) : channel;
+          m_channels[channel] = new iecChannelHandlerDirect(this, bufferNum);
+          m_numOpenChannels++;
+          Debug_printv("Direct access channel, buffer %d", bufferNum);
+          setStatusCode(ST_OK);
+        }
+    }
+  else if( name[0]!='$' && channel>1 && 
+           (recordLen>0 || (pt.size()>=2 && pt[1]=="L") || (pt.size()<2 && mode==std::ios_base::in)) &&
+           openRelativeFile(channel, name, recordLen) )
+    {
+      // relative file was opened (or status was set)
+    }
+  else
+    {
+      if ( name[0] == '$' ) 
+        name.clear();
+
+      // get file
+      MFile *f = m_cwd->cd(mstr::toUTF8(name));
+
+      if( f == nullptr || f->url.empty() )
+        {
+          Debug_printv("Error: could not find file system for URL [%s]", name.c_str());
+          setStatusCode(ST_FILE_NOT_FOUND);
+          if( f!=nullptr ) delete f;
+          f = nullptr;
+        }
+      else if( f->isDirectory() )
+        {
+          if( mode == std::ios_base::in )
+            {
+              // reading directory
+              time_t stamp;
+              std::shared_ptr<const std::string> listing = m_dirCache.get(f, stamp);
+              std::unique_ptr<MFile> entry;
+              if( listing!=nullptr || (entry = std::unique_ptr<MFile>( f->getNextFileInDir() ))!=nullptr )
+                {
+                  // regular directory
+                  if( listing==nullptr ) f->rewindDirectory();
+                  m_channels[channel] = new iecChannelHandlerDir(this, f, &m_dirCache, stamp, listing);
+                  m_numOpenChannels++;
+                  m_cwd.reset(MFSOwner::File(f->url));
+                  m_relDirUrl.clear(); // pick up relative files added from outside
+                  Debug_printv("Reading directory [%s]", f->url.c_str());
+                  f = nullptr; // f will be deleted in iecChannelHandlerDir destructor
+                  setStatusCode(ST_OK);
+                }
+              else
+                {
+                  // can't read file etries => treat directory as file
+                  m_cwd.reset(MFSOwner::File(f->url));
+                  Debug_printv("Treating directory as file [%s]", f->url.c_str());
+                }
+            }
+          else
             {
-              Debug_printv("Error: writing to files on disk media not supported [%s]", f->url.c_str());
+              // cannot write to directory
+              Debug_printv("Error: attempt to write to directory [%s]", f->url.c_str());
               setStatusCode(ST_WRITE_PROTECT);
+              delete f;
+              f = nullptr;
+            }
+        }
+
+      if( f != nullptr )
+        {
+          // opening a file
+          if( (mode == std::ios_base::in) && !f->exists() )
+            {
+              Debug_printv("Error: file doesn't exist [%s]", f->url.c_str());
+              setStatusCode(ST_FILE_NOT_FOUND);
+            }
+          else if( (mode == std::ios_base::out) && f->media_image.size()>0 )
+            {
+              // file type from "name,S/P/U", default is PRG for SAVE and SEQ otherwise
+              uint8_t fileType = channel==1 ? 2 : 1;
+              if( pt.size()>=2 && pt[1].length()>0 )
+                {
+                  const char *p = strchr("SPU", pt[1][0]);
+                  if( p!=nullptr ) fileType = 1 + (p - "SPU");
+                }
+
+              openImageWrite(channel, name, fileType, overwrite);
             }
           else if( (mode == std::ios_base::out) && f->exists() && !overwrite )
             {
@@ -577,232 +2667,1083 @@ bool iecDrive::open(uint8_t channel, const char *cname)
             }
           else
             {
-              MStream *new_stream = f->getSourceStream(mode);
-              
-              if( new_stream==nullptr )
-                {
-                  Debug_printv("Error: could not get stream for file [%s]", f->url.c_str());
-                  setStatusCode(ST_DRIVE_NOT_READY);
-                }
-              else if( (mode == std::ios_base::in) && new_stream->size()==0 && !f->isDirectory() )
-                {
-                  Debug_printv("Error: file length is zero [%s]", f->url.c_str());
-                  delete new_stream;
-                  setStatusCode(ST_FILE_NOT_FOUND);
-                }
-              else if( !new_stream->isOpen() )
-                {
-                  Debug_printv("Error: could not open file stream [%s]", f->url.c_str());
-                  delete new_stream;
-                  setStatusCode(ST_DRIVE_NOT_READY);
-                }
-              else
+              MStream *new_stream = f->getSourceStream(mode);
+              
+              if( new_stream==nullptr )
+                {
+                  Debug_printv("Error: could not get stream for file [%s]", f->url.c_str());
+                  setStatusCode(ST_DRIVE_NOT_READY);
+                }
+              else if( (mode == std::ios_base::in) && new_stream->size()==0 && !f->isDirectory() )
+                {
+                  Debug_printv("Error: file length is zero [%s]", f->url.c_str());
+                  delete new_stream;
+                  setStatusCode(ST_FILE_NOT_FOUND);
+                }
+              else if( !new_stream->isOpen() )
+                {
+                  Debug_printv("Error: could not open file stream [%s]", f->url.c_str());
+                  delete new_stream;
+                  setStatusCode(ST_DRIVE_NOT_READY);
+                }
+              else
+                {
+                  Debug_printv("Stream created for file [%s]", f->url.c_str());
+          
+                  if( new_stream->has_subdirs )
+                    {
+                      // Filesystem supports sub directories => set m_cwd to parent directory of file
+                      Debug_printv("Subdir Change Directory Here! stream[%s] > base[%s]", f->url.c_str(), f->base().c_str());
+                      m_cwd.reset(MFSOwner::File(f->base()));
+                    }
+                  else
+                    {
+                      // Handles media files that may have '/' as part of the filename
+                      auto f = MFSOwner::File( new_stream->url );
+                      Debug_printv( "Change Directory Here! istream[%s] > base[%s]", new_stream->url.c_str(), f->streamFile->url.c_str() );
+                      m_cwd.reset( f->streamFile );
+                    }
+
+                  // new_stream will be deleted in iecChannelHandlerFile destructor
+                  // (create handler last since it may start reading new_stream in a background task)
+                  if( mode == std::ios_base::in )
+                    m_channels[channel] = new iecChannelHandlerFile(this, new_stream, f->isDirectory() ? 0x0801 : -1, m_readAheadDepth);
+                  else
+                    {
+                      m_channels[channel] = new iecChannelHandlerFile(this, new_stream, -1, m_writeBehindDepth, true);
+                      invalidateDirCache(m_cwd->url);
+                      MediaCache::invalidate(f->url);
+                    }
+                  m_numOpenChannels++;
+                  setStatusCode(ST_OK);
+                }
+            }
+        }
+      
+      delete f;
+    }
+
+  return m_channels[channel]!=NULL;
+}
+
+
+void iecDrive::close(uint8_t channel)
+{
+  Debug_printv("iecDrive::close(#%d, %d)", m_devnr, channel);
+
+  if( m_channels[channel] != nullptr )
+    {
+      iecChannelHandler *handler = m_channels[channel];
+      m_channels[channel] = nullptr;
+      if( m_numOpenChannels>0 ) m_numOpenChannels--;
+      if( m_lastWriteChannel==channel ) m_lastWriteChannel = 0xFF;
+
+      // file size is final now => drop listing rendered while writing
+      if( handler->isWriting() ) invalidateDirCache(m_cwd->url);
+
+      uint8_t st = handler->finish(m_writeBehindWaitOnClose);
+      if( handler->isBusy() )
+        {
+          // write-behind queue still has data => finish writing in the background
+          Debug_printv("Channel %d closed, writing remaining data in background.", channel);
+          m_closingChannels.push_back(handler);
+        }
+      else
+        {
+          delete handler;
+          Debug_printv("Channel %d closed.", channel);
+        }
+
+      if( st!=ST_OK ) setStatusCode(st);
+    }
+}
+
+
+uint8_t iecDrive::write(uint8_t channel, uint8_t *data, uint8_t dataLen) 
+{
+  iecChannelHandler *handler = m_channels[channel];
+  if( handler==nullptr )
+    {
+      if( m_statusCode==ST_OK ) setStatusCode(ST_FILE_NOT_OPEN);
+      return 0;
+    }
+  else
+    {
+      m_lastWriteChannel = channel;
+      return handler->write(data, dataLen);
+    }
+}
+
+ 
+uint8_t iecDrive::read(uint8_t channel, uint8_t *data, uint8_t maxDataLen)
+{ 
+  iecChannelHandler *handler = m_channels[channel];
+  if( handler==nullptr )
+    {
+      if( m_statusCode==ST_OK ) setStatusCode(ST_FILE_NOT_OPEN);
+      return 0;
+    }
+  else
+    return handler->read(data, maxDataLen);
+}
+
+
+void iecDrive::execute(const char *cmd, uint8_t cmdLen)
+{
+  Debug_printv("iecDrive::execute(#%d, \"%s\", %d)", m_devnr, cmd, cmdLen);
+
+  std::string command = std::string(cmd, cmdLen);
+
+  if( mstr::startsWith(command, "S:") )
+    {
+      // SCRATCH (delete)
+      uint8_t n = 0;
+      command = command.substr(2);
+
+      if( m_cwd->media_image.size()>0 )
+        {
+          // scratch inside disk image: free blocks in BAM and clear directory entries
+          iecDiskImage *image = getDiskImage();
+          uint8_t st = image!=nullptr ? image->scratch(command, n) : ST_WRITE_PROTECT;
+          if( st==ST_OK ) st = flushSectorCache();
+          if( st!=ST_OK ) { setStatusCode(st); return; }
+        }
+      else
+        {
+          MFile *dir = MFSOwner::File(m_cwd->url);
+          if( dir!=nullptr )
+            {
+              if( dir->isDirectory() )
                 {
-                  Debug_printv("Stream created for file [%s]", f->url.c_str());
-                  // new_stream will be deleted in iecChannelHandlerFile destructor
-                  m_channels[channel] = new iecChannelHandlerFile(this, new_stream, f->isDirectory() ? 0x0801 : -1);
-                  m_numOpenChannels++;
-                  setStatusCode(ST_OK);
-          
-                  if( new_stream->has_subdirs )
-                    {
-                      // Filesystem supports sub directories => set m_cwd to parent directory of file
-                      Debug_printv("Subdir Change Directory Here! stream[%s] > base[%s]", f->url.c_str(), f->base().c_str());
-                      m_cwd.reset(MFSOwner::File(f->base()));
-                    }
-                  else
+                  std::unique_ptr<MFile> entry;
+                  while( (entry=std::unique_ptr<MFile>(m_cwd->getNextFileInDir()))!=nullptr )
                     {
-                      // Handles media files that may have '/' as part of the filename
-                      auto f = MFSOwner::File( new_stream->url );
-                      Debug_printv( "Change Directory Here! istream[%s] > base[%s]", new_stream->url.c_str(), f->streamFile->url.c_str() );
-                      m_cwd.reset( f->streamFile );
+                      if( !entry->isDirectory() && isMatch(mstr::toPETSCII2(entry->name), command) )
+                        {
+                          Debug_printv("DELETING %s", entry->name.c_str());
+                          if( entry->remove() ) 
+                            {
+                              n++;
+                              MediaCache::invalidate(entry->url);
+
+                              // remove record length sidecar of relative files
+                              std::unique_ptr<MFile> side( m_cwd->cd("." + entry->name + ".rel") );
+                              if( side!=nullptr && side->exists() ) side->remove();
+                            }
+                        }
+                      //else Debug_printv("NOT DELETING %s", entry->name.c_str());
                     }
                 }
+
+              delete dir;
+            }
+        }
+
+      if( n>0 ) invalidateDirCache(m_cwd->url);
+      setStatusCode(ST_SCRATCHED, n);
+    }
+  else if( command[0]=='R' && command.find('=')!=std::string::npos )
+    {
+      rename(command);
+    }
+  else if( mstr::startsWith(command, "CD") )
+    {
+      set_cwd(mstr::drop(command, 2));
+    }
+  else if( command.length()>=2 && command[0]=='U' && strchr("12AB", command[1])!=nullptr )
+    {
+      executeBlockCommand(command);
+    }
+  else if( mstr::startsWith(command, "B-") )
+    {
+      executeBlockCommand(command);
+    }
+  else if( command[0]=='P' && command.length()>=2 )
+    {
+      // POSITION relative file: P <channel> <record low> <record high> <position>
+      uint8_t  channel = command[1] & 0x0F;
+      uint16_t record  = (command.length()>2 ? (uint8_t) command[2] : 1) + (command.length()>3 ? (uint8_t) command[3] : 0) * 256;
+      uint8_t  pos     = command.length()>4 ? (uint8_t) command[4] : 1;
+
+      if( m_channels[channel]==nullptr || !m_channels[channel]->isRelative() )
+        setStatusCode(ST_NO_CHANNEL);
+      else
+        {
+          // data already fetched for the old position must not be sent
+          clearReadBuffer(channel);
+
+          // record numbers and positions start at 1
+          iecChannelHandlerRel *handler = (iecChannelHandlerRel *) m_channels[channel];
+          setStatusCode(handler->position(record>0 ? record-1 : 0, pos>0 ? pos-1 : 0));
+        }
+    }
+  else if( command=="I" || command=="I0" )
+    {
+      // INITIALIZE: write back modified sectors and re-read the image
+      uint8_t st = flushSectorCache();
+      m_trackCache.clear();
+      m_imageStream.reset();
+      m_diskImage.unload();
+      setStatusCode(st);
+    }
+#ifdef SUPPORT_JIFFY
+  else if( command=="EJ+" || command=="EJ-" )
+    {
+      enableJiffyDosSupport(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+#endif  
+#ifdef SUPPORT_EPYX
+  else if( command=="EE+" || command=="EE-" )
+    {
+      enableEpyxFastLoadSupport(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+#endif  
+#ifdef SUPPORT_BURST
+  else if( command=="EB+" || command=="EB-" )
+    {
+      enableBurstSupport(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+#endif  
+#ifdef SUPPORT_DOLPHIN
+  else if( command=="ED+" || command=="ED-" )
+    {
+      enableDolphinDosSupport(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+  else if( command == "M-R\xfa\x02\x03" )
+    {
+      // hack: DolphinDos' MultiDubTwo copy program reads 02FA-02FC to determine
+      // number of free blocks => report the disk image's BAM or pretend we have 664 (0298h) blocks available
+      iecDiskImage *image = m_cwd->media_image.size()>0 ? getDiskImage() : nullptr;
+      uint16_t n = image!=nullptr ? image->blocksFree() : 664;
+      m_statusCode = ST_OK;
+      uint8_t data[3] = {(uint8_t) (n & 255), 0, (uint8_t) (n / 256)};
+      setStatus((char *) data, 3);
+    }
+#endif
+#if IEC_TRACE_BUFFER_SIZE>0
+  else if( command=="ET+" || command=="ET-" )
+    {
+      // start/stop recording IEC bus transactions (see /iectrace in the web UI)
+      IEC.enableTrace(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+#endif
+  else if( mstr::startsWith(command, "M-STAT") )
+    {
+      // transfer statistics: "M-STAT" (all), "M-STAT:<backend or protocol>", "M-STAT-" (clear)
+      if( command=="M-STAT-" )
+        {
+          m_stats.clear();
+          setStatusCode(ST_OK);
+        }
+      else
+        {
+          std::string which = command.length()>7 && command[6]==':' ? command.substr(7) : "";
+          std::string summary = m_stats.getSummary(which);
+          if( summary.empty() )
+            setStatusCode(ST_SYNTAX_ERROR_31);
+          else
+            {
+              m_statusCode = ST_OK;
+              summary += "\r";
+              setStatus(summary.c_str(), summary.length());
             }
         }
-      
-      delete f;
+    }
+  else if( command.length()>=6 && mstr::startsWith(command, "M-W") )
+    {
+      // memory write that is not part of a known fast-loader upload (see IECFileDevice::checkDriveCode()).
+      // There is no drive RAM to write to, accept it like a drive would and log it so the
+      // upload sequence can be added to the signature table
+      uint8_t len = command[5], checksum = 0;
+      for(size_t i=6; i<command.length() && i<6u+len; i++) checksum += command[i];
+      Debug_printv("M-W $%04X len[%d] checksum[$%02X]", (uint8_t) command[3] | ((uint8_t) command[4] << 8), len, checksum);
+      setStatusCode(ST_OK);
+    }
+  else if( command.length()>=5 && mstr::startsWith(command, "M-E") )
+    {
+      // unknown drive code can not be run, the host falls back to the standard protocol
+      Debug_printv("M-E $%04X", (uint8_t) command[3] | ((uint8_t) command[4] << 8));
+      setStatusCode(ST_OK);
+    }
+  else
+    {
+      setStatusCode(ST_SYNTAX_ERROR_31);
+      Debug_printv("Invalid command");
+    }
+}
+
+
+void iecDrive::executeBlockCommand(std::string command)
+{
+  // U1/UA: block read, U2/UB: block write, B-R/B-W: block read/write with
+  // byte count in first byte, B-P: buffer pointer, B-A/B-F: allocate/free block in the BAM
+  char op;
+  if( command[0]=='U' )
+    op = (command[1]=='1' || command[1]=='A') ? '1' : '2';
+  else if( command.length()>=3 )
+    op = command[2];
+  else
+    op = 0;
+
+  // parameters follow an optional ':' and are separated by spaces, commas or colons
+  size_t i = command[0]=='U' ? 2 : 3;
+  int params[4] = {0, 0, 0, 0};
+  uint8_t numParams = 0;
+  while( i<command.length() && numParams<4 )
+    {
+      while( i<command.length() && strchr(": ,\x1D\r", command[i])!=nullptr ) i++;
+      if( i<command.length() && isdigit(command[i]) )
+        {
+          params[numParams] = 0;
+          while( i<command.length() && isdigit(command[i]) ) params[numParams] = params[numParams]*10 + (command[i++]-'0');
+          numParams++;
+        }
+      else
+        break;
+    }
+
+  uint8_t numRequired = (op=='P') ? 2 : ((op=='A' || op=='F') ? 3 : 4);
+  if( strchr("12RWPAF", op)==nullptr || op==0 || numParams<numRequired )
+    {
+      Debug_printv("Invalid block command");
+      setStatusCode(ST_SYNTAX_ERROR_31);
+      return;
+    }
+
+  if( op=='A' || op=='F' )
+    {
+      // B-A/B-F <drive> <track> <sector>, no channel involved
+      iecDiskImage *image = getDiskImage();
+      uint8_t track = params[1], sector = params[2];
+      uint8_t st;
+
+      if( image==nullptr )
+        st = ST_WRITE_PROTECT;
+      else if( op=='A' )
+        st = image->allocateBlockAt(track, sector);
+      else if( image->isValidBlock(track, sector) )
+        { image->freeBlock(track, sector); st = ST_OK; }
+      else
+        st = ST_ILLEGAL_TRACK_SECTOR;
+
+      // the BAM goes to the track cache right away, the program writes the block with U2 next
+      if( st==ST_OK ) st = image->writeBAM();
+
+      if( st==ST_OK )
+        setStatusCode(ST_OK);
+      else
+        setStatusCode(st, track, sector);
+      return;
+    }
+
+  uint8_t channel = params[0] & 0x0F;
+  if( m_channels[channel]==nullptr || !m_channels[channel]->isDirectAccess() )
+    {
+      Debug_printv("Channel %d is not a direct access channel", channel);
+      setStatusCode(ST_NO_CHANNEL);
+      return;
+    }
+
+  iecChannelHandlerDirect *handler = (iecChannelHandlerDirect *) m_channels[channel];
+  uint8_t *buffer = handler->getBuffer();
+  uint8_t track = params[2], sector = params[3];
+  uint8_t st = ST_OK;
+
+  switch( op )
+    {
+    case 'P':
+      handler->setPointer(params[1]);
+      break;
+
+    case '1':
+      st = readSector(track, sector, buffer);
+      if( st==ST_OK ) handler->setPointer(0);
+      break;
+
+    case 'R':
+      st = readSector(track, sector, buffer);
+      if( st==ST_OK ) handler->setPointer(1, buffer[0]==0 ? 256 : buffer[0]+1);
+      break;
+
+    case 'W':
+      buffer[0] = handler->getPointer()>0 ? handler->getPointer()-1 : 0;
+      // fall through
+
+    case '2':
+      st = writeSector(track, sector, buffer);
+      break;
+    }
+
+  if( st==ST_OK )
+    setStatusCode(ST_OK);
+  else
+    setStatusCode(st, track, sector);
+}
+
+
+void iecDrive::invalidateDirCache(const std::string &url)
+{
+  m_dirCache.invalidate(url);
+  if( mstr::startsWith(m_relDirUrl, url.c_str()) ) m_relDirUrl.clear();
+}
+
+
+void iecDrive::setStatusCode(uint8_t code, uint8_t trk, uint8_t sec)
+{
+  m_stats.addError(code);
+  m_statusCode = code;
+  m_statusTrk  = trk;
+  m_statusSec  = sec;
+
+  // clear current status buffer to force a call to getStatus()
+  clearStatus();
+}
+
+
+bool iecDrive::hasError()
+{
+  return (m_statusCode>=20) && (m_statusCode!=ST_SPLASH);
+}
+
+
+void iecDrive::getStatus(char *buffer, uint8_t bufferSize)
+{
+  Debug_printv("iecDrive::getStatus(#%d)", m_devnr);
+
+  // report errors from background (write-behind) writes. Modified sectors are only written
+  // back here in durable mode, otherwise a U2 followed by a status check for every block
+  // would defeat the track cache (errors of the delayed write-back are set by task())
+  if( m_statusCode==ST_OK || m_statusCode==ST_SPLASH )
+    {
+      // the sector writer stays open since programs often check the status after every block
+      uint8_t st = m_writeBehindDurable ? flushSectorCache(true) : ST_OK;
+      if( st==ST_OK ) st = reapClosedChannels(m_writeBehindDurable);
+
+      // only the channel written last (which a status check after PRINT# is about) is
+      // synced, the others report errors their background writes already ran into
+      for(int i=0; i<16 && st==ST_OK; i++)
+        if( m_channels[i]!=nullptr )
+          st = (m_writeBehindDurable && i==m_lastWriteChannel) ? m_channels[i]->sync() : m_channels[i]->getDeferredStatus();
+
+      if( st!=ST_OK )
+        {
+          m_stats.addError(st);
+          m_statusCode = st;
+          m_statusTrk  = 0;
+          m_statusSec  = 0;
+        }
+    }
+
+  const char *msg = NULL;
+  switch( m_statusCode )
+    {
+    case ST_OK             : msg = " OK"; break;
+    case ST_SCRATCHED      : msg = "FILES SCRATCHED"; break;
+    case ST_READ_ERROR     : msg = "READ ERROR"; break;
+    case ST_WRITE_ERROR    : msg = "WRITE ERROR"; break;
+    case ST_WRITE_PROTECT  : msg = "WRITE PROTECT"; break;
+    case ST_SYNTAX_ERROR_31:
+    case ST_SYNTAX_ERROR_33: msg = "SYNTAX ERROR"; break;
+    case ST_RECORD_NOT_PRESENT: msg = "RECORD NOT PRESENT"; break;
+    case ST_OVERFLOW_IN_RECORD: msg = "OVERFLOW IN RECORD"; break;
+    case ST_FILE_TOO_LARGE : msg = "FILE TOO LARGE"; break;
+    case ST_FILE_NOT_FOUND : msg = "FILE NOT FOUND"; break;
+    case ST_FILE_NOT_OPEN  : msg = "FILE NOT OPEN"; break;
+    case ST_FILE_EXISTS    : msg = "FILE EXISTS"; break;
+    case ST_SPLASH         : msg = PRODUCT_ID; break;
+    case ST_NO_CHANNEL     : msg = "NO CHANNEL"; break;
+    case ST_DISK_FULL      : msg = "DISK FULL"; break;
+    case ST_DRIVE_NOT_READY: msg = "DRIVE NOT READY"; break;
+    case ST_FILE_TYPE_MISMATCH: msg = "FILE TYPE MISMATCH"; break;
+    case ST_NO_BLOCK       : msg = "NO BLOCK"; break;
+    case ST_ILLEGAL_TRACK_SECTOR: msg = "ILLEGAL TRACK OR SECTOR"; break;
+    default                : msg = "UNKNOWN ERROR"; break;
+    }
+
+  snprintf(buffer, bufferSize, "%02d,%s,%02d,%02d\r", m_statusCode, msg, m_statusTrk, m_statusSec);
+
+  Debug_printv("status: %s", buffer);
+  m_statusCode = ST_OK;
+  m_statusTrk  = 0;
+  m_statusSec  = 0;
+}
+
+
+
+void iecDrive::reset()
+{
+  Debug_printv("iecDrive::reset(#%d)", m_devnr);
+  setStatusCode(ST_SPLASH);
+
+  // close all open channels
+  for(int i=0; i<16; i++)
+    if( m_channels[i]!=nullptr )
+      close(i);
+  m_numOpenChannels = 0;
+  reapClosedChannels(true);
+  flushSectorCache();
+  m_trackCache.clear();
+  m_imageStream.reset();
+  m_diskImage.unload();
+
+  IECFileDevice::reset();
+}
+
+
+void iecDrive::endTransfer(uint8_t channel, bool talk)
+{
+  if( m_channels[channel]!=nullptr )
+    m_channels[channel]->endTransfer(talk);
+}
+
+
+MStream *iecDrive::getImageStream()
+{
+  if( m_cwd==nullptr || m_cwd->media_image.empty() )
+    {
+      flushSectorCache();
+      m_trackCache.clear();
+      m_imageStream.reset();
+      m_imageUrl.clear();
+      return nullptr;
+    }
+
+  // reloaded tracks must include what the open writer has written so far
+  if( m_imageWriter!=nullptr && m_imageUrl==m_cwd->url )
+    return m_imageWriter.get();
+
+  // re-open the image if the current directory has moved to a different one
+  // (or the stream was closed after writing back modified sectors)
+  if( m_imageStream==nullptr || m_imageStream->url!=m_cwd->url )
+    {
+      if( m_imageUrl!=m_cwd->url )
+        {
+          flushSectorCache();
+          m_trackCache.clear();
+          m_imageUrl = m_cwd->url;
+        }
+
+      m_imageStream.reset( m_cwd->getSourceStream() );
+      if( m_imageStream==nullptr )
+        Debug_printv("Unable to open image stream [%s]", m_cwd->url.c_str());
     }
 
-  return m_channels[channel]!=NULL;
+  return m_imageStream.get();
 }
 
 
-void iecDrive::close(uint8_t channel)
+uint8_t iecDrive::readSector(uint8_t track, uint8_t sector, uint8_t *buffer)
 {
-  Debug_printv("iecDrive::close(#%d, %d)", m_devnr, channel);
+  MStream *image = getImageStream();
+  if( image==nullptr ) return ST_DRIVE_NOT_READY;
 
-  if( m_channels[channel] != nullptr )
+  // loading a new track may evict one with modified sectors
+  if( m_trackCache.isDirty() && !m_trackCache.isCached(track, sector) )
     {
-      delete m_channels[channel];
-      m_channels[channel] = nullptr;
-      if( m_numOpenChannels>0 ) m_numOpenChannels--;
-      Debug_printv("Channel %d closed.", channel);
+      uint8_t st = flushSectorCache(true);
+      if( st!=ST_OK ) return st;
+      if( (image = getImageStream())==nullptr ) return ST_DRIVE_NOT_READY;
     }
+
+  return m_trackCache.readSector(image, track, sector, buffer);
 }
 
 
-uint8_t iecDrive::write(uint8_t channel, uint8_t *data, uint8_t dataLen) 
+uint8_t iecDrive::writeSector(uint8_t track, uint8_t sector, const uint8_t *buffer)
 {
-  iecChannelHandler *handler = m_channels[channel];
-  if( handler==nullptr )
+  MStream *image = getImageStream();
+  if( image==nullptr ) return ST_DRIVE_NOT_READY;
+
+  if( m_trackCache.isDirty() && !m_trackCache.isCached(track, sector) )
     {
-      if( m_statusCode==ST_OK ) setStatusCode(ST_FILE_NOT_OPEN);
-      return 0;
+      uint8_t st = flushSectorCache(true);
+      if( st!=ST_OK ) return st;
+      if( (image = getImageStream())==nullptr ) return ST_DRIVE_NOT_READY;
     }
-  else
-    return handler->write(data, dataLen);
+
+  // BAM modified from outside (B-W, U2, fast loaders) => re-read it before the next allocation
+  if( m_diskImage.isLoaded() && !m_diskImage.isWritingBAM() && m_diskImage.isBAMSector(track, sector) )
+    m_diskImage.unload();
+
+  uint8_t st = m_trackCache.writeSector(image, track, sector, buffer);
+  if( st==ST_OK ) invalidateDirCache(m_imageUrl);
+  return st;
 }
 
- 
-uint8_t iecDrive::read(uint8_t channel, uint8_t *data, uint8_t maxDataLen)
-{ 
-  iecChannelHandler *handler = m_channels[channel];
-  if( handler==nullptr )
+
+uint8_t iecDrive::flushSectorCache(bool keepWriter)
+{
+  uint8_t st = ST_OK;
+  if( m_trackCache.isDirty() )
     {
-      if( m_statusCode==ST_OK ) setStatusCode(ST_FILE_NOT_OPEN);
-      return 0;
+      // the cached image stream is read-only => open a separate stream for writing
+      if( m_imageWriter==nullptr )
+        {
+          std::unique_ptr<MFile> f( MFSOwner::File(m_imageUrl) );
+          if( f!=nullptr ) m_imageWriter.reset( f->getSourceStream(std::ios_base::in | std::ios_base::out) );
+
+          if( m_imageWriter==nullptr || !m_imageWriter->isOpen() )
+            {
+              Debug_printv("Unable to open image for writing [%s]", m_imageUrl.c_str());
+              m_imageWriter.reset();
+              m_trackCache.flush(nullptr);
+              m_diskImage.unload();
+              return ST_WRITE_PROTECT;
+            }
+        }
+
+      st = m_trackCache.flush(m_imageWriter.get());
+      if( st!=ST_OK ) { m_diskImage.unload(); keepWriter = false; }
     }
-  else
-    return handler->read(data, maxDataLen);
+
+  if( m_imageWriter!=nullptr && !keepWriter )
+    {
+      m_imageWriter.reset();
+
+      // re-open read stream on next access so it does not return stale data, same
+      // for the stream the image broker shares between directory listings
+      m_imageStream.reset();
+      ImageBroker::dispose(m_imageUrl);
+    }
+
+  return st;
 }
 
 
-void iecDrive::execute(const char *cmd, uint8_t cmdLen)
+iecDiskImage *iecDrive::getDiskImage()
 {
-  Debug_printv("iecDrive::execute(#%d, \"%s\", %d)", m_devnr, cmd, cmdLen);
+  // only files in the root directory of the image
+  if( getImageStream()==nullptr || !m_cwd->pathInStream.empty() ) return nullptr;
 
-  std::string command = std::string(cmd, cmdLen);
+  if( !m_diskImage.isLoaded() || m_diskImage.getUrl()!=m_imageUrl )
+    if( !m_diskImage.load(m_imageUrl, m_cwd->media_image) )
+      {
+        Debug_printv("Unable to read BAM of disk image [%s]", m_imageUrl.c_str());
+        return nullptr;
+      }
 
-  if( mstr::startsWith(command, "S:") )
-    {
-      // SCRATCH (delete)
-      uint8_t n = 0;
-      command = command.substr(2);
+  return &m_diskImage;
+}
 
-      MFile *dir = MFSOwner::File(m_cwd->url);
-      if( dir!=nullptr )
-        {
-          if( dir->isDirectory() )
-            {
-              std::unique_ptr<MFile> entry;
-              while( (entry=std::unique_ptr<MFile>(m_cwd->getNextFileInDir()))!=nullptr )
-                {
-                  if( !entry->isDirectory() && isMatch(mstr::toPETSCII2(entry->name), command) )
-                    {
-                      Debug_printv("DELETING %s", entry->name.c_str());
-                      if( entry->remove() ) n++;
-                    }
-                  //else Debug_printv("NOT DELETING %s", entry->name.c_str());
-                }
-            }
 
-          delete dir;
-        }
+void iecDrive::openImageWrite(uint8_t channel, std::string name, uint8_t fileType, bool overwrite)
+{
+  iecDiskImage *image = getDiskImage();
+  uint8_t entry[32];
+  uint16_t index;
 
-      setStatusCode(ST_SCRATCHED, n);
+  if( image==nullptr || name.find('/')!=std::string::npos )
+    {
+      Debug_printv("Error: writing to files on this disk media not supported [%s]", name.c_str());
+      setStatusCode(ST_WRITE_PROTECT);
     }
-  else if( mstr::startsWith(command, "CD") )
+  else if( name.find_first_of("*?")!=std::string::npos )
     {
-      set_cwd(mstr::drop(command, 2));
+      setStatusCode(ST_SYNTAX_ERROR_33);
     }
-#ifdef SUPPORT_JIFFY
-  else if( command=="EJ+" || command=="EJ-" )
+  else if( image->findEntry(name, entry, index) && !overwrite )
     {
-      enableJiffyDosSupport(command[2]=='+');
-      setStatusCode(ST_OK);
+      Debug_printv("Error: file exists [%s]", name.c_str());
+      setStatusCode(ST_FILE_EXISTS);
     }
-#endif  
-#ifdef SUPPORT_EPYX
-  else if( command=="EE+" || command=="EE-" )
+  else if( image->blocksFree()==0 )
     {
-      enableEpyxFastLoadSupport(command[2]=='+');
-      setStatusCode(ST_OK);
+      setStatusCode(ST_DISK_FULL);
     }
-#endif  
-#ifdef SUPPORT_DOLPHIN
-  else if( command=="ED+" || command=="ED-" )
+  else
     {
-      enableDolphinDosSupport(command[2]=='+');
+      m_channels[channel] = new iecChannelHandlerImageWrite(this, image, name, fileType, overwrite);
+      m_numOpenChannels++;
+      invalidateDirCache(m_cwd->url);
       setStatusCode(ST_OK);
     }
-  else if( command == "M-R\xfa\x02\x03" )
+}
+
+
+void iecDrive::rename(std::string command)
+{
+  // RENAME: R[0]:<new name>=[0:]<old name>
+  size_t i = command.find(':'), j = command.find('=');
+  if( i==std::string::npos || i>j )
     {
-      // hack: DolphinDos' MultiDubTwo copy program reads 02FA-02FC to determine
-      // number of free blocks => pretend we have 664 (0298h) blocks available
-      m_statusCode = ST_OK;
-      uint8_t data[3] = {0x98, 0, 0x02};
-      setStatus((char *) data, 3);
+      setStatusCode(ST_SYNTAX_ERROR_31);
+      return;
+    }
+
+  std::string newName = command.substr(i+1, j-i-1);
+  std::string oldName = command.substr(j+1);
+  if( mstr::startsWith(oldName, "0:") ) oldName = mstr::drop(oldName, 2);
+  if( newName.empty() || oldName.empty() || newName.find_first_of("*?")!=std::string::npos )
+    {
+      setStatusCode(ST_SYNTAX_ERROR_33);
+      return;
+    }
+
+  uint8_t st;
+  if( m_cwd->media_image.size()>0 )
+    {
+      iecDiskImage *image = getDiskImage();
+      st = image!=nullptr ? image->rename(newName, oldName) : ST_WRITE_PROTECT;
+      if( st==ST_OK ) st = flushSectorCache();
     }
-#endif
   else
     {
-      setStatusCode(ST_SYNTAX_ERROR_31);
-      Debug_printv("Invalid command");
+      std::unique_ptr<MFile> src( m_cwd->cd(mstr::toUTF8(oldName)) );
+      std::unique_ptr<MFile> dst( m_cwd->cd(mstr::toUTF8(newName)) );
+      if( src==nullptr || dst==nullptr || !src->exists() )
+        st = ST_FILE_NOT_FOUND;
+      else if( dst->exists() )
+        st = ST_FILE_EXISTS;
+      else if( !src->rename(dst->path) )
+        st = ST_WRITE_PROTECT;
+      else
+        {
+          // keep record length sidecar of relative files with the data file
+          std::unique_ptr<MFile> side( m_cwd->cd(mstr::toUTF8("." + oldName + ".rel")) );
+          std::unique_ptr<MFile> sideNew( m_cwd->cd(mstr::toUTF8("." + newName + ".rel")) );
+          if( side!=nullptr && sideNew!=nullptr && side->exists() ) side->rename(sideNew->path);
+          st = ST_OK;
+        }
     }
+
+  if( st==ST_OK ) invalidateDirCache(m_cwd->url);
+  setStatusCode(st);
 }
 
 
-void iecDrive::setStatusCode(uint8_t code, uint8_t trk)
+#if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
+bool iecDrive::epyxReadSector(uint8_t track, uint8_t sector, uint8_t *buffer)
 {
-  m_statusCode = code;
-  m_statusTrk  = trk;
+  uint8_t st = readSector(track, sector, buffer);
+  if( st!=ST_OK ) Debug_printv("read failed: track[%d] sector[%d] status[%d]", track, sector, st);
+  return st==ST_OK;
+}
 
-  // clear current status buffer to force a call to getStatus()
-  clearStatus();
+
+bool iecDrive::epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buffer)
+{
+  uint8_t st = writeSector(track, sector, buffer);
+  if( st!=ST_OK ) Debug_printv("write failed: track[%d] sector[%d] status[%d]", track, sector, st);
+  return st==ST_OK;
 }
+#endif
 
 
-bool iecDrive::hasError()
+#ifdef SUPPORT_BURST
+uint8_t iecDrive::getBurstTrack(uint8_t track, uint8_t side)
 {
-  return (m_statusCode>=20) && (m_statusCode!=ST_SPLASH);
+  if( side==0 ) return track;
+
+  // second side of a double-sided (1571) disk continues at track 36 of a D71 image,
+  // D81 track/sector numbers already cover both sides of the disk
+  const std::string &image = m_cwd->media_image;
+  if( mstr::endsWith(image, ".d71", false) ) return track + 35;
+  if( mstr::endsWith(image, ".d81", false) ) return track;
+
+  // single-sided image
+  Debug_printv("no side 1 on image [%s]", image.c_str());
+  return 0;
 }
 
 
-void iecDrive::getStatus(char *buffer, uint8_t bufferSize)
+bool iecDrive::burstReadSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer)
 {
-  Debug_printv("iecDrive::getStatus(#%d)", m_devnr);
+  if( (track = getBurstTrack(track, side))==0 ) return false;
 
-  const char *msg = NULL;
-  switch( m_statusCode )
+  uint8_t st = readSector(track, sector, buffer);
+  if( st!=ST_OK ) Debug_printv("read failed: track[%d] sector[%d] status[%d]", track, sector, st);
+  return st==ST_OK;
+}
+
+
+bool iecDrive::burstWriteSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer)
+{
+  if( (track = getBurstTrack(track, side))==0 ) return false;
+
+  uint8_t st = writeSector(track, sector, buffer);
+  if( st!=ST_OK ) Debug_printv("write failed: track[%d] sector[%d] status[%d]", track, sector, st);
+  return st==ST_OK;
+}
+#endif
+
+
+bool iecDrive::openRelativeFile(uint8_t channel, std::string name, uint8_t recordLen)
+{
+  iecChannelHandler *handler = nullptr;
+  bool isRelative = false;
+
+  if( recordLen==255 )
     {
-    case ST_OK             : msg = " OK"; break;
-    case ST_SCRATCHED      : msg = "FILES SCRATCHED"; break;
-    case ST_WRITE_ERROR    : msg = "WRITE ERROR"; break;
-    case ST_WRITE_PROTECT  : msg = "WRITE PROTECT"; break;
-    case ST_SYNTAX_ERROR_31:
-    case ST_SYNTAX_ERROR_33: msg = "SYNTAX ERROR"; break;
-    case ST_FILE_NOT_FOUND : msg = "FILE NOT FOUND"; break;
-    case ST_FILE_NOT_OPEN  : msg = "FILE NOT OPEN"; break;
-    case ST_FILE_EXISTS    : msg = "FILE EXISTS"; break;
-    case ST_SPLASH         : msg = PRODUCT_ID; break;
-    case ST_NO_CHANNEL     : msg = "NO CHANNEL"; break;
-    case ST_DRIVE_NOT_READY: msg = "DRIVE NOT READY"; break;
-    case ST_FILE_TYPE_MISMATCH: msg = "FILE TYPE MISMATCH"; break;
-    default                : msg = "UNKNOWN ERROR"; break;
+      setStatusCode(ST_SYNTAX_ERROR_33);
+      return true;
     }
 
-  snprintf(buffer, bufferSize, "%02d,%s,%02d,00\r", m_statusCode, msg, m_statusTrk);
+  if( m_cwd->media_image.size()>0 )
+    handler = openRelativeImageFile(name, recordLen, isRelative);
+  else
+    {
+      // native file system: record length is stored in a hidden sidecar file
+      if( recordLen==0 && (!loadRelativeDir() || m_relNames.count(mstr::toUTF8(name))==0) ) return false;
 
-  Debug_printv("status: %s", buffer);
-  m_statusCode = ST_OK;
-  m_statusTrk  = 0;
+      std::unique_ptr<MFile> side( m_cwd->cd(mstr::toUTF8("." + name + ".rel")) );
+      if( side==nullptr ) return false;
+
+      uint8_t len = 0;
+      if( recordLen==0 || side->exists() )
+        {
+          std::unique_ptr<MStream> s( side->getSourceStream() );
+          if( s!=nullptr && s->isOpen() ) s->read(&len, 1);
+        }
+
+      if( len==0 && recordLen==0 ) return false;
+      isRelative = true;
+
+      std::unique_ptr<MFile> f( m_cwd->cd(mstr::toUTF8(name)) );
+      if( f==nullptr )
+        {
+          setStatusCode(ST_FILE_NOT_FOUND);
+          return true;
+        }
+      else if( len==0 )
+        {
+          // create new relative file (record length sidecar and empty data file)
+          if( f->exists() )
+            {
+              Debug_printv("Error: file exists and is not a relative file [%s]", f->url.c_str());
+              setStatusCode(ST_FILE_TYPE_MISMATCH);
+              return true;
+            }
+
+          std::unique_ptr<MStream> s( side->getSourceStream(std::ios_base::out) );
+          std::unique_ptr<MStream> d( f->getSourceStream(std::ios_base::out) );
+          if( s==nullptr || d==nullptr || !s->isOpen() || !d->isOpen() || s->write(&recordLen, 1)!=1 )
+            {
+              Debug_printv("Error: could not create relative file [%s]", f->url.c_str());
+              setStatusCode(ST_WRITE_PROTECT);
+              return true;
+            }
+
+          len = recordLen;
+          invalidateDirCache(m_cwd->url);
+        }
+      else if( recordLen>0 && recordLen!=len )
+        Debug_printv("Record length %d requested but file has %d", recordLen, len);
+
+      MStream *stream = f->getSourceStream(std::ios_base::in | std::ios_base::out);
+      if( stream==nullptr || !stream->isOpen() )
+        {
+          Debug_printv("Error: could not open relative file [%s]", f->url.c_str());
+          delete stream;
+          setStatusCode(ST_DRIVE_NOT_READY);
+          return true;
+        }
+
+      handler = new iecChannelHandlerRelFile(this, stream, len);
+    }
+
+  if( handler!=nullptr )
+    {
+      Debug_printv("Relative file opened on channel %d, record length %d", channel, ((iecChannelHandlerRel *) handler)->getRecordLength());
+      m_channels[channel] = handler;
+      m_numOpenChannels++;
+      setStatusCode(ST_OK);
+    }
+
+  return isRelative;
 }
 
 
+iecChannelHandler *iecDrive::openRelativeImageFile(std::string name, uint8_t recordLen, bool &isRelative)
+{
+  isRelative = false;
+
+  // directory/side sector layout is known for 1541/1571/1581 images (root directory only)
+  uint8_t headerTrack;
+  if( mstr::endsWith(m_cwd->media_image, ".d64", false) || mstr::endsWith(m_cwd->media_image, ".d71", false) )
+    headerTrack = 18;
+  else if( mstr::endsWith(m_cwd->media_image, ".d81", false) )
+    headerTrack = 40;
+  else
+    return nullptr;
 
-void iecDrive::reset()
+  if( !m_cwd->pathInStream.empty() ) return nullptr;
+
+  // find directory entry
+  uint8_t buffer[256], *entry = nullptr;
+  if( !loadRelativeDir(headerTrack) ) return nullptr;
+  for(size_t i=0; entry==nullptr && i<m_relDirEntries.size(); i+=32)
+    {
+      uint8_t *e = m_relDirEntries.data() + i;
+      std::string ename((char *) e+5, 16);
+      size_t p = ename.find('\xa0');
+      if( p!=std::string::npos ) ename.resize(p);
+      if( isMatch(ename, name) )
+        entry = e;
+    }
+
+  if( entry==nullptr )
+    {
+      if( recordLen>0 )
+        {
+          isRelative = true;
+          return createRelativeImageFile(name, recordLen);
+        }
+
+      return nullptr;
+    }
+  else if( (entry[2] & 0x07)!=4 )
+    {
+      // not a relative file
+      if( recordLen>0 )
+        {
+          isRelative = true;
+          setStatusCode(ST_FILE_TYPE_MISMATCH);
+        }
+
+      return nullptr;
+    }
+
+  isRelative = true;
+  uint8_t len = entry[23];
+  uint8_t ssTrack = entry[21], ssSector = entry[22];
+  if( recordLen>0 && recordLen!=len )
+    Debug_printv("Record length %d requested but file has %d", recordLen, len);
+
+  // build data block index from side sectors (bytes 16-255 hold up to 120 data block
+  // pointers, bytes 0/1 link to the next side sector). On 1581 disks the directory
+  // entry points to a super side sector (byte 2 = $FE) which links to the first side sector
+  std::vector<uint16_t> blocks, sideSectors;
+  uint16_t superSide = 0;
+  if( readSector(ssTrack, ssSector, buffer)!=ST_OK ) 
+    { setStatusCode(ST_READ_ERROR, ssTrack, ssSector); return nullptr; }
+  if( buffer[2]==0xFE )
+    {
+      superSide = ssTrack*256 + ssSector;
+      ssTrack = buffer[0]; ssSector = buffer[1];
+      if( readSector(ssTrack, ssSector, buffer)!=ST_OK )
+        { setStatusCode(ST_READ_ERROR, ssTrack, ssSector); return nullptr; }
+    }
+
+  for(int n=0; n<6*127; n++)
+    {
+      sideSectors.push_back(ssTrack*256 + ssSector);
+      for(int i=16; i<256 && buffer[i]!=0; i+=2)
+        blocks.push_back(buffer[i]*256 + buffer[i+1]);
+
+      if( buffer[0]==0 ) break;
+      ssTrack = buffer[0]; ssSector = buffer[1];
+      if( readSector(ssTrack, ssSector, buffer)!=ST_OK ) 
+        { setStatusCode(ST_READ_ERROR, ssTrack, ssSector); return nullptr; }
+    }
+
+  if( blocks.empty() || len==0 )
+    {
+      setStatusCode(ST_RECORD_NOT_PRESENT);
+      return nullptr;
+    }
+
+  // byte 1 of the last data block is the index of its last used byte
+  uint32_t dataSize = (blocks.size()-1) * 254;
+  if( readSector(blocks.back() / 256, blocks.back() & 255, buffer)!=ST_OK ) 
+    { setStatusCode(ST_READ_ERROR, blocks.back() / 256, blocks.back() & 255); return nullptr; }
+  dataSize += buffer[0]==0 ? std::max(buffer[1], (uint8_t) 1)-1 : 254;
+
+  // records written past the end extend the file, which needs the BAM and the entry's position
+  uint8_t e[32];
+  uint16_t index = 0;
+  iecDiskImage *image = getDiskImage();
+  if( image!=nullptr && !image->findEntry(getEntryName(entry), e, index) ) image = nullptr;
+  if( image==nullptr ) memcpy(e, entry, 32);
+
+  Debug_printv("Relative file: %d blocks, %d bytes, record length %d", (int) blocks.size(), (int) dataSize, len);
+  return new iecChannelHandlerRelImage(this, image, m_cwd->media_image, e, index, blocks, sideSectors, superSide, dataSize);
+}
+
+
+iecChannelHandler *iecDrive::createRelativeImageFile(std::string name, uint8_t recordLen)
 {
-  Debug_printv("iecDrive::reset(#%d)", m_devnr);
-  setStatusCode(ST_SPLASH);
+  iecDiskImage *image = getDiskImage();
+  if( image==nullptr || name.find('/')!=std::string::npos )
+    {
+      Debug_printv("Error: creating relative files on this disk media not supported [%s]", name.c_str());
+      setStatusCode(ST_WRITE_PROTECT);
+      return nullptr;
+    }
+  else if( name.empty() || name.find_first_of("*?")!=std::string::npos )
+    {
+      setStatusCode(ST_SYNTAX_ERROR_33);
+      return nullptr;
+    }
 
-  // close all open channels
-  for(int i=0; i<16; i++)
-    if( m_channels[i]!=nullptr )
-      close(i);
-  m_numOpenChannels = 0;
+  // new entry (closed relative file, no blocks yet)
+  uint8_t entry[32];
+  uint16_t index;
+  memset(entry, 0, 32);
+  entry[2]  = 0x84;
+  entry[23] = recordLen;
+  setEntryName(entry, name);
 
-  IECFileDevice::reset();
+  uint8_t st = image->addEntry(entry, index);
+  if( st==ST_OK )
+    {
+      // like the DOS, create the first data block (filled with empty records) right away
+      iecChannelHandlerRelImage *handler = new iecChannelHandlerRelImage(this, image, m_cwd->media_image, entry, index, {}, {}, 0, 0);
+      if( (st = handler->extend(recordLen))==ST_OK )
+        {
+          Debug_printv("Created relative file [%s], record length %d", name.c_str(), recordLen);
+          return handler;
+        }
+
+      delete handler;
+      entry[2] = 0;
+      image->writeEntry(index, entry);
+    }
+
+  // blocks allocated for a failed creation are released by re-reading the BAM
+  image->unload();
+  setStatusCode(st);
+  return nullptr;
+}
+
+
+bool iecDrive::loadRelativeDir(uint8_t headerTrack)
+{
+  if( !m_relDirUrl.empty() && m_relDirUrl==m_cwd->url ) return true;
+
+  m_relNames.clear();
+  m_relDirEntries.clear();
+  if( headerTrack>0 )
+    {
+      // disk image: keep all used directory entries (the sectors are read through the track cache)
+      uint8_t buffer[256];
+      if( readSector(headerTrack, 0, buffer)!=ST_OK ) return false;
+      for(int n=0; buffer[0]!=0 && n<256; n++)
+        {
+          if( readSector(buffer[0], buffer[1], buffer)!=ST_OK ) return false;
+          for(int i=0; i<8; i++)
+            if( (buffer[i*32+2] & 0x07)!=0 )
+              m_relDirEntries.insert(m_relDirEntries.end(), buffer+i*32, buffer+i*32+32);
+        }
+    }
+  else
+    {
+      // native file system: relative files are the ones with a ".<name>.rel" sidecar
+      std::unique_ptr<MFile> dir( MFSOwner::File(m_cwd->url) );
+      if( dir==nullptr || !dir->rewindDirectory() ) return false;
+
+      std::unique_ptr<MFile> entry;
+      while( (entry=std::unique_ptr<MFile>(dir->getNextFileInDir()))!=nullptr )
+        if( entry->name.size()>5 && entry->name[0]=='.' && mstr::endsWith(entry->name, ".rel", false) )
+          m_relNames.insert(entry->name.substr(1, entry->name.size()-5));
+    }
+
+  m_relDirUrl = m_cwd->url;
+  return true;
 }
 
 
@@ -810,7 +3751,7 @@ void iecDrive::set_cwd(std::string path)
 {
     // Isolate path
     if ( mstr::startsWith(path, ":") || mstr::startsWith(path, " " ) )
-      path = mstr::drop(path, 1);
+      path.erase(0, 1);
 
     Debug_printv("path[%s]", path.c_str());
     path = mstr::toUTF8( path );
@@ -868,6 +3809,10 @@ void iecDrive::unmount()
       //m_cwd->unmount();
       device_active = false;
     }
+
+    flushSectorCache();
+    m_trackCache.clear();
+    m_imageStream.reset();
 }
 
 
@@ -3,8 +3,16 @@
 
 #include "../fuji/fujiHost.h"
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include "../../bus/iec/IECFileDevice.h"
 #include "../../media/media.h"
@@ -18,20 +26,283 @@
 
 #define PRODUCT_ID "MEATLOAF CBM"
 
+// Number of blocks that iecChannelHandlerFile reads ahead of the bus in a background
+// task when a file is opened for reading. This keeps network/SD latency out of the
+// IEC transfer. Can be changed per drive via iecDrive::setReadAheadDepth(), 0 disables
+// read-ahead (stream is read synchronously from within the bus task)
+#define IEC_READAHEAD_DEPTH     3
+#define IEC_READAHEAD_MAX_DEPTH 8
+
+// Number of blocks that iecChannelHandlerFile queues for writing in a background
+// task when a file is opened for writing, so SAVE does not wait for the backend.
+// Errors are reported with the next write, status channel read or CLOSE.
+// Can be changed per drive via iecDrive::setWriteBehindDepth(), 0 disables write-behind.
+// IEC_WRITEBEHIND_WAIT_ON_CLOSE: CLOSE waits until all queued data is written,
+//   otherwise the data is written in the background after CLOSE returns
+// IEC_WRITEBEHIND_DURABLE: reading the status channel waits until the data queued for
+//   closed channels and the channel written last is written, i.e. "00, OK" means that
+//   data has reached the backend (other open channels only report errors so far)
+#define IEC_WRITEBEHIND_DEPTH     4
+#define IEC_WRITEBEHIND_MAX_DEPTH 16
+#define IEC_WRITEBEHIND_WAIT_ON_CLOSE true
+#define IEC_WRITEBEHIND_DURABLE       false
+
+// Sector access (direct access "#" channels, U1/U2/B-R/B-W, Epyx and burst sector
+// operations) goes through a cache holding IEC_TRACKCACHE_TRACKS tracks of the current
+// disk image. A track is read completely on first access, tracks with more than
+// IEC_TRACKCACHE_MAX_SECTORS sectors (DNP) are cached in segments of that size.
+// Modified sectors are written back when a direct access channel is closed, a track is
+// evicted or IEC_TRACKCACHE_FLUSH_DELAY ms after the last write, and when the status
+// channel is read if setWriteBehindDurable(true) was called.
+#define IEC_TRACKCACHE_TRACKS      2
+#define IEC_TRACKCACHE_MAX_SECTORS 40
+#define IEC_TRACKCACHE_FLUSH_DELAY 1000
+
+// Rendered directory listings ("$") of the last IEC_DIRCACHE_ENTRIES directories are
+// kept in memory and sent directly on the next load (0 disables the cache). Listings
+// larger than IEC_DIRCACHE_MAX_SIZE bytes are not cached. An entry is valid while the
+// modification time of the directory (plus its entry names on SD/flash) is unchanged.
+// Directories without a time (disk images, HTTP) are re-read once the entry is older
+// than IEC_DIRCACHE_REFRESH_AGE seconds.
+// Entries are dropped when a file is saved or scratched or sectors are written.
+#define IEC_DIRCACHE_ENTRIES     4
+#define IEC_DIRCACHE_MAX_SIZE    16384
+#define IEC_DIRCACHE_REFRESH_AGE 30
+
+// Transfer statistics are kept per storage backend and per bus protocol. Open-to-first-byte
+// latency and transfer rate are kept as histograms with IEC_STATS_BUCKETS power-of-two
+// buckets. A buffer fill for which the bus waited more than IEC_STATS_STALL_MS for the
+// backend counts as a stall.
+#define IEC_STATS_BUCKETS   12
+#define IEC_STATS_STALL_MS  20
+
 class iecDrive;
 
+
+class iecTrackCache
+{
+ public:
+  iecTrackCache();
+  ~iecTrackCache();
+
+  // return ST_OK or an error code, "image" is the stream to load tracks from.
+  // Loading a track may evict another one, modified sectors in an evicted
+  // track are lost so the caller must flush() first if !isCached() && isDirty()
+  uint8_t readSector(MStream *image, uint8_t track, uint8_t sector, uint8_t *buffer);
+  uint8_t writeSector(MStream *image, uint8_t track, uint8_t sector, const uint8_t *buffer);
+
+  // writes all modified sectors to "image" (which must be writable), returns
+  // the first error. Sectors are considered clean afterwards even if writing failed
+  uint8_t flush(MStream *image);
+
+  bool     isCached(uint8_t track, uint8_t sector);
+  bool     isDirty();
+  uint64_t getLastWriteTime() { return m_lastWrite; }
+
+  // drops all cached tracks (without writing modified sectors) and frees their buffers
+  void clear();
+
+ private:
+  struct Entry
+  {
+    uint8_t  track, firstSector, numSectors;
+    uint64_t dirty;      // bit n set => sector firstSector+n was modified
+    uint32_t lastUsed;
+    uint8_t *data;
+  };
+
+  Entry *findEntry(uint8_t track, uint8_t sector);
+  Entry *loadEntry(MStream *image, uint8_t track, uint8_t sector, uint8_t &status);
+  void   freeEntries();
+
+  Entry    m_entries[IEC_TRACKCACHE_TRACKS];
+  uint32_t m_useCounter;
+  uint64_t m_lastWrite;
+};
+
+
+class iecDirCache
+{
+ public:
+  iecDirCache();
+  ~iecDirCache();
+
+  // returns the cached listing for "dir" (nullptr if none), "stamp" is set to
+  // getStamp(dir) so a listing rendered after a miss can be put() without reading it again
+  std::shared_ptr<const std::string> get(MFile *dir, time_t &stamp);
+
+  // stores a listing rendered for "url", "generation" is the value of getGeneration()
+  // when rendering started (the listing is dropped if the cache was invalidated since)
+  void put(const std::string &url, time_t stamp, std::shared_ptr<const std::string> listing, uint32_t generation);
+
+  // drops all entries for "url" and its sub-directories
+  void invalidate(const std::string &url);
+  void clear();
+
+  uint32_t getGeneration() { return m_generation; }
+  uint32_t getHits()   { return m_hits; }
+  uint32_t getMisses() { return m_misses; }
+
+  // changes whenever the contents of "dir" change, 0 if unknown (directories in disk images)
+  static time_t getStamp(MFile *dir);
+
+ private:
+  struct Entry
+  {
+    std::string url;
+    time_t      stamp;
+    uint64_t    created;
+    uint32_t    lastUsed;
+    std::shared_ptr<const std::string> listing;
+  };
+
+  static uint32_t getNamesHash(const std::string &path, time_t mtime);
+
+  std::vector<Entry> m_entries;
+  SemaphoreHandle_t  m_lock;
+  std::atomic<uint32_t> m_generation;
+  uint32_t  m_hits, m_misses, m_useCounter;
+};
+
+
+// Block allocation map (BAM) and directory of a D64/D71/D81 disk image, used for
+// writing, scratching and renaming files inside images. The BAM is read once and kept
+// in memory (free counts and bitmaps per track), changes are written to the drive's
+// track cache by writeBAM(), i.e. together with the directory entry when a file is closed.
+class iecDiskImage
+{
+ public:
+  iecDiskImage(iecDrive *drive);
+
+  // reads geometry and BAM of the drive's current disk image ("name" is the image file
+  // name, "url" identifies the image), returns false if the image type is not supported
+  bool     load(const std::string &url, const std::string &name);
+  void     unload() { m_loaded = false; }
+  bool     isLoaded() { return m_loaded; }
+  const std::string &getUrl() { return m_url; }
+  bool     isBAMSector(uint8_t track, uint8_t sector);
+  bool     isWritingBAM() { return m_writingBAM; }
+
+  uint16_t blocksFree();
+  uint8_t  getSectorCount(uint8_t track);
+  uint8_t  getType() { return m_type; }     // 64, 71 or 81
+
+  // allocates a block for a file: "track"/"sector" holds the previous block of the file
+  // (track 0 for the first block) and receives the new one. Returns a status code
+  uint8_t  allocateBlock(uint8_t &track, uint8_t &sector);
+  void     freeBlock(uint8_t track, uint8_t sector);
+
+  // allocates a given block (B-A), if it is in use then "track"/"sector" receive the
+  // next free block (track 0 if there is none) and ST_NO_BLOCK is returned
+  uint8_t  allocateBlockAt(uint8_t &track, uint8_t &sector);
+  bool     isValidBlock(uint8_t track, uint8_t sector) { return track>0 && track<=m_numTracks && sector<getSectorCount(track); }
+  void     freeChain(uint8_t track, uint8_t sector);
+
+  // directory entries are 32 bytes as stored on disk (bytes 0/1 are ignored when writing),
+  // "index" is the position in the directory. Return a status code
+  bool     findEntry(const std::string &pattern, uint8_t *entry, uint16_t &index, uint16_t start = 0);
+  uint8_t  writeEntry(uint16_t index, const uint8_t *entry);
+  uint8_t  addEntry(const uint8_t *entry, uint16_t &index);
+
+  // writes the BAM to the drive's track cache if it was modified
+  uint8_t  writeBAM();
+
+  uint8_t  scratch(const std::string &pattern, uint8_t &count);
+  uint8_t  rename(const std::string &newName, const std::string &oldName);
+
+ private:
+  bool     isFree(uint8_t track, uint8_t sector) { return (m_map[track] & (1ULL << sector))!=0; }
+  void     take(uint8_t track, uint8_t sector);
+  bool     isSystemTrack(uint8_t track) { return track==m_dirTrack || (m_type==71 && track==53); }
+
+  iecDrive   *m_drive;
+  std::string m_url;
+  bool     m_loaded, m_dirty, m_writingBAM;
+  uint8_t  m_type, m_numTracks, m_dirTrack, m_dirSector, m_interleave, m_dirInterleave;
+  uint8_t  m_free[81];
+  uint64_t m_map[81];   // bit n set => sector n is free
+};
+
+
+// Rolling transfer statistics of a drive, shown by the "M-STAT" command and the web UI
+class iecDriveStats
+{
+ public:
+  enum { BACKEND_SD, BACKEND_FLASH, BACKEND_TNFS, BACKEND_HTTP, BACKEND_OTHER, BACKEND_COUNT };
+
+  struct Record
+  {
+    uint32_t files, bytes, stalls;
+    uint64_t busTimeUS, transportTimeUS, latencySumUS;
+    uint32_t latency[IEC_STATS_BUCKETS];  // bucket n: open-to-first-byte < 2^n ms (last: larger)
+    uint32_t rate[IEC_STATS_BUCKETS];     // bucket n: bytes per second < 2^n*256 (last: larger)
+  };
+
+  iecDriveStats();
+  ~iecDriveStats();
+
+  static uint8_t getBackend(const std::string &url);
+
+  // called when a file channel is closed, latencyUS is 0 if no data was read
+  void addTransfer(uint8_t backend, uint8_t protocol, uint32_t bytes, uint64_t totalUS,
+                   uint64_t transportUS, uint64_t latencyUS, uint32_t stalls);
+  void addError(uint8_t code);
+  void clear();
+
+  // short summary for the status channel, "which" is empty (all transfers) or a backend/protocol name
+  std::string getSummary(const std::string &which);
+  std::string getJSON();
+
+ private:
+  static void addRecord(Record &r, uint32_t bytes, uint64_t totalUS, uint64_t transportUS, uint64_t latencyUS, uint32_t stalls);
+  static void writeRecord(std::string &s, const char *name, const Record &r);
+
+  SemaphoreHandle_t m_lock;
+  // each transfer is counted in m_total, its backend and its protocol
+  Record   m_total, m_backend[BACKEND_COUNT], m_protocol[IEC_PROTOCOL_COUNT];
+  uint16_t m_errors[100];
+};
+
+
 class iecChannelHandler
 {
  public:
   iecChannelHandler(iecDrive *drive);
   virtual ~iecChannelHandler();
 
-  uint8_t read(uint8_t *data, uint8_t n);
-  uint8_t write(uint8_t *data, uint8_t n);
+  virtual uint8_t read(uint8_t *data, uint8_t n);
+  virtual uint8_t write(uint8_t *data, uint8_t n);
 
   virtual uint8_t writeBufferData() = 0;
   virtual uint8_t readBufferData()  = 0;
 
+  // called when the channel is closed, hands buffered data to any background
+  // writer and (if "wait" is true) waits until it has been written.
+  // Returns the status of writes that completed in the background.
+  virtual uint8_t finish(bool wait) { return 0; }
+
+  // returns true while a background writer still has data to write
+  virtual bool    isBusy() { return false; }
+
+  // returns an error that occurred in a background write (each error only once)
+  virtual uint8_t getDeferredStatus() { return 0; }
+
+  // waits until data written to the channel so far has been stored without closing
+  // the channel, returns the status of writes that completed in the background
+  virtual uint8_t sync() { return getDeferredStatus(); }
+
+  // returns true for direct access ("#") channels, see iecChannelHandlerDirect
+  virtual bool    isDirectAccess() { return false; }
+
+  // returns true if the channel writes a file (directory listing changes)
+  virtual bool    isWriting() { return false; }
+
+  // returns true for relative file channels, see iecChannelHandlerRel
+  virtual bool    isRelative() { return false; }
+
+  // called at the end of each data transfer (UNTALK/UNLISTEN) on the channel
+  virtual void    endTransfer(bool talk) {}
+
  protected:
   iecDrive *m_drive;
   uint8_t  *m_data;
@@ -42,35 +313,232 @@ class iecChannelHandler
 class iecChannelHandlerFile : public iecChannelHandler
 {
  public: 
-  iecChannelHandlerFile(iecDrive *drive, MStream *stream, int fixLoadAddress = -1);
+  iecChannelHandlerFile(iecDrive *drive, MStream *stream, int fixLoadAddress = -1, uint8_t queueDepth = 0, bool writeBehind = false);
   virtual ~iecChannelHandlerFile();
 
   virtual uint8_t readBufferData();
   virtual uint8_t writeBufferData();
 
+  virtual uint8_t finish(bool wait);
+  virtual bool    isBusy();
+  virtual uint8_t getDeferredStatus();
+  virtual uint8_t sync() { return finish(true); } // file channels stay usable after finish()
+  virtual bool    isWriting() { return m_stream->mode != std::ios_base::in; }
+
  private:
+  static void queueTask(void *arg);
+  void    readAhead();
+  void    writeBehind();
+  void    stopQueue();
+  uint8_t readAheadBufferData();
+  uint8_t writeBehindBufferData();
+  uint8_t readStreamBufferData();
+  uint8_t writeStreamBufferData();
+  void    updateStats(uint64_t transportTimeUS);
+
   MStream *m_stream;
   int      m_fixLoadAddress;
   uint32_t  m_byteCount;
   uint64_t  m_timeStart, m_transportTimeUS;
+
+  // read-ahead/write-behind ring buffer with a single producer and single consumer
+  // (bus task and queueTask), m_qHead/m_qTail are free-running block counters
+  // statistics, m_timeFirstByte is 0 until data has been read from the stream
+  uint8_t   m_backend, m_protocol;
+  uint32_t  m_stalls;
+  uint64_t  m_timeOpen, m_timeFirstByte;
+
+  uint8_t   m_qDepth;
+  bool      m_qWrite, m_qStatusReported;
+  uint8_t **m_qData;
+  size_t   *m_qLen;
+  std::atomic<uint32_t> m_qHead, m_qTail;
+  std::atomic<bool>     m_qEOF, m_qStop;
+  std::atomic<uint8_t>  m_qStatus;
+  SemaphoreHandle_t     m_qReady, m_qSpace, m_qDone;
+  TaskHandle_t          m_qTask;
+  uint64_t  m_qStreamTimeUS;
+};
+
+
+class iecChannelHandlerDirect : public iecChannelHandler
+{
+ public:
+  iecChannelHandlerDirect(iecDrive *drive, uint8_t bufferNum);
+
+  // reading/writing the channel accesses the 256-byte sector buffer at the buffer pointer
+  virtual uint8_t read(uint8_t *data, uint8_t n);
+  virtual uint8_t write(uint8_t *data, uint8_t n);
+
+  virtual uint8_t readBufferData()  { return 0; }
+  virtual uint8_t writeBufferData() { return 0; }
+
+  // writes modified sectors in the drive's track cache back to the image
+  virtual uint8_t finish(bool wait);
+  virtual bool    isDirectAccess() { return true; }
+
+  uint8_t *getBuffer()  { return m_data; }
+  uint8_t  getBufferNum() { return m_bufferNum; }
+
+  // sets the buffer pointer (B-P), "end" is the position after the last byte to read
+  void     setPointer(uint8_t ptr, size_t end = 256) { m_ptr = ptr; m_len = end; }
+  uint8_t  getPointer() { return m_ptr; }
+
+ private:
+  uint8_t m_bufferNum;
+};
+
+
+// Relative files: the host reads/writes one record per transfer, the "P" command
+// selects the record. Derived classes implement record storage.
+class iecChannelHandlerRel : public iecChannelHandler
+{
+ public:
+  iecChannelHandlerRel(iecDrive *drive, uint8_t recordLen);
+
+  virtual uint8_t read(uint8_t *data, uint8_t n);
+  virtual uint8_t write(uint8_t *data, uint8_t n);
+
+  virtual uint8_t readBufferData()  { return 0; }
+  virtual uint8_t writeBufferData() { return 0; }
+
+  virtual uint8_t finish(bool wait);
+  virtual bool    isWriting()  { return m_modified; }
+  virtual bool    isRelative() { return true; }
+  virtual void    endTransfer(bool talk);
+
+  // selects record (0-based) and position within the record, returns status
+  uint8_t position(uint16_t record, uint8_t pos);
+  uint8_t getRecordLength() { return m_recordLen; }
+
+ protected:
+  virtual uint16_t getNumRecords() = 0;
+  virtual uint8_t  readRecord(uint16_t record, uint8_t *buffer) = 0;
+  virtual uint8_t  writeRecord(uint16_t record, const uint8_t *buffer) = 0;
+  virtual uint8_t  flush() { return 0; }
+
+ private:
+  uint8_t loadRecord();
+  uint8_t storeRecord();
+  void    nextRecord();
+
+  uint8_t  m_recordLen;
+  uint16_t m_record;
+  bool     m_loaded, m_dirty, m_modified, m_eoi, m_next, m_writing;
+};
+
+
+// relative file on a native file system, records are stored back-to-back in the
+// file, the record length is kept in a hidden sidecar file (".<name>.rel")
+class iecChannelHandlerRelFile : public iecChannelHandlerRel
+{
+ public:
+  iecChannelHandlerRelFile(iecDrive *drive, MStream *stream, uint8_t recordLen);
+  virtual ~iecChannelHandlerRelFile();
+
+ protected:
+  virtual uint16_t getNumRecords();
+  virtual uint8_t  readRecord(uint16_t record, uint8_t *buffer);
+  virtual uint8_t  writeRecord(uint16_t record, const uint8_t *buffer);
+
+ private:
+  MStream *m_stream;
+  uint32_t m_size;
+};
+
+
+// relative file on a D64/D71/D81 image, accessed through the drive's track cache.
+// The data blocks are indexed from the side sectors when the file is opened so
+// a record's track/sector/offset is computed directly. Writing a record past the
+// end allocates data blocks (and side sectors) from "image" and fills the new
+// blocks with empty records, like the CBM DOS does
+class iecChannelHandlerRelImage : public iecChannelHandlerRel
+{
+ public:
+  // "entry" (32 bytes) is the directory entry at "index", "sideSectors" holds track*256+sector
+  // of each side sector and "superSide" that of the 1581 super side sector (0 if none)
+  iecChannelHandlerRelImage(iecDrive *drive, iecDiskImage *image, const std::string &imageName,
+                            const uint8_t *entry, uint16_t index, const std::vector<uint16_t> &blocks,
+                            const std::vector<uint16_t> &sideSectors, uint16_t superSide, uint32_t dataSize);
+
+  // makes the file at least "size" bytes long, returns a status code
+  uint8_t extend(uint32_t size);
+
+ protected:
+  virtual uint16_t getNumRecords();
+  virtual uint8_t  readRecord(uint16_t record, uint8_t *buffer);
+  virtual uint8_t  writeRecord(uint16_t record, const uint8_t *buffer);
+  virtual uint8_t  flush();
+
+ private:
+  uint8_t writeData(uint32_t offset, const uint8_t *data, uint8_t len);
+  uint8_t addBlock();
+  uint8_t addSideSector(uint8_t track, uint8_t sector);
+
+  iecDiskImage *m_image;
+  std::string   m_imageName;
+  uint8_t  m_entry[32];
+  uint16_t m_entryIndex;
+  std::vector<uint16_t> m_blocks;       // track*256+sector of each data block
+  std::vector<uint16_t> m_sideSectors;  // track*256+sector of each side sector
+  uint16_t m_superSide;
+  uint32_t m_dataSize;
+};
+
+
+// writes a new file into a disk image, the directory entry and BAM are written
+// (and the track cache flushed) when the channel is closed
+class iecChannelHandlerImageWrite : public iecChannelHandler
+{
+ public:
+  iecChannelHandlerImageWrite(iecDrive *drive, iecDiskImage *image, const std::string &name, uint8_t fileType, bool replace);
+
+  virtual uint8_t readBufferData();
+  virtual uint8_t writeBufferData();
+
+  virtual uint8_t finish(bool wait);
+  virtual bool    isWriting() { return true; }
+
+ private:
+  uint8_t writeBlock(bool last);
+
+  iecDiskImage *m_image;
+  std::string   m_name;
+  uint8_t  m_fileType, m_status;
+  bool     m_replace, m_finished;
+  uint8_t  m_block[256];
+  uint16_t m_blockLen, m_numBlocks;
+  uint8_t  m_track, m_sector, m_startTrack, m_startSector;
 };
 
 
 class iecChannelHandlerDir : public iecChannelHandler
 {
  public: 
-  iecChannelHandlerDir(iecDrive *drive, MFile *dir);
+  // if "listing" is given it is sent instead of reading "dir", otherwise the
+  // rendered listing is stored in "cache" (if given, with "stamp" from iecDirCache::get())
+  // once it has been sent completely
+  iecChannelHandlerDir(iecDrive *drive, MFile *dir, iecDirCache *cache = nullptr, time_t stamp = 0,
+                       std::shared_ptr<const std::string> listing = nullptr);
   virtual ~iecChannelHandlerDir();
 
   virtual uint8_t readBufferData();
   virtual uint8_t writeBufferData();
 
  private:
-  void addExtraInfo(std::string title, std::string text);
+  void    addExtraInfo(const char *title, std::string_view text);
+  uint8_t renderBufferData();
   
   MFile   *m_dir;
   uint8_t  m_headerLine;
   std::vector<std::string> m_headers;
+
+  iecDirCache *m_cache;
+  uint32_t     m_cacheGeneration;
+  time_t       m_cacheStamp;
+  std::shared_ptr<std::string>       m_rendered;
+  std::shared_ptr<const std::string> m_listing;
+  size_t       m_listingPos;
 };
 
 
@@ -87,9 +555,33 @@ class iecDrive : public IECFileDevice
   int     id() { return m_devnr; };
   uint8_t getNumOpenChannels() { return m_numOpenChannels; }
   uint8_t getStatusCode() { return m_statusCode; }
-  void    setStatusCode(uint8_t code, uint8_t trk = 0);
+  void    setStatusCode(uint8_t code, uint8_t trk = 0, uint8_t sec = 0);
   bool    hasError();
 
+  // sector access on the current disk image (via track cache), return ST_OK or an error code
+  uint8_t readSector(uint8_t track, uint8_t sector, uint8_t *buffer);
+  uint8_t writeSector(uint8_t track, uint8_t sector, const uint8_t *buffer);
+
+  // writes modified sectors back to the image. With "keepWriter" the stream used for
+  // writing stays open (and serves sector reads) for the next flush, otherwise it is
+  // closed so the written data is visible to the other streams of the image
+  uint8_t flushSectorCache(bool keepWriter = false);
+
+  // drops cached directory listings for "url" (all if empty), call when files change
+  void    invalidateDirCache(const std::string &url = "");
+  iecDirCache &getDirCache() { return m_dirCache; }
+
+  iecDriveStats &getStats() { return m_stats; }
+  uint64_t getOpenTime() { return m_openTime; }
+
+  uint8_t getReadAheadDepth() { return m_readAheadDepth; }
+  void    setReadAheadDepth(uint8_t depth) { m_readAheadDepth = std::min(depth, (uint8_t) IEC_READAHEAD_MAX_DEPTH); }
+
+  uint8_t getWriteBehindDepth() { return m_writeBehindDepth; }
+  void    setWriteBehindDepth(uint8_t depth) { m_writeBehindDepth = std::min(depth, (uint8_t) IEC_WRITEBEHIND_MAX_DEPTH); }
+  void    setWriteBehindWaitOnClose(bool wait) { m_writeBehindWaitOnClose = wait; }
+  void    setWriteBehindDurable(bool durable) { m_writeBehindDurable = durable; }
+
   fujiHost *m_host;
 
   // overriding the IECDevice isActive() function because device_active
@@ -128,11 +620,76 @@ class iecDrive : public IECFileDevice
   // called on falling edge of RESET line
   virtual void reset();
 
+  // called at the end of each data transfer on a channel
+  virtual void endTransfer(uint8_t channel, bool talk);
+
+  // called during IECBusHandler::task()
+  virtual void task();
+
+#if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
+  // called for Epyx FastLoad cartridge sector operations (disk editor/copy)
+  virtual bool epyxReadSector(uint8_t track, uint8_t sector, uint8_t *buffer);
+  virtual bool epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buffer);
+#endif
+
+#ifdef SUPPORT_BURST
+  // called for 1571/1581 burst mode ("U0") sector reads/writes
+  virtual bool burstReadSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer);
+  virtual bool burstWriteSector(uint8_t track, uint8_t sector, uint8_t side, uint8_t *buffer);
+
+  // image track for a burst command's track and side, 0 if the image has no such side
+  uint8_t getBurstTrack(uint8_t track, uint8_t side);
+#endif
+
+  // stream for the disk image containing the current directory (nullptr if none)
+  MStream *getImageStream();
+
+  // handles U1/U2/B-R/B-W/B-P/B-A/B-F commands
+  void executeBlockCommand(std::string command);
+
+  // BAM/directory of the current disk image (nullptr if not in the root of a supported image)
+  iecDiskImage *getDiskImage();
+
+  // opens a new file (PETSCII name) for writing inside the current disk image
+  void openImageWrite(uint8_t channel, std::string name, uint8_t fileType, bool overwrite);
+
+  void rename(std::string command);
+
+  // opens relative file "name" (PETSCII) on channel if it is one (or recordLen>0 to
+  // create it), returns false if the file is not a relative file
+  bool openRelativeFile(uint8_t channel, std::string name, uint8_t recordLen);
+  iecChannelHandler *openRelativeImageFile(std::string name, uint8_t recordLen, bool &isRelative);
+  iecChannelHandler *createRelativeImageFile(std::string name, uint8_t recordLen);
+
+  // reads the relative file sidecars (native file system) or the directory entries
+  // (disk image, directory on "headerTrack") of the current directory unless they
+  // are already known, returns false on a read error
+  bool loadRelativeDir(uint8_t headerTrack = 0);
+
   void set_cwd(std::string path);
 
+  // delete closed channels whose write-behind queue has finished (or wait for
+  // them to finish if "wait" is true), returns the first deferred error found
+  uint8_t reapClosedChannels(bool wait);
+
   std::unique_ptr<MFile> m_cwd;   // current working directory
   iecChannelHandler *m_channels[16];
-  uint8_t m_statusCode, m_statusTrk, m_numOpenChannels;
+  uint8_t m_statusCode, m_statusTrk, m_statusSec, m_numOpenChannels;
+  uint8_t m_lastWriteChannel;     // channel data was last written to, 0xFF if none is open
+  uint8_t m_readAheadDepth, m_writeBehindDepth;
+  bool    m_writeBehindWaitOnClose, m_writeBehindDurable;
+  std::vector<iecChannelHandler *> m_closingChannels;
+  std::unique_ptr<MStream> m_imageStream;
+  std::unique_ptr<MStream> m_imageWriter; // open while sector writes keep evicting modified tracks
+  std::string   m_imageUrl;
+  std::string   m_relDirUrl;      // directory m_relNames/m_relDirEntries belong to, empty if none
+  std::unordered_set<std::string> m_relNames; // (UTF8) names of relative files with a sidecar
+  std::vector<uint8_t> m_relDirEntries;       // 32-byte directory entries of the disk image
+  uint64_t      m_openTime;
+  iecDriveStats m_stats;
+  iecTrackCache m_trackCache;
+  iecDirCache   m_dirCache;
+  iecDiskImage  m_diskImage;
 };
 
 #endif // DRIVE_H
@@ -504,6 +504,12 @@ esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *co
         esp_transport_ssl_skip_common_name_check(ssl);
         ESP_LOGD(TAG, "esp_transport_ssl_skip_common_name_check() skipped");
     }
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Keep the TLS session when the connection closes so a reconnect of
+    // this handle does an abbreviated handshake
+    esp_transport_ssl_session_tickets_enable(ssl);
+#endif
     
 #endif
 
@@ -1195,6 +1201,15 @@ int esp_http_client_get_errno(esp_http_client_handle_t client)
     return esp_transport_get_errno(client->transport);
 }
 
+esp_err_t esp_http_client_set_user_data(esp_http_client_handle_t client, void *data)
+{
+    if (client == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    client->user_data = data;
+    return ESP_OK;
+}
+
 int esp_http_client_get_content_length(esp_http_client_handle_t client)
 {
     return client->response->content_length;
@@ -545,6 +545,19 @@ int esp_http_client_get_status_code(esp_http_client_handle_t client);
  */
 int esp_http_client_get_errno(esp_http_client_handle_t client);
 
+/**
+ * @brief      Set the user data passed to the event handler, used when a
+ *             pooled handle is taken over by a new owner
+ *
+ * @param[in]  client  The esp_http_client handle
+ * @param[in]  data    The user data
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t esp_http_client_set_user_data(esp_http_client_handle_t client, void *data);
+
 /**
  * @brief      Get http response content length (from header Content-Length)
  *             the valid value if this function invoke after `esp_http_client_perform`
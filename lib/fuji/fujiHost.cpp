@@ -277,6 +277,14 @@ const char *fujiHost::get_basepath()
     return _fs->basepath();
 }
 
+tnfsMountInfo *fujiHost::get_tnfs_mountinfo()
+{
+    if (_type != HOSTTYPE_TNFS || _fs == nullptr || !_fs->running())
+        return nullptr;
+
+    return ((FileSystemTNFS *)_fs)->mountinfo();
+}
+
 /* Returns pointer to current hostname and, if provided, fills buffer with that string
 */
 const char *fujiHost::get_prefix(char *buffer, size_t buffersize)
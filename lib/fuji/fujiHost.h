@@ -3,6 +3,8 @@
 
 #include "fnFS.h"
 
+class tnfsMountInfo;
+
 #define MAX_HOSTNAME_LEN 32
 #define MAX_HOST_PREFIX_LEN 256
 
@@ -52,6 +54,9 @@ public:
     bool mount();
     bool umount();
 
+    // Session of a mounted TNFS host, nullptr for other hosts
+    tnfsMountInfo * get_tnfs_mountinfo();
+
     // Host prefixes are used for host file operations that take a path (file_exists, file_open, dir_open)
     void set_prefix(const char *prefix);
     const char* get_prefix(char *buffer, size_t buffersize);
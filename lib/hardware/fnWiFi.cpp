@@ -20,6 +20,7 @@
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "httpService.h"
+#include "httpConnectionPool.h"
 #include "led.h"
 
 
@@ -196,6 +197,8 @@ void WiFiManager::conn_event_handler(void* arg, esp_event_base_t event_base, int
             case WIFI_EVENT_STA_DISCONNECTED:
                 Debug_println("WIFI_EVENT_STA_DISCONNECTED: settting WIFI_FAIL_BIT");
                 xEventGroupSetBits(wifi_event_group, WIFI_FAIL_BIT);
+                // pooled keep-alive connections don't survive losing the network
+                fnHttpPool.closeIdle();
                 break;
             case WIFI_EVENT_STA_CONNECTED:
                 Debug_printf("WIFI_EVENT_STA_CONNECTED received, ssid: %s, channel: %d\r\n", ((wifi_event_sta_connected_t*)event_data)->ssid, ((wifi_event_sta_connected_t*)event_data)->channel);
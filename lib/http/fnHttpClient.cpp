@@ -33,7 +33,9 @@ fnHttpClient::~fnHttpClient()
     Debug_printv("BEFORE free heap/low: %lu/%lu", esp_get_free_heap_size(), esp_get_free_internal_heap_size());
     if (_handle != nullptr)
     {
-        esp_http_client_cleanup(_handle);
+        // Hand the connection (or its TLS session) to the next client for this host
+        fnHttpPool.checkin(_pool_key, _handle, _cleanup_handle, _disconnect_handle, _pool_state());
+        _handle = nullptr;
     }
 
     free(_buffer);
@@ -60,12 +62,54 @@ bool fnHttpClient::begin(const std::string &url)
     // Keep track of the auth type set
     _auth_type = cfg.auth_type;
 
+    if (_handle != nullptr)
+        fnHttpPool.checkin(_pool_key, _handle, _cleanup_handle, _disconnect_handle, _pool_state());
+
+    // Take over an idle keep-alive connection or a saved TLS session for the host
+    _pool_key = HttpConnectionPool::key("fn", url);
+    _request_modified = false;
+    _handle = (esp_http_client_handle_t)fnHttpPool.checkout(_pool_key);
+    if (_handle != nullptr)
+    {
+        esp_http_client_set_user_data(_handle, this);
+        if (esp_http_client_set_url(_handle, url.c_str()) == ESP_OK)
+            return true;
+
+        _cleanup_handle(_handle);
+    }
+
     _handle = esp_http_client_init(&cfg);
     if (_handle == nullptr)
+    {
+        fnHttpPool.checkin(_pool_key, nullptr, _cleanup_handle, _disconnect_handle, HttpConnectionPool::HANDLE_DISCARD);
         return false;
+    }
     return true;
 }
 
+// The handle can be passed on if no request state of ours is left on it, the
+// connection too if the last transaction completed and the server kept it open
+HttpConnectionPool::handle_state fnHttpClient::_pool_state()
+{
+    if (_handle == nullptr || _request_modified)
+        return HttpConnectionPool::HANDLE_DISCARD;
+
+    if (_transaction_done && _client_err == ESP_OK && _handle->state == HTTP_STATE_CONNECTED)
+        return HttpConnectionPool::HANDLE_KEEP;
+
+    return HttpConnectionPool::HANDLE_DISCONNECT;
+}
+
+void fnHttpClient::_cleanup_handle(void *handle)
+{
+    esp_http_client_cleanup((esp_http_client_handle_t)handle);
+}
+
+void fnHttpClient::_disconnect_handle(void *handle)
+{
+    esp_http_client_close((esp_http_client_handle_t)handle);
+}
+
 int fnHttpClient::available()
 {
     if (_handle == nullptr)
@@ -237,7 +281,8 @@ void fnHttpClient::close()
     // Debug_println("::close");
     _delete_subtask_if_running();
 
-    if (_handle != nullptr)
+    // Keep the connection open if it can be reused
+    if (_handle != nullptr && _pool_state() != HttpConnectionPool::HANDLE_KEEP)
         esp_http_client_close(_handle);
 
     _stored_headers.clear();
@@ -601,6 +646,7 @@ int fnHttpClient::PUT(const char *put_data, int put_datalen)
 
     // Set method
     esp_http_client_set_method(_handle, esp_http_client_method_t::HTTP_METHOD_PUT);
+    _request_modified = true;
     // See if a content-type has been set and set a default one if not
     // Call this before esp_http_client_set_post_field() otherwise that function will definitely set the content type to form
     char *value = nullptr;
@@ -626,6 +672,7 @@ int fnHttpClient::PROPFIND(webdav_depth depth, const char *properties_xml)
 
     // Set method
     esp_http_client_set_method(_handle, esp_http_client_method_t::HTTP_METHOD_PROPFIND);
+    _request_modified = true;
     // Assume any request body will be XML
     esp_http_client_set_header(_handle, "Content-Type", "text/xml");
     // Set depth
@@ -690,6 +737,7 @@ int fnHttpClient::COPY(const char *destination, bool overwrite, bool move)
 
     // Set method
     esp_http_client_set_method(_handle, move ? esp_http_client_method_t::HTTP_METHOD_MOVE : esp_http_client_method_t::HTTP_METHOD_COPY);
+    _request_modified = true;
     // Set detination
     esp_http_client_set_header(_handle, "Destination", destination);
     // Set overwrite
@@ -726,6 +774,7 @@ int fnHttpClient::POST(const char *post_data, int post_datalen)
 
     // Set method
     esp_http_client_set_method(_handle, esp_http_client_method_t::HTTP_METHOD_POST);
+    _request_modified = true;
     esp_http_client_set_post_field(_handle, post_data, post_datalen);
 
     return _perform();
@@ -782,6 +831,7 @@ bool fnHttpClient::set_header(const char *header_key, const char *header_value)
     if (_handle == nullptr)
         return false;
 
+    _request_modified = true;
     esp_err_t e = esp_http_client_set_header(_handle, header_key, header_value);
     if (e != ESP_OK)
     {
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "fn_esp_http_client.h"
+#include "httpConnectionPool.h"
 
 using namespace fujinet;
 
@@ -33,13 +34,22 @@ private:
     int _max_redirects = 0;
     bool connected = false;
     esp_http_client_auth_type_t _auth_type;
-    esp_err_t _client_err;
+    esp_err_t _client_err = ESP_FAIL;
 
     uint16_t _port = 80;
     header_map_t _stored_headers;
 
     esp_http_client_handle_t _handle = nullptr;
 
+    // Key of the connection pool entry the handle was taken from / is returned to
+    std::string _pool_key;
+    // Request headers or post data were set, the handle can't be passed on
+    bool _request_modified = false;
+
+    HttpConnectionPool::handle_state _pool_state();
+    static void _cleanup_handle(void *handle);
+    static void _disconnect_handle(void *handle);
+
     static void _perform_subtask(void *param);
     static esp_err_t _httpevent_handler(esp_http_client_event_t *evt);
 
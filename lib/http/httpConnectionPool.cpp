@@ -0,0 +1,236 @@
+#include "httpConnectionPool.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "../../include/debug.h"
+
+#include "fnSystem.h"
+
+HttpConnectionPool fnHttpPool;
+
+std::string HttpConnectionPool::key(const char *tag, const std::string &url)
+{
+    std::string scheme = "http";
+    size_t start = url.find("://");
+    if (start != std::string::npos)
+    {
+        scheme = url.substr(0, start);
+        start += 3;
+    }
+    else
+        start = 0;
+
+    size_t end = url.find_first_of("/?#", start);
+    std::string authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+    std::transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+    size_t host = authority.rfind('@');
+    host = (host == std::string::npos) ? 0 : host + 1;
+    std::transform(authority.begin() + host, authority.end(), authority.begin() + host, ::tolower);
+
+    // Add the default port so "host" and "host:80" share connections
+    if (authority.find(':', host) == std::string::npos || authority.back() == ']')
+        authority += (scheme == "https") ? ":443" : ":80";
+
+    return std::string(tag) + ":" + scheme + "://" + authority;
+}
+
+bool HttpConnectionPool::_is_tls(const std::string &key)
+{
+    return key.find(":https://") != std::string::npos;
+}
+
+// Closes the connection of a returned handle but keeps the handle for its TLS
+// session, plain HTTP handles have nothing worth keeping
+void HttpConnectionPool::_keep_session(Entry &e)
+{
+    if (!_is_tls(e.key) || e.disconnect == nullptr)
+    {
+        e.cleanup(e.handle);
+        return;
+    }
+
+    if (e.connected)
+    {
+        e.disconnect(e.handle);
+        e.connected = false;
+    }
+
+    std::vector<Entry> dropped;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _idle.push_back(e);
+
+        // least recently used sessions go first
+        int sessions = std::count_if(_idle.begin(), _idle.end(), [](const Entry &i) { return !i.connected; });
+        for (auto it = _idle.begin(); it != _idle.end() && sessions > HTTP_POOL_MAX_SESSIONS;)
+        {
+            if (!it->connected)
+            {
+                dropped.push_back(*it);
+                it = _idle.erase(it);
+                sessions--;
+            }
+            else
+                ++it;
+        }
+    }
+
+    for (auto &d : dropped)
+        d.cleanup(d.handle);
+}
+
+void HttpConnectionPool::_expire(uint64_t now)
+{
+    std::vector<Entry> closed, dropped;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (auto it = _idle.begin(); it != _idle.end();)
+        {
+            if (it->connected && now - it->lastUsed > HTTP_POOL_IDLE_TIMEOUT_MS)
+            {
+                closed.push_back(*it);
+                it = _idle.erase(it);
+            }
+            else if (!it->connected && now - it->lastUsed > HTTP_POOL_SESSION_TIMEOUT_MS)
+            {
+                dropped.push_back(*it);
+                it = _idle.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    for (auto &e : closed)
+    {
+        Debug_printv("closing idle connection [%s]", e.key.c_str());
+        _keep_session(e);
+    }
+
+    for (auto &e : dropped)
+        e.cleanup(e.handle);
+}
+
+void *HttpConnectionPool::checkout(const std::string &key)
+{
+    uint64_t now = fnSystem.millis();
+    _expire(now);
+
+    void *handle = nullptr;
+    bool connected = false;
+    Entry evicted = {"", nullptr, nullptr, nullptr, 0, false};
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+
+        // an open connection first, then a saved session, most recently returned first
+        auto found = _idle.rend();
+        for (auto it = _idle.rbegin(); it != _idle.rend(); ++it)
+        {
+            if (it->key == key && (found == _idle.rend() || (it->connected && !found->connected)))
+                found = it;
+        }
+
+        if (found != _idle.rend())
+        {
+            handle = found->handle;
+            connected = found->connected;
+            _idle.erase(std::next(found).base());
+        }
+
+        if (connected)
+            _hits++;
+        else
+        {
+            if (handle != nullptr)
+                _resumed++;
+            else
+                _misses++;
+
+            // make room by closing the least recently used idle connection
+            int open = _checkedOut + std::count_if(_idle.begin(), _idle.end(), [](const Entry &i) { return i.connected; });
+            if (open >= HTTP_POOL_MAX_CONNECTIONS)
+            {
+                for (auto it = _idle.begin(); it != _idle.end(); ++it)
+                {
+                    if (it->connected)
+                    {
+                        evicted = *it;
+                        _idle.erase(it);
+                        break;
+                    }
+                }
+            }
+        }
+
+        _checkedOut++;
+    }
+
+    if (evicted.handle != nullptr)
+    {
+        Debug_printv("connection limit reached, closing [%s]", evicted.key.c_str());
+        _keep_session(evicted);
+    }
+
+    if (handle != nullptr)
+        Debug_printv("%s [%s] hits[%lu] resumed[%lu] misses[%lu]", connected ? "reusing connection" : "resuming session",
+                     key.c_str(), _hits, _resumed, _misses);
+
+    return handle;
+}
+
+void HttpConnectionPool::checkin(const std::string &key, void *handle, handle_fn cleanup, handle_fn disconnect, handle_state state)
+{
+    if (handle == nullptr)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _checkedOut--;
+        return;
+    }
+
+    Entry e = {key, handle, cleanup, disconnect, fnSystem.millis(), state == HANDLE_KEEP};
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _checkedOut--;
+
+        int open = _checkedOut + std::count_if(_idle.begin(), _idle.end(), [](const Entry &i) { return i.connected; });
+        if (state == HANDLE_KEEP && open < HTTP_POOL_MAX_CONNECTIONS)
+        {
+            _idle.push_back(e);
+            return;
+        }
+    }
+
+    if (state == HANDLE_DISCARD)
+        cleanup(handle);
+    else
+        _keep_session(e);
+}
+
+void HttpConnectionPool::closeIdle()
+{
+    std::vector<Entry> closed;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (auto it = _idle.begin(); it != _idle.end();)
+        {
+            if (it->connected)
+            {
+                closed.push_back(*it);
+                it = _idle.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    // sessions stay valid on the server side
+    for (auto &e : closed)
+        _keep_session(e);
+}
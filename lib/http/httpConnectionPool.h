@@ -0,0 +1,97 @@
+#ifndef _HTTP_CONNECTION_POOL_H_
+#define _HTTP_CONNECTION_POOL_H_
+
+/* Process-wide pool of idle HTTP client handles
+
+Both fnHttpClient (network protocol) and MeatHttpClient (meatloaf) hand their
+handle back here instead of destroying it. The next client for the same
+scheme/host/port checks it out and
+
+ * reuses the open TCP/TLS connection if the previous response was read to
+   its end and the server kept the connection open, or
+ * reconnects with an abbreviated TLS handshake using the session the
+   handle saved from its previous connection (HTTPS only).
+
+A full TLS handshake takes several hundred ms on the ESP32, resuming a
+session saves the key exchange and the certificate chain.
+
+Handles are opaque to the pool, each one is stored with the functions that
+close its connection and destroy it. Keys carry a tag for the client
+implementation so handles of different types never mix.
+*/
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+// Idle connections older than this are closed instead of reused, servers
+// commonly drop keep-alive connections after 5-15s
+#define HTTP_POOL_IDLE_TIMEOUT_MS 5000
+
+// Upper bound for connections (idle and checked out). Idle ones are closed
+// to make room; when all are checked out a new one is still allowed but is
+// not kept open when it is returned.
+#define HTTP_POOL_MAX_CONNECTIONS 4
+
+// Closed HTTPS handles kept for their TLS session (a few hundred bytes plus
+// the client buffers each), and how long a session is considered valid
+#define HTTP_POOL_MAX_SESSIONS 4
+#define HTTP_POOL_SESSION_TIMEOUT_MS (5 * 60 * 1000)
+
+class HttpConnectionPool
+{
+public:
+    typedef void (*handle_fn)(void *handle);
+
+    enum handle_state
+    {
+        HANDLE_DISCARD,    // request state is left on the handle, destroy it
+        HANDLE_DISCONNECT, // connection can't be reused, the handle and its TLS session can
+        HANDLE_KEEP        // response was read to its end and the connection is still open
+    };
+
+    // "tag:scheme://user@host:port" for the given URL
+    static std::string key(const char *tag, const std::string &url);
+
+    // Returns a pooled handle for the key or nullptr if the caller has to
+    // create one. Either way the connection counts as checked out until
+    // checkin().
+    void *checkout(const std::string &key);
+
+    // Returns a handle, "disconnect" closes its connection but keeps the handle usable
+    void checkin(const std::string &key, void *handle, handle_fn cleanup, handle_fn disconnect, handle_state state);
+
+    // Closes all idle connections, e.g. after the network went down
+    void closeIdle();
+
+    uint32_t getHits() { return _hits; }
+    uint32_t getResumed() { return _resumed; }
+    uint32_t getMisses() { return _misses; }
+
+private:
+    struct Entry
+    {
+        std::string key;
+        void *handle;
+        handle_fn cleanup;
+        handle_fn disconnect;
+        uint64_t lastUsed;
+        bool connected;
+    };
+
+    static bool _is_tls(const std::string &key);
+    void _keep_session(Entry &e);
+    void _expire(uint64_t now);
+
+    std::mutex _lock;
+    std::vector<Entry> _idle;
+    int _checkedOut = 0;
+    uint32_t _hits = 0;
+    uint32_t _resumed = 0;
+    uint32_t _misses = 0;
+};
+
+extern HttpConnectionPool fnHttpPool;
+
+#endif // _HTTP_CONNECTION_POOL_H_
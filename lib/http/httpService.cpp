@@ -22,6 +22,7 @@
 #include "httpServiceConfigurator.h"
 #include "httpServiceParser.h"
 #include "fuji.h"
+#include "tnfslib.h"
 
 using namespace std;
 
@@ -621,6 +622,122 @@ esp_err_t fnHttpService::get_handler_modem_sniffer(httpd_req_t *req)
     return ESP_OK;
 }
 
+#ifdef BUILD_IEC
+esp_err_t fnHttpService::get_handler_iec_trace(httpd_req_t *req)
+{
+#if IEC_TRACE_BUFFER_SIZE>0
+    queryparts qp;
+    parse_query(req, &qp);
+
+    IECTrace *trace = IEC.getTrace();
+
+    if (qp.query_parsed.find("enable") != qp.query_parsed.end())
+        trace->enable(qp.query_parsed["enable"] == "1");
+
+    if (qp.query_parsed["clear"] == "1")
+        trace->clear();
+
+    bool vcd = qp.query_parsed["format"] == "vcd";
+    if (vcd)
+    {
+        httpd_resp_set_type(req, "application/octet-stream");
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"iectrace.vcd\"");
+    }
+    else
+        httpd_resp_set_type(req, "application/json");
+
+    // collect the output into FNWS_SEND_BUFF_SIZE chunks
+    char *buf = (char *)malloc(FNWS_SEND_BUFF_SIZE);
+    size_t count = 0, total = 0;
+    IECTrace::Writer out = [&](const char *data, size_t len)
+    {
+        while (len > 0)
+        {
+            size_t n = std::min(len, (size_t)FNWS_SEND_BUFF_SIZE - count);
+            memcpy(buf + count, data, n);
+            count += n;
+            data += n;
+            len -= n;
+            if (count == FNWS_SEND_BUFF_SIZE)
+            {
+                httpd_resp_send_chunk(req, buf, count);
+                total += count;
+                count = 0;
+            }
+        }
+    };
+
+    if (vcd)
+        trace->writeVCD(out);
+    else
+        trace->writeJSON(out);
+
+    if (count > 0)
+        httpd_resp_send_chunk(req, buf, count);
+    total += count;
+    httpd_resp_send_chunk(req, nullptr, 0);
+    free(buf);
+
+#ifdef VERBOSE_HTTP
+    Debug_printf("Sent %u bytes of IEC trace\n", total);
+#endif
+#else
+    // tracing compiled out (IEC_TRACE_BUFFER_SIZE 0, e.g. not ESP32), say so
+    // instead of leaving /iectrace unregistered
+    httpd_resp_set_status(req, "501 Not Implemented");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"available\":false,\"enabled\":false}");
+#endif
+
+    return ESP_OK;
+}
+#endif
+
+#ifdef BUILD_IEC
+esp_err_t fnHttpService::get_handler_iec_stats(httpd_req_t *req)
+{
+    queryparts qp;
+    parse_query(req, &qp);
+    bool clear = qp.query_parsed["clear"] == "1";
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, "{\"drives\":[", HTTPD_RESP_USE_STRLEN);
+    for (int i = 0; i < MAX_DISK_DEVICES; i++)
+    {
+        iecDrive *drive = &theFuji.get_disks(i)->disk_dev;
+        std::string s = (i > 0 ? ",{\"device\":" : "{\"device\":") + std::to_string(drive->id()) + ",\"stats\":" + drive->getStats().getJSON() + "}";
+        httpd_resp_send_chunk(req, s.c_str(), s.length());
+        if (clear)
+            drive->getStats().clear();
+    }
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, nullptr, 0);
+
+    return ESP_OK;
+}
+#endif
+
+esp_err_t fnHttpService::get_handler_tnfs_stats(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send_chunk(req, "{\"hosts\":[", HTTPD_RESP_USE_STRLEN);
+    bool first = true;
+    for (int i = 0; i < MAX_HOSTS; i++)
+    {
+        tnfsMountInfo *mi = theFuji.get_hosts(i)->get_tnfs_mountinfo();
+        if (mi == nullptr)
+            continue;
+
+        std::string s = (first ? "{\"slot\":" : ",{\"slot\":") + std::to_string(i) + ",\"tnfs\":" + mi->shared->stats_json() + "}";
+        httpd_resp_send_chunk(req, s.c_str(), s.length());
+        first = false;
+    }
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, nullptr, 0);
+
+    return ESP_OK;
+}
+
 esp_err_t fnHttpService::get_handler_mount(httpd_req_t *req)
 {
     queryparts qp;
@@ -1441,6 +1558,29 @@ httpd_handle_t fnHttpService::start_server(serverstate &state)
          .is_websocket = false,
          .handle_ws_control_frames = false,
          .supported_subprotocol = nullptr},
+        {.uri = "/tnfsstats",
+         .method = HTTP_GET,
+         .handler = get_handler_tnfs_stats,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+#ifdef BUILD_IEC
+        {.uri = "/iecstats",
+         .method = HTTP_GET,
+         .handler = get_handler_iec_stats,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+        {.uri = "/iectrace",
+         .method = HTTP_GET,
+         .handler = get_handler_iec_trace,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+#endif
 #ifdef BUILD_ADAM
         {.uri = "/term",
          .method = HTTP_GET,
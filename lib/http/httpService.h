@@ -9,6 +9,8 @@ URI: "/" - Forces loading/parsing (see below) of /<FNWS_FILE_ROOT>/index.html
 URI: "/file?<filename>" - Sends static file /<FNWS_FILE_ROOT>/<filename>
 URI: "/favico.ico" - Sends /<FNWS_FILE_ROOT>/favico.ico
 URI: "/print" - Sends current printer output to user
+URI: "/iectrace" - Sends IEC bus trace as JSON (or VCD with "format=vcd"), 501 if tracing is compiled out
+URI: "/iecstats" - Sends IEC drive transfer statistics as JSON
 
 MIME types are assigned based on file extention.  See/update
     static std::map<string, string> mime_map
@@ -35,6 +37,10 @@ If a file has an extention pre-determined to support parsing (see/update
 
 #include "fnFS.h"
 
+#ifdef BUILD_IEC
+#include "IECConfig.h"
+#endif
+
 #ifdef ESP_PLATFORM
 #include "webdav/request.h"
 #include <esp_http_server.h>
@@ -138,6 +144,12 @@ public:
     static esp_err_t get_handler_eject(httpd_req_t *req);
     static esp_err_t get_handler_dir(httpd_req_t *req);
     static esp_err_t get_handler_slot(httpd_req_t *req);
+    static esp_err_t get_handler_tnfs_stats(httpd_req_t *req);
+
+#ifdef BUILD_IEC
+    static esp_err_t get_handler_iec_stats(httpd_req_t *req);
+    static esp_err_t get_handler_iec_trace(httpd_req_t *req);
+#endif
 
 #ifdef BUILD_ADAM
     static esp_err_t get_handler_term(httpd_req_t *req);
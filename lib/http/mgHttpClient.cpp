@@ -40,6 +40,7 @@
 #include "fnSystem.h"
 #include "utils.h"
 #include "mgHttpClient.h"
+#include "mgTlsSessionCache.h"
 
 #include "../../include/debug.h"
 
@@ -355,7 +356,11 @@ void mgHttpClient::handle_connect(struct mg_connection *c)
         // opts.key = mg_file_read(&mg_fs_posix, "tls/private-key.pem");
 #endif
         opts.name = host;
-        mg_tls_init(c, &opts);
+
+        // offer the TLS session of the previous connection to this host (if any)
+        _tls_session_key = mgTlsSessionCache::key(url);
+        _tls_start_ms = mg_millis();
+        mgTlsSessionCache::init(c, &opts, _tls_session_key);
     }
 
     // reset response status code
@@ -623,10 +628,6 @@ void report_unhandled(int ev)
 #ifdef VERBOSE_HTTP
     switch(ev)
     {
-    case MG_EV_TLS_HS:
-        Debug_printf("mgHttpClient: TLS Handshake succeeded\n");
-        break;
-
     case MG_EV_HTTP_HDRS:
         Debug_printf("mgHttpClient: HTTP Headers received\n");
         break;
@@ -683,10 +684,19 @@ void mgHttpClient::_httpevent_handler(struct mg_connection *c, int ev, void *ev_
         client->handle_read(c);
         break;
 
+    case MG_EV_TLS_HS:
+#ifdef VERBOSE_HTTP
+        Debug_printf("mgHttpClient: TLS handshake took %lu ms\n", (unsigned long)(mg_millis() - client->_tls_start_ms));
+#endif
+        break;
+
     case MG_EV_CLOSE:
 #ifdef VERBOSE_HTTP
         Debug_printf("mgHttpClient: Connection closed\n");
 #endif
+        // keep the TLS session for the next connection to this host
+        if (c->is_tls)
+            mgTlsSessionCache::save(c, client->_tls_session_key);
         client->_transaction_done = true;
         client->is_chunked = false;
         break;
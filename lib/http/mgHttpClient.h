@@ -81,6 +81,10 @@ private:
     // http redirect location
     std::string _location;
 
+    // TLS session cache key (host:port) of the current connection, see mgTlsSessionCache
+    std::string _tls_session_key;
+    uint64_t _tls_start_ms = 0;
+
     // HTTP methods
     enum HttpMethod
     {
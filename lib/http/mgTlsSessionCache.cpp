@@ -0,0 +1,159 @@
+#ifndef ESP_PLATFORM
+
+#include "mgTlsSessionCache.h"
+
+#include <algorithm>
+#include <cctype>
+
+std::mutex mgTlsSessionCache::_lock;
+uint32_t mgTlsSessionCache::_offered = 0;
+uint32_t mgTlsSessionCache::_saved = 0;
+
+std::string mgTlsSessionCache::key(const char *url)
+{
+    struct mg_str host = mg_url_host(url);
+    std::string k(host.ptr, host.len);
+    std::transform(k.begin(), k.end(), k.begin(), ::tolower);
+    return k + ":" + std::to_string(mg_url_port(url));
+}
+
+#if MG_TLS == MG_TLS_MBED
+
+struct TlsSessionEntry
+{
+    std::string key;
+    mbedtls_ssl_session session;
+    uint64_t saved;
+    uint64_t lastUsed;
+    bool valid;
+};
+
+static TlsSessionEntry s_sessions[TLS_SESSION_CACHE_ENTRIES];
+static uint64_t s_useCounter = 0;
+
+static void drop_session(TlsSessionEntry &e)
+{
+    if (e.valid)
+        mbedtls_ssl_session_free(&e.session);
+    e.valid = false;
+    e.key.clear();
+}
+
+// Entry saved for the key (expired ones are dropped), nullptr if none
+static TlsSessionEntry *find_session(const std::string &key)
+{
+    for (auto &e : s_sessions)
+    {
+        if (!e.valid || e.key != key)
+            continue;
+
+        if (mg_millis() - e.saved > TLS_SESSION_CACHE_TIMEOUT_MS)
+        {
+            drop_session(e);
+            return nullptr;
+        }
+        return &e;
+    }
+    return nullptr;
+}
+
+void mgTlsSessionCache::init(struct mg_connection *c, const struct mg_tls_opts *opts, const std::string &key)
+{
+    // mg_tls_init() starts the handshake right away on a connected socket,
+    // hold it back until the saved session is set for the ClientHello
+    bool connecting = c->is_connecting;
+    c->is_connecting = 1;
+    mg_tls_init(c, opts);
+    c->is_connecting = connecting;
+
+    struct mg_tls *tls = (struct mg_tls *)c->tls;
+    if (tls == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        TlsSessionEntry *e = find_session(key);
+        if (e != nullptr && mbedtls_ssl_set_session(&tls->ssl, &e->session) == 0)
+        {
+            e->lastUsed = ++s_useCounter;
+            _offered++;
+        }
+    }
+
+    if (!c->is_connecting && !c->is_resolving)
+        mg_tls_handshake(c);
+}
+
+void mgTlsSessionCache::save(struct mg_connection *c, const std::string &key)
+{
+    struct mg_tls *tls = (struct mg_tls *)c->tls;
+    if (tls == nullptr || key.empty())
+        return;
+
+    std::lock_guard<std::mutex> guard(_lock);
+    TlsSessionEntry *e = find_session(key);
+
+    // a failed handshake may have been caused by the session offered
+    if (c->is_tls_hs)
+    {
+        if (e != nullptr)
+            drop_session(*e);
+        return;
+    }
+
+    if (e == nullptr)
+    {
+        // free entry or the least recently used one
+        e = &s_sessions[0];
+        for (auto &s : s_sessions)
+        {
+            if (!s.valid)
+            {
+                e = &s;
+                break;
+            }
+            if (s.lastUsed < e->lastUsed)
+                e = &s;
+        }
+    }
+
+    drop_session(*e);
+    mbedtls_ssl_session_init(&e->session);
+    if (mbedtls_ssl_get_session(&tls->ssl, &e->session) != 0)
+    {
+        mbedtls_ssl_session_free(&e->session);
+        return;
+    }
+
+    e->key = key;
+    e->saved = mg_millis();
+    e->lastUsed = ++s_useCounter;
+    e->valid = true;
+    _saved++;
+}
+
+void mgTlsSessionCache::clear()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    for (auto &e : s_sessions)
+        drop_session(e);
+}
+
+#else // MG_TLS != MG_TLS_MBED
+
+void mgTlsSessionCache::init(struct mg_connection *c, const struct mg_tls_opts *opts, const std::string &key)
+{
+    mg_tls_init(c, opts);
+}
+
+void mgTlsSessionCache::save(struct mg_connection *c, const std::string &key)
+{
+}
+
+void mgTlsSessionCache::clear()
+{
+}
+
+#endif // MG_TLS
+
+#endif // !ESP_PLATFORM
@@ -0,0 +1,57 @@
+#ifndef _MG_TLS_SESSION_CACHE_H_
+#define _MG_TLS_SESSION_CACHE_H_
+
+/* TLS sessions of mongoose client connections (FujiNet-PC)
+
+mgHttpClient creates a new mg_mgr for every request, so nothing of a
+previous connection survives in mongoose. The session of each HTTPS
+connection is saved here when it closes (per host:port). The next
+connection to the same host offers it in its ClientHello and the server can
+resume it with an abbreviated handshake: no certificate chain is sent or
+verified and no key exchange is done.
+
+Only implemented for MG_TLS_MBED (the FujiNet-PC default). With other TLS
+backends init() is plain mg_tls_init() and save() does nothing.
+*/
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+#include "mongoose.h"
+#undef mkdir
+
+// Sessions kept (one per host:port), the least recently used one is replaced
+#define TLS_SESSION_CACHE_ENTRIES 8
+
+// Saved sessions are not offered anymore after this, servers rarely accept
+// tickets older than a few hours
+#define TLS_SESSION_CACHE_TIMEOUT_MS (60 * 60 * 1000)
+
+class mgTlsSessionCache
+{
+public:
+    // "host:port" for the given URL
+    static std::string key(const char *url);
+
+    // Starts TLS on the (connected) client connection "c" like mg_tls_init(),
+    // but offers the session saved for "key" if there is one
+    static void init(struct mg_connection *c, const struct mg_tls_opts *opts, const std::string &key);
+
+    // Saves the session of "c" for "key", call on MG_EV_CLOSE. A connection
+    // whose handshake did not complete drops the saved session instead.
+    static void save(struct mg_connection *c, const std::string &key);
+
+    // Drops all saved sessions
+    static void clear();
+
+    static uint32_t getOffered() { return _offered; }
+    static uint32_t getSaved() { return _saved; }
+
+private:
+    static std::mutex _lock;
+    static uint32_t _offered;
+    static uint32_t _saved;
+};
+
+#endif // _MG_TLS_SESSION_CACHE_H_
@@ -0,0 +1,454 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+
+/********************************************************
+ * Inflate
+ ********************************************************/
+
+uint32_t ArchiveInflater::restarts = 0;
+
+
+// checkpoints only go to PSRAM, the decompressor itself may use internal RAM
+static void *inflateAlloc(size_t n, bool psram)
+{
+#ifdef ESP_PLATFORM
+    void *p = heap_caps_malloc(n, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if ( p != nullptr || psram )
+        return p;
+#endif
+    return malloc(n);
+}
+
+
+ArchiveInflater::ArchiveInflater(std::shared_ptr<MStream> source, uint32_t offset, uint32_t compressed_size, uint32_t size)
+{
+    this->source = source;
+    this->offset = offset;
+    this->compressed_size = compressed_size;
+    this->size = size;
+
+    // large entries get fewer checkpoints rather than more memory
+    interval = std::max((uint32_t) INFLATE_CHECKPOINT_INTERVAL, size / INFLATE_MAX_CHECKPOINTS + 1);
+
+    state = (State *) inflateAlloc(sizeof(State), false);
+    if ( state == nullptr )
+    {
+        Debug_printv("Error: could not allocate %u bytes for inflate", sizeof(State));
+        return;
+    }
+
+    restart(0);
+}
+
+
+ArchiveInflater::~ArchiveInflater()
+{
+    free(state);
+    for ( auto cp : checkpoints )
+        free(cp);
+}
+
+
+// latest checkpoint at or before "position"
+ArchiveInflater::State* ArchiveInflater::nearest(uint32_t position)
+{
+    State *found = nullptr;
+    for ( auto cp : checkpoints )
+    {
+        if ( cp->out_pos <= position )
+            found = cp;
+    }
+
+    return found;
+}
+
+
+// continues from the latest checkpoint at or before "position", or from the start
+bool ArchiveInflater::restart(uint32_t position)
+{
+    State *from = nearest(position);
+    if ( from != nullptr )
+    {
+        *state = *from;
+    }
+    else
+    {
+        tinfl_init(&state->decomp);
+        state->in_pos = 0;
+        state->out_pos = 0;
+        state->done = false;
+    }
+
+    input_len = 0;
+    input_used = 0;
+
+    if ( position > 0 )
+    {
+        restarts++;
+        Debug_printv("position[%lu] from[%lu] restarts[%lu]", position, state->out_pos, restarts);
+    }
+
+    return true;
+}
+
+
+// inflates the next chunk into the dictionary, returns false at the end of the entry
+bool ArchiveInflater::inflate()
+{
+    if ( state->done )
+        return false;
+
+    if ( input_used == input_len && state->in_pos < compressed_size )
+    {
+        uint32_t n = std::min((uint32_t) INFLATE_INPUT_SIZE, compressed_size - state->in_pos);
+        if ( !source->seek(offset + state->in_pos) )
+            return false;
+
+        input_len = source->read(input, n);
+        input_used = 0;
+        if ( input_len == 0 )
+            return false;
+    }
+
+    size_t in_bytes = input_len - input_used;
+    size_t dict_ofs = state->out_pos & (TINFL_LZ_DICT_SIZE - 1);
+    size_t out_bytes = TINFL_LZ_DICT_SIZE - dict_ofs;
+    uint32_t flags = ( state->in_pos + in_bytes < compressed_size ) ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+
+    tinfl_status status = tinfl_decompress(&state->decomp, input + input_used, &in_bytes,
+                                           state->dict, state->dict + dict_ofs, &out_bytes, flags);
+
+    input_used += in_bytes;
+    state->in_pos += in_bytes;
+    state->out_pos += out_bytes;
+
+    if ( status < TINFL_STATUS_DONE )
+    {
+        Debug_printv("Error: inflate failed status[%d] in[%lu] out[%lu]", status, state->in_pos, state->out_pos);
+        state->done = true;
+        return false;
+    }
+
+    if ( status == TINFL_STATUS_DONE || ( in_bytes == 0 && out_bytes == 0 ) )
+        state->done = true;
+
+    checkpoint();
+
+    return out_bytes > 0;
+}
+
+
+void ArchiveInflater::checkpoint()
+{
+    if ( interval == 0 || state->done || checkpoints.size() >= INFLATE_MAX_CHECKPOINTS )
+        return;
+
+    uint32_t last = checkpoints.empty() ? 0 : checkpoints.back()->out_pos;
+    if ( state->out_pos < last + interval )
+        return;
+
+    State *cp = (State *) inflateAlloc(sizeof(State), true);
+    if ( cp == nullptr )
+    {
+        // no PSRAM, stop trying
+        interval = 0;
+        return;
+    }
+
+    *cp = *state;
+    checkpoints.push_back(cp);
+}
+
+
+uint32_t ArchiveInflater::read(uint32_t position, uint8_t* buf, uint32_t size)
+{
+    if ( state == nullptr || position >= this->size )
+        return 0;
+
+    // the dictionary holds the last 32K inflated, further back or ahead of a
+    // checkpoint continue from the checkpoint
+    uint32_t history = std::min(state->out_pos, (uint32_t) TINFL_LZ_DICT_SIZE);
+    State *cp = nearest(position);
+    if ( position < state->out_pos - history || ( cp != nullptr && cp->out_pos > state->out_pos ) )
+        restart(position);
+
+    while ( state->out_pos <= position )
+    {
+        if ( !inflate() )
+            return 0;
+    }
+
+    size = std::min(size, state->out_pos - position);
+    uint32_t start = position & (TINFL_LZ_DICT_SIZE - 1);
+    uint32_t n = std::min(size, (uint32_t) TINFL_LZ_DICT_SIZE - start);
+    memcpy(buf, state->dict + start, n);
+    if ( n < size )
+        memcpy(buf + n, state->dict, size - n);
+
+    return size;
+}
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+std::shared_ptr<ArchiveDirectory> ArchiveMStream::getDirectory()
+{
+    if ( directory != nullptr )
+        return directory;
+
+    std::string key = "archive:" + containerStream->url;
+    uint32_t archive_size = containerStream->size();
+    if ( !containerStream->url.empty() )
+    {
+        auto cached = std::static_pointer_cast<ArchiveDirectory>(MBroker::get(key));
+        if ( cached != nullptr && cached->archive_size == archive_size )
+        {
+            directory = cached;
+            return directory;
+        }
+    }
+
+    auto dir = std::make_shared<ArchiveDirectory>();
+    dir->archive_size = archive_size;
+    directory = dir;
+
+    // an unreadable archive is shown empty and not cached
+    if ( !readDirectory(*dir) )
+    {
+        Debug_printv("Error: invalid archive [%s]", containerStream->url.c_str());
+        dir->entries.clear();
+        return directory;
+    }
+
+    Debug_printv("entries[%d] url[%s]", dir->entries.size(), containerStream->url.c_str());
+
+    if ( !containerStream->url.empty() )
+    {
+        uint32_t cost = sizeof(ArchiveDirectory) + dir->header.size() + dir->entries.size() * sizeof(ArchiveEntry);
+        for ( const auto &e : dir->entries )
+            cost += e.name.size();
+        MBroker::put(key, dir, cost);
+    }
+
+    return directory;
+}
+
+
+std::string ArchiveMStream::archiveName()
+{
+    std::string name = containerStream->url;
+    size_t slash = name.find_last_of('/');
+    if ( slash != std::string::npos )
+        name.erase(0, slash + 1);
+
+    size_t dot = name.find_last_of('.');
+    if ( dot != std::string::npos && dot > 0 )
+        name.erase(dot);
+
+    return name;
+}
+
+
+std::string ArchiveMStream::decodeType(uint8_t file_type, bool show_hidden)
+{
+    if ( file_type == ARCHIVE_TYPE_NONE )
+        return "";
+
+    return file_type_label[ file_type & 0b00000111 ];
+}
+
+
+bool ArchiveMStream::seekEntry( std::string filename )
+{
+    if ( filename.empty() )
+        return false;
+
+    if ( getIndex() != nullptr )
+    {
+        int pos = dir_index->find(filename);
+        return ( pos >= 0 && seekEntry( dir_index->entries[pos].index ) );
+    }
+
+    for ( uint16_t index = 1; seekEntry( index ); index++ )
+    {
+        if ( mstr::compare(filename, entry.name) )
+            return true;
+    }
+
+    return false;
+}
+
+
+bool ArchiveMStream::seekEntry( uint16_t index )
+{
+    auto dir = getDirectory();
+
+    entry_index = index;
+    if ( index == 0 || index > dir->entries.size() )
+        return false;
+
+    entry = dir->entries[index - 1];
+    return true;
+}
+
+
+bool ArchiveMStream::indexEntry( MediaIndex::Entry &e )
+{
+    e.name = entry.name;
+    e.file_type = entry.file_type;
+    e.track = e.sector = e.offset = 0;
+
+    return true;
+}
+
+
+bool ArchiveMStream::seekPath(std::string path)
+{
+    seekCalled = true;
+
+    entry_index = 0;
+    inflater.reset();
+
+    if ( !seekEntry(path) || !seekData(entry) )
+    {
+        Debug_printv( "Not found! [%s]", path.c_str());
+        return false;
+    }
+
+    if ( entry.method == ARCHIVE_DEFLATED )
+    {
+        inflater.reset(new ArchiveInflater(containerStream, entry.offset, entry.compressed_size, entry.size));
+        if ( !inflater->isValid() )
+        {
+            inflater.reset();
+            return false;
+        }
+    }
+    else if ( entry.method != ARCHIVE_STORED )
+    {
+        Debug_printv( "Unsupported compression method[%d] [%s]", entry.method, path.c_str());
+        return false;
+    }
+
+    _size = entry.size;
+    _position = 0;
+
+    Debug_printv("name[%s] method[%d] offset[%lu] compressed[%lu] size[%lu]", entry.name.c_str(), entry.method, entry.offset, entry.compressed_size, entry.size);
+
+    return true;
+}
+
+
+uint32_t ArchiveMStream::readFile(uint8_t* buf, uint32_t size)
+{
+    size = std::min(size, _size - _position);
+
+    if ( inflater != nullptr )
+        return inflater->read(_position, buf, size);
+
+    if ( !containerStream->seek(entry.offset + _position) )
+        return 0;
+
+    return containerStream->read(buf, size);
+}
+
+
+bool ArchiveMStream::seek(uint32_t offset)
+{
+    if ( !seekCalled )
+        return MMediaStream::seek(offset);
+
+    if ( offset > _size )
+        return false;
+
+    _position = offset;
+    return true;
+}
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+bool ArchiveMFile::isDirectory() {
+    //Debug_printv("pathInStream[%s]", pathInStream.c_str());
+    if ( pathInStream == "" )
+        return true;
+    else
+        return false;
+};
+
+bool ArchiveMFile::rewindDirectory() {
+    dirIsOpen = false;
+    Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
+    auto image = ImageBroker::obtain<ArchiveMStream>(streamFile->url);
+    if ( image == nullptr )
+    {
+        Debug_printv("image pointer is null");
+        dirImage.reset();
+        return false;
+    }
+
+    dirImage = image;
+    dirIsOpen = true;
+
+    image->resetEntryCounter();
+
+    // Read Header
+    image->seekHeader();
+
+    // Set Media Info Fields
+    media_header = image->directory->header.empty() ? image->archiveName() : image->directory->header;
+    media_id = media_type;
+    media_blocks_free = 0;
+    media_block_size = image->block_size;
+    media_image = name;
+
+    Debug_printv("media_header[%s] media_id[%s] media_blocks_free[%d] media_block_size[%d] media_image[%s]", media_header.c_str(), media_id.c_str(), media_blocks_free, media_block_size, media_image.c_str());
+
+    return true;
+}
+
+MFile* ArchiveMFile::getNextFileInDir() {
+
+    if(!dirIsOpen && !rewindDirectory())
+        return nullptr;
+
+    // Get entry pointed to by containerStream
+    auto image = dirImage;
+
+    if ( image->seekNextImageEntry() )
+    {
+        auto file = MFSOwner::File(streamFile->url + "/" + image->entry.name);
+        if ( image->entry.file_type != ARCHIVE_TYPE_NONE )
+            file->extension = image->decodeType(image->entry.file_type);
+        Debug_printv( "entry[%s] ext[%s]", image->entry.name.c_str(), file->extension.c_str() );
+        return file;
+    }
+    else
+    {
+        //Debug_printv( "END OF DIRECTORY");
+        dirIsOpen = false;
+        dirImage.reset();
+        return nullptr;
+    }
+}
+
+
+uint32_t ArchiveMFile::size() {
+    // size of the current directory entry while listing, of the opened entry otherwise
+    auto image = ImageBroker::obtain<ArchiveMStream>(streamFile->url);
+    if ( image == nullptr )
+        return 0;
+
+    return image->entry.size;
+}
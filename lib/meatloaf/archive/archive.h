@@ -0,0 +1,196 @@
+// Archives - ZIP, GZ, LNX and ARK
+//
+// Files inside an archive are read straight from the archive stream (e.g. HTTP), so
+// http://host/game.zip/disk1.d64/PROG opens PROG without unpacking the archive first.
+// Compressed entries are inflated while they are read, see ArchiveInflater.
+//
+
+
+#ifndef MEATLOAF_ARCHIVE
+#define MEATLOAF_ARCHIVE
+
+#include "../meatloaf.h"
+#include "../meat_media.h"
+
+#ifdef ESP_PLATFORM
+#include "rom/miniz.h"
+#else
+#include "miniz.h"
+#endif
+
+
+/********************************************************
+ * Directory
+ ********************************************************/
+
+#define ARCHIVE_STORED   0
+#define ARCHIVE_DEFLATED 8
+
+// entry has no CBM file type, its type is the extension of its name
+#define ARCHIVE_TYPE_NONE 0xFF
+
+// little endian fields of archive headers
+static inline uint16_t archiveLE16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t archiveLE32(const uint8_t *p) { return archiveLE16(p) | ((uint32_t) archiveLE16(p + 2) << 16); }
+
+struct ArchiveEntry {
+    std::string name;           // UTF-8, "/" separates the folders of ZIP entries
+    uint32_t offset;            // data (or ZIP local header) offset in the archive
+    uint32_t compressed_size;
+    uint32_t size;
+    uint8_t method;             // ARCHIVE_STORED or ARCHIVE_DEFLATED
+    uint8_t file_type;          // CBM directory file type or ARCHIVE_TYPE_NONE
+};
+
+// Parsed directory of an archive (e.g. the ZIP central directory), shared by all streams
+// of the archive through MBroker ("archive:" + archive URL)
+struct ArchiveDirectory {
+    uint32_t archive_size;      // the directory is read again if the archive changed
+    std::string header;
+    std::vector<ArchiveEntry> entries;
+};
+
+
+/********************************************************
+ * Inflate
+ ********************************************************/
+
+// Inflated bytes between checkpoints. A checkpoint is a copy of the decompressor and its
+// 32K dictionary (about 43K), it is only kept in PSRAM. Without checkpoints seeking
+// backwards further than the dictionary restarts inflating at the start of the entry.
+#define INFLATE_CHECKPOINT_INTERVAL (64 * 1024)
+#define INFLATE_MAX_CHECKPOINTS     16
+#define INFLATE_INPUT_SIZE          1024
+
+class ArchiveInflater {
+public:
+    ArchiveInflater(std::shared_ptr<MStream> source, uint32_t offset, uint32_t compressed_size, uint32_t size);
+    ~ArchiveInflater();
+
+    bool isValid() { return state != nullptr; }
+
+    // RAM held by the inflate state and its checkpoints
+    uint32_t bytes() { return sizeof(ArchiveInflater) + (state != nullptr ? sizeof(State) : 0) + checkpoints.size() * sizeof(State); }
+
+    // copies up to "size" inflated bytes at "position"
+    uint32_t read(uint32_t position, uint8_t* buf, uint32_t size);
+
+    static uint32_t getRestarts() { return restarts; }
+
+private:
+    struct State {
+        tinfl_decompressor decomp;
+        uint32_t in_pos;        // compressed bytes consumed
+        uint32_t out_pos;       // inflated bytes produced
+        bool done;
+        uint8_t dict[TINFL_LZ_DICT_SIZE];
+    };
+
+    State* nearest(uint32_t position);
+    bool restart(uint32_t position);
+    bool inflate();
+    void checkpoint();
+
+    std::shared_ptr<MStream> source;
+    uint32_t offset, compressed_size, size;
+
+    State* state = nullptr;
+    std::vector<State*> checkpoints;
+    uint32_t interval;
+
+    uint8_t input[INFLATE_INPUT_SIZE];
+    uint32_t input_len = 0, input_used = 0;
+
+    static uint32_t restarts;
+};
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class ArchiveMStream : public MMediaStream {
+
+public:
+    ArchiveMStream(std::shared_ptr<MStream> is) : MMediaStream(is) {};
+
+    // seeks inside the selected entry once seekPath() found it
+    bool seek(uint32_t offset) override;
+
+    // the archive directory is an MBroker entry of its own and not counted here
+    uint32_t bytes() override {
+        return MMediaStream::bytes() + (inflater != nullptr ? inflater->bytes() : 0);
+    }
+
+protected:
+    void seekHeader() override {
+        getDirectory();
+    }
+
+    bool seekNextImageEntry() override {
+        return seekEntry(entry_index + 1);
+    }
+
+    bool seekEntry( std::string filename ) override;
+    bool seekEntry( uint16_t index ) override;
+    bool indexEntry( MediaIndex::Entry &e ) override;
+
+    uint32_t readFile(uint8_t* buf, uint32_t size) override;
+    bool seekPath(std::string path) override;
+
+    std::string decodeType(uint8_t file_type, bool show_hidden = false) override;
+
+    std::shared_ptr<ArchiveDirectory> getDirectory();
+    // parses the directory of the archive in containerStream
+    virtual bool readDirectory( ArchiveDirectory &dir ) = 0;
+    // points e.offset to the data of the entry if it is not known from the directory
+    virtual bool seekData( ArchiveEntry &e ) { return true; };
+
+    // name of the archive without its extension
+    std::string archiveName();
+
+    std::shared_ptr<ArchiveDirectory> directory;
+    ArchiveEntry entry;
+    std::unique_ptr<ArchiveInflater> inflater;
+
+private:
+    friend class ArchiveMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class ArchiveMFile: public MFile {
+public:
+
+    ArchiveMFile(std::string path, bool is_dir = true): MFile(path) {
+        isDir = is_dir;
+
+        media_image = name;
+        isPETSCII = true;
+    };
+
+    bool isDirectory() override;
+    bool rewindDirectory() override;
+    MFile* getNextFileInDir() override;
+    bool mkDir() override { return false; };
+
+    bool exists() override { return true; };
+    bool remove() override { return false; };
+    bool rename(std::string dest) override { return false; };
+    time_t getLastWrite() override { return 0; };
+    time_t getCreationTime() override { return 0; };
+    uint32_t size() override;
+
+    bool isDir = true;
+    bool dirIsOpen = false;
+    std::shared_ptr<ArchiveMStream> dirImage; // holds the entry cursor while dirIsOpen (keeps MBroker from evicting it)
+
+protected:
+    // shown as media_id in directory listings
+    std::string media_type;
+};
+
+#endif /* MEATLOAF_ARCHIVE */
@@ -0,0 +1,56 @@
+#include "ark.h"
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool ARKMStream::readDirectory( ArchiveDirectory &dir )
+{
+    uint32_t archive_size = containerStream->size();
+
+    uint8_t count;
+    if ( !containerStream->seek(0) || containerStream->read(&count, 1) != 1 || count == 0 )
+        return false;
+
+    // files start at the first block after the directory
+    uint32_t data = ( ( 1 + count * sizeof(Entry) + 253 ) / 254 ) * 254;
+    if ( data > archive_size )
+        return false;
+
+    Entry entry;
+    for ( uint8_t i = 0; i < count; i++ )
+    {
+        if ( containerStream->read((uint8_t *)&entry, sizeof(entry)) != sizeof(entry) )
+            return false;
+
+        std::string name(entry.filename, 16);
+        size_t pad = name.find('\xA0');
+        if ( pad != std::string::npos )
+            name.erase(pad);
+        mstr::replaceAll(name, "/", "\\");
+
+        uint32_t blocks = archiveLE16(entry.blocks);
+        uint32_t last = entry.last_sector_bytes;
+
+        ArchiveEntry e;
+        e.name = mstr::toUTF8(name);
+        e.offset = data;
+        // the side sectors of REL files follow their data
+        e.compressed_size = ( blocks + ( ( entry.file_type & 0x07 ) == 4 ? entry.rel_side_sectors : 0 ) ) * 254;
+        // "last" is the position of the last byte in its sector, as in a sector link
+        e.size = blocks ? ( blocks - 1 ) * 254 + ( last > 1 ? last - 1 : 254 ) : 0;
+        e.method = ARCHIVE_STORED;
+        e.file_type = entry.file_type;
+
+        // the last file may be cut short
+        if ( e.offset >= archive_size )
+            break;
+        if ( e.offset + e.size > archive_size )
+            e.size = archive_size - e.offset;
+
+        dir.entries.push_back(e);
+        data += e.compressed_size;
+    }
+
+    return true;
+}
@@ -0,0 +1,85 @@
+// .ARK - Arkive archive
+// https://ist.uwaterloo.ca/~schepers/formats/ARK.TXT
+//
+// A count byte and 29 byte directory entries followed by the files in 254 byte
+// blocks, files are stored uncompressed.
+//
+
+
+#ifndef MEATLOAF_ARCHIVE_ARK
+#define MEATLOAF_ARCHIVE_ARK
+
+#include "archive.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class ARKMStream : public ArchiveMStream {
+    // override everything that requires overriding here
+
+public:
+    ARKMStream(std::shared_ptr<MStream> is) : ArchiveMStream(is) { };
+
+protected:
+    struct Entry {
+        uint8_t file_type;
+        char filename[16];
+        uint8_t rel_record_length;
+        uint8_t unused[7];
+        uint8_t rel_side_sectors;
+        uint8_t last_sector_bytes;
+        uint8_t blocks[2];
+    };
+
+    bool readDirectory( ArchiveDirectory &dir ) override;
+
+private:
+    friend class ARKMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class ARKMFile: public ArchiveMFile {
+public:
+
+    ARKMFile(std::string path, bool is_dir = true): ArchiveMFile(path, is_dir) {
+        media_type = " ARK ";
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new ARKMStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class ARKMFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ARKMFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(".ark", fileName);
+    }
+
+    ARKMFileSystem(): MFileSystem("ark") {
+        is_archive = true;
+    };
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_ARK */
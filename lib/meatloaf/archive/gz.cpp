@@ -0,0 +1,78 @@
+#include "gz.h"
+
+#define GZ_HEADER_SIZE  10
+#define GZ_TRAILER_SIZE 8
+
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool GZMStream::readDirectory( ArchiveDirectory &dir )
+{
+    uint32_t archive_size = containerStream->size();
+    if ( archive_size < GZ_HEADER_SIZE + GZ_TRAILER_SIZE )
+        return false;
+
+    uint8_t buf[GZ_HEADER_SIZE];
+    if ( !containerStream->seek(0) || containerStream->read(buf, GZ_HEADER_SIZE) != GZ_HEADER_SIZE )
+        return false;
+    if ( buf[0] != 0x1F || buf[1] != 0x8B || buf[2] != ARCHIVE_DEFLATED )
+        return false;
+
+    uint8_t flags = buf[3];
+    uint32_t pos = GZ_HEADER_SIZE;
+    std::string name;
+
+    if ( flags & GZ_FEXTRA )
+    {
+        if ( containerStream->read(buf, 2) != 2 )
+            return false;
+        pos += 2 + archiveLE16(buf);
+    }
+
+    // zero terminated name and comment
+    for ( uint8_t field = GZ_FNAME; field <= GZ_FCOMMENT; field <<= 1 )
+    {
+        if ( !( flags & field ) )
+            continue;
+
+        if ( !containerStream->seek(pos) )
+            return false;
+
+        uint8_t c;
+        do
+        {
+            if ( containerStream->read(&c, 1) != 1 )
+                return false;
+            pos++;
+            if ( c != 0 && field == GZ_FNAME && name.size() < 255 )
+                name += (char) c;
+        } while ( c != 0 );
+    }
+
+    if ( flags & GZ_FHCRC )
+        pos += 2;
+
+    if ( pos + GZ_TRAILER_SIZE > archive_size )
+        return false;
+
+    // inflated size modulo 4G
+    if ( !containerStream->seek(archive_size - 4) || containerStream->read(buf, 4) != 4 )
+        return false;
+
+    ArchiveEntry e;
+    e.name = name.empty() ? archiveName() : name;
+    e.offset = pos;
+    e.compressed_size = archive_size - pos - GZ_TRAILER_SIZE;
+    e.size = archiveLE32(buf);
+    e.method = ARCHIVE_DEFLATED;
+    e.file_type = ARCHIVE_TYPE_NONE;
+    dir.entries.push_back(e);
+
+    return true;
+}
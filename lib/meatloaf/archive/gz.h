@@ -0,0 +1,75 @@
+// .GZ - gzip compressed file
+// https://www.rfc-editor.org/rfc/rfc1952
+//
+// Shown as a directory holding the single compressed file, named as stored in the
+// header or after the archive without ".gz" (game.d64.gz/game.d64).
+//
+
+
+#ifndef MEATLOAF_ARCHIVE_GZ
+#define MEATLOAF_ARCHIVE_GZ
+
+#include "archive.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class GZMStream : public ArchiveMStream {
+    // override everything that requires overriding here
+
+public:
+    GZMStream(std::shared_ptr<MStream> is) : ArchiveMStream(is) { };
+
+protected:
+    bool readDirectory( ArchiveDirectory &dir ) override;
+
+private:
+    friend class GZMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class GZMFile: public ArchiveMFile {
+public:
+
+    GZMFile(std::string path, bool is_dir = true): ArchiveMFile(path, is_dir) {
+        media_type = " GZ  ";
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new GZMStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class GZMFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new GZMFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(".gz", fileName);
+    }
+
+    GZMFileSystem(): MFileSystem("gz") {
+        is_archive = true;
+    };
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_GZ */
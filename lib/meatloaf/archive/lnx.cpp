@@ -0,0 +1,103 @@
+#include "lnx.h"
+
+#include <cstdlib>
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+std::string LNXMStream::readLine()
+{
+    std::string line;
+    uint8_t c;
+    while ( line.size() < 40 && containerStream->read(&c, 1) == 1 && c != 0x0D )
+        line += (char) c;
+
+    return line;
+}
+
+
+bool LNXMStream::readDirectory( ArchiveDirectory &dir )
+{
+    uint32_t archive_size = containerStream->size();
+
+    // skip the BASIC loader by following its line links
+    uint8_t buf[2];
+    uint32_t pos = 0;
+    if ( !containerStream->seek(0) || containerStream->read(buf, 2) != 2 )
+        return false;
+
+    if ( archiveLE16(buf) == 0x0801 )
+    {
+        pos = 2;
+        do
+        {
+            if ( !containerStream->seek(pos) || containerStream->read(buf, 2) != 2 )
+                return false;
+
+            uint16_t link = archiveLE16(buf);
+            if ( link == 0 )
+                break;
+            if ( link < 0x0801 || link - 0x0801 + 2u <= pos )
+                return false;
+
+            pos = link - 0x0801 + 2;
+        } while ( pos < archive_size );
+
+        pos += 2;
+    }
+
+    if ( !containerStream->seek(pos) )
+        return false;
+
+    // " 1  *LYNX XV  BY WILL CORLEY", number of directory blocks and signature
+    std::string line;
+    for ( int i = 0; i < 4 && line.empty(); i++ )
+        line = readLine();
+
+    std::string signature = line;
+    mstr::toUpper(signature);
+    if ( signature.find("LYNX") == std::string::npos )
+        return false;
+
+    uint32_t data = strtoul(line.c_str(), nullptr, 10) * 254;
+    uint32_t count = strtoul(readLine().c_str(), nullptr, 10);
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        std::string name = readLine();
+        uint32_t blocks = strtoul(readLine().c_str(), nullptr, 10);
+        std::string type = readLine();
+        mstr::trim(type);
+
+        // REL files have their record length before the last sector size
+        if ( type == "R" )
+            readLine();
+        uint32_t last = strtoul(readLine().c_str(), nullptr, 10);
+
+        size_t pad = name.find('\xA0');
+        if ( pad != std::string::npos )
+            name.erase(pad);
+        mstr::replaceAll(name, "/", "\\");
+
+        ArchiveEntry e;
+        e.name = mstr::toUTF8(name);
+        e.offset = data;
+        e.compressed_size = blocks * 254;
+        // "last" is the position of the last byte in its sector, as in a sector link
+        e.size = blocks ? ( blocks - 1 ) * 254 + ( last > 1 ? last - 1 : 254 ) : 0;
+        e.method = ARCHIVE_STORED;
+        e.file_type = 0x80 | ( type == "S" ? 1 : type == "U" ? 3 : type == "R" ? 4 : type == "D" ? 0 : 2 );
+
+        // the last file may be cut short
+        if ( e.offset >= archive_size )
+            break;
+        if ( e.offset + e.size > archive_size )
+            e.size = archive_size - e.offset;
+
+        dir.entries.push_back(e);
+        data += e.compressed_size;
+    }
+
+    return true;
+}
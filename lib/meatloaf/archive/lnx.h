@@ -0,0 +1,78 @@
+// .LNX - Lynx archive
+// https://ist.uwaterloo.ca/~schepers/formats/LNX.TXT
+//
+// A BASIC loader followed by a PETSCII directory and the files in 254 byte blocks,
+// files are stored uncompressed.
+//
+
+
+#ifndef MEATLOAF_ARCHIVE_LNX
+#define MEATLOAF_ARCHIVE_LNX
+
+#include "archive.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class LNXMStream : public ArchiveMStream {
+    // override everything that requires overriding here
+
+public:
+    LNXMStream(std::shared_ptr<MStream> is) : ArchiveMStream(is) { };
+
+protected:
+    bool readDirectory( ArchiveDirectory &dir ) override;
+
+    // next CR terminated line of the directory
+    std::string readLine();
+
+private:
+    friend class LNXMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class LNXMFile: public ArchiveMFile {
+public:
+
+    LNXMFile(std::string path, bool is_dir = true): ArchiveMFile(path, is_dir) {
+        media_type = " LNX ";
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new LNXMStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class LNXMFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new LNXMFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(".lnx", fileName);
+    }
+
+    LNXMFileSystem(): MFileSystem("lnx") {
+        is_archive = true;
+    };
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_LNX */
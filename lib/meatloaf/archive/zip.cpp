@@ -0,0 +1,112 @@
+#include "zip.h"
+
+#define ZIP_EOCD_SIZE           22
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_LOCAL_HEADER_SIZE   30
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+bool ZIPMStream::readDirectory( ArchiveDirectory &dir )
+{
+    uint32_t archive_size = containerStream->size();
+    if ( archive_size < ZIP_EOCD_SIZE )
+        return false;
+
+    // The end of central directory record is followed by a comment of up to 64K,
+    // search for its signature backwards from the end
+    uint8_t buf[256];
+    uint32_t limit = ( archive_size > ZIP_EOCD_SIZE + 0xFFFF ) ? archive_size - ZIP_EOCD_SIZE - 0xFFFF : 0;
+    uint32_t end = archive_size - ZIP_EOCD_SIZE + 4;
+    uint32_t eocd = 0xFFFFFFFF;
+    while ( eocd == 0xFFFFFFFF && end > limit )
+    {
+        uint32_t start = ( end - limit > sizeof(buf) ) ? end - sizeof(buf) : limit;
+        uint32_t len = end - start;
+        if ( !containerStream->seek(start) || containerStream->read(buf, len) != len )
+            return false;
+
+        for ( int i = (int) len - 4; i >= 0; i-- )
+        {
+            if ( archiveLE32(buf + i) == 0x06054b50 )
+            {
+                eocd = start + i;
+                break;
+            }
+        }
+
+        if ( start == limit )
+            break;
+        end = start + 3;
+    }
+
+    if ( eocd == 0xFFFFFFFF )
+        return false;
+
+    if ( !containerStream->seek(eocd) || containerStream->read(buf, ZIP_EOCD_SIZE) != ZIP_EOCD_SIZE )
+        return false;
+
+    uint16_t count = archiveLE16(buf + 10);
+    uint32_t cd_offset = archiveLE32(buf + 16);
+    if ( count == 0xFFFF || cd_offset == 0xFFFFFFFF )
+    {
+        Debug_printv("ZIP64 archives are not supported");
+        return false;
+    }
+
+    // Central directory
+    uint32_t pos = cd_offset;
+    dir.entries.reserve(count);
+    for ( uint16_t i = 0; i < count; i++ )
+    {
+        if ( !containerStream->seek(pos) || containerStream->read(buf, ZIP_CENTRAL_HEADER_SIZE) != ZIP_CENTRAL_HEADER_SIZE )
+            return false;
+        if ( archiveLE32(buf) != 0x02014b50 )
+            return false;
+
+        uint16_t flags = archiveLE16(buf + 8);
+        uint16_t method = archiveLE16(buf + 10);
+        uint16_t name_len = archiveLE16(buf + 28);
+        uint16_t extra_len = archiveLE16(buf + 30);
+        uint16_t comment_len = archiveLE16(buf + 32);
+
+        ArchiveEntry e;
+        e.compressed_size = archiveLE32(buf + 20);
+        e.size = archiveLE32(buf + 24);
+        e.offset = archiveLE32(buf + 42);
+        e.method = method;
+        e.file_type = ARCHIVE_TYPE_NONE;
+
+        e.name.resize(name_len);
+        if ( containerStream->read((uint8_t *)&e.name[0], name_len) != name_len )
+            return false;
+
+        pos += ZIP_CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len;
+
+        // skip folders, encrypted entries and compression methods we can't read
+        if ( e.name.empty() || e.name.back() == '/' || ( flags & 0x0001 ) )
+            continue;
+        if ( method != ARCHIVE_STORED && method != ARCHIVE_DEFLATED )
+            continue;
+
+        dir.entries.push_back(e);
+    }
+
+    return true;
+}
+
+
+bool ZIPMStream::seekData( ArchiveEntry &e )
+{
+    // the central directory only points to the local header, its name and extra
+    // field lengths may differ from the central directory ones
+    uint8_t buf[ZIP_LOCAL_HEADER_SIZE];
+    if ( !containerStream->seek(e.offset) || containerStream->read(buf, ZIP_LOCAL_HEADER_SIZE) != ZIP_LOCAL_HEADER_SIZE )
+        return false;
+    if ( archiveLE32(buf) != 0x04034b50 )
+        return false;
+
+    e.offset += ZIP_LOCAL_HEADER_SIZE + archiveLE16(buf + 26) + archiveLE16(buf + 28);
+    return true;
+}
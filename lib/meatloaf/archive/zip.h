@@ -0,0 +1,76 @@
+// .ZIP - ZIP archive
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+//
+// Stored and deflated entries, no encryption and no ZIP64. Entries in folders are
+// listed with their full path ("games/disk1.d64").
+//
+
+
+#ifndef MEATLOAF_ARCHIVE_ZIP
+#define MEATLOAF_ARCHIVE_ZIP
+
+#include "archive.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class ZIPMStream : public ArchiveMStream {
+    // override everything that requires overriding here
+
+public:
+    ZIPMStream(std::shared_ptr<MStream> is) : ArchiveMStream(is) { };
+
+protected:
+    bool readDirectory( ArchiveDirectory &dir ) override;
+    bool seekData( ArchiveEntry &e ) override;
+
+private:
+    friend class ZIPMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class ZIPMFile: public ArchiveMFile {
+public:
+
+    ZIPMFile(std::string path, bool is_dir = true): ArchiveMFile(path, is_dir) {
+        media_type = " ZIP ";
+    };
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new ZIPMStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class ZIPMFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new ZIPMFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(".zip", fileName);
+    }
+
+    ZIPMFileSystem(): MFileSystem("zip") {
+        is_archive = true;
+    };
+};
+
+
+#endif /* MEATLOAF_ARCHIVE_ZIP */
@@ -350,8 +350,9 @@ bool FlashMStream::open(std::ios_base::openmode mode) {
         handle->obtain(localPath, "a+");
 
     // The below code will definitely destroy whatever open above does, because it will move the file pointer
-    // so I just wrapped it to be called only for in
-    if(isOpen() && mode == std::ios_base::in) {
+    // so I just wrapped it to be called only for in (and in|out which starts at position 0 anyways,
+    // disk images opened for sector writes need the size to determine their geometry)
+    if(isOpen() && (mode == std::ios_base::in || mode == (std::ios_base::in | std::ios_base::out))) {
         //Debug_printv("IStream: past obtain");
         // Set file size
         fseek(handle->file_h, 0, SEEK_END);
@@ -405,6 +406,13 @@ uint32_t FlashMStream::write(const uint8_t *buf, uint32_t size) {
     int result = fwrite((void*) buf, 1, size, handle->file_h );
 
     Debug_printv("result[%d]", result);
+    if ( result > 0 )
+    {
+        // keep position/size in sync so reads after writes (in|out mode) work
+        _position += result;
+        if ( _position > _size )
+            _size = _position;
+    }
     return result;
 };
 
@@ -1,6 +1,7 @@
-
 #include "d64.h"
 
+#include <cstring>
+
 //#include "meat_broker.h"
 #include "../meat_media.h"
 #include "endianness.h"
@@ -55,7 +56,7 @@ bool D64MStream::seekSector(uint8_t track, uint8_t sector, uint8_t offset)
 
     // Is this a valid sector?
     c = getSectorCount(track);
-    if (sector > c)
+    if (sector >= c)
     {
         Debug_printv("Invalid Sector: sector[%d] sectorsPerTrack[%d]", sector, c);
         return false;
@@ -195,22 +196,37 @@ bool D64MStream::isBlockFree(uint8_t track, uint8_t sector)
     return true;
 }
 
+std::string D64MStream::entryName()
+{
+    std::string name(entry.filename, strnlen(entry.filename, sizeof(entry.filename)));
+    name = name.substr(0, name.find_first_of(0xA0));
+    //mstr::rtrimA0(name);
+    return mstr::toUTF8(name);
+}
+
 bool D64MStream::seekEntry(std::string filename)
 {
     uint16_t index = 1;
     mstr::replaceAll(filename, "\\", "/");
     bool wildcard = (mstr::contains(filename, "*") || mstr::contains(filename, "?"));
 
+    dir_index_pos = -1;
+
     // Read Directory Entries
-    if (filename.size())
+    if (filename.size() && getIndex() != nullptr)
+    {
+        dir_index_pos = dir_index->find(filename, 0b00000111);
+        if (dir_index_pos >= 0 && seekEntry(dir_index->entries[dir_index_pos]))
+            return true;
+
+        dir_index_pos = -1;
+        Debug_printv("File not found!");
+    }
+    else if (filename.size())
     {
         while (seekEntry(index))
         {
-            std::string entryFilename = entry.filename;
-            uint8_t i = entryFilename.find_first_of(0xA0);
-            entryFilename = entryFilename.substr(0, i);
-            //mstr::rtrimA0(entryFilename);
-            entryFilename = mstr::toUTF8(entryFilename);
+            std::string entryFilename = entryName();
 
             //Debug_printv("index[%d] track[%d] sector[%d] filename[%s] entry.filename[%.16s]", index, track, sector, filename.c_str(), entryFilename.c_str());
 
@@ -250,6 +266,31 @@ bool D64MStream::seekEntry(std::string filename)
     return false;
 }
 
+bool D64MStream::seekEntry(const MediaIndex::Entry &e)
+{
+    if (!seekSector(e.track, e.sector, e.offset))
+        return false;
+
+    readContainer((uint8_t *)&entry, sizeof(entry));
+    entry_track = e.track;
+    entry_sector = e.sector;
+    entry_offset = e.offset;
+    entry_index = e.index;
+
+    return true;
+}
+
+bool D64MStream::indexEntry(MediaIndex::Entry &e)
+{
+    e.name = entryName();
+    e.file_type = entry.file_type;
+    e.track = entry_track;
+    e.sector = entry_sector;
+    e.offset = entry_offset;
+
+    return true;
+}
+
 bool D64MStream::seekEntry(uint16_t index)
 {
     // Calculate Sector offset & Entry offset
@@ -304,6 +345,9 @@ bool D64MStream::seekEntry(uint16_t index)
         }
     }
 
+    entry_track = track;
+    entry_sector = sector;
+    entry_offset = entryOffset;
     readContainer((uint8_t *)&entry, sizeof(entry));
 
     // If we are at the first entry in the sector then get next_track/next_sector
@@ -324,6 +368,11 @@ bool D64MStream::seekEntry(uint16_t index)
 
 uint16_t D64MStream::blocksFree()
 {
+    // the BAM only changes when the image is written, which goes through a
+    // separate stream (and the image broker drops this one afterwards)
+    if (blocks_free_valid)
+        return blocks_free;
+
     uint16_t free_count = 0;
 
     for (uint8_t x = 0; x < partitions[partition].block_allocation_map.size(); x++)
@@ -362,6 +411,8 @@ uint16_t D64MStream::blocksFree()
         }
     }
 
+    blocks_free = free_count;
+    blocks_free_valid = true;
     return free_count;
 }
 
@@ -437,10 +488,16 @@ bool D64MStream::seekPath(std::string path)
         auto type = decodeType(entry.file_type).c_str();
         //Debug_printv("filename[%.16s] type[%s] start_track[%d] start_sector[%d]", entry.filename, type, entry.start_track, entry.start_sector);
 
-        // Calculate file size
+        // Calculate file size (walks the sector chain, so remember it in the index)
         uint8_t t = entry.start_track;
         uint8_t s = entry.start_sector;
-        _size = seekFileSize(t, s);
+        _size = (dir_index_pos >= 0) ? dir_index->sizes[dir_index_pos].load() : 0;
+        if (_size == 0)
+        {
+            _size = seekFileSize(t, s);
+            if (dir_index_pos >= 0)
+                dir_index->sizes[dir_index_pos] = _size;
+        }
 
         // Set position to beginning of file
         bool r = seekSector(t, s);
@@ -472,14 +529,18 @@ bool D64MFile::isDirectory()
 
 bool D64MFile::rewindDirectory()
 {
-    dirIsOpen = true;
+    dirIsOpen = false;
     // Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
     auto image = ImageBroker::obtain<D64MStream>(streamFile->url);
     if (image == nullptr)
     {
+        dirImage.reset();
         return false;
     }
 
+    dirImage = image;
+    dirIsOpen = true;
+
     image->resetEntryCounter();
 
     // Read Header
@@ -501,15 +562,11 @@ bool D64MFile::rewindDirectory()
 MFile *D64MFile::getNextFileInDir()
 {
 
-    if (!dirIsOpen)
-        rewindDirectory();
+    if (!dirIsOpen && !rewindDirectory())
+        return nullptr;
 
     // Get entry pointed to by containerStream
-    auto image = ImageBroker::obtain<D64MStream>(streamFile->url);
-    if (image == nullptr)
-    {
-        return nullptr;
-    }
+    auto image = dirImage;
 
     bool r = false;
     do
@@ -533,6 +590,7 @@ MFile *D64MFile::getNextFileInDir()
     {
         // Debug_printv( "END OF DIRECTORY");
         dirIsOpen = false;
+        dirImage.reset();
         return nullptr;
     }
 }
@@ -544,15 +602,21 @@ time_t D64MFile::getLastWrite()
 
 time_t D64MFile::getCreationTime()
 {
-    tm *entry_time = 0;
-    auto entry = ImageBroker::obtain<D64MStream>(streamFile->url)->entry;
-    entry_time->tm_year = entry.year + 1900;
-    entry_time->tm_mon = entry.month;
-    entry_time->tm_mday = entry.day;
-    entry_time->tm_hour = entry.hour;
-    entry_time->tm_min = entry.minute;
-
-    return mktime(entry_time);
+    struct tm entry_time = {};
+    auto image = ImageBroker::obtain<D64MStream>(streamFile->url);
+    if ( image == nullptr )
+        return 0;
+
+    // GEOS style entry time: two digit year (80-99 => 19xx), month 1-12
+    auto entry = image->entry;
+    entry_time.tm_year = entry.year < 80 ? entry.year + 100 : entry.year;
+    entry_time.tm_mon = entry.month > 0 ? entry.month - 1 : 0;
+    entry_time.tm_mday = entry.day;
+    entry_time.tm_hour = entry.hour;
+    entry_time.tm_min = entry.minute;
+    entry_time.tm_isdst = -1;
+
+    return mktime(&entry_time);
 }
 
 bool D64MFile::exists()
@@ -254,16 +254,26 @@ public:
     uint8_t sector = 0;
     uint8_t offset = 0;
     uint64_t blocks_free = 0;
+    bool blocks_free_valid = false;
 
     uint8_t next_track = 0;
     uint8_t next_sector = 0;
     uint8_t sector_offset = 0;
 
+    // location of the current directory entry
+    uint8_t entry_track = 0;
+    uint8_t entry_sector = 0;
+    uint8_t entry_offset = 0;
+
 private:
     void sendListing();
 
+    std::string entryName();
+
     bool seekEntry( std::string filename ) override;
     bool seekEntry( uint16_t index = 0 ) override;
+    bool seekEntry( const MediaIndex::Entry &e );
+    bool indexEntry( MediaIndex::Entry &e ) override;
 
     std::string readBlock( uint8_t track, uint8_t sector );
     bool writeBlock( uint8_t track, uint8_t sector, std::string data );
@@ -283,6 +293,8 @@ private:
     friend class D81MFile;
     friend class D82MFile;
     friend class DNPMFile;    
+    friend class G64MFile;
+    friend class NIBMFile;
 };
 
 
@@ -326,6 +338,7 @@ public:
 
     bool isDir = true;
     bool dirIsOpen = false;
+    std::shared_ptr<D64MStream> dirImage; // holds the entry cursor while dirIsOpen (keeps MBroker from evicting it)
 };
 
 
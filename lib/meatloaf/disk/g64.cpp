@@ -0,0 +1,263 @@
+#include "g64.h"
+
+#include <cstring>
+
+#include "endianness.h"
+
+/********************************************************
+ * GCR decoding
+ ********************************************************/
+
+#define GCR_SYNC_BITS   10
+#define GCR_HEADER_ID   0x08
+#define GCR_DATA_ID     0x07
+#define GCR_HEADER_SIZE 8       // decoded bytes
+#define GCR_DATA_SIZE   260
+
+uint32_t GCRMStream::decodes = 0;
+
+// 5 bit GCR code => nybble, 0xFF for invalid codes
+static const uint8_t gcr_decode[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x08, 0x00, 0x01, 0xFF, 0x0C, 0x04, 0x05,
+    0xFF, 0xFF, 0x02, 0x03, 0xFF, 0x0F, 0x06, 0x07,
+    0xFF, 0x09, 0x0A, 0x0B, 0xFF, 0x0D, 0x0E, 0xFF
+};
+
+
+// bit "pos" of the track, wrapping around at its end
+static inline uint8_t gcrBit(const uint8_t *raw, uint32_t bits, uint32_t pos)
+{
+    pos %= bits;
+    return ( raw[pos >> 3] >> ( 7 - ( pos & 7 ) ) ) & 1;
+}
+
+
+// decodes "size" bytes from the GCR bits starting at "pos", false on invalid codes
+static bool gcrDecode(const uint8_t *raw, uint32_t bits, uint32_t pos, uint8_t *out, uint16_t size)
+{
+    for ( uint16_t i = 0; i < size; i++ )
+    {
+        uint16_t code = 0;
+        for ( uint8_t b = 0; b < 10; b++ )
+            code = ( code << 1 ) | gcrBit(raw, bits, pos++);
+
+        uint8_t hi = gcr_decode[code >> 5];
+        uint8_t lo = gcr_decode[code & 0x1F];
+        if ( hi == 0xFF || lo == 0xFF )
+            return false;
+
+        out[i] = ( hi << 4 ) | lo;
+    }
+
+    return true;
+}
+
+
+GCRMStream::GCRMStream(std::shared_ptr<MStream> is, std::vector<Track> tracks)
+{
+    stream = is;
+    mode = is->mode;
+    this->tracks = tracks;
+    if ( this->tracks.size() > GCR_MAX_TRACKS )
+        this->tracks.resize(GCR_MAX_TRACKS);
+    while ( !this->tracks.empty() && this->tracks.back().offset == 0 )
+        this->tracks.pop_back();
+
+    _size = 0;
+    for ( uint8_t t = 1; t <= this->tracks.size(); t++ )
+        _size += sectorCount(t) * block_size;
+}
+
+
+bool GCRMStream::seek(uint32_t pos)
+{
+    if ( pos > _size )
+        return false;
+
+    _position = pos;
+    return true;
+}
+
+
+uint32_t GCRMStream::read(uint8_t* buf, uint32_t size)
+{
+    uint32_t total = 0;
+    while ( size > 0 && _position < _size )
+    {
+        // D64 layout
+        uint32_t block = _position / block_size;
+        uint32_t offset = _position % block_size;
+        uint8_t track = 1;
+        while ( block >= sectorCount(track) )
+            block -= sectorCount(track++);
+
+        uint32_t n = std::min(size, (uint32_t) block_size - offset);
+        auto t = getTrack(track);
+        if ( t != nullptr )
+            memcpy(buf, t->data + block * block_size + offset, n);
+        else
+            memset(buf, 0, n);
+
+        _position += n;
+        total += n;
+        buf += n;
+        size -= n;
+    }
+
+    return total;
+}
+
+
+GCRMStream::DecodedTrack* GCRMStream::getTrack(uint8_t track)
+{
+    if ( cache == nullptr )
+    {
+        cache.reset(new DecodedTrack[GCR_TRACK_CACHE]);
+        for ( uint8_t i = 0; i < GCR_TRACK_CACHE; i++ )
+            cache[i].track = 0;
+    }
+
+    // decoded already or replace the least recently used track
+    DecodedTrack *t = &cache[0];
+    for ( uint8_t i = 0; i < GCR_TRACK_CACHE; i++ )
+    {
+        if ( cache[i].track == track )
+        {
+            cache[i].lastUsed = ++useCounter;
+            return &cache[i];
+        }
+        if ( cache[i].track == 0 || ( t->track != 0 && cache[i].lastUsed < t->lastUsed ) )
+            t = &cache[i];
+    }
+
+    if ( !decodeTrack(track, t) )
+    {
+        t->track = 0;
+        return nullptr;
+    }
+
+    t->track = track;
+    t->lastUsed = ++useCounter;
+    return t;
+}
+
+
+bool GCRMStream::decodeTrack(uint8_t track, DecodedTrack *t)
+{
+    const Track &info = tracks[track - 1];
+    uint16_t length = info.length;
+    if ( info.offset == 0 || !stream->seek(info.offset) )
+    {
+        Debug_printv("track[%d] not in image", track);
+        return false;
+    }
+
+    if ( info.prefixed )
+    {
+        uint8_t size[2];
+        if ( stream->read(size, 2) != 2 )
+            return false;
+        length = std::min(length, (uint16_t) UINT16_FROM_HILOBYTES(size[1], size[0]));
+    }
+    if ( length == 0 )
+        return false;
+
+    std::unique_ptr<uint8_t[]> raw(new uint8_t[length]);
+    uint32_t len = 0;
+    while ( len < length )
+    {
+        uint32_t r = stream->read(raw.get() + len, length - len);
+        if ( r == 0 ) break;
+        len += r;
+    }
+    if ( len < length )
+        return false;
+
+    decodes++;
+    memset(t->data, 0, sizeof(t->data));
+
+    // Each sector is a header block (sector number) and a data block, both preceded by
+    // a sync of at least 10 one bits. Syncs need not be byte aligned. The scan runs past
+    // the end of the track to find the block the track data starts in.
+    uint8_t count = sectorCount(track);
+    uint32_t found = 0, bad = 0;
+    uint32_t bits = length * 8;
+    uint32_t ones = 0;
+    int sector = -1;
+    uint8_t block[GCR_DATA_SIZE];
+    for ( uint32_t pos = 0; pos < bits + 128 && found != ( 1UL << count ) - 1; pos++ )
+    {
+        if ( gcrBit(raw.get(), bits, pos) )
+        {
+            ones++;
+            continue;
+        }
+
+        bool sync = ( ones >= GCR_SYNC_BITS );
+        ones = 0;
+        if ( !sync || !gcrDecode(raw.get(), bits, pos, block, 1) )
+            continue;
+
+        if ( block[0] == GCR_HEADER_ID && gcrDecode(raw.get(), bits, pos, block, GCR_HEADER_SIZE) )
+        {
+            // id, checksum, sector, track, id2, id1
+            bool valid = ( block[1] == ( block[2] ^ block[3] ^ block[4] ^ block[5] ) );
+            sector = ( valid && block[3] == track && block[2] < count ) ? block[2] : -1;
+        }
+        else if ( block[0] == GCR_DATA_ID && sector >= 0 && !( found & ( 1UL << sector ) ) )
+        {
+            if ( gcrDecode(raw.get(), bits, pos, block, GCR_DATA_SIZE) )
+            {
+                uint8_t checksum = 0;
+                for ( uint16_t i = 1; i <= 256; i++ )
+                    checksum ^= block[i];
+                if ( checksum != block[257] )
+                    bad++;
+
+                memcpy(t->data + sector * 256, block + 1, 256);
+                found |= ( 1UL << sector );
+            }
+            sector = -1;
+        }
+    }
+
+    if ( found != ( 1UL << count ) - 1 || bad )
+        Debug_printv("track[%d] sectors[%d] found[%08lX] checksum errors[%lu]", track, count, found, bad);
+
+    return true;
+}
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+std::vector<GCRMStream::Track> G64MStream::readTracks()
+{
+    // "GCR-1541", version, half track count, max track size, track offsets (half tracks)
+    std::vector<GCRMStream::Track> tracks;
+    uint8_t header[12];
+    if ( !containerStream->seek(0) || containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "GCR-1541", 8) != 0 )
+    {
+        Debug_printv("Invalid G64 header");
+        return tracks;
+    }
+
+    uint8_t half_tracks = std::min(header[9], (uint8_t) (GCR_MAX_TRACKS * 2));
+    std::vector<uint8_t> offsets(half_tracks * 4);
+    if ( containerStream->read(offsets.data(), offsets.size()) != offsets.size() )
+        return tracks;
+
+    // full tracks only, their lengths are read when they are decoded
+    uint16_t max_length = UINT16_FROM_HILOBYTES(header[11], header[10]);
+    for ( uint8_t i = 0; i < half_tracks; i += 2 )
+    {
+        const uint8_t *o = &offsets[i * 4];
+        uint32_t offset = o[0] | o[1] << 8 | o[2] << 16 | (uint32_t) o[3] << 24;
+        tracks.push_back({ offset, max_length, true });
+    }
+
+    Debug_printv("tracks[%d]", tracks.size());
+    return tracks;
+}
@@ -0,0 +1,145 @@
+// .G64, .G41 - 1541 GCR disk image format
+//
+// https://vice-emu.sourceforge.io/vice_16.html#SEC401
+// https://ist.uwaterloo.ca/~schepers/formats/G64.TXT
+//
+// Tracks are stored as the GCR bit stream read from the disk. GCRMStream decodes them
+// into the sector layout of a D64 so D64MStream reads directory and files as usual.
+// Tracks are only decoded when one of their sectors is read. The image is read-only.
+//
+
+
+#ifndef MEATLOAF_MEDIA_G64
+#define MEATLOAF_MEDIA_G64
+
+#include "../meatloaf.h"
+#include "d64.h"
+
+
+/********************************************************
+ * GCR decoding
+ ********************************************************/
+
+// Decoded tracks kept per stream (21 sectors, 5376 bytes each). Listing the directory
+// only touches track 18, loading a file moves on one track at a time.
+#define GCR_TRACK_CACHE 2
+#define GCR_MAX_TRACKS  42
+
+class GCRMStream: public MStream {
+
+public:
+    struct Track {
+        uint32_t offset;    // GCR data of the track in the image, 0 if not present
+        uint16_t length;    // maximum length if prefixed
+        bool prefixed;      // data starts with its 16 bit length (G64)
+    };
+
+    GCRMStream(std::shared_ptr<MStream> is, std::vector<Track> tracks);
+
+    bool isOpen() override { return stream->isOpen(); }
+    bool isRandomAccess() override { return true; }
+    bool isShared() override { return stream->isShared(); }
+    // the track cache is charged even before its first use, it is allocated by the first read
+    uint32_t bytes() override {
+        return sizeof(GCRMStream) + GCR_TRACK_CACHE * sizeof(DecodedTrack) + tracks.capacity() * sizeof(Track) + stream->bytes();
+    }
+    bool open(std::ios_base::openmode mode) override { return stream->open(mode); }
+    void close() override { stream->close(); }
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override { return 0; };
+    bool seek(uint32_t pos) override;
+
+    static uint8_t sectorCount(uint8_t track) {
+        return 17 + (track < 18) * 2 + (track < 25) + (track < 31);
+    }
+
+    static uint32_t getDecodes() { return decodes; }
+
+private:
+    struct DecodedTrack {
+        uint8_t track;      // 0 => unused
+        uint32_t lastUsed;
+        uint8_t data[21 * 256];
+    };
+
+    DecodedTrack* getTrack(uint8_t track);
+    bool decodeTrack(uint8_t track, DecodedTrack *t);
+
+    std::shared_ptr<MStream> stream;
+    std::vector<Track> tracks;  // index is track - 1
+    std::unique_ptr<DecodedTrack[]> cache;
+    uint32_t useCounter = 0;
+
+    static uint32_t decodes;
+};
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class G64MStream : public D64MStream {
+    // override everything that requires overriding here
+
+public:
+    G64MStream(std::shared_ptr<MStream> is) : D64MStream(is)
+    {
+        auto gcr = std::make_shared<GCRMStream>(containerStream, readTracks());
+        gcr->url = containerStream->url;
+        containerStream = gcr;
+    };
+
+protected:
+    // track table from the image header
+    std::vector<GCRMStream::Track> readTracks();
+
+private:
+    friend class G64MFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class G64MFile: public D64MFile {
+public:
+    G64MFile(std::string path, bool is_dir = true) : D64MFile(path, is_dir) {};
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new G64MStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class G64MFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new G64MFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(
+            {
+                ".g64",
+                ".g41"
+            },
+            fileName
+        );
+    }
+
+    G64MFileSystem(): MFileSystem("g64") {};
+};
+
+
+#endif /* MEATLOAF_MEDIA_G64 */
@@ -0,0 +1,38 @@
+#include "nib.h"
+
+#include <cstring>
+
+#define NIB_HEADER_SIZE 0x100
+#define NIB_TRACK_SIZE  0x2000
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+std::vector<GCRMStream::Track> NIBMStream::readTracks()
+{
+    // "MNIB-1541-RAW", version, then (half track, density) pairs until 0
+    std::vector<GCRMStream::Track> tracks;
+    uint8_t header[NIB_HEADER_SIZE];
+    if ( !containerStream->seek(0) || containerStream->read(header, sizeof(header)) != sizeof(header) || memcmp(header, "MNIB-1541-RAW", 13) != 0 )
+    {
+        Debug_printv("Invalid NIB header");
+        return tracks;
+    }
+
+    // half tracks are numbered from 2 (track 1), only full tracks are used
+    for ( uint16_t i = 0; 0x10 + i * 2 < NIB_HEADER_SIZE && header[0x10 + i * 2] != 0; i++ )
+    {
+        uint8_t half_track = header[0x10 + i * 2];
+        uint8_t track = half_track / 2;
+        if ( ( half_track & 1 ) || track == 0 || track > GCR_MAX_TRACKS )
+            continue;
+
+        if ( tracks.size() < track )
+            tracks.resize(track, { 0, 0, false });
+        tracks[track - 1] = { NIB_HEADER_SIZE + (uint32_t) i * NIB_TRACK_SIZE, NIB_TRACK_SIZE, false };
+    }
+
+    Debug_printv("tracks[%d]", tracks.size());
+    return tracks;
+}
@@ -0,0 +1,78 @@
+// .NIB - MNIB/nibtools raw 1541 disk image format
+//
+// https://c64preservation.com/dp.php?pg=nibtools
+//
+// A 256 byte header listing the half tracks in the image followed by 8K of raw GCR
+// data per track, decoded like G64 tracks (see GCRMStream). The image is read-only.
+//
+
+
+#ifndef MEATLOAF_MEDIA_NIB
+#define MEATLOAF_MEDIA_NIB
+
+#include "../meatloaf.h"
+#include "g64.h"
+
+
+/********************************************************
+ * Streams
+ ********************************************************/
+
+class NIBMStream : public D64MStream {
+    // override everything that requires overriding here
+
+public:
+    NIBMStream(std::shared_ptr<MStream> is) : D64MStream(is)
+    {
+        auto gcr = std::make_shared<GCRMStream>(containerStream, readTracks());
+        gcr->url = containerStream->url;
+        containerStream = gcr;
+    };
+
+protected:
+    // track table from the image header
+    std::vector<GCRMStream::Track> readTracks();
+
+private:
+    friend class NIBMFile;
+};
+
+
+/********************************************************
+ * File implementations
+ ********************************************************/
+
+class NIBMFile: public D64MFile {
+public:
+    NIBMFile(std::string path, bool is_dir = true) : D64MFile(path, is_dir) {};
+
+    MStream* getDecodedStream(std::shared_ptr<MStream> containerIstream) override
+    {
+        Debug_printv("[%s]", url.c_str());
+
+        return new NIBMStream(containerIstream);
+    }
+};
+
+
+
+/********************************************************
+ * FS
+ ********************************************************/
+
+class NIBMFileSystem: public MFileSystem
+{
+public:
+    MFile* getFile(std::string path) override {
+        return new NIBMFile(path);
+    }
+
+    bool handles(std::string fileName) override {
+        return byExtension(".nib", fileName);
+    }
+
+    NIBMFileSystem(): MFileSystem("nib") {};
+};
+
+
+#endif /* MEATLOAF_MEDIA_NIB */
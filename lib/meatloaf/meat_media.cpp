@@ -1,6 +1,381 @@
 #include "meat_media.h"
 
-std::unordered_map<std::string, MMediaStream*> ImageBroker::image_repo;
+#include <algorithm>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+
+/********************************************************
+ * Block cache
+ ********************************************************/
+
+#define MEDIA_CACHE_NONE 0xFFFF
+
+std::mutex MediaCache::lock;
+uint32_t MediaCache::size = 0xFFFFFFFF;  // not initialized
+uint32_t MediaCache::count = 0;
+uint32_t MediaCache::useCounter = 0;
+uint32_t MediaCache::hits = 0;
+uint32_t MediaCache::misses = 0;
+MediaCache::Entry *MediaCache::entries = nullptr;
+uint16_t *MediaCache::heads = nullptr;
+uint8_t  *MediaCache::data = nullptr;
+std::unordered_map<std::string, std::pair<uint8_t, uint32_t>> MediaCache::urls;
+
+
+static void *cacheAlloc(size_t n)
+{
+#ifdef ESP_PLATFORM
+    void *p = heap_caps_malloc(n, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if ( p != nullptr )
+        return p;
+#endif
+    return malloc(n);
+}
+
+
+bool MediaCache::init()
+{
+    // called with lock held
+    if ( size == 0xFFFFFFFF )
+    {
+#ifdef ESP_PLATFORM
+        size = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0 ? MEDIA_CACHE_SIZE_PSRAM : MEDIA_CACHE_SIZE;
+#else
+        size = MEDIA_CACHE_SIZE;
+#endif
+    }
+
+    if ( entries == nullptr && size >= MEDIA_CACHE_BLOCK_SIZE )
+    {
+        count   = std::min(size / MEDIA_CACHE_BLOCK_SIZE, (uint32_t) MEDIA_CACHE_NONE);
+        entries = (Entry *) cacheAlloc(count * sizeof(Entry));
+        heads   = (uint16_t *) cacheAlloc(count * sizeof(uint16_t));
+        data    = (uint8_t *) cacheAlloc(count * MEDIA_CACHE_BLOCK_SIZE);
+        if ( entries == nullptr || heads == nullptr || data == nullptr )
+        {
+            Debug_printv("Error: could not allocate %u bytes for media cache", size);
+            free(entries); free(heads); free(data);
+            entries = nullptr; heads = nullptr; data = nullptr;
+            size = 0;
+        }
+        else
+        {
+            Debug_printv("Media cache: %u blocks", count);
+            clear();
+        }
+    }
+
+    return entries != nullptr;
+}
+
+
+void MediaCache::clear()
+{
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        entries[i].len = 0;
+        entries[i].lastUsed = 0;
+        heads[i] = MEDIA_CACHE_NONE;
+    }
+    urls.clear();
+}
+
+
+void MediaCache::setSize(uint32_t bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    free(entries); free(heads); free(data);
+    entries = nullptr; heads = nullptr; data = nullptr;
+    urls.clear();
+    size = bytes;
+}
+
+
+int MediaCache::urlId(const std::string &url, bool create)
+{
+    auto it = urls.find(url);
+    if ( it != urls.end() )
+        return it->second.first;
+    else if ( !create )
+        return -1;
+
+    // url ids are 8 bits, start over once they are used up
+    if ( urls.size() >= 256 )
+        clear();
+
+    uint8_t id = 0;
+    bool used;
+    do
+    {
+        used = false;
+        for ( auto &u : urls )
+            if ( u.second.first == id ) { used = true; id++; break; }
+    } while ( used );
+
+    urls[url] = std::make_pair(id, 0);
+    return id;
+}
+
+
+int MediaCache::find(uint32_t key)
+{
+    for ( uint16_t i = heads[key % count]; i != MEDIA_CACHE_NONE; i = entries[i].next )
+        if ( entries[i].key == key )
+            return i;
+
+    return -1;
+}
+
+
+void MediaCache::unlink(uint16_t i)
+{
+    uint16_t *p = &heads[entries[i].key % count];
+    while ( *p != i )
+        p = &entries[*p].next;
+    *p = entries[i].next;
+    entries[i].len = 0;
+    entries[i].lastUsed = 0;
+}
+
+
+void MediaCache::invalidate(const std::string &url)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        int id = entries != nullptr ? urlId(url, false) : -1;
+        if ( id >= 0 )
+        {
+            for ( uint32_t i = 0; i < count; i++ )
+                if ( entries[i].len > 0 && (entries[i].key >> 24) == (uint32_t) id )
+                    unlink(i);
+            urls.erase(url);
+        }
+    }
+
+    MediaIndex::invalidate(url);
+}
+
+
+std::shared_ptr<MStream> MediaCache::wrap(std::shared_ptr<MStream> is)
+{
+    if ( is == nullptr || is->url.empty() || is->size() == 0 )
+        return is;
+
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if ( !init() )
+            return is;
+
+        // blocks cached for an image whose size has changed are stale
+        auto it = urls.find(is->url);
+        if ( it != urls.end() && it->second.second != is->size() )
+        {
+            Debug_printv("Image size changed, dropping cached blocks [%s]", is->url.c_str());
+            for ( uint32_t i = 0; i < count; i++ )
+                if ( entries[i].len > 0 && (entries[i].key >> 24) == it->second.first )
+                    unlink(i);
+            urls.erase(it);
+            changed = true;
+        }
+
+        int id = urlId(is->url, true);
+        urls[is->url] = std::make_pair((uint8_t) id, is->size());
+    }
+
+    if ( changed )
+        MediaIndex::invalidate(is->url);
+
+    return std::make_shared<MediaCacheStream>(is);
+}
+
+
+uint32_t MediaCache::read(const std::string &url, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int id = entries != nullptr ? urlId(url, false) : -1;
+    int i  = id >= 0 ? find(((uint32_t) id << 24) | (block & 0xFFFFFF)) : -1;
+    if ( i < 0 || offset >= entries[i].len )
+    {
+        misses++;
+        return 0;
+    }
+
+    size = std::min(size, (uint32_t) entries[i].len - offset);
+    memcpy(buf, data + i * MEDIA_CACHE_BLOCK_SIZE + offset, size);
+    entries[i].lastUsed = ++useCounter;
+    hits++;
+    return size;
+}
+
+
+void MediaCache::put(const std::string &url, uint32_t block, const uint8_t *buf, uint32_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if ( entries == nullptr || size == 0 || block > 0xFFFFFF )
+        return;
+
+    uint32_t key = ((uint32_t) urlId(url, true) << 24) | block;
+    int i = find(key);
+    if ( i < 0 )
+    {
+        // take an unused entry or evict the least recently used one
+        i = 0;
+        for ( uint32_t j = 1; j < count && entries[i].len > 0; j++ )
+            if ( entries[j].len == 0 || entries[j].lastUsed < entries[i].lastUsed )
+                i = j;
+
+        if ( entries[i].len > 0 )
+            unlink(i);
+
+        entries[i].key  = key;
+        entries[i].next = heads[key % count];
+        heads[key % count] = i;
+    }
+
+    size = std::min(size, (uint32_t) MEDIA_CACHE_BLOCK_SIZE);
+    memcpy(data + i * MEDIA_CACHE_BLOCK_SIZE, buf, size);
+    entries[i].len = size;
+    entries[i].lastUsed = ++useCounter;
+}
+
+
+void MediaCache::update(const std::string &url, uint32_t position, const uint8_t *buf, uint32_t size)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int id = entries != nullptr ? urlId(url, false) : -1;
+    if ( id < 0 )
+        return;
+
+    while ( size > 0 )
+    {
+        uint32_t block  = position / MEDIA_CACHE_BLOCK_SIZE;
+        uint32_t offset = position % MEDIA_CACHE_BLOCK_SIZE;
+        uint32_t n = std::min(size, MEDIA_CACHE_BLOCK_SIZE - offset);
+
+        int i = find(((uint32_t) id << 24) | (block & 0xFFFFFF));
+        if ( i >= 0 )
+        {
+            if ( offset <= entries[i].len )
+            {
+                memcpy(data + i * MEDIA_CACHE_BLOCK_SIZE + offset, buf, n);
+                entries[i].len = std::max((uint32_t) entries[i].len, offset + n);
+            }
+            else
+                unlink(i);
+        }
+
+        position += n;
+        buf += n;
+        size -= n;
+    }
+
+    // the image size may have grown
+    auto it = urls.find(url);
+    if ( it != urls.end() && position > it->second.second )
+        it->second.second = position;
+}
+
+
+MediaCacheStream::MediaCacheStream(std::shared_ptr<MStream> is)
+{
+    stream = is;
+    url = is->url;
+    mode = is->mode;
+    has_subdirs = is->has_subdirs;
+    block_size = is->block_size;
+    streamPosition = is->position();
+    _position = streamPosition;
+    buffer = new uint8_t[MEDIA_CACHE_BLOCK_SIZE];
+}
+
+
+MediaCacheStream::~MediaCacheStream()
+{
+    delete [] buffer;
+}
+
+
+bool MediaCacheStream::seekStream(uint32_t pos)
+{
+    if ( pos == streamPosition )
+        return true;
+
+    if ( !stream->seek(pos) )
+        return false;
+
+    streamPosition = pos;
+    return true;
+}
+
+
+bool MediaCacheStream::seek(uint32_t pos)
+{
+    // the container stream is only positioned when data is not found in the cache
+    if ( pos > size() )
+        return false;
+
+    _position = pos;
+    return true;
+}
+
+
+uint32_t MediaCacheStream::read(uint8_t* buf, uint32_t size)
+{
+    uint32_t total = 0;
+    while ( size > 0 && _position < this->size() )
+    {
+        uint32_t block  = _position / MEDIA_CACHE_BLOCK_SIZE;
+        uint32_t offset = _position % MEDIA_CACHE_BLOCK_SIZE;
+        uint32_t n = MediaCache::read(url, block, offset, buf, size);
+
+        if ( n == 0 )
+        {
+            // not cached => read the whole block from the container
+            uint32_t len = 0;
+            if ( seekStream(block * MEDIA_CACHE_BLOCK_SIZE) )
+            {
+                while ( len < MEDIA_CACHE_BLOCK_SIZE )
+                {
+                    uint32_t r = stream->read(buffer + len, MEDIA_CACHE_BLOCK_SIZE - len);
+                    if ( r == 0 ) break;
+                    len += r;
+                }
+                streamPosition += len;
+            }
+
+            if ( len <= offset )
+                break;
+
+            MediaCache::put(url, block, buffer, len);
+            n = std::min(size, len - offset);
+            memcpy(buf, buffer + offset, n);
+        }
+
+        _position += n;
+        total += n;
+        buf += n;
+        size -= n;
+    }
+
+    return total;
+}
+
+
+uint32_t MediaCacheStream::write(const uint8_t *buf, uint32_t size)
+{
+    if ( !seekStream(_position) )
+        return 0;
+
+    uint32_t n = stream->write(buf, size);
+    streamPosition += n;
+    MediaCache::update(url, _position, buf, n);
+    _position += n;
+    return n;
+}
 
 // Utility Functions
 
@@ -49,6 +424,131 @@ std::string MMediaStream::decodeType(std::string file_type)
     return type;
 }
 
+/********************************************************
+ * Directory index
+ ********************************************************/
+
+void MediaIndex::add(const Entry &e)
+{
+    // the first of several entries with the same name wins, as with a directory scan
+    names.emplace(e.name, (uint16_t) entries.size());
+    entries.push_back(e);
+}
+
+
+void MediaIndex::finish()
+{
+    sorted.resize(entries.size());
+    for ( uint16_t i = 0; i < entries.size(); i++ )
+        sorted[i] = i;
+
+    std::stable_sort(sorted.begin(), sorted.end(), [this](uint16_t a, uint16_t b) {
+        return entries[a].name < entries[b].name;
+    });
+
+    sizes.reset(new std::atomic<uint32_t>[entries.size()]);
+    for ( size_t i = 0; i < entries.size(); i++ )
+        sizes[i] = 0;
+}
+
+
+int MediaIndex::find(const std::string &pattern, uint8_t first_mask)
+{
+    auto exact = names.find(pattern);
+    int found = ( exact != names.end() ) ? exact->second : -1;
+
+    size_t wildcard = pattern.find_first_of("*?");
+    if ( wildcard == std::string::npos )
+        return found;
+
+    if ( pattern == "*" )
+    {
+        // first loadable entry
+        for ( int i = 0; i < (int) entries.size() && ( found < 0 || i < found ); i++ )
+        {
+            if ( first_mask == 0 || ( entries[i].file_type & first_mask ) )
+                return i;
+        }
+        return found;
+    }
+
+    // mstr::compare() matches characters before the first wildcard literally, so
+    // only names starting with that prefix can match
+    std::string prefix = pattern.substr(0, wildcard);
+    std::string p = pattern;
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), prefix, [this](uint16_t a, const std::string &b) {
+        return entries[a].name < b;
+    });
+
+    for ( ; it != sorted.end() && mstr::startsWith(entries[*it].name, prefix.c_str()); ++it )
+    {
+        if ( ( found < 0 || *it < found ) && mstr::compare(p, entries[*it].name) )
+            found = *it;
+    }
+
+    return found;
+}
+
+
+std::shared_ptr<MediaIndex> MediaIndex::get(const std::string &url)
+{
+    return std::static_pointer_cast<MediaIndex>(MBroker::get("index:" + url));
+}
+
+
+void MediaIndex::put(const std::string &url, std::shared_ptr<MediaIndex> index)
+{
+    MBroker::put("index:" + url, index, index->bytes());
+}
+
+
+uint32_t MediaIndex::bytes() const
+{
+    // entry, sorted position, size and name lookup for each entry plus the names themselves
+    uint32_t n = entries.size() * (sizeof(Entry) + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(std::string) + sizeof(uint16_t));
+    for ( const auto &e : entries )
+        n += 2 * e.name.size();
+    return n;
+}
+
+
+void MediaIndex::invalidate(const std::string &url)
+{
+    MBroker::remove("index:" + url);
+}
+
+
+std::shared_ptr<MediaIndex> MMediaStream::getIndex()
+{
+    if ( dir_index != nullptr || containerStream->url.empty() )
+        return dir_index;
+
+    dir_index = MediaIndex::get(containerStream->url);
+    if ( dir_index != nullptr )
+        return dir_index;
+
+    // scan the directory once
+    auto index = std::make_shared<MediaIndex>();
+    MediaIndex::Entry e;
+    for ( uint16_t i = 1; i < 0xFFFF && seekEntry(i); i++ )
+    {
+        if ( !indexEntry(e) )
+            return nullptr;
+
+        e.index = i;
+        index->add(e);
+    }
+    index->finish();
+    entry_index = 0;
+
+    Debug_printv("entries[%d] url[%s]", index->entries.size(), containerStream->url.c_str());
+
+    MediaIndex::put(containerStream->url, index);
+    dir_index = index;
+    return dir_index;
+}
+
+
 /********************************************************
  * Istream impls
  ********************************************************/
@@ -86,6 +586,26 @@ uint32_t MMediaStream::readContainer(uint8_t *buf, uint32_t size)
     return containerStream->read(buf, size);
 }
 
+bool MMediaStream::readSector(uint8_t track, uint8_t sector, uint8_t *buf)
+{
+    if ( !seekSector(track, sector) )
+        return false;
+
+    return readContainer(buf, block_size) == block_size;
+}
+
+bool MMediaStream::writeSector(uint8_t track, uint8_t sector, const uint8_t *buf)
+{
+    if ( !seekSector(track, sector) )
+        return false;
+
+    // the directory may have changed
+    dir_index.reset();
+    MediaIndex::invalidate(containerStream->url);
+
+    return containerStream->write(buf, block_size) == block_size;
+}
+
 
 uint8_t MMediaStream::read() 
 {
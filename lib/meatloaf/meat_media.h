@@ -6,6 +6,8 @@
 
 #include <map>
 #include <bitset>
+#include <mutex>
+#include <atomic>
 #include <unordered_map>
 #include <sstream>
 
@@ -14,6 +16,137 @@
 #include "string_utils.h"
 
 
+/********************************************************
+ * Block cache
+ ********************************************************/
+
+// Container streams of disk and tape images are read through a block cache shared by
+// all MMediaStreams (and therefore all devices) opening the same image. Blocks are keyed
+// by (container URL, block number) so directory scans and multi-file loads from remote
+// images fetch each block only once. The cache uses MEDIA_CACHE_SIZE bytes of RAM, or
+// MEDIA_CACHE_SIZE_PSRAM bytes of PSRAM if available (see MediaCache::setSize()), and
+// evicts the least recently used block. Writes go to the container and update cached
+// blocks. Cached blocks of an image are dropped when its size changes.
+#define MEDIA_CACHE_BLOCK_SIZE 256
+#define MEDIA_CACHE_SIZE       (16 * 1024)
+#define MEDIA_CACHE_SIZE_PSRAM (256 * 1024)
+
+class MediaCache {
+public:
+    // returns a stream that reads "is" through the cache ("is" itself if the cache is disabled)
+    static std::shared_ptr<MStream> wrap(std::shared_ptr<MStream> is);
+
+    // changes the cache size (0 disables caching), drops all cached blocks
+    static void setSize(uint32_t bytes);
+
+    // drops all cached blocks of "url"
+    static void invalidate(const std::string &url);
+
+    // copies up to "size" bytes at "offset" within "block" of "url", returns 0 if not cached
+    static uint32_t read(const std::string &url, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t size);
+    static void     put(const std::string &url, uint32_t block, const uint8_t *buf, uint32_t size);
+    // updates cached blocks overlapping data written at "position"
+    static void     update(const std::string &url, uint32_t position, const uint8_t *buf, uint32_t size);
+
+    static uint32_t getHits()   { return hits; }
+    static uint32_t getMisses() { return misses; }
+
+private:
+    struct Entry {
+        uint32_t key;       // url id (8 bits) | block number (24 bits)
+        uint32_t lastUsed;
+        uint16_t len;       // 0 => unused
+        uint16_t next;      // next entry in hash chain
+    };
+
+    static bool init();
+    static void clear();
+    static int  find(uint32_t key);
+    static void unlink(uint16_t i);
+    static int  urlId(const std::string &url, bool create);
+
+    static std::mutex lock;
+    static uint32_t   size, count, useCounter, hits, misses;
+    static Entry     *entries;
+    static uint16_t  *heads;
+    static uint8_t   *data;
+    static std::unordered_map<std::string, std::pair<uint8_t, uint32_t>> urls; // id, container size
+};
+
+
+class MediaCacheStream: public MStream {
+
+public:
+    MediaCacheStream(std::shared_ptr<MStream> is);
+    ~MediaCacheStream() override;
+
+    bool isOpen() override { return stream->isOpen(); }
+    bool isRandomAccess() override { return stream->isRandomAccess(); }
+    bool isBrowsable() override { return stream->isBrowsable(); }
+    bool isShared() override { return stream->isShared(); }
+    bool open(std::ios_base::openmode mode) override { return stream->open(mode); }
+    void close() override { stream->close(); }
+
+    uint32_t size() override { return stream->size(); }
+    uint32_t bytes() override { return sizeof(MediaCacheStream) + MEDIA_CACHE_BLOCK_SIZE + stream->bytes(); }
+    uint32_t available() override { return _position < size() ? size() - _position : 0; }
+    size_t   error() override { return stream->error(); }
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t write(const uint8_t *buf, uint32_t size) override;
+    bool seek(uint32_t pos) override;
+
+private:
+    bool seekStream(uint32_t pos);
+
+    std::shared_ptr<MStream> stream;
+    uint32_t streamPosition;
+    uint8_t *buffer;
+};
+
+
+/********************************************************
+ * Directory index
+ ********************************************************/
+
+// Directory of a disk or tape image, built by the first open by name and shared by all
+// streams of the image through MBroker ("index:" + container URL), so it is evicted with
+// the other broker objects. Exact names are a hash lookup, wildcard patterns only compare
+// the names sharing their literal prefix. Writes to the image drop its index.
+class MediaIndex {
+public:
+    struct Entry {
+        std::string name;       // UTF-8, as matched by seekEntry()
+        uint16_t index;         // directory entry number (1 based)
+        uint8_t file_type;
+        uint8_t track;          // directory sector and offset of the entry (disks)
+        uint8_t sector;
+        uint8_t offset;
+    };
+
+    std::vector<Entry> entries;                 // directory order
+    std::unique_ptr<std::atomic<uint32_t>[]> sizes; // file sizes, 0 until first computed
+
+    void add(const Entry &e);
+    void finish();
+
+    // returns the position in entries of the first entry matching "pattern" in
+    // directory order or -1, "*" matches the first entry with (file_type & first_mask)
+    int find(const std::string &pattern, uint8_t first_mask = 0);
+
+    // approximate memory held by the index (its MBroker cost)
+    uint32_t bytes() const;
+
+    static std::shared_ptr<MediaIndex> get(const std::string &url);
+    static void put(const std::string &url, std::shared_ptr<MediaIndex> index);
+    static void invalidate(const std::string &url);
+
+private:
+    std::vector<uint16_t> sorted;               // positions in entries, sorted by name
+    std::unordered_map<std::string, uint16_t> names; // first entry with each name
+};
+
+
 /********************************************************
  * Streams
  ********************************************************/
@@ -22,7 +155,7 @@ class MMediaStream: public MStream {
 
 public:
     MMediaStream(std::shared_ptr<MStream> is) {
-        containerStream = is;
+        containerStream = MediaCache::wrap(is);
         _is_open = true;
         has_subdirs = false;
     }
@@ -48,6 +181,12 @@ public:
     bool isBrowsable() override { return false; };
     // Random access streams might call seekPath to jump to a specific file
     bool isRandomAccess() override { return true; };
+    // Each stream of an image reads through its own container stream
+    bool isShared() override { return containerStream->isShared(); };
+    // The directory index is an MBroker entry of its own and not counted here
+    uint32_t bytes() override {
+        return sizeof(MMediaStream) + url.capacity() + MStream::url.capacity() + containerStream->bytes();
+    }
 
     bool open(std::ios_base::openmode mode) override;
     void close() override;
@@ -74,6 +213,9 @@ public:
 
     virtual uint32_t seekFileSize( uint8_t start_track, uint8_t start_sector );
 
+    bool readSector( uint8_t track, uint8_t sector, uint8_t* buf ) override;
+    bool writeSector( uint8_t track, uint8_t sector, const uint8_t* buf ) override;
+
 
 protected:
 
@@ -113,6 +255,14 @@ protected:
     virtual bool seekEntry( std::string filename ) { return false; };
     virtual bool seekEntry( uint16_t index ) { return false; };
 
+    // Directory index of the image, nullptr if the stream has no container URL or the
+    // format does not implement indexEntry()
+    std::shared_ptr<MediaIndex> dir_index;
+    int dir_index_pos = -1;     // position of the current entry in dir_index, -1 if unknown
+    std::shared_ptr<MediaIndex> getIndex();
+    // describes the current entry after seekEntry(index)
+    virtual bool indexEntry( MediaIndex::Entry &e ) { return false; };
+
     virtual uint32_t readContainer(uint8_t *buf, uint32_t size);
     virtual uint32_t readFile(uint8_t* buf, uint32_t size) = 0;
     virtual std::string decodeType(uint8_t file_type, bool show_hidden = false);
@@ -134,6 +284,8 @@ private:
     friend class D80MFile;
     friend class D81MFile;
     friend class D82MFile;
+    friend class G64MFile;
+    friend class NIBMFile;
 
     // HARD DRIVE
     friend class DNPMFile;
@@ -153,57 +305,45 @@ private:
  * Utility implementations
  ********************************************************/
 class ImageBroker {
-    static std::unordered_map<std::string, MMediaStream*> image_repo;
 public:
-    template<class T> static T* obtain(std::string url) 
+    template<class T> static std::shared_ptr<T> obtain(std::string url) 
     {
-        //Debug_printv("streams[%d] url[%s]", image_repo.size(), url.c_str());
-
         // obviously you have to supply STREAMFILE.url to this function!
-        if(image_repo.find(url)!=image_repo.end()) {
-            return (T*)image_repo.at(url);
-        }
+        auto cached = MBroker::get("image:" + url);
+        if ( cached != nullptr )
+            return std::static_pointer_cast<T>(std::static_pointer_cast<MStream>(cached));
 
         // create and add stream to broker if not found
-        auto newFile = MFSOwner::File(url);
+        std::unique_ptr<MFile> newFile(MFSOwner::File(url));
+        if ( newFile == nullptr )
+            return nullptr;
 
-        T* newStream = (T*)newFile->getSourceStream();
+        std::shared_ptr<MStream> newStream(newFile->getSourceStream());
+        if ( newStream == nullptr )
+            return nullptr;
 
-        if ( newStream != nullptr )
+        // Are we at the root of the pathInStream?
+        if ( newFile->pathInStream == "")
         {
-            // Are we at the root of the pathInStream?
-            if ( newFile->pathInStream == "")
-            {
-                Debug_printv("DIRECTORY [%s]", url.c_str());
-            }
-            else
-            {
-                Debug_printv("SINGLE FILE [%s]", url.c_str());
-            }
-
-            image_repo.insert(std::make_pair(url, newStream));
-            return newStream;
+            Debug_printv("DIRECTORY [%s]", url.c_str());
+        }
+        else
+        {
+            Debug_printv("SINGLE FILE [%s]", url.c_str());
         }
 
-        delete newFile;
-        return nullptr;
+        newFile.reset();
+        MBroker::put("image:" + url, newStream, newStream->bytes());
+        return std::static_pointer_cast<T>(newStream);
     }
 
-    static MMediaStream* obtain(std::string url) {
+    static std::shared_ptr<MMediaStream> obtain(std::string url) {
         return obtain<MMediaStream>(url);
     }
 
     static void dispose(std::string url) {
-        if(image_repo.find(url)!=image_repo.end()) {
-            auto toDelete = image_repo.at(url);
-            image_repo.erase(url);
-            delete toDelete;
-        }
-        Debug_printv("streams[%d]", image_repo.size());
-    }
-
-    static void validate() {
-        
+        MBroker::remove("image:" + url);
+        MediaIndex::invalidate(url);
     }
 };
 
@@ -0,0 +1,95 @@
+#include "meatloaf.h"
+
+#include <algorithm>
+
+#include "string_utils.h"
+
+/********************************************************
+ * MFSOwner path resolution
+ ********************************************************/
+
+std::mutex MFSOwner::resolveLock;
+std::unordered_map<std::string, MFSOwner::ResolveEntry> MFSOwner::resolveCache;
+std::list<std::string> MFSOwner::resolveOrder;
+uint32_t MFSOwner::resolveHits = 0;
+uint32_t MFSOwner::resolveMisses = 0;
+uint32_t MFSOwner::resolveEvictions = 0;
+
+void MFSOwner::clearResolveCache() {
+    std::lock_guard<std::mutex> guard(resolveLock);
+    resolveCache.clear();
+    resolveOrder.clear();
+}
+
+// end of each '/' separated component of "path"
+std::vector<size_t> MFSOwner::splitPath(const std::string &path) {
+    std::vector<size_t> ends;
+    for ( size_t pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1) )
+        ends.push_back(pos);
+    ends.push_back(path.size());
+
+    return ends;
+}
+
+MFileSystem* MFSOwner::resolveFS(const std::string &path) {
+    auto ends = splitPath(path);
+    return resolve(path, ends, ends.size()).fs;
+}
+
+// Same as testScan() over the first "count" components of "path", which end at
+// "ends". Results are cached per prefix, so resolving a path only asks the
+// filesystems about components not seen under that prefix before.
+MFSOwner::Resolution MFSOwner::resolve(const std::string &path, const std::vector<size_t> &ends, size_t count) {
+    if ( count == 0 )
+        return { *availableFS.begin(), 0 };
+
+    std::string prefix = path.substr(0, ends[count - 1]);
+    {
+        std::lock_guard<std::mutex> guard(resolveLock);
+        auto it = resolveCache.find(prefix);
+        if ( it != resolveCache.end() )
+        {
+            resolveHits++;
+            resolveOrder.splice(resolveOrder.begin(), resolveOrder, it->second.order);
+            return it->second.resolution;
+        }
+        resolveMisses++;
+    }
+
+    size_t start = (count > 1) ? ends[count - 2] + 1 : 0;
+    auto part = path.substr(start, ends[count - 1] - start);
+    mstr::toLower(part);
+
+    auto foundIter=std::find_if(availableFS.begin() + 1, availableFS.end(), [&part](MFileSystem* fs){
+        return fs->handles(part);
+    } );
+
+    Resolution r;
+    if(foundIter != availableFS.end())
+        r = { *foundIter, count - 1 };
+    else
+        r = resolve(path, ends, count - 1);
+
+    std::lock_guard<std::mutex> guard(resolveLock);
+    auto it = resolveCache.find(prefix);
+    if ( it != resolveCache.end() )
+    {
+        // added by another task meanwhile
+        it->second.resolution = r;
+        resolveOrder.splice(resolveOrder.begin(), resolveOrder, it->second.order);
+        return r;
+    }
+
+    if ( resolveCache.size() >= MFS_RESOLVE_CACHE_SIZE )
+    {
+        // full => drop the least recently used prefix, the ones of the
+        // paths currently being worked in stay
+        resolveCache.erase(resolveOrder.back());
+        resolveOrder.pop_back();
+        resolveEvictions++;
+    }
+    resolveOrder.push_front(prefix);
+    resolveCache[prefix] = { r, resolveOrder.begin() };
+
+    return r;
+}
@@ -6,9 +6,6 @@
 #include <vector>
 #include <sstream>
 
-std::unordered_map<std::string, MFile*> FileBroker::file_repo;
-std::unordered_map<std::string, MStream*> StreamBroker::stream_repo;
-
 #ifdef FLASH_SPIFFS
 #include "esp_spiffs.h"
 #endif
@@ -28,8 +25,13 @@ std::unordered_map<std::string, MStream*> StreamBroker::stream_repo;
 #include "MIOException.h"
 #include "../../include/debug.h"
 
+#include "fnSystem.h"
+
 // Archive
-//#include "archive/archive_ml.h"
+#include "archive/ark.h"
+#include "archive/gz.h"
+#include "archive/lnx.h"
+#include "archive/zip.h"
 
 // Cartridge
 
@@ -49,6 +51,8 @@ std::unordered_map<std::string, MStream*> StreamBroker::stream_repo;
 #include "disk/d82.h"
 #include "disk/d90.h"
 #include "disk/dnp.h"
+#include "disk/g64.h"
+#include "disk/nib.h"
 
 // File
 #include "file/p00.h"
@@ -86,7 +90,10 @@ SDFileSystem sdFS;
 
 
 // Archive
-//ArchiveMFileSystem archiveFS;
+ARKMFileSystem arkFS;
+GZMFileSystem gzFS;
+LNXMFileSystem lnxFS;
+ZIPMFileSystem zipFS;
 
 // Cartridge
 
@@ -105,6 +112,8 @@ D81MFileSystem d81FS;
 D82MFileSystem d82FS;
 D90MFileSystem d90FS;
 DNPMFileSystem dnpFS;
+G64MFileSystem g64FS;
+NIBMFileSystem nibFS;
 
 // Network
 HTTPMFileSystem httpFS;
@@ -129,8 +138,8 @@ std::vector<MFileSystem*> MFSOwner::availableFS {
 #ifdef SD_CARD
     &sdFS,
 #endif
-//    &archiveFS, // extension-based FS have to be on top to be picked first, otherwise the scheme will pick them!
-    &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d90FS, &dnpFS,
+    &arkFS, &gzFS, &lnxFS, &zipFS, // extension-based FS have to be on top to be picked first, otherwise the scheme will pick them!
+    &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d90FS, &dnpFS, &g64FS, &nibFS,
     &d8bFS, &dfiFS,
     &p00FS,
     &httpFS, &tnfsFS,
@@ -144,6 +153,8 @@ bool MFSOwner::mount(std::string name) {
     Debug_print("MFSOwner::mount fs:");
     Debug_println(name.c_str());
 
+    clearResolveCache();
+
     for(auto i = availableFS.begin() + 1; i < availableFS.end() ; i ++) {
         auto fs = (*i);
 
@@ -166,6 +177,8 @@ bool MFSOwner::mount(std::string name) {
 }
 
 bool MFSOwner::umount(std::string name) {
+    clearResolveCache();
+
     for(auto i = availableFS.begin() + 1; i < availableFS.end() ; i ++) {
         auto fs = (*i);
 
@@ -185,21 +198,45 @@ MFile* MFSOwner::File(std::shared_ptr<MFile> file) {
 }
 
 
+// The component at index "part" of "path" as a file of the filesystem of the
+// container holding it, e.g. disk1.d64 in http://host/game.zip/disk1.d64/PROG as a
+// ZIP file. Files in archives get the archive as their own stream file.
+MFile* MFSOwner::containerFile(const std::string &path, const std::vector<size_t> &ends, size_t part) {
+    auto upper = resolve(path, ends, part);
+
+    if ( upper.fs == nullptr )
+    {
+        //Debug_printv("WARNING!!!! CONTAINER FAILED FOR: '%s'", path.c_str());
+        return nullptr;
+    }
+
+    auto wholePath = path.substr(0, ends[part]);
+
+    //Debug_printv("CONTAINER PATH WILL BE: '%s' ", wholePath.c_str());
+    auto file = upper.fs->getFile(wholePath);
+    //Debug_printv("CONTAINER: '%s' is in FS [%s]", file->url.c_str(), upper.fs->symbol);
+
+    if ( file != nullptr && upper.fs->is_archive && upper.part > 0 )
+    {
+        file->pathInStream = path.substr(ends[upper.part] + 1, ends[part] - ends[upper.part] - 1);
+        file->streamFile = containerFile(path, ends, upper.part);
+    }
+
+    return file;
+}
+
 MFile* MFSOwner::File(std::string path) {
     // if(mstr::startsWith(path,"cs:", false)) {
     //     //Serial.printf("CServer path found!\r\n");
     //     return csFS.getFile(path);
     // }
 
-    std::vector<std::string> paths = mstr::split(path,'/');
+    auto ends = splitPath(path);
 
     //Debug_printv("Trying to factory path [%s]", path.c_str());
 
-    auto pathIterator = paths.end();
-    auto begin = paths.begin();
-    auto end = paths.end();
-
-    auto foundFS = testScan(begin, end, pathIterator);
+    auto found = resolve(path, ends, ends.size());
+    auto foundFS = found.fs;
 
     if ( foundFS != nullptr )
     {
@@ -207,38 +244,19 @@ MFile* MFSOwner::File(std::string path) {
         auto newFile = foundFS->getFile(path);
         //Debug_printv("newFile: '%s'", newFile->url.c_str());
 
-        pathIterator++;
-        newFile->pathInStream = mstr::joinToString(&pathIterator, &end, "/");
+        newFile->pathInStream = (ends[found.part] < path.size()) ? path.substr(ends[found.part] + 1) : "";
         //Debug_printv("newFile->pathInStream: '%s'", newFile->pathInStream.c_str());
 
-        auto endHere = pathIterator;
-        pathIterator--;
-
-        if(begin == pathIterator) 
+        if(found.part == 0) 
         {
             //Debug_printv("** LOOK DOWN PATH NOT NEEDED   path[%s]", path.c_str());
-            newFile->streamFile = foundFS->getFile(mstr::joinToString(&begin, &pathIterator, "/"));
+            newFile->streamFile = foundFS->getFile("");
         } 
         else 
         {
-            auto upperPath = mstr::joinToString(&begin, &pathIterator, "/");
-            //Debug_printv("** LOOK DOWN PATH: %s", upperPath.c_str());
-
-            auto upperFS = testScan(begin, end, pathIterator);
+            //Debug_printv("** LOOK DOWN PATH: %s", path.substr(0, ends[found.part - 1]).c_str());
 
-            if ( upperFS != nullptr )
-            {
-                auto wholePath = mstr::joinToString(&begin, &endHere, "/");
-
-                //auto cp = mstr::joinToString(&begin, &pathIterator, "/");
-                //Debug_printv("CONTAINER PATH WILL BE: '%s' ", wholePath.c_str());
-                newFile->streamFile = upperFS->getFile(wholePath); // skończy się na d64
-                //Debug_printv("CONTAINER: '%s' is in FS [%s]", newFile->streamFile->url.c_str(), upperFS->symbol);
-            }
-            else
-            {
-                //Debug_printv("WARNING!!!! CONTAINER FAILED FOR: '%s'", upperPath.c_str());
-            }
+            newFile->streamFile = containerFile(path, ends, found.part); // skończy się na d64
         }
 
         return newFile;
@@ -314,17 +332,6 @@ MFileSystem* MFSOwner::testScan(std::vector<std::string>::iterator &begin, std::
     return fs;
 }
 
-/********************************************************
- * MFileSystem implementations
- ********************************************************/
-
-MFileSystem::MFileSystem(const char* s)
-{
-    symbol = s;
-}
-
-MFileSystem::~MFileSystem() {}
-
 /********************************************************
  * MFile implementations
  ********************************************************/
@@ -372,6 +379,10 @@ MStream* MFile::getSourceStream(std::ios_base::openmode mode) {
     if ( sourceStream == nullptr )
         return nullptr;
 
+    // the container URL identifies the image in the media block cache
+    if ( sourceStream->url.empty() )
+        sourceStream->url = streamFile->url;
+
     // will be replaced by streamBroker->getSourceStream(streamFile, mode)
     std::shared_ptr<MStream> containerStream(sourceStream); // get its base stream, i.e. zip raw file contents
 
@@ -415,9 +426,30 @@ MStream* MFile::getSourceStream(std::ios_base::openmode mode) {
     return decodedStream;
 };
 
-MFile* MFile::cd(std::string newDir) 
+// "dir" + "/" + "plus", built in one allocation
+static std::string joinDir(std::string_view dir, std::string_view plus)
+{
+    std::string path;
+    path.reserve(dir.size() + plus.size() + 1);
+    path.append(dir);
+    path.push_back('/');
+    path.append(plus);
+    return path;
+}
+
+// url without its last path component (a trailing '/' does not count)
+static std::string_view parentOf(std::string_view url)
+{
+    size_t lastSlash = url.find_last_of('/');
+    if ( lastSlash != std::string_view::npos && lastSlash == url.size() - 1 )
+        lastSlash = url.find_last_of('/', url.size() - 2);
+
+    return lastSlash == std::string_view::npos ? std::string_view() : url.substr(0, lastSlash);
+}
+
+MFile* MFile::cd(std::string_view newDir) 
 {
-    Debug_printv("cd[%s]", newDir.c_str());
+    Debug_printv("cd[%.*s]", (int) newDir.size(), newDir.data());
 
     // OK to clarify - coming here there should be ONLY path or magicSymbol-path combo!
     // NO "cd:xxxxx", no "/cd:xxxxx" ALLOWED here! ******************
@@ -425,21 +457,21 @@ MFile* MFile::cd(std::string newDir)
     // if you want to support LOAD"CDxxxxxx" just parse/drop the CD BEFORE calling this function
     // and call it ONLY with the path you want to change into!
 
-    if(newDir.find(':') != std::string::npos) 
+    if(newDir.find(':') != std::string_view::npos) 
     {
         // I can only guess we're CDing into another url scheme, this means we're changing whole path
-        return MFSOwner::File(newDir);
+        return MFSOwner::File(std::string(newDir));
     }
-    else if(newDir[0]=='_') // {CBM LEFT ARROW}
+    else if(mstr::startsWith(newDir, "_")) // {CBM LEFT ARROW}
     {
         // user entered: CD:_ or CD_ 
         // means: go up one directory
 
         // user entered: CD:_DIR or CD_DIR
         // means: go to a directory in the same directory as this one
-        return cdParent(mstr::drop(newDir,1));
+        return cdParent(newDir.substr(1));
     }
-    else if(newDir[0]=='.' && newDir[1]=='.')
+    else if(mstr::startsWith(newDir, ".."))
     {
         if(newDir.size()==2) 
         {
@@ -451,42 +483,46 @@ MFile* MFile::cd(std::string newDir)
         {
             // user entered: CD:..DIR or CD..DIR
             // meaning: Go back one directory
-            return cdLocalParent(mstr::drop(newDir,2));
+            return cdLocalParent(newDir.substr(2));
         }
     }
-    else if(newDir[0]=='/' && newDir[1]=='/') 
+    else if(mstr::startsWith(newDir, "//")) 
     {
         // user entered: CD:// or CD//
         // means: change to the root of stream
 
         // user entered: CD://DIR or CD//DIR
         // means: change to a dir in root of stream
-        return cdLocalRoot(mstr::drop(newDir,2));
+        return cdLocalRoot(newDir.substr(2));
     }
-    else if(newDir[0]=='/') 
+    else if(mstr::startsWith(newDir, "/")) 
     {
         // user entered: CD:/DIR or CD/DIR
         // means: go to a directory in the same directory as this one
-        return cdParent(mstr::drop(newDir,1));
+        return cdParent(newDir.substr(1));
     }
-    else if(newDir[0]=='^') // {CBM UP ARROW}
+    else if(mstr::startsWith(newDir, "^")) // {CBM UP ARROW}
     {
         // user entered: CD:^ or CD^ 
         // means: change to flash root
-        return cdRoot(mstr::drop(newDir,1));
+        return cdRoot(newDir.substr(1));
     }
     else 
     {
         //newDir = mstr::toUTF8( newDir );
 
         // Add new directory to path
+        std::string newUrl;
+        newUrl.reserve(url.size() + newDir.size() + 1);
+        newUrl = url;
         if ( !mstr::endsWith(url, "/") && newDir.size() )
-            url.push_back('/');
+            newUrl.push_back('/');
+        newUrl.append(newDir);
 
-        // Add new directory to path
-        MFile* newPath = MFSOwner::File(url + newDir);
+        bool isUrlFile = mstr::endsWith(newDir, ".url", false);
+        MFile* newPath = MFSOwner::File(std::move(newUrl));
 
-        if(mstr::endsWith(newDir, ".url", false)) {
+        if(isUrlFile) {
             // we need to get actual url
 
             //auto reader = Meat::New<MFile>(newDir);
@@ -512,9 +548,9 @@ MFile* MFile::cd(std::string newDir)
 };
 
 
-MFile* MFile::cdParent(std::string plus) 
+MFile* MFile::cdParent(std::string_view plus) 
 {
-    Debug_printv("url[%s] path[%s] plus[%s]", url.c_str(), path.c_str(), plus.c_str());
+    Debug_printv("url[%s] path[%s] plus[%.*s]", url.c_str(), path.c_str(), (int) plus.size(), plus.data());
 
     // drop last dir
     // add plus
@@ -523,52 +559,44 @@ MFile* MFile::cdParent(std::string plus)
         // from here we can go only to flash root!
         return MFSOwner::File("/");
     }
+    else if(plus.empty())
+    {
+        return MFSOwner::File(std::string(parentOf(url)));
+    }
     else 
     {
-        int lastSlash = url.find_last_of('/');
-        if ( lastSlash == url.size() - 1 ) 
-        {
-            lastSlash = url.find_last_of('/', url.size() - 2);
-        }
-        std::string newDir = mstr::dropLast(url, url.size() - lastSlash);
-        if(!plus.empty())
-            newDir+= ("/" + plus);
-
-        return MFSOwner::File(newDir);
+        return MFSOwner::File(joinDir(parentOf(url), plus));
     }
 };
 
-MFile* MFile::cdLocalParent(std::string plus) 
+MFile* MFile::cdLocalParent(std::string_view plus) 
 {
-    Debug_printv("url[%s] path[%s] plus[%s]", url.c_str(), path.c_str(), plus.c_str());
+    Debug_printv("url[%s] path[%s] plus[%.*s]", url.c_str(), path.c_str(), (int) plus.size(), plus.data());
     // drop last dir
     // check if it isn't shorter than streamFile
     // add plus
-    int lastSlash = url.find_last_of('/');
-    if ( lastSlash == url.size() - 1 ) {
-        lastSlash = url.find_last_of('/', url.size() - 2);
-    }
-    std::string parent = mstr::dropLast(url, url.size() - lastSlash);
+    std::string_view parent = parentOf(url);
     if(parent.length()-streamFile->url.length()>1)
         parent = streamFile->url;
-    return MFSOwner::File( parent + "/" + plus );
+
+    return MFSOwner::File( joinDir(parent, plus) );
 };
 
-MFile* MFile::cdRoot(std::string plus) 
+MFile* MFile::cdRoot(std::string_view plus) 
 {
-    Debug_printv("url[%s] path[%s] plus[%s]", url.c_str(), path.c_str(), plus.c_str());
-    return MFSOwner::File( "/" + plus );
+    Debug_printv("url[%s] path[%s] plus[%.*s]", url.c_str(), path.c_str(), (int) plus.size(), plus.data());
+    return MFSOwner::File( joinDir("", plus) );
 };
 
-MFile* MFile::cdLocalRoot(std::string plus) 
+MFile* MFile::cdLocalRoot(std::string_view plus) 
 {
-    Debug_printv("url[%s] path[%s] plus[%s]", url.c_str(), path.c_str(), plus.c_str());
+    Debug_printv("url[%s] path[%s] plus[%.*s]", url.c_str(), path.c_str(), (int) plus.size(), plus.data());
 
     if ( path.empty() || streamFile == nullptr ) {
         // from here we can go only to flash root!
-        return MFSOwner::File( "/" + plus );
+        return cdRoot(plus);
     }
-    return MFSOwner::File( streamFile->url + "/" + plus );
+    return MFSOwner::File( joinDir(streamFile->url, plus) );
 };
 
 // bool MFile::copyTo(MFile* dst) {
@@ -634,3 +662,120 @@ uint64_t MFile::getAvailableSpace()
 
     return 65535;
 }
+
+
+/********************************************************
+ * Broker cache
+ ********************************************************/
+
+std::mutex MBroker::lock;
+std::unordered_map<std::string, MBroker::Entry> MBroker::entries;
+uint32_t MBroker::bytes = 0, MBroker::useCounter = 0;
+uint32_t MBroker::hits = 0, MBroker::misses = 0, MBroker::evictions = 0;
+
+uint32_t MBroker::freeHeap()
+{
+    return fnSystem.get_free_heap_size();
+}
+
+std::shared_ptr<void> MBroker::get(const std::string &key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto it = entries.find(key);
+    if ( it == entries.end() )
+    {
+        misses++;
+        return nullptr;
+    }
+
+    hits++;
+    it->second.lastUsed = ++useCounter;
+    it->second.uses++;
+    return it->second.object;
+}
+
+void MBroker::put(const std::string &key, std::shared_ptr<void> object, uint32_t cost)
+{
+    if ( cost < BROKER_MIN_ENTRY_COST )
+        cost = BROKER_MIN_ENTRY_COST;
+
+    std::shared_ptr<void> replaced;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto it = entries.find(key);
+        if ( it != entries.end() )
+        {
+            replaced = it->second.object;
+            bytes -= it->second.bytes;
+            entries.erase(it);
+        }
+
+        entries[key] = { std::move(object), cost, ++useCounter, 1 };
+        bytes += cost;
+    }
+
+    Debug_printv("key[%s] cost[%lu] entries[%lu] bytes[%lu] hits[%lu] misses[%lu] evictions[%lu]",
+                 key.c_str(), cost, getCount(), bytes, hits, misses, evictions);
+
+    trim();
+}
+
+void MBroker::remove(const std::string &key)
+{
+    // objects still in use by someone else are destroyed by their last owner
+    std::shared_ptr<void> removed;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        auto it = entries.find(key);
+        if ( it == entries.end() )
+            return;
+
+        removed = it->second.object;
+        bytes -= it->second.bytes;
+        entries.erase(it);
+    }
+
+    Debug_printv("key[%s] entries[%lu] bytes[%lu]", key.c_str(), getCount(), bytes);
+}
+
+void MBroker::trim(bool all)
+{
+    uint32_t budget = (fnSystem.get_psram_size() > 0) ? BROKER_BUDGET_PSRAM : BROKER_BUDGET;
+
+    while ( true )
+    {
+        std::shared_ptr<void> evicted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+
+            if ( !all && bytes <= budget && freeHeap() >= BROKER_MIN_FREE_HEAP )
+                return;
+
+            // least recently used entry nobody else is holding on to
+            auto victim = entries.end();
+            for ( auto it = entries.begin(); it != entries.end(); ++it )
+            {
+                if ( it->second.object.use_count() == 1 &&
+                     ( victim == entries.end() || it->second.lastUsed < victim->second.lastUsed ) )
+                    victim = it;
+            }
+
+            if ( victim == entries.end() )
+                return;
+
+            Debug_printv("evicting key[%s] bytes[%lu] uses[%lu] heap[%lu]", victim->first.c_str(),
+                         victim->second.bytes, victim->second.uses, freeHeap());
+
+            evicted = victim->second.object;
+            bytes -= victim->second.bytes;
+            entries.erase(victim);
+            evictions++;
+        }
+
+        // destroyed outside the lock, a stream may close a network connection
+        evicted.reset();
+    }
+}
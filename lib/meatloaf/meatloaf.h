@@ -6,7 +6,9 @@
 #include <vector>
 #include <fstream>
 #include <ctime>
-//#include <unordered_map>
+#include <unordered_map>
+#include <list>
+#include <mutex>
 
 #include "../../include/debug.h"
 
@@ -76,6 +78,12 @@ public:
         return _size;
     };
 
+    // RAM held by the stream (object, buffers, index, header), its MBroker cost.
+    // Sector data read through MediaCache has its own budget and is not counted
+    virtual uint32_t bytes() {
+        return sizeof(MStream) + url.capacity();
+    }
+
     virtual uint32_t available() {
         if ( _position > _size )
             return 0;
@@ -111,6 +119,9 @@ public:
     virtual bool isOpen() = 0;
     virtual bool isBrowsable() { return false; };
     virtual bool isRandomAccess() { return false; };
+    // Shared streams read through a stream other MStreams use as well without serialising
+    // the access (see MSharedStream), so seeks and reads must all come from one task
+    virtual bool isShared() { return false; };
 
     virtual bool open(std::ios_base::openmode mode) = 0;
     virtual void close() = 0;
@@ -148,6 +159,13 @@ public:
     virtual bool seekSector( uint8_t track, uint8_t sector, uint8_t offset = 0 ) { return false; };
     virtual bool seekSector( std::vector<uint8_t> trackSectorOffset ) { return false; };
 
+    // Raw sector access for disk images (e.g. burst mode sector reads/writes)
+    virtual bool readSector( uint8_t track, uint8_t sector, uint8_t* buf ) { return false; };
+    virtual bool writeSector( uint8_t track, uint8_t sector, const uint8_t* buf ) { return false; };
+
+    // held by every MSharedStream of this stream while accessing it
+    std::mutex shareLock;
+
 private:
 
     // DEVICE
@@ -202,11 +220,11 @@ public:
     virtual MStream* getDecodedStream(std::shared_ptr<MStream> src) = 0;
     virtual MStream* createStream(std::ios_base::openmode) { return nullptr; };
 
-    MFile* cd(std::string newDir);
-    MFile* cdParent(std::string = "");
-    MFile* cdLocalParent(std::string);
-    MFile* cdRoot(std::string);
-    MFile* cdLocalRoot(std::string);
+    MFile* cd(std::string_view newDir);
+    MFile* cdParent(std::string_view = "");
+    MFile* cdLocalParent(std::string_view);
+    MFile* cdRoot(std::string_view);
+    MFile* cdLocalRoot(std::string_view);
     virtual bool isDirectory() = 0;
     virtual bool rewindDirectory() = 0 ;
     virtual MFile* getNextFileInDir() = 0 ;
@@ -253,8 +271,8 @@ friend class MFSOwner;
 
 class MFileSystem {
 public:
-    MFileSystem(const char* symbol);
-    virtual ~MFileSystem() = 0;
+    MFileSystem(const char* symbol) : symbol(symbol) {}
+    virtual ~MFileSystem() {}
     virtual bool mount() { return true; };
     virtual bool umount() { return true; };
     virtual bool handles(std::string path) = 0;
@@ -280,6 +298,9 @@ public:
 protected:
     const char* symbol = nullptr;
     bool _is_mounted = false;
+    // files of archives are read from the archive, so an archive inside another
+    // path (game.zip/disk1.d64) needs the stream chain down to its own container
+    bool is_archive = false;
 
     friend class MFSOwner;
 };
@@ -289,7 +310,31 @@ protected:
  * MFile factory
  ********************************************************/
 
+// Number of path prefixes MFSOwner::File() remembers the filesystem for,
+// the least recently used one is dropped when a new prefix is added
+#define MFS_RESOLVE_CACHE_SIZE 128
+
 class MFSOwner {
+    // rightmost component of a path prefix handled by a filesystem
+    struct Resolution {
+        MFileSystem* fs;
+        size_t part;    // index of that component, 0 for the default filesystem
+    };
+
+    struct ResolveEntry {
+        Resolution resolution;
+        std::list<std::string>::iterator order;
+    };
+
+    static std::mutex resolveLock;
+    static std::unordered_map<std::string, ResolveEntry> resolveCache;
+    static std::list<std::string> resolveOrder;     // cached prefixes, most recently used first
+    static uint32_t resolveHits, resolveMisses, resolveEvictions;
+
+    static std::vector<size_t> splitPath(const std::string &path);
+    static Resolution resolve(const std::string &path, const std::vector<size_t> &ends, size_t count);
+    static MFile* containerFile(const std::string &path, const std::vector<size_t> &ends, size_t part);
+
 public:
     static std::vector<MFileSystem*> availableFS;
 
@@ -305,6 +350,14 @@ public:
 
     static bool mount(std::string name);
     static bool umount(std::string name);
+
+    // filesystem that File(path) creates the file with
+    static MFileSystem* resolveFS(const std::string &path);
+
+    static void clearResolveCache();
+    static uint32_t getResolveHits() { return resolveHits; }
+    static uint32_t getResolveMisses() { return resolveMisses; }
+    static uint32_t getResolveEvictions() { return resolveEvictions; }
 };
 
 /********************************************************
@@ -369,117 +422,248 @@ namespace Meat {
  * Utility implementations
  ********************************************************/
 
+// Objects shared by the brokers below are kept here. Entries are reference
+// counted through their shared_ptr, entries nobody else holds a reference to
+// are evicted least recently used first when the cache grows beyond its
+// budget or the heap runs low. The cost of an entry is the RAM it holds
+// (MStream::bytes() of a stream, the entries of a directory), given by put().
+#define BROKER_BUDGET         (32 * 1024)
+#define BROKER_BUDGET_PSRAM   (256 * 1024)
+#define BROKER_MIN_FREE_HEAP  (48 * 1024)
+#define BROKER_MIN_ENTRY_COST 256
+
+class MBroker {
+    struct Entry {
+        std::shared_ptr<void> object;
+        uint32_t bytes;
+        uint32_t lastUsed;
+        uint32_t uses;
+    };
+
+    static std::mutex lock;
+    static std::unordered_map<std::string, Entry> entries;
+    static uint32_t bytes, useCounter;
+    static uint32_t hits, misses, evictions;
+
+public:
+    static std::shared_ptr<void> get(const std::string &key);
+    static void put(const std::string &key, std::shared_ptr<void> object, uint32_t cost);
+    static void remove(const std::string &key);
+
+    // evicts unreferenced entries until the cache is within its budget and
+    // enough heap is free, "all" drops every unreferenced entry
+    static void trim(bool all = false);
+
+    static uint32_t freeHeap();
+
+    static uint32_t getHits() { return hits; }
+    static uint32_t getMisses() { return misses; }
+    static uint32_t getEvictions() { return evictions; }
+    static uint32_t getBytes() { return bytes; }
+    static uint32_t getCount() { return entries.size(); }
+};
+
 class FileBroker {
-    static std::unordered_map<std::string, MFile*> file_repo;
 public:
-    template<class T> static T* obtain(std::string url, MFile* sourceFile) 
+    template<class T> static std::shared_ptr<T> obtain(std::string url, MFile* sourceFile) 
     {
-        //Debug_printv("streams[%d] url[%s]", file_repo.size(), url.c_str());
-
         // obviously you have to supply STREAMFILE.url to this function!
-        if(file_repo.find(url)!=file_repo.end())
+        auto cached = MBroker::get("file:" + url);
+        if ( cached != nullptr )
         {
             Debug_printv("Reusing Existing MFile url[%s]", url.c_str());
-            return (T*)file_repo.at(url);
+            return std::static_pointer_cast<T>(std::static_pointer_cast<MFile>(cached));
         }
 
-        // create and add stream to broker if not found
-        Debug_printv("Creating New Stream url[%s]", url.c_str());
-        auto newFile = MFSOwner::File(url);
+        // create and add file to broker if not found
+        Debug_printv("Creating New File url[%s]", url.c_str());
+        std::shared_ptr<MFile> newFile(MFSOwner::File(url));
 
-        if ( newFile != nullptr )
+        if ( newFile == nullptr )
+            return nullptr;
+
+        // Are we at the root of the filesystem?
+        if ( newFile->pathInStream == "")
         {
-            // Are we at the root of the filesystem?
-            if ( newFile->pathInStream == "")
-            {
-                Debug_printv("ROOT FILESYSTEM... CACHING [%s]", url.c_str());
-                file_repo.insert(std::make_pair(url, newFile));
-            }
-            else
-            {
-                Debug_printv("SINGLE FILE... DON'T CACHE [%s]", url.c_str());
-            }
-            
-            return newFile;
+            Debug_printv("ROOT FILESYSTEM... CACHING [%s]", url.c_str());
+            MBroker::put("file:" + url, newFile, sizeof(MFile) + url.size());
+        }
+        else
+        {
+            Debug_printv("SINGLE FILE... DON'T CACHE [%s]", url.c_str());
         }
 
-        delete newFile;
-        return nullptr;
+        return std::static_pointer_cast<T>(newFile);
     }
 
-    static MFile* obtain(std::string url, MFile* sourceFile) {
+    static std::shared_ptr<MFile> obtain(std::string url, MFile* sourceFile) {
         return obtain<MFile>(url, sourceFile);
     }
 
     static void dispose(std::string url) {
-        if(file_repo.find(url)!=file_repo.end()) {
-            auto toDelete = file_repo.at(url);
-            file_repo.erase(url);
-            delete toDelete;
-        }
-        Debug_printv("streams[%d]", file_repo.size());
-    }
-
-    static void validate() {
-        
+        MBroker::remove("file:" + url);
     }
 };
 
 class StreamBroker {
-    static std::unordered_map<std::string, MStream*> stream_repo;
 public:
-    template<class T> static T* obtain(std::string url, std::ios_base::openmode mode) 
+    template<class T> static std::shared_ptr<T> obtain(std::string url, std::ios_base::openmode mode) 
     {
-        //Debug_printv("streams[%d] url[%s]", stream_repo.size(), url.c_str());
-
         // obviously you have to supply STREAMFILE.url to this function!
-        if(stream_repo.find(url)!=stream_repo.end())
+        auto cached = MBroker::get("stream:" + url);
+        if ( cached != nullptr )
         {
             Debug_printv("Reusing Existing Stream url[%s]", url.c_str());
-            return (T*)stream_repo.at(url);
+            return std::static_pointer_cast<T>(std::static_pointer_cast<MStream>(cached));
         }
 
         // create and add stream to broker if not found
         Debug_printv("Creating New Stream url[%s]", url.c_str());
-        auto newFile = MFSOwner::File(url);
-
-        T* newStream = (T*)newFile->createStream(mode);
-
-        if ( newStream != nullptr )
+        std::unique_ptr<MFile> newFile(MFSOwner::File(url));
+        if ( newFile == nullptr )
+            return nullptr;
+
+        std::shared_ptr<MStream> newStream(newFile->createStream(mode));
+        if ( newStream == nullptr )
+            return nullptr;
+
+        // Are we at the root of the filesystem?
+        bool root = newFile->pathInStream == "";
+        newFile.reset();
+        if ( root )
         {
-            // Are we at the root of the filesystem?
-            if ( newFile->pathInStream == "")
-            {
-                Debug_printv("ROOT FILESYSTEM... CACHING [%s]", url.c_str());
-                stream_repo.insert(std::make_pair(url, newStream));
-            }
-            else
-            {
-                Debug_printv("SINGLE FILE... DON'T CACHE [%s]", url.c_str());
-            }
-            
-            return newStream;
+            Debug_printv("ROOT FILESYSTEM... CACHING [%s]", url.c_str());
+            MBroker::put("stream:" + url, newStream, newStream->bytes());
+        }
+        else
+        {
+            Debug_printv("SINGLE FILE... DON'T CACHE [%s]", url.c_str());
         }
 
-        delete newFile;
-        return nullptr;
+        return std::static_pointer_cast<T>(newStream);
     }
 
-    static MStream* obtain(std::string url, std::ios_base::openmode mode) {
+    static std::shared_ptr<MStream> obtain(std::string url, std::ios_base::openmode mode) {
         return obtain<MStream>(url, mode);
     }
 
     static void dispose(std::string url) {
-        if(stream_repo.find(url)!=stream_repo.end()) {
-            auto toDelete = stream_repo.at(url);
-            stream_repo.erase(url);
-            delete toDelete;
-        }
-        Debug_printv("streams[%d]", stream_repo.size());
+        MBroker::remove("stream:" + url);
     }
+};
 
-    static void validate() {
-        
+// Hands out a stream held by StreamBroker where the caller takes ownership
+// of the returned MStream*, all instances share the underlying stream.
+// Each instance keeps its own position and moves the underlying stream
+// there (under its shareLock) before using it, so instances can be read
+// from different tasks (e.g. the IEC drive's read-ahead) without seeing
+// each other's seeks
+class MSharedStream: public MStream {
+    std::shared_ptr<MStream> stream;
+
+    // with stream->shareLock held
+    void sync() {
+        if ( stream->position() != _position )
+            stream->seek(_position);
+    }
+
+public:
+    MSharedStream(std::shared_ptr<MStream> is): stream(is) {
+        url = is->url;
+        mode = is->mode;
+        block_size = is->block_size;
+        has_subdirs = is->has_subdirs;
+        std::lock_guard<std::mutex> guard(is->shareLock);
+        _position = is->position();
+    }
+
+    std::unordered_map<std::string, std::string> info() override { return stream->info(); }
+    uint32_t size() override { return stream->size(); }
+    uint32_t available() override { std::lock_guard<std::mutex> guard(stream->shareLock); sync(); return stream->available(); }
+    uint32_t position() override { return _position; }
+    bool position(uint32_t p) override { return seek(p); }
+    size_t error() override { return stream->error(); }
+    bool eos() override { std::lock_guard<std::mutex> guard(stream->shareLock); sync(); return stream->eos(); }
+    void reset() override { std::lock_guard<std::mutex> guard(stream->shareLock); stream->reset(); _position = stream->position(); }
+
+    bool isOpen() override { return stream->isOpen(); }
+    bool isBrowsable() override { return stream->isBrowsable(); }
+    bool isRandomAccess() override { return stream->isRandomAccess(); }
+
+    bool open(std::ios_base::openmode m) override { std::lock_guard<std::mutex> guard(stream->shareLock); return stream->open(m); }
+    void close() override { std::lock_guard<std::mutex> guard(stream->shareLock); stream->close(); }
+
+    uint32_t read(uint8_t* buf, uint32_t size) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        sync();
+        uint32_t n = stream->read(buf, size);
+        _position = stream->position();
+        return n;
+    }
+    uint32_t write(const uint8_t *buf, uint32_t size) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        sync();
+        uint32_t n = stream->write(buf, size);
+        _position = stream->position();
+        return n;
+    }
+
+    bool seek(uint32_t pos, int mode) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        sync();
+        bool ok = stream->seek(pos, mode);
+        _position = stream->position();
+        return ok;
+    }
+    bool seek(uint32_t pos) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->seek(pos);
+        _position = stream->position();
+        return ok;
+    }
+    bool seekPath(std::string path) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->seekPath(path);
+        _position = stream->position();
+        return ok;
+    }
+    std::string seekNextEntry() override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        sync();
+        std::string entry = stream->seekNextEntry();
+        _position = stream->position();
+        return entry;
+    }
+    bool seekBlock(uint64_t index, uint8_t offset = 0) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->seekBlock(index, offset);
+        _position = stream->position();
+        return ok;
+    }
+    bool seekSector(uint8_t track, uint8_t sector, uint8_t offset = 0) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->seekSector(track, sector, offset);
+        _position = stream->position();
+        return ok;
+    }
+    bool seekSector(std::vector<uint8_t> trackSectorOffset) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->seekSector(trackSectorOffset);
+        _position = stream->position();
+        return ok;
+    }
+    bool readSector(uint8_t track, uint8_t sector, uint8_t* buf) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->readSector(track, sector, buf);
+        _position = stream->position();
+        return ok;
+    }
+    bool writeSector(uint8_t track, uint8_t sector, const uint8_t* buf) override {
+        std::lock_guard<std::mutex> guard(stream->shareLock);
+        bool ok = stream->writeSector(track, sector, buf);
+        _position = stream->position();
+        return ok;
     }
 };
+
 #endif // MEATLOAF_FILE
@@ -1,6 +1,8 @@
 #include "http.h"
 
 #include <esp_idf_version.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 
 #include "../meatloaf.h"
 #include "../../../include/debug.h"
@@ -21,6 +23,9 @@ MeatHttpClient* HTTPMFile::fromHeader() {
         client->HEAD(url);
         //Debug_printv("after head url[%s]", client->url.c_str());
         resetURL(client->url);
+
+        // only the headers are needed, hand the connection on to the stream
+        client->close();
     }
     return client;
 }
@@ -174,7 +179,11 @@ bool HTTPMStream::seek(uint32_t pos) {
         return false;
     }
 
-    return _http.seek(pos);
+    if ( !_http.seek(pos) )
+        return false;
+
+    _position = pos;
+    return true;
 }
 
 uint32_t HTTPMStream::read(uint8_t* buf, uint32_t size) {
@@ -229,6 +238,56 @@ bool MeatHttpClient::HEAD(std::string dstUrl) {
     return rc;
 }
 
+// Takes over an idle keep-alive connection or a saved TLS session for the
+// host, or creates a new client
+bool MeatHttpClient::connect() {
+    if (_http != nullptr)
+        return true;
+
+    _poolKey = HttpConnectionPool::key("ml", url);
+    _http = (esp_http_client_handle_t) fnHttpPool.checkout(_poolKey);
+    if (_http != nullptr) {
+        esp_http_client_set_user_data(_http, this);
+        _reused = true;
+        return true;
+    }
+
+    esp_http_client_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.url = "https://api.meatloaf.cc/?$";
+    config.auth_type = HTTP_AUTH_TYPE_BASIC;
+    config.user_agent = USER_AGENT;
+    config.method = HTTP_METHOD_GET;
+    config.timeout_ms = 10000;
+    config.max_redirection_count = 10;
+    config.event_handler = _http_event_handler;
+    config.user_data = this;
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = 5;
+    config.keep_alive_interval = 5;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    config.save_client_session = true;
+#endif
+
+    //Debug_printv("HTTP Init url[%s]", url.c_str());
+    _http = esp_http_client_init(&config);
+    if (_http == nullptr) {
+        fnHttpPool.checkin(_poolKey, nullptr, cleanupHandle, disconnectHandle, HttpConnectionPool::HANDLE_DISCARD);
+        return false;
+    }
+
+    _reused = false;
+    return true;
+}
+
+void MeatHttpClient::cleanupHandle(void *handle) {
+    esp_http_client_cleanup((esp_http_client_handle_t) handle);
+}
+
+void MeatHttpClient::disconnectHandle(void *handle) {
+    esp_http_client_close((esp_http_client_handle_t) handle);
+}
+
 bool MeatHttpClient::processRedirectsAndOpen(uint32_t position, uint32_t size) {
     wasRedirected = false;
 
@@ -255,6 +314,28 @@ bool MeatHttpClient::processRedirectsAndOpen(uint32_t position, uint32_t size) {
     _exists = true;
     _position = position;
 
+    if (lastMethod == HTTP_METHOD_HEAD) {
+        // no body
+        _responsePos = position;
+        _rangeEnd = position;
+    }
+    else if (lastRC == 206) {
+        _responsePos = position;
+        _rangeEnd = position + ((_contentLength > 0) ? _contentLength : size);
+    }
+    else {
+        // range was ignored, the body starts at the beginning of the file
+        if (lastMethod == HTTP_METHOD_GET)
+            isFriendlySkipper = false;
+        _responsePos = 0;
+        _rangeEnd = (_size > 0) ? _size : UINT32_MAX;
+
+        if (lastMethod == HTTP_METHOD_GET && lastRC == HttpStatus_Ok && !_bodyTried) {
+            _bodyTried = true;
+            downloadBody();
+        }
+    }
+
     //Debug_printv("size[%d] avail[%d] isFriendlySkipper[%d] isText[%d] httpCode[%d] method[%d]", _size, available(), isFriendlySkipper, isText, lastRC, lastMethod);
 
     return true;
@@ -265,19 +346,46 @@ bool MeatHttpClient::open(std::string dstUrl, esp_http_client_method_t meth) {
     lastMethod = meth;
     _error = 0;
 
+    free(_body);
+    _body = nullptr;
+    _bodyLen = 0;
+    _bodyTried = false;
+    _readAhead = HTTP_BLOCK_SIZE;
+    _responsePos = 0;
+    _rangeEnd = 0;
+
+    if (!connect()) {
+        _error = 1;
+        return false;
+    }
+
     return processRedirectsAndOpen(0);
 };
 
 void MeatHttpClient::close() {
     if(_http != nullptr) {
-        if ( _is_open ) {
-            esp_http_client_close(_http);
-        }
-        esp_http_client_cleanup(_http);
-        Debug_printv("HTTP Close and Cleanup");
+        if ( _requests > 0 )
+            Debug_printv("url[%s] requests[%lu] received[%lu] skipped[%lu] readahead[%lu]", url.c_str(), _requests, _bytesReceived, _bytesSkipped, _readAhead);
+
+        // A response read to its end leaves the keep-alive connection ready
+        // for the next client, otherwise only the handle and its TLS session
+        // are kept. Custom headers would stick to the handle.
+        auto state = HttpConnectionPool::HANDLE_DISCONNECT;
+        if (!headers.empty())
+            state = HttpConnectionPool::HANDLE_DISCARD;
+        else if (_is_open && _error == 0 && _responsePos == _rangeEnd &&
+                 (lastMethod == HTTP_METHOD_GET || lastMethod == HTTP_METHOD_HEAD))
+            state = HttpConnectionPool::HANDLE_KEEP;
+
+        fnHttpPool.checkin(_poolKey, _http, cleanupHandle, disconnectHandle, state);
+        Debug_printv("HTTP Close%s", state == HttpConnectionPool::HANDLE_DISCARD ? " and Cleanup" : "");
         _http = nullptr;
     }
     _is_open = false;
+
+    free(_body);
+    _body = nullptr;
+    _bodyLen = 0;
 }
 
 void MeatHttpClient::setOnHeader(const std::function<int(char*, char*)> &lambda) {
@@ -286,72 +394,120 @@ void MeatHttpClient::setOnHeader(const std::function<int(char*, char*)> &lambda)
 
 bool MeatHttpClient::seek(uint32_t pos) {
 
-    if(isFriendlySkipper) {
-
-        if (_is_open) {
-            // Read to end of the stream
-            //Debug_printv("Skipping to end!");
-            while(1)
-            {
-                char c[HTTP_BLOCK_SIZE];
-                int bytes = esp_http_client_read(_http, c, HTTP_BLOCK_SIZE);
-                if ( bytes < HTTP_BLOCK_SIZE )
-                    break;
-            }
-        }
+    // Without range support only GET can be restarted and read through
+    if (!_is_open || (!isFriendlySkipper && lastMethod != HTTP_METHOD_GET))
+        return false;
 
-        bool op = processRedirectsAndOpen(pos);
+    // The request is deferred to the next read(), so seeking within the open
+    // response or to where it ends doesn't cost a round trip
+    _position = pos;
+    return true;
+}
 
-        //Debug_printv("SEEK in HTTPMStream %s: range request RC=%d", url.c_str(), lastRC);
+bool MeatHttpClient::skip(uint32_t count) {
+    char c[HTTP_BLOCK_SIZE];
 
-        if(!op)
+    while (count > 0) {
+        int bytes = esp_http_client_read(_http, c, std::min<uint32_t>(count, HTTP_BLOCK_SIZE));
+        if (bytes <= 0) {
+            _rangeEnd = _responsePos;
             return false;
-
-         // 200 = range not supported! according to https://developer.mozilla.org/en-US/docs/Web/HTTP/Range_requests
-        if(lastRC == 206)
-        {
-            //Debug_printv("Seek successful");
-            _position = pos;
-            return true;
         }
+
+        count -= bytes;
+        _responsePos += bytes;
+        _bytesReceived += bytes;
+        _bytesSkipped += bytes;
     }
 
-    if(lastMethod == HTTP_METHOD_GET) {
-        Debug_printv("Server doesn't support resume, reading from start and discarding");
-        // server doesn't support resume, so...
-        if(pos<_position || pos == 0) {
-            // skipping backward let's simply reopen the stream...
-            esp_http_client_close(_http);
-            bool op = open(url, lastMethod);
-            if(!op)
-                return false;
-
-            // and read pos bytes - requires some buffer
-            for(int i = 0; i<pos; i++) {
-                char c;
-                int rc = esp_http_client_read(_http, &c, 1);
-                if(rc == -1)
-                    return false;
-            }
-        }
-        else {
-            auto delta = pos-_position;
-            // skipping forward let's skip a proper amount of bytes - requires some buffer
-            for(int i = 0; i<delta; i++) {
-                char c;
-                int rc = esp_http_client_read(_http, &c, 1);
-                if(rc == -1)
-                    return false;
-            }
-        }
+    return true;
+}
+
+void MeatHttpClient::dropResponse() {
+    uint32_t remaining = _rangeEnd - _responsePos;
+    if (remaining == 0)
+        return;
+
+    // A keep-alive connection can only be reused once the response has been
+    // read to its end, larger remainders are dropped together with the connection
+    if (remaining > HTTP_SKIP_MAX || !skip(remaining))
+        esp_http_client_close(_http);
+
+    _rangeEnd = _responsePos;
+}
 
-        _position = pos;
-        Debug_printv("stream opened[%s]", url.c_str());
+bool MeatHttpClient::prepareRange(uint32_t size) {
 
+    if (_body != nullptr)
         return true;
+
+    if (_position >= _responsePos && _position < _rangeEnd) {
+        // Small forward gaps are read through, without range support there is no other way
+        if (!isFriendlySkipper || _position - _responsePos <= HTTP_SKIP_MAX)
+            return skip(_position - _responsePos);
     }
+
+    if (isFriendlySkipper && _size > 0 && _position >= _size)
+        return false;
+
+    // Grow the window while reads continue where the previous range ended
+    if (_position == _rangeEnd)
+        _readAhead = std::min<uint32_t>(_readAhead * 2, HTTP_READAHEAD_MAX);
     else
+        _readAhead = HTTP_BLOCK_SIZE;
+
+    dropResponse();
+
+    if (size < _readAhead)
+        size = _readAhead;
+    if (_size > 0 && _position < _size && size > _size - _position)
+        size = _size - _position;
+
+    if (!processRedirectsAndOpen(_position, size))
+        return false;
+
+    if (_body != nullptr)
+        return true;
+
+    // A server that ignored the range starts over at the beginning
+    if (_position < _responsePos || _position >= _rangeEnd)
         return false;
+
+    return skip(_position - _responsePos);
+}
+
+bool MeatHttpClient::downloadBody() {
+    if (_size == 0 || _size > HTTP_FULL_BODY_MAX || esp_http_client_is_chunked_response(_http))
+        return false;
+
+    uint8_t* body = (uint8_t*) heap_caps_malloc(_size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if (body == nullptr && _size <= HTTP_FULL_BODY_MAX_RAM)
+        body = (uint8_t*) malloc(_size);
+    if (body == nullptr)
+        return false;
+
+    uint32_t len = 0;
+    while (len < _size) {
+        int bytes = esp_http_client_read(_http, (char *)body + len, _size - len);
+        if (bytes <= 0)
+            break;
+        len += bytes;
+    }
+    _bytesReceived += len;
+    _responsePos = len;
+
+    if (len < _size) {
+        Debug_printv("Short body, got %lu of %lu bytes [%s]", len, _size, url.c_str());
+        free(body);
+        esp_http_client_close(_http);
+        _rangeEnd = _responsePos;
+        return false;
+    }
+
+    Debug_printv("Server ignored range request, downloaded %lu bytes [%s]", len, url.c_str());
+    _body = body;
+    _bodyLen = len;
+    return true;
 }
 
 uint32_t MeatHttpClient::read(uint8_t* buf, uint32_t size) {
@@ -361,23 +517,42 @@ uint32_t MeatHttpClient::read(uint8_t* buf, uint32_t size) {
         processRedirectsAndOpen(0, size);
     }
 
-    if (_is_open) {
-        //Debug_printv("Reading HTTP Stream!");
-        auto bytesRead= esp_http_client_read(_http, (char *)buf, size );
-        
-        if (bytesRead >= 0) {
-            _position+=bytesRead;
+    if (!_is_open)
+        return 0;
+
+    uint32_t bytesRead = 0;
+    while (bytesRead < size && prepareRange(size - bytesRead)) {
+        uint32_t len = size - bytesRead;
 
-            if (bytesRead < size)
-                openAndFetchHeaders(lastMethod, _position);
+        if (_body != nullptr) {
+            if (_position >= _bodyLen)
+                break;
+
+            len = std::min(len, _bodyLen - _position);
+            memcpy(buf + bytesRead, _body + _position, len);
         }
-        if (bytesRead < 0)
-            return 0;
+        else {
+            len = std::min(len, _rangeEnd - _responsePos);
+            int rc = esp_http_client_read(_http, (char *)buf + bytesRead, len);
+            if (rc <= 0) {
+                // Response ended early
+                _rangeEnd = _responsePos;
+                if (rc < 0)
+                    _error = 1;
+                break;
+            }
 
-        //Debug_printv("size[%d] bytesRead[%d] _position[%d]", size, bytesRead, _position);
-        return bytesRead;
+            len = rc;
+            _responsePos += len;
+            _bytesReceived += len;
+        }
+
+        bytesRead += len;
+        _position += len;
     }
-    return 0;
+
+    //Debug_printv("size[%d] bytesRead[%d] _position[%d]", size, bytesRead, _position);
+    return bytesRead;
 };
 
 uint32_t MeatHttpClient::write(const uint8_t* buf, uint32_t size) {
@@ -397,7 +572,7 @@ uint32_t MeatHttpClient::write(const uint8_t* buf, uint32_t size) {
 
 int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_t position, uint32_t size) {
 
-    if ( url.size() < 5)
+    if ( url.size() < 5 || _http == nullptr )
         return 0;
 
     // Set URL and Method
@@ -413,8 +588,11 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
 
     // Set Range Header
     char str[40];
-    snprintf(str, sizeof str, "bytes=%lu-%lu", position, (position + size + 5));
+    snprintf(str, sizeof str, "bytes=%lu-%lu", position, (position + (size > 0 ? size : 1) - 1));
     esp_http_client_set_header(_http, "Range", str);
+    _contentLength = -1;
+    _rangeTotal = 0;
+    _requests++;
     //Debug_printv("seeking range[%s] url[%s]", str, url.c_str());
 
     // POST
@@ -422,22 +600,45 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
     // esp_http_client_set_post_field(client, post_data, strlen(post_data));
 
     //Debug_printv("--- PRE OPEN");
+    int64_t started = esp_timer_get_time();
     esp_err_t rc = esp_http_client_open(_http, 0); // or open? It's not entirely clear...
+    int64_t lengthResp = (rc == ESP_OK) ? esp_http_client_fetch_headers(_http) : -1;
+
+    if (_reused && (rc != ESP_OK || (lengthResp < 0 && !esp_http_client_is_chunked_response(_http))))
+    {
+        // A pooled connection may have been closed by the server while idle
+        Debug_printv("pooled connection failed, reconnecting");
+        esp_http_client_close(_http);
+        _error = 0;
+        rc = esp_http_client_open(_http, 0);
+        lengthResp = (rc == ESP_OK) ? esp_http_client_fetch_headers(_http) : -1;
+    }
+    _reused = false;
+
+    // time to first response, shows the effect of connection reuse and TLS session resumption
+    if (_requests == 1)
+        Debug_printv("first request took %lums [%s]", (uint32_t)((esp_timer_get_time() - started) / 1000), url.c_str());
 
     if (rc == ESP_OK)
     {
         //Debug_printv("--- PRE FETCH HEADERS");
 
-        int64_t lengthResp = esp_http_client_fetch_headers(_http);
-        if(_size == -1 && lengthResp > 0) {
+        if(_contentLength < 0 && lengthResp > 0) {
             // only if we aren't chunked!
-            _size = lengthResp;
-            _position = position;
+            _contentLength = lengthResp;
         }
     }
 
     //Debug_printv("--- PRE GET STATUS CODE");
-    return esp_http_client_get_status_code(_http);
+    int status = esp_http_client_get_status_code(_http);
+
+    // Content-Length of a partial response is the length of the range only
+    if (status == 206 && _rangeTotal > 0)
+        _size = _rangeTotal;
+    else if (status == HttpStatus_Ok && _contentLength > 0)
+        _size = _contentLength;
+
+    return status;
 }
 
 esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
@@ -448,7 +649,8 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
         case HTTP_EVENT_ERROR: // This event occurs when there are any errors during execution
             Debug_printv("HTTP_EVENT_ERROR");
             meatClient->_error = 1;
-            meatClient->close();
+            if (!meatClient->_reused) // a pooled connection gets retried first
+                meatClient->close();
             break;
 
         case HTTP_EVENT_ON_CONNECTED: // Once the HTTP has been connected to the server, no data exchange has been performed
@@ -476,8 +678,8 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
                 if(meatClient != nullptr) {
                     meatClient->isFriendlySkipper = true;
                     auto cr = util_tokenize(evt->header_value, '/');
-                    if( cr.size() > 1 )
-                        meatClient->_size = std::stoi(cr[1]);
+                    if( cr.size() > 1 && cr[1] != "*" )
+                        meatClient->_rangeTotal = std::stoul(cr[1]);
                 }
             }
             // what can we do UTF8<->PETSCII on this stream?
@@ -509,7 +711,7 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
             else if(mstr::equals("Content-Length", evt->header_key, false))
             {
                 //Debug_printv("* Content len present '%s'", evt->header_value);
-                meatClient->_size = std::stoi(evt->header_value);
+                meatClient->_contentLength = std::stoll(evt->header_value);
             }
             else if(mstr::equals("Location", evt->header_key, false))
             {
@@ -19,9 +19,22 @@
 //#include "../../include/global_defines.h"
 #include "../../include/version.h"
 #include "utils.h"
+#include "httpConnectionPool.h"
 
 #define HTTP_BLOCK_SIZE 256
 
+// Read-ahead: a range request starts at HTTP_BLOCK_SIZE bytes and doubles each
+// time the previous range was read to its end, up to HTTP_READAHEAD_MAX.
+// Forward seeks of up to HTTP_SKIP_MAX bytes read through the open response
+// instead of issuing a new request.
+#define HTTP_READAHEAD_MAX (16 * 1024)
+#define HTTP_SKIP_MAX      (4 * 1024)
+
+// Servers that answer a range request with "200 OK" get the whole body
+// downloaded once and kept in memory (PSRAM, or internal RAM for small bodies)
+#define HTTP_FULL_BODY_MAX     (512 * 1024)
+#define HTTP_FULL_BODY_MAX_RAM (8 * 1024)
+
 #define PRODUCT_ID "MEATLOAF CBM"
 #define PLATFORM_DETAILS "C64; 6510; 2; NTSC; EN;" // Make configurable. This will help server side to select appropriate content.
 #define USER_AGENT "MEATLOAF/" FN_VERSION_FULL " (" PLATFORM_DETAILS ")"
@@ -29,8 +42,36 @@
 class MeatHttpClient {
     esp_http_client_handle_t _http = nullptr;
     static esp_err_t _http_event_handler(esp_http_client_event_t *evt);
+    static void cleanupHandle(void *handle);
+    static void disconnectHandle(void *handle);
+    bool connect();
     int openAndFetchHeaders(esp_http_client_method_t method, uint32_t position, uint32_t size = HTTP_BLOCK_SIZE);
+    bool prepareRange(uint32_t size);
+    void dropResponse();
+    bool skip(uint32_t count);
+    bool downloadBody();
     esp_http_client_method_t lastMethod;
+
+    // body of the open response covers [_responsePos, _rangeEnd)
+    uint32_t _responsePos = 0;
+    uint32_t _rangeEnd = 0;
+    uint32_t _readAhead = HTTP_BLOCK_SIZE;
+    int64_t _contentLength = -1;
+    uint32_t _rangeTotal = 0;
+
+    // whole body, for servers without range support
+    uint8_t* _body = nullptr;
+    uint32_t _bodyLen = 0;
+    bool _bodyTried = false;
+
+    // connection taken from the pool, may have been closed by the server meanwhile
+    std::string _poolKey;
+    bool _reused = false;
+
+    // debug stats
+    uint32_t _requests = 0;
+    uint32_t _bytesReceived = 0;
+    uint32_t _bytesSkipped = 0;
     std::function<int(char*, char*)> onHeader = [] (char* key, char* value){ 
         //Debug_printv("HTTP_EVENT_ON_HEADER, key=%s, value=%s", key, value);
         return 0; 
@@ -40,24 +81,7 @@ class MeatHttpClient {
 
 public:
 
-    MeatHttpClient() {
-        esp_http_client_config_t config;
-        memset(&config, 0, sizeof(config));
-        config.url = "https://api.meatloaf.cc/?$";
-        config.auth_type = HTTP_AUTH_TYPE_BASIC;
-        config.user_agent = USER_AGENT;
-        config.method = HTTP_METHOD_GET;
-        config.timeout_ms = 10000;
-        config.max_redirection_count = 10;
-        config.event_handler = _http_event_handler;
-        config.user_data = this;
-        config.keep_alive_enable = true;
-        config.keep_alive_idle = 5;
-        config.keep_alive_interval = 5;
-
-        //Debug_printv("HTTP Init url[%s]", url.c_str());
-        _http = esp_http_client_init(&config);
-    }
+    MeatHttpClient() {}
     
     ~MeatHttpClient() {
         close();
@@ -97,6 +121,11 @@ public:
         return _size - _position;
     }
 
+    // RAM held by the client, the whole body if it was downloaded
+    uint32_t bytes() {
+        return sizeof(MeatHttpClient) + url.capacity() + (_body != nullptr ? _bodyLen : 0);
+    }
+
     uint32_t _size = 0;
     uint32_t _position = 0;
     size_t _error = 0;
@@ -177,6 +206,7 @@ public:
     bool isOpen() override;
     bool isBrowsable() override { return false; };
     bool isRandomAccess() override { return true; };
+    uint32_t bytes() override { return MStream::bytes() + _http.bytes(); }
 
     bool open(std::ios_base::openmode mode) override;
     void close() override;
@@ -291,8 +291,10 @@ public:
         // has to return OPENED streamm
         //MStream* istream = new TCPMStream(url);
         auto istream = StreamBroker::obtain<TCPMStream>(url, mode);
+        if ( istream == nullptr )
+            return nullptr;
         //istream->open(std::ios_base::openmode mode);
-        return istream;
+        return new MSharedStream(istream);
     } 
 
     // DUMMY return value - we've overriden getSourceStream, so this one won't be even called!
@@ -49,10 +49,12 @@ MStream* TNFSMFile::getSourceStream(std::ios_base::openmode mode)
     std::string full_path = basepath + path;
     //MStream* istream = new TNFSMStream(full_path);
     auto istream = StreamBroker::obtain<TNFSMStream>(full_path, mode);
+    if ( istream == nullptr )
+        return nullptr;
     //Debug_printv("TNFSMFile::getSourceStream() 3, not null=%d", istream != nullptr);
     istream->open(mode);   
     //Debug_printv("TNFSMFile::getSourceStream() 4");
-    return istream;
+    return new MSharedStream(istream);
 }
 
 MStream* TNFSMFile::getDecodedStream(std::shared_ptr<MStream> is) {
@@ -326,8 +326,10 @@ bool CSIPMFile::isDirectory() {
 MStream* CSIPMFile::getSourceStream(std::ios_base::openmode mode) {
     //MStream* istream = new CSIPMStream(url);
     auto istream = StreamBroker::obtain<CSIPMStream>(url, mode);
+    if ( istream == nullptr )
+        return nullptr;
     istream->open(mode);   
-    return istream;
+    return new MSharedStream(istream);
 };
 
 
@@ -22,6 +22,14 @@ std::string T64MStream::decodeType(uint8_t file_type, bool show_hidden)
     return type;
 }
 
+std::string T64MStream::entryName()
+{
+    std::string name = mstr::format("%.16s", entry.filename);
+    mstr::replaceAll(name, "/", "\\");
+    mstr::trim(name);
+    return mstr::toUTF8(name);
+}
+
 bool T64MStream::seekEntry( std::string filename )
 {
     size_t index = 1;
@@ -29,14 +37,17 @@ bool T64MStream::seekEntry( std::string filename )
     bool wildcard =  ( mstr::contains(filename, "*") || mstr::contains(filename, "?") );
 
     // Read Directory Entries
-    if ( filename.size() )
+    if ( filename.size() && getIndex() != nullptr )
+    {
+        int pos = dir_index->find(filename);
+        if ( pos >= 0 && seekEntry( dir_index->entries[pos].index ) )
+            return true;
+    }
+    else if ( filename.size() )
     {
         while ( seekEntry( index ) )
         {
-            std::string entryFilename = mstr::format("%.16s", entry.filename);
-            mstr::replaceAll(entryFilename, "/", "\\");
-            mstr::trim(entryFilename);
-            entryFilename = mstr::toUTF8(entryFilename);
+            std::string entryFilename = entryName();
 
             //Debug_printv("filename[%s] entry.filename[%s]", filename.c_str(), entryFilename.c_str());
 
@@ -66,6 +77,15 @@ bool T64MStream::seekEntry( std::string filename )
     return false;
 }
 
+bool T64MStream::indexEntry( MediaIndex::Entry &e )
+{
+    e.name = entryName();
+    e.file_type = entry.file_type;
+    e.track = e.sector = e.offset = 0;
+
+    return true;
+}
+
 bool T64MStream::seekEntry( uint16_t index )
 {
     // Calculate Sector offset & Entry offset
@@ -167,11 +187,18 @@ bool T64MFile::isDirectory() {
 };
 
 bool T64MFile::rewindDirectory() {
-    dirIsOpen = true;
+    dirIsOpen = false;
     Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
     auto image = ImageBroker::obtain<T64MStream>(streamFile->url);
     if ( image == nullptr )
+    {
         Debug_printv("image pointer is null");
+        dirImage.reset();
+        return false;
+    }
+
+    dirImage = image;
+    dirIsOpen = true;
 
     image->resetEntryCounter();
 
@@ -193,11 +220,11 @@ bool T64MFile::rewindDirectory() {
 
 MFile* T64MFile::getNextFileInDir() {
 
-    if(!dirIsOpen)
-        rewindDirectory();
+    if(!dirIsOpen && !rewindDirectory())
+        return nullptr;
 
     // Get entry pointed to by containerStream
-    auto image = ImageBroker::obtain<T64MStream>(streamFile->url);
+    auto image = dirImage;
 
     if ( image->seekNextImageEntry() )
     {
@@ -214,6 +241,7 @@ MFile* T64MFile::getNextFileInDir() {
     {
         //Debug_printv( "END OF DIRECTORY");
         dirIsOpen = false;
+        dirImage.reset();
         return nullptr;
     }
 }
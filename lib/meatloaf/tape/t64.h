@@ -46,8 +46,11 @@ protected:
         return seekEntry(entry_index + 1);
     }
 
+    std::string entryName();
+
     bool seekEntry( std::string filename ) override;
     bool seekEntry( uint16_t index ) override;
+    bool indexEntry( MediaIndex::Entry &e ) override;
 
     uint32_t readFile(uint8_t* buf, uint32_t size) override;
     bool seekPath(std::string path) override;
@@ -101,6 +104,7 @@ public:
 
     bool isDir = true;
     bool dirIsOpen = false;
+    std::shared_ptr<T64MStream> dirImage; // holds the entry cursor while dirIsOpen (keeps MBroker from evicting it)
 };
 
 
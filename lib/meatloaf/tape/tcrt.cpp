@@ -205,11 +205,18 @@ bool TCRTMFile::isDirectory() {
 };
 
 bool TCRTMFile::rewindDirectory() {
-    dirIsOpen = true;
+    dirIsOpen = false;
     Debug_printv("streamFile->url[%s]", streamFile->url.c_str());
     auto image = ImageBroker::obtain<TCRTMStream>(streamFile->url);
     if ( image == nullptr )
+    {
         Debug_printv("image pointer is null");
+        dirImage.reset();
+        return false;
+    }
+
+    dirImage = image;
+    dirIsOpen = true;
 
     image->resetEntryCounter();
 
@@ -231,11 +238,11 @@ bool TCRTMFile::rewindDirectory() {
 
 MFile* TCRTMFile::getNextFileInDir() {
 
-    if(!dirIsOpen)
-        rewindDirectory();
+    if(!dirIsOpen && !rewindDirectory())
+        return nullptr;
 
     // Get entry pointed to by containerStream
-    auto image = ImageBroker::obtain<TCRTMStream>(streamFile->url);
+    auto image = dirImage;
 
     bool r = false;
     do
@@ -256,6 +263,7 @@ MFile* TCRTMFile::getNextFileInDir() {
     {
         //Debug_printv( "END OF DIRECTORY");
         dirIsOpen = false;
+        dirImage.reset();
         return nullptr;
     }
 }
@@ -102,6 +102,7 @@ public:
 
     bool isDir = true;
     bool dirIsOpen = false;
+    std::shared_ptr<TCRTMStream> dirImage; // holds the entry cursor while dirIsOpen (keeps MBroker from evicting it)
 };
 
 
@@ -30,58 +30,62 @@
 
 #include "string_utils.h"
 
-void PeoplesUrlParser::processHostPort(std::string hostPort) {
-    auto byColon = mstr::split(hostPort,':',2);
-    host = byColon[0];
-    if(byColon.size()>1) {
-        port = byColon[1];
-    }
-}
-
-void PeoplesUrlParser::processAuthorityPath(std::string authorityPath) {
-    //             /path
-    // authority:80/path
-    // authority:100
-    // authority
-    auto bySlash = mstr::split(authorityPath,'/',2);
+PeoplesUrlView PeoplesUrlView::parse(std::string_view u) {
+    PeoplesUrlView v;
 
-    processHostPort(bySlash[0]);
-    if(bySlash.size()>1) {
-        // hasPath
-        path = bySlash[1];
+    auto colon = u.find(':');
+    if(colon == std::string_view::npos) {
+        // no scheme, good old local path
+        v.path = u;
+        return v;
     }
 
-}
+    v.scheme = u.substr(0, colon);
+    auto pastTheColon = u.substr(colon + 1); // don't visualise!
 
-void PeoplesUrlParser::processUserPass(std::string userPass) {
-    // user:pass
-    auto byColon = mstr::split(userPass,':',2);
-    if(byColon.size()==1) {
-        user = byColon[0];
-    }
-    else {
-        user = byColon[0];
-        password = byColon[1];
+    if(pastTheColon.size() < 2 || pastTheColon[0] != '/' || pastTheColon[1] != '/') {
+        // we have just a plain old path
+        // /path
+        // user@server
+        // etc.
+        v.path = pastTheColon;
+        return v;
     }
-}
 
-void PeoplesUrlParser::processAuthority(std::string pastTheColon) {
     // //user:password@/path
     // //user:password@host:80/path
     // //          host:100
     // //          host:30/path            
-    auto byAtSign = mstr::split(pastTheColon,'@', 2);
-
-    if(byAtSign.size()==1) {
-        // just address, port, path
-        processAuthorityPath(mstr::drop(byAtSign[0],2));
+    auto authorityPath = pastTheColon.substr(2);
+    auto at = pastTheColon.find('@');
+    if(at != std::string_view::npos) {
+        // user:pass
+        auto userPass = pastTheColon.substr(2, at - 2);
+        auto byColon = userPass.find(':');
+        v.user = userPass.substr(0, byColon);
+        if(byColon != std::string_view::npos)
+            v.password = userPass.substr(byColon + 1);
+
+        authorityPath = pastTheColon.substr(at + 1);
     }
-    else {
-        // user:password
-        processUserPass(mstr::drop(byAtSign[0],2));
-        // address, port, path
-        processAuthorityPath(byAtSign[1]);
+
+    //             /path
+    // authority:80/path
+    // authority:100
+    // authority
+    auto slash = authorityPath.find('/');
+    auto hostPort = authorityPath.substr(0, slash);
+    if(slash != std::string_view::npos) {
+        // hasPath
+        v.path = authorityPath.substr(slash + 1);
     }
+
+    auto byColon = hostPort.find(':');
+    v.host = hostPort.substr(0, byColon);
+    if(byColon != std::string_view::npos)
+        v.port = hostPort.substr(byColon + 1);
+
+    return v;
 }
 
 void PeoplesUrlParser::cleanPath() {
@@ -100,37 +104,31 @@ void PeoplesUrlParser::processPath() {
     if(path.size() == 0)
         return;
 
-    auto pathParts = mstr::split(path, '/');
-    auto queryParts = mstr::split(*(--pathParts.end()), '?');
-    auto fragmentParts = mstr::split(*(--queryParts.end()), '#');
-
-    // path
-    if(pathParts.size() > 1)
-        name = *(--pathParts.end());
-    else
-        name = path;
+    // last path component: name?query#fragment
+    std::string_view last = path;
+    last.remove_prefix(last.rfind('/') + 1);
+    std::string_view lastQuery = last.substr(last.rfind('?') + 1);
+    auto q = last.find('?');
+    auto f = lastQuery.find('#');
 
     // filename
-    if(queryParts.size() > 1)
-        name = queryParts.front();
-
-    auto nameParts = mstr::split(name, '.');
-
-    // base name
-    if(nameParts.size() > 1)
-        base_name = nameParts.front();
-
-    // extension
-    if(nameParts.size() > 1)
-        extension = *(--nameParts.end());
+    std::string_view n = last.substr(0, q);
+    name = n;
+
+    // base name & extension
+    auto dot = n.find('.');
+    if(dot != std::string_view::npos) {
+        base_name = n.substr(0, dot);
+        extension = n.substr(n.rfind('.') + 1);
+    }
 
     // query
-    if(queryParts.size() > 1)
-        query = *(fragmentParts.begin());
+    if(q != std::string_view::npos)
+        query = lastQuery.substr(0, f);
     
     // fragment
-    if(fragmentParts.size() > 1)
-        fragment = *(--fragmentParts.end());
+    if(f != std::string_view::npos)
+        fragment = lastQuery.substr(lastQuery.rfind('#') + 1);
 }
 
 
@@ -146,8 +144,13 @@ std::string PeoplesUrlParser::root(void)
 {
     // set root URL
     std::string root;
+    root.reserve(scheme.size() + user.size() + password.size() + host.size() + port.size() + 6);
+
     if ( scheme.size() )
-        root = scheme + ":";
+    {
+        root += scheme;
+        root += ':';
+    }
 
     if ( host.size() )
         root += "//";
@@ -156,14 +159,20 @@ std::string PeoplesUrlParser::root(void)
     {
         root += user;
         if ( password.size() )
-            root += ':' + password;
+        {
+            root += ':';
+            root += password;
+        }
         root += '@';
     }
 
     root += host;
 
     if ( port.size() )
-        root += ':' + port;
+    {
+        root += ':';
+        root += port;
+    }
 
     //Debug_printv("root[%s]", root.c_str());
     return root;
@@ -188,7 +197,7 @@ uint16_t PeoplesUrlParser::getPort() {
 }
 
 
-std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(const std::string &u) {
+std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(std::string_view u) {
     // Directly creating a unique_ptr using a private constructor workaround. If direct constructor was available, this wouldn't be needed
     struct MakeUniqueEnabler : public PeoplesUrlParser {};
     auto parser = std::make_unique<MakeUniqueEnabler>();
@@ -196,53 +205,29 @@ std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(const std::string &
     return parser;
 }
 
-void PeoplesUrlParser::resetURL(const std::string u) {
+void PeoplesUrlParser::resetURL(std::string_view u) {
 
     if ( u.empty() )
         return;
 
-    //Debug_printv("u[%s]", u.c_str());
+    //Debug_printv("u[%s]", std::string(u).c_str());
 
-    url = u;
+    // the views returned by the parser point into mRawUrl
     mRawUrl = u;
+    auto v = PeoplesUrlView::parse(mRawUrl);
 
-    //Debug_printv("Before [%s]", url.c_str());
-
-    auto byColon = mstr::split(url, ':', 2);
+    scheme = v.scheme;
+    user = v.user;
+    password = v.password;
+    host = v.host;
+    port = v.port;
+    path = v.path;
 
-    scheme = "";
-    path = "";
-    user = "";
-    password = "";
-    host = "";
-    port = "";
-
-    if(byColon.size()==1) {
-        // no scheme, good old local path
-        path = byColon[0];
-    }
-    else
-    {
-        scheme = byColon[0];
-
-        auto pastTheColon = byColon[1]; // don't visualise!
-
-        if(pastTheColon[0]=='/' && pastTheColon[1]=='/') {
-            // //user:pass@/path
-            // //user:pass@authority:80/path
-            // //authority:100
-            // //authority:30/path            
-
-            processAuthority(pastTheColon);
-        }
-        else {
-            // we have just a plain old path
-            // /path
-            // user@server
-            // etc.
-            path = pastTheColon;
-        }            
-    }
+    name.clear();
+    base_name.clear();
+    extension.clear();
+    query.clear();
+    fragment.clear();
 
     // Clean things up before exiting
     cleanPath();
@@ -258,11 +243,12 @@ std::string PeoplesUrlParser::rebuildUrl(void)
 {
     // set full URL
     if ( !mstr::startsWith(path, "/") )
-        path = "/" + path;
+        path.insert(0, 1, '/');
 
     cleanPath();
 
-    url = root() + path;
+    url = root();
+    url += path;
     //Debug_printv("url[%s]", url.c_str());
     // url += name;
     // Debug_printv("url[%s]", url.c_str());
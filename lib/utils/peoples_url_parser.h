@@ -22,14 +22,25 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+
+// Components of a URL as views into the parsed string, nothing is copied.
+// The path is not canonicalized and has no leading '/' after an authority.
+struct PeoplesUrlView
+{
+    std::string_view scheme;
+    std::string_view user;
+    std::string_view password;
+    std::string_view host;
+    std::string_view port;
+    std::string_view path;
+
+    static PeoplesUrlView parse(std::string_view u);
+};
 
 class PeoplesUrlParser
 {
 private:
-    void processHostPort(std::string hostPort);
-    void processAuthorityPath(std::string authorityPath);
-    void processUserPass(std::string userPass);
-    void processAuthority(std::string pastTheColon);
     void cleanPath();
     void processPath();
 
@@ -59,8 +70,8 @@ public:
 
     uint16_t getPort();
 
-    static std::unique_ptr<PeoplesUrlParser> parseURL(const std::string &u);
-    void resetURL(const std::string u);
+    static std::unique_ptr<PeoplesUrlParser> parseURL(std::string_view u);
+    void resetURL(std::string_view u);
     std::string rebuildUrl(void);
     bool isValidUrl();
 
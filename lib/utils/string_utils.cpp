@@ -96,48 +96,59 @@ namespace mstr {
     }
 
 
-    std::string drop(std::string str, size_t count) {
+    std::string drop(std::string_view str, size_t count) {
         if(count>str.length())
             return "";
         else
-            return str.substr(count);
+            return std::string(str.substr(count));
     }
 
-    std::string dropLast(std::string str, size_t count) {
+    std::string dropLast(std::string_view str, size_t count) {
         if(count>str.length())
             return "";
         else
-            return str.substr(0, str.length()-count);
+            return std::string(str.substr(0, str.length()-count));
     }
 
-    bool startsWith(std::string s, const char *pattern, bool case_sensitive)
+    // compares "s" with the first s.size() characters of "pattern"
+    static bool equalsPrefix(std::string_view s, const char *pattern, bool case_sensitive)
+    {
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            if (s[i] == pattern[i])
+                continue;
+            if (case_sensitive || std::toupper((unsigned char)s[i]) != std::toupper((unsigned char)pattern[i]))
+                return false;
+        }
+        return true;
+    }
+
+    bool startsWith(std::string_view s, const char *pattern, bool case_sensitive)
     {
         if (s.empty() && pattern == nullptr)
             return true;
         if (s.empty() || pattern == nullptr)
             return false;
-        if(s.length()<strlen(pattern))
-            return false;
 
-        std::string ss = s.substr(0, strlen(pattern));
-        std::string pp = pattern;
+        size_t len = strlen(pattern);
+        if(s.length()<len)
+            return false;
 
-        return equals(ss, pp, case_sensitive);
+        return equalsPrefix(s.substr(0, len), pattern, case_sensitive);
     }
 
-    bool endsWith(std::string s, const char *pattern, bool case_sensitive)
+    bool endsWith(std::string_view s, const char *pattern, bool case_sensitive)
     {
         if (s.empty() && pattern == nullptr)
             return true;
         if (s.empty() || pattern == nullptr)
             return false;
-        if(s.length()<strlen(pattern))
-            return false;
 
-        std::string ss = s.substr((s.length() - strlen(pattern)));
-        std::string pp = pattern;
+        size_t len = strlen(pattern);
+        if(s.length()<len)
+            return false;
 
-        return equals(ss, pp, case_sensitive);
+        return equalsPrefix(s.substr(s.length() - len), pattern, case_sensitive);
     }
 
 
@@ -203,12 +214,12 @@ namespace mstr {
     
     bool contains(std::string &s1, const char *s2, bool case_sensitive)
     {
-        std::string sn = s2;
+        const char *e2 = s2 + strlen(s2);
         std::string::iterator it;
         if(case_sensitive)
-            it = ( std::search(s1.begin(), s1.end(), sn.begin(), sn.end(), &compare_char) );
+            it = ( std::search(s1.begin(), s1.end(), s2, e2, [](char c1, char c2) { return c1 == c2; }) );
         else
-            it = ( std::search(s1.begin(), s1.end(), sn.begin(), sn.end(), &compare_char_insensitive) );
+            it = ( std::search(s1.begin(), s1.end(), s2, e2, [](char c1, char c2) { return std::toupper((unsigned char)c1) == std::toupper((unsigned char)c2); }) );
 
         return ( it != s1.end() );
     }
@@ -284,6 +295,7 @@ namespace mstr {
     std::string toPETSCII2(const std::string &utfInputString)
     {
         std::string petsciiString;
+        petsciiString.reserve(utfInputString.length());
         char* utfInput = (char*)utfInputString.c_str();
         auto end = utfInput + utfInputString.length();
 
@@ -383,20 +395,20 @@ namespace mstr {
     }
 
 
-    std::vector<std::string> split(std::string toSplit, char ch, int limit) {
-        std::vector<std::string> parts;
+    std::vector<std::string_view> splitView(std::string_view toSplit, char ch, int limit) {
+        std::vector<std::string_view> parts;
 
         limit--;
 
         while(limit > 0 && toSplit.size()>0) {
             auto pos = toSplit.find(ch);
-            if(pos == std::string::npos) {
+            if(pos == std::string_view::npos) {
                 parts.push_back(toSplit);
                 return parts;
             }
             parts.push_back(toSplit.substr(0, pos));
 
-            toSplit = toSplit.substr(pos+1);
+            toSplit.remove_prefix(pos+1);
 
             limit--;
         }
@@ -405,7 +417,12 @@ namespace mstr {
         return parts;
     }
 
-    std::string joinToString(std::vector<std::string>::iterator* start, std::vector<std::string>::iterator* end, std::string separator) {
+    std::vector<std::string> split(std::string_view toSplit, char ch, int limit) {
+        auto views = splitView(toSplit, ch, limit);
+        return std::vector<std::string>(views.begin(), views.end());
+    }
+
+    std::string joinToString(std::vector<std::string>::iterator* start, std::vector<std::string>::iterator* end, std::string_view separator) {
         std::string res;
 
         if((*start)>=(*end))
@@ -413,26 +430,32 @@ namespace mstr {
             //Debug_printv("start >= end");
             return std::string();
         }
-            
+
+        size_t len = 0;
+        for(auto i = (*start); i<(*end); i++)
+            len += i->size() + separator.size();
+        res.reserve(len);
 
         for(auto i = (*start); i<(*end); i++) 
         {
-            //Debug_printv("b %d res [%s]", i, res.c_str());
-            res+=(*i);
-            if(i<(*end))
+            if(i != (*start))
                 res+=separator;
-
-            //Debug_printv("a %d res [%s]", i, res.c_str());
+            res+=(*i);
         }
         //Debug_printv("res[%s] length[%d] size[%d]", res.c_str(), res.length(), res.size());
 
-        return res.erase(res.length()-1,1);
+        return res;
     }
 
-    std::string joinToString(std::vector<std::string> strings, std::string separator) {
-        auto st = strings.begin();
-        auto ed = strings.end();
-        return joinToString(&st, &ed, separator);
+    std::string joinToString(const std::vector<std::string> &strings, std::string_view separator) {
+        std::string res;
+        for(size_t i = 0; i < strings.size(); i++)
+        {
+            if(i)
+                res+=separator;
+            res+=strings[i];
+        }
+        return res;
     }
 
 
@@ -22,11 +22,11 @@ inline constexpr auto operator"" _sh(const char *str, size_t len) {
 }
 
 namespace mstr {
-    std::string drop(std::string str, size_t count);
-    std::string dropLast(std::string str, size_t count);
+    std::string drop(std::string_view str, size_t count);
+    std::string dropLast(std::string_view str, size_t count);
 
-    bool startsWith(std::string s, const char *pattern, bool case_sensitive = true);
-    bool endsWith(std::string s, const char *pattern, bool case_sensitive = true);
+    bool startsWith(std::string_view s, const char *pattern, bool case_sensitive = true);
+    bool endsWith(std::string_view s, const char *pattern, bool case_sensitive = true);
 
     bool equals(std::string &s1, std::string &s2, bool case_sensitive = true);
     bool equals(std::string &s1, char *s2, bool case_sensitive = true);
@@ -34,7 +34,9 @@ namespace mstr {
     bool contains(std::string &s1, const char *s2, bool case_sensitive = true);
     bool compare(std::string &s1, std::string &s2, bool case_sensitive = true); // s1 is Wildcard string, s2 is potential match
 
-    std::vector<std::string> split(std::string toSplit, char ch, int limit = 9999);
+    std::vector<std::string> split(std::string_view toSplit, char ch, int limit = 9999);
+    // same as split() but returns views into "toSplit", which has to outlive them
+    std::vector<std::string_view> splitView(std::string_view toSplit, char ch, int limit = 9999);
     void toLower(std::string &s);
     void toUpper(std::string &s);
 
@@ -45,8 +47,8 @@ namespace mstr {
 
     void replaceAll(std::string &s, const std::string &search, const std::string &replace);
 
-    std::string joinToString(std::vector<std::string>::iterator* start, std::vector<std::string>::iterator* end, std::string separator);
-    std::string joinToString(std::vector<std::string>, std::string separator);
+    std::string joinToString(std::vector<std::string>::iterator* start, std::vector<std::string>::iterator* end, std::string_view separator);
+    std::string joinToString(const std::vector<std::string> &strings, std::string_view separator);
 
     std::string urlEncode(const std::string &s);
 
@@ -6,7 +6,6 @@
 #include <cstring>
 #include <map>
 #include <sstream>
-#include <stack>
 #include <string>
 
 #include "compat_string.h"
@@ -795,29 +794,29 @@ void util_replaceAll(std::string &str, const std::string &from, const std::strin
  * @param path FujiNet path such as TNFS://myhost/path/to/here/
  * or tnfs://myhost/some/filename.ext
  */
-std::string util_get_canonical_path(std::string path)
+std::string util_get_canonical_path(std::string_view path)
 {
+    if (path.empty())
+        return std::string();
+
     bool is_last_slash = (path.back() == '/') ? true : false;
 
     std::size_t proto_host_len;
 
-    // stack to store the file's names.
-    std::stack<std::string> st;
-
-    // temporary string which stores the extracted
-    // directory name or commands("." / "..")
-    // Eg. "/a/b/../."
-    // dir will contain "a", "b", "..", ".";
-    std::string dir;
+    // directory names ("a", "b" etc.) left after applying the
+    // commands ("." / ".."), as views into path
+    // Eg. "/a/b/../." leaves "a"
+    std::vector<std::string_view> st;
 
     // contains resultant simplifies string.
     std::string res;
+    res.reserve(path.length() + 1);
 
     // advance beyond protocol and hostname
     proto_host_len = path.find("://");
 
     // If protocol delimiter "://" is found, skip over the protocol
-    if (proto_host_len < std::string::npos)
+    if (proto_host_len != std::string_view::npos)
     {
         proto_host_len += 3; // "://" is 3 chars
         proto_host_len = path.find("/", proto_host_len) + 1;
@@ -827,73 +826,51 @@ std::string util_get_canonical_path(std::string path)
     {
         proto_host_len = 0; // no protocol prefix and hostname
         // Preserve an absolute path if one is provided in the input
-        if (!path.empty() && path[0] == '/')
+        if (path[0] == '/')
             res = "/";
     }
 
-    int len_path = path.length();
+    size_t len_path = path.length();
 
-    for (int i = proto_host_len; i < len_path; i++)
+    for (size_t i = proto_host_len; i < len_path; i++)
     {
-        // we will clear the temporary string
-        // every time to accommodate new directory
-        // name or command.
-        dir.clear();
-
         // skip all the multiple '/' Eg. "/////""
-        while (path[i] == '/')
+        while (i < len_path && path[i] == '/')
             i++;
 
-        // stores directory's name("a", "b" etc.)
-        // or commands("."/"..") into dir
+        // directory's name("a", "b" etc.)
+        // or commands("."/"..")
+        size_t start = i;
         while (i < len_path && path[i] != '/')
-        {
-            dir.push_back(path[i]);
             i++;
-        }
+        std::string_view dir = path.substr(start, i - start);
 
         // if dir has ".." just pop the topmost
         // element if the stack is not empty
         // otherwise ignore.
-        if (dir.compare("..") == 0)
+        if (dir == "..")
         {
             if (!st.empty())
-                st.pop();
+                st.pop_back();
         }
 
         // if dir has "." then simply continue
         // with the process.
-        else if (dir.compare(".") == 0)
+        else if (dir == ".")
             continue;
 
         // pushes if it encounters directory's
         // name("a", "b").
         else if (dir.length() != 0)
-            st.push(dir);
+            st.push_back(dir);
     }
 
-    // a temporary stack  (st1) which will contain
-    // the reverse of original stack(st).
-    std::stack<std::string> st1;
-    while (!st.empty())
+    // no "/" after the last element
+    for (size_t j = 0; j < st.size(); j++)
     {
-        st1.push(st.top());
-        st.pop();
-    }
-
-    // the st1 will contain the actual res.
-    while (!st1.empty())
-    {
-        std::string temp = st1.top();
-
-        // if it's the last element no need
-        // to append "/"
-        if (st1.size() != 1)
-            res.append(temp + "/");
-        else
-            res.append(temp);
-
-        st1.pop();
+        if (j > 0)
+            res.push_back('/');
+        res.append(st[j]);
     }
 
     // Append trailing slash if not already there
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
@@ -95,7 +96,7 @@ void util_sam_say_swap_label();
 void util_replaceAll(std::string& str, const std::string& from, const std::string& to);
 
 //std::string util_get_canonical_path(char* path);
-std::string util_get_canonical_path(std::string path);
+std::string util_get_canonical_path(std::string_view path);
 
 char util_petscii_to_ascii(char c);
 char util_ascii_to_petscii(char c);
@@ -0,0 +1,135 @@
+/* Path resolution benchmark (FujiNet-PC)
+
+Opens nested container paths (http://host/dir/game.zip/disk1.d64/PROG) the
+way MFSOwner::File() resolves them: MFSOwner::resolveFS() walks the path
+components through MFSOwner::resolveCache, asking the filesystems' handles()
+only for prefixes not cached. The filesystems below stand in for the ones in
+meatloaf.cpp, matching by scheme or extension like the real ones do. Prints
+opens/sec and cache hits/misses/evictions for
+
+    cold   cache cleared before each open
+    warm   a few paths opened over and over (e.g. files in the mounted image)
+    mixed  mostly the warm paths, every 4th open a path not seen before
+           (more distinct prefixes than MFS_RESOLVE_CACHE_SIZE over the run)
+
+    cmake --build build --target resolve_cache_bench
+    ./build/resolve_cache_bench [opens]
+*/
+
+#ifndef ESP_PLATFORM
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "meatloaf.h"
+
+class BenchMFileSystem : public MFileSystem
+{
+    std::vector<std::string> m_names;
+    bool m_scheme;
+
+public:
+    BenchMFileSystem(const char *symbol, std::vector<std::string> names, bool scheme = false)
+        : MFileSystem(symbol), m_names(names), m_scheme(scheme) {}
+
+    bool handles(std::string name) override
+    {
+        if ( !m_scheme )
+            return byExtension(m_names, name);
+
+        for ( auto &n : m_names )
+        {
+            if ( mstr::equals(name, n, false) )
+                return true;
+        }
+        return false;
+    }
+
+    MFile* getFile(std::string path) override { return nullptr; }
+};
+
+// one per filesystem in meatloaf.cpp, in the same order
+static BenchMFileSystem defaultFS("/", {});
+static BenchMFileSystem arkFS("ark", {".ark"}), gzFS("gz", {".gz"}), lnxFS("lnx", {".lnx"}), zipFS("zip", {".zip"});
+static BenchMFileSystem d64FS("d64", {".d64", ".d41"}), d71FS("d71", {".d71"}), d80FS("d80", {".d80"}), d81FS("d81", {".d81"});
+static BenchMFileSystem d82FS("d82", {".d82"}), d90FS("d90", {".d90", ".d60"}), dnpFS("dnp", {".dnp"}), g64FS("g64", {".g64", ".g41"});
+static BenchMFileSystem nibFS("nib", {".nib"}), d8bFS("d8b", {".d8b"}), dfiFS("dfi", {".dfi"}), p00FS("p00", {".p00"});
+static BenchMFileSystem httpFS("http", {"http:", "https:"}, true), tnfsFS("tnfs", {"tnfs:"}, true);
+static BenchMFileSystem csipFS("csip", {"csip:"}, true), mlFS("ml", {"ml:"}, true);
+static BenchMFileSystem t64FS("t64", {".t64"}), tcrtFS("tcrt", {".tcrt"});
+
+std::vector<MFileSystem*> MFSOwner::availableFS {
+    &defaultFS,
+    &arkFS, &gzFS, &lnxFS, &zipFS,
+    &d64FS, &d71FS, &d80FS, &d81FS, &d82FS, &d90FS, &dnpFS, &g64FS, &nibFS,
+    &d8bFS, &dfiFS,
+    &p00FS,
+    &httpFS, &tnfsFS,
+    &csipFS, &mlFS,
+    &t64FS, &tcrtFS
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static std::string benchPath(unsigned n)
+{
+    return "http://games.example.com/c64/collection/" + std::to_string(n / 8) +
+           "/game" + std::to_string(n) + ".zip/disk1.d64/PROGRAM" + std::to_string(n % 8);
+}
+
+// the lookups MFSOwner::File() does for such a path: the file itself (in the
+// disk image), then its container chain (disk image in the archive, archive on HTTP)
+static bool benchOpen(const std::string &path)
+{
+    size_t zip = path.find(".zip/");
+    return MFSOwner::resolveFS(path) == &d64FS &&
+           MFSOwner::resolveFS(path.substr(0, zip + 4)) == &zipFS &&
+           MFSOwner::resolveFS(path.substr(0, path.rfind('/', zip))) == &httpFS;
+}
+
+static void run(const char *name, unsigned opens, bool cold, unsigned uniqueEvery)
+{
+    std::vector<std::string> warm;
+    for ( unsigned i = 0; i < 8; i++ )
+        warm.push_back(benchPath(i));
+
+    MFSOwner::clearResolveCache();
+    uint32_t hits = MFSOwner::getResolveHits();
+    uint32_t misses = MFSOwner::getResolveMisses();
+    uint32_t evictions = MFSOwner::getResolveEvictions();
+
+    unsigned unique = 1000, found = 0;
+    auto start = bench_clock::now();
+    for ( unsigned i = 0; i < opens; i++ )
+    {
+        if ( cold )
+            MFSOwner::clearResolveCache();
+
+        const std::string path = (uniqueEvery > 0 && i % uniqueEvery == 0) ? benchPath(unique++) : warm[i % warm.size()];
+        if ( benchOpen(path) )
+            found++;
+    }
+    double s = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    printf("%-6s %8u opens %10.0f opens/s  hits %u misses %u evictions %u%s\n", name, opens, opens / s,
+           MFSOwner::getResolveHits() - hits, MFSOwner::getResolveMisses() - misses,
+           MFSOwner::getResolveEvictions() - evictions, found == opens ? "" : "  (RESOLVED WRONG FS)");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned opens = argc > 1 ? atoi(argv[1]) : 100000;
+
+    run("cold", opens, true, 0);
+    run("warm", opens, false, 0);
+    run("mixed", opens, false, 4);
+
+    return 0;
+}
+
+#else
+int main() { return 0; }
+#endif